@@ -0,0 +1,178 @@
+/**************************************************************************************************
+  Filename:       Analog.cpp
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    continuous ADC sampling implementation
+**************************************************************************************************/
+#include "Analog.h"
+#include "LogRing.h"
+
+AnalogSampler g_Analog;
+
+AnalogSampler::AnalogSampler()
+{
+	memset(&_last, 0, sizeof(_last));
+	memset(&_cur, 0, sizeof(_cur));
+	_fresh = false;
+	_running = false;
+	_samples = 0;
+	_start_ms = 0;
+	_blocks = 0;
+	_overflows = 0;
+	_errors = 0;
+	_busy_us = 0;
+	_task = nullptr;
+	_mux = portMUX_INITIALIZER_UNLOCKED;
+}
+
+void AnalogSampler::Begin(AsyncWebServer *server)
+{
+	server->on(ADC_URL, HTTP_GET, [this](AsyncWebServerRequest *request) { _sendJson(request); });
+
+	adc_digi_init_config_t init = {};
+	init.max_store_buf_size = sizeof(_buf) * 4;			// DMA pool, 4 blocks
+	init.conv_num_each_intr = sizeof(_buf);				// one read is one block
+	init.adc1_chan_mask = BIT(ADC_CH_CURRENT) | BIT(ADC_CH_SUPPLY);
+	init.adc2_chan_mask = 0;
+
+	adc_digi_pattern_config_t pattern[2] = {};
+	pattern[0].atten = ADC_ATTEN_DB_11;
+	pattern[0].channel = ADC_CH_CURRENT;
+	pattern[0].unit = 0;
+	pattern[0].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+	pattern[1] = pattern[0];
+	pattern[1].channel = ADC_CH_SUPPLY;
+
+	adc_digi_configuration_t dig = {};
+	dig.conv_limit_en = 1;								// required on the ESP32
+	dig.conv_limit_num = 250;
+	dig.pattern_num = 2;
+	dig.adc_pattern = pattern;
+	dig.sample_freq_hz = ADC_SAMPLE_HZ;
+	dig.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+	dig.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+
+	if(( adc_digi_initialize(&init) != ESP_OK ) || ( adc_digi_controller_configure(&dig) != ESP_OK )) {
+		SLOG_ERROR_PRINTF("Analog: ADC continuous mode setup failed\n");
+		return;
+	}
+	esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_11, ADC_WIDTH_BIT_12, 1100, &_cal);
+
+	_start_ms = millis();
+	_running = ( adc_digi_start() == ESP_OK );
+	if( _running )
+		xTaskCreatePinnedToCore(_taskLoop, "adc", ADC_TASK_STACK, this, ADC_TASK_PRIO, &_task, 0);
+	SLOG_INFO_PRINTF("Analog: %s, %u Hz, %u samples per block\n", _running ? "running" : "start failed", ADC_SAMPLE_HZ,
+		ADC_BLOCK_SAMPLES);
+}
+
+void AnalogSampler::_taskLoop(void *arg)
+{
+	AnalogSampler *self = (AnalogSampler *)arg;
+
+	for(;;) {
+		uint32_t len = 0;
+		esp_err_t err = adc_digi_read_bytes(self->_buf, sizeof(self->_buf), &len, ADC_STALE_MS);
+
+		if( err == ESP_ERR_INVALID_STATE )				// the pool filled up, older blocks were dropped
+			self->_overflows++;
+		else if( err != ESP_OK ) {
+			self->_errors++;
+			continue;
+		}
+		if( len > 0 )
+			self->_reduce(len);
+	}
+}
+
+// adc task: one block to mean, min and max per channel
+void AnalogSampler::_reduce(uint32_t len)
+{
+	int64_t t0 = esp_timer_get_time();
+	uint32_t sum[2] = {0, 0};
+	uint16_t lo[2] = {0xFFFF, 0xFFFF};
+	uint16_t hi[2] = {0, 0};
+	uint16_t n[2] = {0, 0};
+
+	for(uint32_t i = 0; i + ADC_RESULT_BYTES <= len; i += ADC_RESULT_BYTES) {
+		const adc_digi_output_data_t *d = (const adc_digi_output_data_t *)&_buf[i];
+		uint8_t c;
+
+		if( d->type1.channel == ADC_CH_CURRENT )
+			c = 0;
+		else if( d->type1.channel == ADC_CH_SUPPLY )
+			c = 1;
+		else
+			continue;
+		uint16_t v = d->type1.data;
+		sum[c] += v;
+		n[c]++;
+		if( v < lo[c] )
+			lo[c] = v;
+		if( v > hi[c] )
+			hi[c] = v;
+	}
+
+	AnalogBlock_t b;
+	b.ms = millis();
+	b.n_current = n[0];
+	b.n_supply = n[1];
+	b.current_ma = n[0] ? ( _pinMv(sum[0] / n[0]) - ADC_CURRENT_ZERO_MV ) * ADC_CURRENT_MA_PER_V / 1000 : 0;
+	b.current_peak_ma = n[0] ? ( _pinMv(hi[0]) - ADC_CURRENT_ZERO_MV ) * ADC_CURRENT_MA_PER_V / 1000 : 0;
+	b.supply_mv = n[1] ? _pinMv(sum[1] / n[1]) * ADC_SUPPLY_DIVIDER : 0;
+	b.supply_min_mv = n[1] ? _pinMv(lo[1]) * ADC_SUPPLY_DIVIDER : 0;
+
+	uint32_t us = (uint32_t)( esp_timer_get_time() - t0 );
+
+	portENTER_CRITICAL(&_mux);
+	b.seq = _last.seq + 1;
+	_last = b;
+	_samples += n[0] + n[1];
+	_blocks++;
+	_busy_us += us;
+	_reduce_us.Add(us);
+	portEXIT_CRITICAL(&_mux);
+}
+
+// control tick stage, before safety and dome: take the newest block
+void AnalogSampler::Loop()
+{
+	if( !_running )
+		return;
+
+	portENTER_CRITICAL(&_mux);
+	if( _last.seq != _cur.seq )
+		_cur = _last;
+	portEXIT_CRITICAL(&_mux);
+
+	_fresh = ( _cur.seq != 0 ) && (( millis() - _cur.ms ) < ADC_STALE_MS );
+}
+
+void AnalogSampler::_sendJson(AsyncWebServerRequest *request)
+{
+	AnalogBlock_t b;
+	uint64_t samples, busy_us;
+	uint32_t blocks;
+	Histogram h;
+
+	portENTER_CRITICAL(&_mux);
+	b = _last;
+	samples = _samples;
+	busy_us = _busy_us;
+	blocks = _blocks;
+	h = _reduce_us;
+	portEXIT_CRITICAL(&_mux);
+
+	uint32_t run_ms = millis() - _start_ms;
+	AsyncResponseStream *response = request->beginResponseStream("application/json");
+
+	response->printf("{\"running\":%s,\"sample_hz\":%u,\"measured_hz\":%u,\"block_samples\":%u,\"blocks\":%u,\"overflows\":%u,\"errors\":%u,"
+		"\"cpu_permille\":%u,\"current_ma\":%d,\"current_peak_ma\":%d,\"supply_mv\":%d,\"supply_min_mv\":%d,\"age_ms\":%u,\"reduce_us\":",
+		_running ? "true" : "false", ADC_SAMPLE_HZ, run_ms ? (uint32_t)( samples * 1000 / run_ms ) : 0, ADC_BLOCK_SAMPLES, blocks,
+		_overflows, _errors, run_ms ? (uint32_t)( busy_us / run_ms ) : 0, b.current_ma, b.current_peak_ma, b.supply_mv,
+		b.supply_min_mv, b.seq ? millis() - b.ms : 0);
+	h.PrintJson(*response);
+	response->print("}");
+	request->send(response);
+}
@@ -0,0 +1,75 @@
+/**************************************************************************************************
+  Filename:       Analog.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    motor current and supply voltage on ADC1 in continuous DMA mode. The DMA fills
+                  blocks of ADC_BLOCK_SAMPLES conversions alternating over both channels, the adc
+                  task reduces each block to mean, min and max per channel, off the control core,
+                  and hands the newest one over. A block is shorter than a control tick, so the
+                  overcurrent cut-off and the undervoltage rule act on data at most one tick old.
+                  Sample rate and the CPU time of the reduction are on /analog.
+**************************************************************************************************/
+#pragma once
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <driver/adc.h>
+#include <esp_adc_cal.h>
+#include "Histogram.h"
+#include "defines.h"
+
+#define ADC_SAMPLE_HZ           20000       // both channels together, the ESP32 DMA minimum
+#define ADC_BLOCK_SAMPLES       256         // 12.8ms at 20kHz, shorter than CONTROL_TICK_MS
+#define ADC_RESULT_BYTES        2           // TYPE1 output format
+#define ADC_STALE_MS            100         // no block for this long, values not used
+#define ADC_TASK_STACK          3072
+#define ADC_TASK_PRIO           4           // below the control task, above async_tcp
+#define ADC_URL                 "/analog"
+
+// one block, raw counts reduced and converted
+struct AnalogBlock_t
+{
+	uint32_t seq;
+	uint32_t ms;							// millis() at the end of the block
+	int32_t current_ma;						// mean
+	int32_t current_peak_ma;				// max
+	int32_t supply_mv;						// mean
+	int32_t supply_min_mv;					// lowest sample, droop under load
+	uint16_t n_current;						// samples per channel in this block
+	uint16_t n_supply;
+};
+
+class AnalogSampler
+{
+private:
+	AnalogBlock_t _last;					// written by the adc task
+	AnalogBlock_t _cur;						// taken by the control task
+	bool _fresh;							// _cur is newer than ADC_STALE_MS
+	bool _running;
+	esp_adc_cal_characteristics_t _cal;
+	uint8_t _buf[ADC_BLOCK_SAMPLES * ADC_RESULT_BYTES];
+	uint64_t _samples;						// both channels, since the start
+	uint32_t _start_ms;
+	uint32_t _blocks;
+	uint32_t _overflows;					// DMA pool full, samples lost
+	uint32_t _errors;
+	uint64_t _busy_us;						// reduction and conversion, total
+	Histogram _reduce_us;					// per block
+	TaskHandle_t _task;
+	portMUX_TYPE _mux;
+
+	static void _taskLoop(void *arg);
+	void _reduce(uint32_t len);
+	int32_t _pinMv(uint32_t raw) { return (int32_t)esp_adc_cal_raw_to_voltage(raw, &_cal); }
+	void _sendJson(AsyncWebServerRequest *request);
+
+public:
+	AnalogSampler();
+	void Begin(AsyncWebServer *server);
+	void Loop();
+	bool GetCurrent(int32_t &mean_ma) const { mean_ma = _cur.current_ma; return _fresh && ( _cur.n_current > 0 ); }
+	bool GetSupply(int32_t &mean_mv) const { mean_mv = _cur.supply_mv; return _fresh && ( _cur.n_supply > 0 ); }
+	TaskHandle_t GetTask() { return _task; }
+};
+
+extern AnalogSampler g_Analog;
@@ -0,0 +1,520 @@
+/**************************************************************************************************
+  Filename:       ChannelMap.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    I/O channel map. k_channels[] is the single description of every channel
+                  on the board: Switch metadata, shift register masks and the Switch <-> shift
+                  register mapping are all derived from it at compile time. Expansion board
+                  channels are generated from SR_IN_BYTES / SR_OUT_BYTES, their Switch IDs after
+                  every fixed one.
+**************************************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include <utility>
+#include "defines.h"
+#include "ShiftReg.h"
+
+#define SR_IN_BITS          (SR_IN_BYTES * 8)       // bits clocked out of the 165 chain
+#define SR_OUT_BITS         (SR_OUT_BYTES * 8)      // bits clocked into the 595 chain
+
+enum struct ChKind_t : uint8_t
+{
+	kSwIn = 0,				// Switch read only input
+	kSwOut,					// Switch relay output
+	kSwPwm,					// Switch PWM output
+	kSwHeatAuto,			// Switch dew heater mode of the PWM with the same ordinal, 1 = auto
+	kSwHeatDuty,			// Switch dew heater applied duty, read only
+	kRoofClose,				// roof close relay
+	kRoofOpen,				// roof open relay
+	kLimitClosed,			// roof closed limit switch
+	kLimitOpened,			// roof opened limit switch
+	kButtonOpen,			// manual open button
+	kButtonClose,			// manual close button
+	kSafeRain,				// rain sensor
+	kSafePower,				// power failure
+	kLedCpu,				// status LEDs
+	kLedWs,
+	kLedDome,
+	kLedSwitch,
+	kLedSafemon
+};
+
+enum struct ChReg_t : uint8_t
+{
+	kSrIn = 0,				// 74HC165 input chain
+	kSrOut,					// 74HC595 output chain
+	kGpio,					// ESP32 pin
+	kNone					// no hardware, pos is the ordinal
+};
+
+struct Channel_t
+{
+	ChKind_t kind;
+	ChReg_t reg;
+	uint8_t pos;				// bit in the shift register image or GPIO number
+	const char *name;			// Switch name, Switch channels only
+	const char *description;	// Switch description, Switch channels only
+};
+
+// Switch channels get their Switch ID in table order. Names here are the defaults,
+// the user can rename them in the setup page (Switch_Configuration in settings.json)
+constexpr Channel_t k_base_channels[] = {
+	// kind						reg					pos				name			description
+	{ChKind_t::kSwIn,			ChReg_t::kSrIn,		0,				"Switch_0",		"IN 1 (R)"},
+	{ChKind_t::kSwIn,			ChReg_t::kSrIn,		1,				"Switch_1",		"IN 2 (R)"},
+	{ChKind_t::kSwIn,			ChReg_t::kSrIn,		2,				"Switch_2",		"IN 3 (R)"},
+	{ChKind_t::kSwIn,			ChReg_t::kSrIn,		3,				"Switch_3",		"IN 4 (R)"},
+	{ChKind_t::kSwIn,			ChReg_t::kSrIn,		4,				"Switch_4",		"IN 5 (R)"},
+	{ChKind_t::kSwIn,			ChReg_t::kSrIn,		5,				"Switch_5",		"IN 6 (R)"},
+	{ChKind_t::kSwIn,			ChReg_t::kSrIn,		6,				"Switch_6",		"IN 7 (R)"},
+	{ChKind_t::kSwIn,			ChReg_t::kSrIn,		7,				"Switch_7",		"IN 8 (R)"},
+	{ChKind_t::kSwOut,			ChReg_t::kSrOut,	7,				"Switch_8",		"OUT 1 (RW)"},
+	{ChKind_t::kSwOut,			ChReg_t::kSrOut,	6,				"Switch_9",		"OUT 2 (RW)"},
+	{ChKind_t::kSwOut,			ChReg_t::kSrOut,	5,				"Switch_10",	"OUT 3 (RW)"},
+	{ChKind_t::kSwOut,			ChReg_t::kSrOut,	4,				"Switch_11",	"OUT 4 (RW)"},
+	{ChKind_t::kSwOut,			ChReg_t::kSrOut,	3,				"Switch_12",	"OUT 5 (RW)"},
+	{ChKind_t::kSwOut,			ChReg_t::kSrOut,	2,				"Switch_13",	"OUT 6 (RW)"},
+	{ChKind_t::kSwOut,			ChReg_t::kSrOut,	1,				"Switch_14",	"OUT 7 (RW)"},
+	{ChKind_t::kSwOut,			ChReg_t::kSrOut,	0,				"Switch_15",	"OUT 8 (RW)"},
+	{ChKind_t::kSwPwm,			ChReg_t::kGpio,		OUT_PIN_PWM0,	"Switch_16",	"PWM 1 (RW)"},
+	{ChKind_t::kSwPwm,			ChReg_t::kGpio,		OUT_PIN_PWM1,	"Switch_17",	"PWM 2 (RW)"},
+	{ChKind_t::kSwPwm,			ChReg_t::kGpio,		OUT_PIN_PWM2,	"Switch_18",	"PWM 3 (RW)"},
+	{ChKind_t::kSwPwm,			ChReg_t::kGpio,		OUT_PIN_PWM3,	"Switch_19",	"PWM 4 (RW)"},
+
+	// dew heater controller on the PWM channels
+	{ChKind_t::kSwHeatAuto,		ChReg_t::kNone,		0,				"HEAT 1 auto",	"PWM 1 dew heater auto (RW)"},
+	{ChKind_t::kSwHeatAuto,		ChReg_t::kNone,		1,				"HEAT 2 auto",	"PWM 2 dew heater auto (RW)"},
+	{ChKind_t::kSwHeatAuto,		ChReg_t::kNone,		2,				"HEAT 3 auto",	"PWM 3 dew heater auto (RW)"},
+	{ChKind_t::kSwHeatAuto,		ChReg_t::kNone,		3,				"HEAT 4 auto",	"PWM 4 dew heater auto (RW)"},
+	{ChKind_t::kSwHeatDuty,		ChReg_t::kNone,		0,				"HEAT 1 duty",	"PWM 1 applied duty % (R)"},
+	{ChKind_t::kSwHeatDuty,		ChReg_t::kNone,		1,				"HEAT 2 duty",	"PWM 2 applied duty % (R)"},
+	{ChKind_t::kSwHeatDuty,		ChReg_t::kNone,		2,				"HEAT 3 duty",	"PWM 3 applied duty % (R)"},
+	{ChKind_t::kSwHeatDuty,		ChReg_t::kNone,		3,				"HEAT 4 duty",	"PWM 4 applied duty % (R)"},
+};
+
+// expansion board channels are generated between these two tables, see below. No Switch channel
+// goes here: the generated ones come after every fixed Switch ID, adding a board keeps those IDs
+constexpr Channel_t k_tail_channels[] = {
+	{ChKind_t::kRoofClose,		ChReg_t::kSrOut,	8,				nullptr,		nullptr},
+	{ChKind_t::kRoofOpen,		ChReg_t::kSrOut,	9,				nullptr,		nullptr},
+	{ChKind_t::kLedCpu,			ChReg_t::kSrOut,	10,				nullptr,		nullptr},
+	{ChKind_t::kLedWs,			ChReg_t::kSrOut,	11,				nullptr,		nullptr},
+	{ChKind_t::kLedDome,		ChReg_t::kSrOut,	12,				nullptr,		nullptr},
+	{ChKind_t::kLedSwitch,		ChReg_t::kSrOut,	13,				nullptr,		nullptr},
+	{ChKind_t::kLedSafemon,		ChReg_t::kSrOut,	14,				nullptr,		nullptr},
+
+	{ChKind_t::kLimitClosed,	ChReg_t::kSrIn,		8,				nullptr,		nullptr},
+	{ChKind_t::kLimitOpened,	ChReg_t::kSrIn,		9,				nullptr,		nullptr},
+	{ChKind_t::kButtonOpen,		ChReg_t::kSrIn,		10,				nullptr,		nullptr},
+	{ChKind_t::kButtonClose,	ChReg_t::kSrIn,		11,				nullptr,		nullptr},
+	{ChKind_t::kSafeRain,		ChReg_t::kSrIn,		12,				nullptr,		nullptr},
+	{ChKind_t::kSafePower,		ChReg_t::kSrIn,		13,				nullptr,		nullptr},
+
+#if DOME_NUM_ROOFS > 1
+	// second roof on the expansion boards. The n-th roof channel of each kind belongs to roof n
+	{ChKind_t::kRoofClose,		ChReg_t::kSrOut,	22,				nullptr,		nullptr},
+	{ChKind_t::kRoofOpen,		ChReg_t::kSrOut,	23,				nullptr,		nullptr},
+	{ChKind_t::kLimitClosed,	ChReg_t::kSrIn,		20,				nullptr,		nullptr},
+	{ChKind_t::kLimitOpened,	ChReg_t::kSrIn,		21,				nullptr,		nullptr},
+	{ChKind_t::kButtonOpen,		ChReg_t::kSrIn,		22,				nullptr,		nullptr},
+	{ChKind_t::kButtonClose,	ChReg_t::kSrIn,		23,				nullptr,		nullptr},
+#endif
+};
+
+/*
+	expansion boards: every bit of the chains past the base board (2 bytes each) that no channel
+	above uses becomes a Switch input or relay output, in bit order, inputs first. They are
+	named like the base board ones: "Switch_<id>", described "IN <n> (R)" / "OUT <n> (RW)".
+*/
+#define SR_BASE_BITS        16
+
+constexpr size_t k_num_base_channels = sizeof(k_base_channels) / sizeof(k_base_channels[0]);
+constexpr size_t k_num_tail_channels = sizeof(k_tail_channels) / sizeof(k_tail_channels[0]);
+
+constexpr bool ch_fixed_uses(ChReg_t reg, size_t pos)
+{
+	for(const Channel_t &c : k_base_channels)
+		if(( c.reg == reg ) && ( c.pos == pos ))
+			return true;
+	for(const Channel_t &c : k_tail_channels)
+		if(( c.reg == reg ) && ( c.pos == pos ))
+			return true;
+	return false;
+}
+
+constexpr size_t ch_exp_count(ChReg_t reg, size_t bits)
+{
+	size_t n = 0;
+	for(size_t b = SR_BASE_BITS; b < bits; b++)
+		if( !ch_fixed_uses(reg, b) )
+			n++;
+	return n;
+}
+
+constexpr size_t ch_base_count(ChKind_t kind)
+{
+	size_t n = 0;
+	for(const Channel_t &c : k_base_channels)
+		if( c.kind == kind )
+			n++;
+	return n;
+}
+
+constexpr size_t k_num_exp_in = ch_exp_count(ChReg_t::kSrIn, SR_IN_BITS);
+constexpr size_t k_num_exp_out = ch_exp_count(ChReg_t::kSrOut, SR_OUT_BITS);
+
+// name and description text of the generated channels
+struct ChText_t
+{
+	char name[12];
+	char description[16];
+};
+
+constexpr size_t ch_put(char *s, size_t n, const char *t)
+{
+	while( *t )
+		s[n++] = *t++;
+	s[n] = 0;
+	return n;
+}
+
+constexpr size_t ch_put_num(char *s, size_t n, size_t v)
+{
+	char d[4] = {};
+	size_t k = 0;
+	do {
+		d[k++] = (char)( '0' + v % 10 );
+		v /= 10;
+	} while( v );
+	while( k )
+		s[n++] = d[--k];
+	s[n] = 0;
+	return n;
+}
+
+constexpr std::array<ChText_t, k_num_exp_in + k_num_exp_out> ch_exp_text()
+{
+	std::array<ChText_t, k_num_exp_in + k_num_exp_out> a{};
+	for(size_t i = 0; i < a.size(); i++) {
+		bool in = i < k_num_exp_in;
+		size_t n = in ? ch_base_count(ChKind_t::kSwIn) + i + 1 : ch_base_count(ChKind_t::kSwOut) + i - k_num_exp_in + 1;
+		ch_put_num(a[i].name, ch_put(a[i].name, 0, "Switch_"), k_num_base_channels + i);
+		ch_put(a[i].description, ch_put_num(a[i].description, ch_put(a[i].description, 0, in ? "IN " : "OUT "), n), in ? " (R)" : " (RW)");
+	}
+	return a;
+}
+
+constexpr auto k_exp_text = ch_exp_text();
+
+constexpr size_t k_num_of_channels = k_num_base_channels + k_num_exp_in + k_num_exp_out + k_num_tail_channels;
+
+// fixed Switch channels, expansion channels, then the rest
+constexpr std::array<Channel_t, k_num_of_channels> ch_table()
+{
+	std::array<Channel_t, k_num_of_channels> a{};
+	size_t n = 0, t = 0;
+
+	for(const Channel_t &c : k_base_channels)
+		a[n++] = c;
+	for(size_t b = SR_BASE_BITS; b < SR_IN_BITS; b++)
+		if( !ch_fixed_uses(ChReg_t::kSrIn, b) ) {
+			a[n++] = {ChKind_t::kSwIn, ChReg_t::kSrIn, (uint8_t)b, k_exp_text[t].name, k_exp_text[t].description};
+			t++;
+		}
+	for(size_t b = SR_BASE_BITS; b < SR_OUT_BITS; b++)
+		if( !ch_fixed_uses(ChReg_t::kSrOut, b) ) {
+			a[n++] = {ChKind_t::kSwOut, ChReg_t::kSrOut, (uint8_t)b, k_exp_text[t].name, k_exp_text[t].description};
+			t++;
+		}
+	for(const Channel_t &c : k_tail_channels)
+		a[n++] = c;
+	return a;
+}
+
+constexpr auto k_channels = ch_table();
+
+constexpr bool ch_is_switch(ChKind_t kind)
+{
+	return ( kind == ChKind_t::kSwIn ) || ( kind == ChKind_t::kSwOut ) || ( kind == ChKind_t::kSwPwm ) ||
+		   ( kind == ChKind_t::kSwHeatAuto ) || ( kind == ChKind_t::kSwHeatDuty );
+}
+
+// number of channels of a kind
+constexpr size_t ch_count(ChKind_t kind)
+{
+	size_t n = 0;
+	for(size_t i = 0; i < k_num_of_channels; i++)
+		if( k_channels[i].kind == kind )
+			n++;
+	return n;
+}
+
+// position of the n-th channel of a kind
+constexpr uint8_t ch_pos(ChKind_t kind, size_t n = 0)
+{
+	for(size_t i = 0; i < k_num_of_channels; i++)
+		if(( k_channels[i].kind == kind ) && ( n-- == 0 ))
+			return k_channels[i].pos;
+	return 0xff;
+}
+
+// shift register mask of all channels of a kind, T is SrIn_t or SrOut_t
+template<typename T>
+constexpr T ch_mask(ChKind_t kind)
+{
+	T m;
+	for(size_t i = 0; i < k_num_of_channels; i++)
+		if(( k_channels[i].kind == kind ) && (( k_channels[i].reg == ChReg_t::kSrIn ) || ( k_channels[i].reg == ChReg_t::kSrOut )))
+			m.set(k_channels[i].pos);
+	return m;
+}
+
+// mask of all bits in use in a shift register
+template<typename T>
+constexpr T ch_reg_mask(ChReg_t reg)
+{
+	T m;
+	for(size_t i = 0; i < k_num_of_channels; i++)
+		if( k_channels[i].reg == reg )
+			m.set(k_channels[i].pos);
+	return m;
+}
+
+// n-th channel of a kind as a shift register mask, empty if there is none
+template<typename T>
+constexpr T ch_mask_n(ChKind_t kind, size_t n)
+{
+	T m;
+	for(size_t i = 0; i < k_num_of_channels; i++)
+		if(( k_channels[i].kind == kind ) && (( k_channels[i].reg == ChReg_t::kSrIn ) || ( k_channels[i].reg == ChReg_t::kSrOut )) && ( n-- == 0 )) {
+			m.set(k_channels[i].pos);
+			break;
+		}
+	return m;
+}
+
+// positions of all channels of a kind, in table order
+template<ChKind_t K>
+constexpr std::array<uint8_t, ch_count(K)> ch_positions()
+{
+	std::array<uint8_t, ch_count(K)> a{};
+	for(size_t n = 0; n < a.size(); n++)
+		a[n] = ch_pos(K, n);
+	return a;
+}
+
+// Switch IDs of all channels of a kind
+template<ChKind_t K>
+constexpr std::array<uint8_t, ch_count(K)> ch_switch_ids()
+{
+	std::array<uint8_t, ch_count(K)> a{};
+	size_t n = 0, id = 0;
+	for(size_t i = 0; i < k_num_of_channels; i++) {
+		if( k_channels[i].kind == K )
+			a[n++] = (uint8_t)id;
+		if( ch_is_switch(k_channels[i].kind) )
+			id++;
+	}
+	return a;
+}
+
+constexpr size_t k_num_sw_in = ch_count(ChKind_t::kSwIn);
+constexpr size_t k_num_sw_out = ch_count(ChKind_t::kSwOut);
+constexpr size_t k_num_sw_pwm = ch_count(ChKind_t::kSwPwm);
+constexpr size_t k_num_sw_heat = ch_count(ChKind_t::kSwHeatAuto);
+constexpr uint32_t k_num_of_switch_devices = k_num_sw_in + k_num_sw_out + k_num_sw_pwm + 2 * k_num_sw_heat;
+
+// Switch value range of a kind, the minimum is 0 for all, steps of 1
+constexpr uint32_t ch_switch_max(ChKind_t kind)
+{
+	return (( kind == ChKind_t::kSwPwm ) || ( kind == ChKind_t::kSwHeatDuty )) ? 100 : 1;
+}
+
+constexpr bool ch_switch_writable(ChKind_t kind)
+{
+	return ( kind == ChKind_t::kSwOut ) || ( kind == ChKind_t::kSwPwm ) || ( kind == ChKind_t::kSwHeatAuto );
+}
+
+// Switch ID -> channel table index, and ordinal of the channel within its kind
+template<size_t N>
+constexpr std::array<uint8_t, N> ch_switch_table(bool ordinal)
+{
+	std::array<uint8_t, N> a{};
+	size_t id = 0;
+	for(size_t i = 0; i < k_num_of_channels; i++) {
+		if( !ch_is_switch(k_channels[i].kind) )
+			continue;
+		size_t ord = 0;
+		for(size_t j = 0; j < i; j++)
+			if( k_channels[j].kind == k_channels[i].kind )
+				ord++;
+		a[id++] = (uint8_t)(ordinal ? ord : i);
+	}
+	return a;
+}
+
+constexpr auto k_switch_ch = ch_switch_table<k_num_of_switch_devices>(false);
+constexpr auto k_switch_ord = ch_switch_table<k_num_of_switch_devices>(true);
+
+enum struct ChWrite_t : uint8_t
+{
+	kOk = 0,
+	kBadId,
+	kReadOnly,
+	kRange					// below 0, above ch_switch_max() or not a whole step
+};
+
+// the one check of a Switch write, for the Alpaca routes and MQTT alike
+constexpr ChWrite_t ch_switch_check(uint32_t id, double value)
+{
+	if( id >= k_num_of_switch_devices )
+		return ChWrite_t::kBadId;
+	ChKind_t kind = k_channels[k_switch_ch[id]].kind;
+	if( !ch_switch_writable(kind) )
+		return ChWrite_t::kReadOnly;
+	if(( value < 0.0 ) || ( value > (double)ch_switch_max(kind) ) || ( value != (double)(uint32_t)value ))
+		return ChWrite_t::kRange;
+	return ChWrite_t::kOk;
+}
+
+constexpr auto k_sw_in_pos = ch_positions<ChKind_t::kSwIn>();
+constexpr auto k_sw_out_pos = ch_positions<ChKind_t::kSwOut>();
+constexpr auto k_sw_pwm_pin = ch_positions<ChKind_t::kSwPwm>();
+constexpr auto k_sw_in_id = ch_switch_ids<ChKind_t::kSwIn>();
+constexpr auto k_sw_out_id = ch_switch_ids<ChKind_t::kSwOut>();
+constexpr auto k_sw_pwm_id = ch_switch_ids<ChKind_t::kSwPwm>();
+constexpr auto k_sw_heat_auto_id = ch_switch_ids<ChKind_t::kSwHeatAuto>();
+constexpr auto k_sw_heat_duty_id = ch_switch_ids<ChKind_t::kSwHeatDuty>();
+
+// hardware binding of one roof
+struct DomeHw_t
+{
+	SrOut_t relay_open;
+	SrOut_t relay_close;
+	SrIn_t limit_opened;
+	SrIn_t limit_closed;
+	SrIn_t button_open;			// empty if the roof has no manual buttons
+	SrIn_t button_close;
+};
+
+constexpr size_t k_num_of_domes = ch_count(ChKind_t::kRoofOpen);
+
+template<size_t N>
+constexpr std::array<DomeHw_t, N> ch_dome_table()
+{
+	std::array<DomeHw_t, N> a{};
+	for(size_t n = 0; n < N; n++) {
+		a[n].relay_open = ch_mask_n<SrOut_t>(ChKind_t::kRoofOpen, n);
+		a[n].relay_close = ch_mask_n<SrOut_t>(ChKind_t::kRoofClose, n);
+		a[n].limit_opened = ch_mask_n<SrIn_t>(ChKind_t::kLimitOpened, n);
+		a[n].limit_closed = ch_mask_n<SrIn_t>(ChKind_t::kLimitClosed, n);
+		a[n].button_open = ch_mask_n<SrIn_t>(ChKind_t::kButtonOpen, n);
+		a[n].button_close = ch_mask_n<SrIn_t>(ChKind_t::kButtonClose, n);
+	}
+	return a;
+}
+
+constexpr auto k_dome_hw = ch_dome_table<k_num_of_domes>();
+
+// bit masks for the output shift register 595
+constexpr SrOut_t BIT_SW_OUT = ch_mask<SrOut_t>(ChKind_t::kSwOut);
+constexpr SrOut_t BIT_OUT_CLEAR = ~BIT_SW_OUT;
+constexpr SrOut_t BIT_CPU_OK = ch_mask<SrOut_t>(ChKind_t::kLedCpu);
+constexpr SrOut_t BIT_WS_OK = ch_mask<SrOut_t>(ChKind_t::kLedWs);
+constexpr SrOut_t BIT_DOME = ch_mask<SrOut_t>(ChKind_t::kLedDome);
+constexpr SrOut_t BIT_SWITCH = ch_mask<SrOut_t>(ChKind_t::kLedSwitch);
+constexpr SrOut_t BIT_SAFEMON = ch_mask<SrOut_t>(ChKind_t::kLedSafemon);
+
+// bit masks for the input shift register 165
+constexpr SrIn_t BIT_SR_IN_USED = ch_reg_mask<SrIn_t>(ChReg_t::kSrIn);
+constexpr SrIn_t BIT_SAFE_RAIN = ch_mask<SrIn_t>(ChKind_t::kSafeRain);
+constexpr SrIn_t BIT_SAFE_POWER = ch_mask<SrIn_t>(ChKind_t::kSafePower);
+
+// consistency checks on the table
+constexpr bool ch_no_overlap()
+{
+	for(size_t i = 0; i < k_num_of_channels; i++)
+		for(size_t j = i + 1; j < k_num_of_channels; j++)
+			if(( k_channels[i].reg == k_channels[j].reg ) && ( k_channels[i].reg != ChReg_t::kNone ) && ( k_channels[i].pos == k_channels[j].pos ))
+				return false;
+	return true;
+}
+
+constexpr bool ch_in_range()
+{
+	for(size_t i = 0; i < k_num_of_channels; i++) {
+		if(( k_channels[i].reg == ChReg_t::kSrIn ) && ( k_channels[i].pos >= SR_IN_BITS ))
+			return false;
+		if(( k_channels[i].reg == ChReg_t::kSrOut ) && ( k_channels[i].pos >= SR_OUT_BITS ))
+			return false;
+	}
+	return true;
+}
+
+constexpr bool ch_pins_free()
+{
+	const uint8_t sr_pins[] = {SR_OUT_PIN_OE, SR_OUT_PIN_STCP, SR_OUT_PIN_MR, SR_OUT_PIN_SHCP, SR_OUT_PIN_SDOUT,
+								SR_IN_PIN_CE, SR_IN_PIN_CP, SR_IN_PIN_PL, SR_IN_PIN_SDIN, IN_PIN_AP_SET, OUT_PIN_AP_LED,
+								IN_PIN_RX1, OUT_PIN_TX1};
+	for(size_t i = 0; i < k_num_of_channels; i++)
+		for(uint8_t p : sr_pins)
+			if(( k_channels[i].reg == ChReg_t::kGpio ) && ( k_channels[i].pos == p ))
+				return false;
+	return true;
+}
+
+constexpr bool ch_tail_no_switch()
+{
+	for(const Channel_t &c : k_tail_channels)
+		if( ch_is_switch(c.kind) )
+			return false;
+	return true;
+}
+
+constexpr bool ch_switch_named()
+{
+	for(size_t i = 0; i < k_num_of_channels; i++)
+		if( ch_is_switch(k_channels[i].kind ) && (( k_channels[i].name == nullptr ) || ( k_channels[i].description == nullptr )))
+			return false;
+	return true;
+}
+
+static_assert(ch_no_overlap(), "two channels share the same register bit or GPIO");
+static_assert(ch_in_range(), "channel bit beyond the shift register chain");
+static_assert(ch_pins_free(), "channel GPIO collides with a board pin");
+static_assert(ch_switch_named(), "Switch channel without name or description");
+static_assert(k_num_of_switch_devices <= 255, "Switch IDs are 8 bit in the channel tables");
+static_assert(ch_tail_no_switch(), "Switch channel in k_tail_channels, its ID would move with the expansion boards");
+static_assert(ch_count(ChKind_t::kSwHeatAuto) == k_num_sw_pwm && ch_count(ChKind_t::kSwHeatDuty) == k_num_sw_pwm, "one dew heater mode and duty per PWM");
+static_assert(ch_count(ChKind_t::kRoofOpen) == DOME_NUM_ROOFS && ch_count(ChKind_t::kRoofClose) == DOME_NUM_ROOFS, "one relay pair per roof");
+static_assert(ch_count(ChKind_t::kLimitOpened) == DOME_NUM_ROOFS && ch_count(ChKind_t::kLimitClosed) == DOME_NUM_ROOFS, "one limit switch pair per roof");
+static_assert(ch_count(ChKind_t::kButtonOpen) <= DOME_NUM_ROOFS && ch_count(ChKind_t::kButtonOpen) == ch_count(ChKind_t::kButtonClose), "manual buttons come in pairs");
+
+// 165 image -> Switch inputs. Each channel is a byte index, a shift and a mask, unrolled at compile time
+template<size_t... I>
+inline void ch_unpack_sw_in(const SrIn_t &reg, bool *sw_in, std::index_sequence<I...>)
+{
+	((sw_in[I] = (( reg.b[k_sw_in_pos[I] >> 3] >> ( k_sw_in_pos[I] & 7 )) & 1 ) != 0 ), ...);
+}
+
+inline void ch_unpack_sw_in(const SrIn_t &reg, bool *sw_in)
+{
+	ch_unpack_sw_in(reg, sw_in, std::make_index_sequence<k_num_sw_in>());
+}
+
+// Switch outputs -> 595 image bits, OR-ed in without branches
+template<size_t... I>
+inline SrOut_t ch_pack_sw_out(const bool *sw_out, std::index_sequence<I...>)
+{
+	SrOut_t v;
+	((v.b[k_sw_out_pos[I] >> 3] |= (uint8_t)(((uint8_t)sw_out[I]) << ( k_sw_out_pos[I] & 7 ))), ...);
+	return v;
+}
+
+inline SrOut_t ch_pack_sw_out(const bool *sw_out)
+{
+	return ch_pack_sw_out(sw_out, std::make_index_sequence<k_num_sw_out>());
+}
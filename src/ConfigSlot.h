@@ -0,0 +1,75 @@
+/**************************************************************************************************
+  Filename:       ConfigSlot.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    read-copy-update holder for a device configuration. The API task copies the
+                  current snapshot, validates the changes on the copy and publishes it with one
+                  atomic index store; readers take Get() once per call and see a complete old or
+                  new configuration, never a mix. Two buffers: before the writer overwrites the
+                  retired one it waits for a control tick to end, after that no control stage can
+                  still hold it. If no tick ends within CONFIG_GRACE_MS the control task is stalled,
+                  possibly inside a reader: Publish() leaves both buffers alone, logs and fails.
+                  One writer at a time, the API task, or setup() before the control task runs.
+**************************************************************************************************/
+#pragma once
+#include <Arduino.h>
+#include <atomic>
+#include "ControlTask.h"
+#include "LogRing.h"
+
+#define CONFIG_GRACE_MS         1000        // 50 control ticks
+
+template <typename T>
+class ConfigSlot
+{
+private:
+	T _buf[2];
+	std::atomic<uint8_t> _cur;
+	std::atomic<uint32_t> _version;			// bumped by every Publish()
+	uint32_t _retired_tick;					// control ticks done when the other buffer was retired
+
+	// grace period: a tick running at the last swap may hold the retired buffer. False when the
+	// tick has not advanced, the buffer may still be read
+	bool _waitGrace()
+	{
+		if( g_Control.GetTask() == nullptr )	// not started yet, no readers
+			return true;
+		for(uint32_t ms = 0; g_Control.GetTicks() == _retired_tick; ms += CONTROL_TICK_MS) {
+			if( ms >= CONFIG_GRACE_MS )
+				return false;
+			delay(CONTROL_TICK_MS);
+		}
+		return true;
+	}
+
+public:
+	ConfigSlot() : _cur(0), _version(0), _retired_tick(0) {}
+
+	// constructors only, before any reader or writer runs
+	void Reset(const T &init)
+	{
+		_buf[0] = init;
+		_buf[1] = init;
+		_cur.store(0, std::memory_order_relaxed);
+	}
+
+	const T &Get() const { return _buf[_cur.load(std::memory_order_acquire)]; }
+	uint32_t Version() const { return _version.load(std::memory_order_acquire); }
+
+	// false when the control task is stalled, the current configuration stays
+	bool Publish(const T &next)
+	{
+		uint8_t spare = _cur.load(std::memory_order_relaxed) ^ 1;
+
+		if( !_waitGrace() ) {
+			RLOG_ERROR_PRINTF("ERROR! Control task stalled for %u ms, configuration not applied\n", CONFIG_GRACE_MS);
+			return false;
+		}
+		_buf[spare] = next;
+		_cur.store(spare, std::memory_order_release);
+		_retired_tick = g_Control.GetTicks();
+		_version.fetch_add(1, std::memory_order_release);
+		return true;
+	}
+};
@@ -0,0 +1,109 @@
+/**************************************************************************************************
+  Filename:       ControlTask.cpp
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    fixed rate control tick implementation
+**************************************************************************************************/
+#include "ControlTask.h"
+#include "LogRing.h"
+
+ControlTask g_Control;
+
+ControlTask::ControlTask()
+{
+	_num_stages = 0;
+	_task = nullptr;
+	_ticks = 0;
+	_overruns = 0;
+	_tick_us = 0;
+	_tick_us_max = 0;
+}
+
+// stages run in the order they are added. Add them all before Begin()
+bool ControlTask::AddStage(const char *name, ControlStageFn_t fn, uint32_t budget_us)
+{
+	if(( _num_stages >= CONTROL_MAX_STAGES ) || ( _task != nullptr ))
+		return false;
+
+	_stage[_num_stages] = {name, fn, budget_us, 0, 0, 0};
+	_num_stages++;
+	return true;
+}
+
+void ControlTask::Begin(AsyncWebServer *server)
+{
+	server->on(CONTROL_URL, HTTP_GET, [this](AsyncWebServerRequest *request) { _sendJson(request); });
+
+	xTaskCreatePinnedToCore(_taskLoop, "control", CONTROL_TASK_STACK, this, CONTROL_TASK_PRIO, &_task, CONTROL_TASK_CORE);
+}
+
+void ControlTask::_taskLoop(void *arg)
+{
+	ControlTask *ctl = (ControlTask *)arg;
+	TickType_t base_tick = xTaskGetTickCount();
+	TickType_t last_wake = base_tick;
+	int64_t base_us = esp_timer_get_time();
+
+	for(;;) {
+		vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(CONTROL_TICK_MS));	// returns at once if the last tick overran
+		ctl->_tick(base_us + (int64_t)(last_wake - base_tick) * portTICK_PERIOD_MS * 1000);
+	}
+}
+
+void ControlTask::_tick(int64_t scheduled_us)
+{
+	int64_t start = esp_timer_get_time();
+	int64_t jitter = start - scheduled_us;
+
+	_jitter.Add((uint32_t)(( jitter < 0 ) ? -jitter : jitter));
+
+	int64_t t0 = start;
+	for(uint8_t i = 0; i < _num_stages; i++) {
+		ControlStage_t &s = _stage[i];
+
+		s.fn();
+
+		int64_t t1 = esp_timer_get_time();
+		s.last_us = (uint32_t)( t1 - t0 );
+		if( s.last_us > s.max_us )
+			s.max_us = s.last_us;
+		if( s.last_us > s.budget_us )
+			s.overruns++;
+		t0 = t1;
+	}
+
+	_tick_us = (uint32_t)( t0 - start );
+	if( _tick_us > _tick_us_max )
+		_tick_us_max = _tick_us;
+	_busy.Add(_tick_us);
+
+	if(( t0 - scheduled_us ) > CONTROL_TICK_MS * 1000 ) {		// next tick will start late
+		_overruns++;
+		RLOG_WARNING_PRINTF("WARNING. Control tick overrun %u us\n", _tick_us);
+	}
+
+	_ticks++;
+}
+
+// counters are read without locking, a sample may be one tick stale
+void ControlTask::_sendJson(AsyncWebServerRequest *request)
+{
+	AsyncResponseStream *response = request->beginResponseStream("application/json");
+
+	response->printf("{\"period_ms\":%u,\"ticks\":%u,\"overruns\":%u,\"tick_us\":%u,\"tick_us_max\":%u,\"jitter_us\":",
+		CONTROL_TICK_MS, _ticks, _overruns, _tick_us, _tick_us_max);
+	_jitter.PrintJson(*response);
+	response->print(",\"busy_us\":");
+	_busy.PrintJson(*response);
+
+	response->print(",\"stages\":[");
+	for(uint8_t i = 0; i < _num_stages; i++) {
+		const ControlStage_t &s = _stage[i];
+		response->printf("%s{\"name\":\"%s\",\"budget_us\":%u,\"last_us\":%u,\"max_us\":%u,\"overruns\":%u}",
+			(i > 0) ? "," : "", s.name, s.budget_us, s.last_us, s.max_us, s.overruns);
+	}
+	response->print("]}");
+
+	request->send(response);
+}
@@ -0,0 +1,60 @@
+/**************************************************************************************************
+  Filename:       ControlTask.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    fixed rate control tick. Runs the I/O stages (shift registers, dome, safety,
+                  switch outputs) from a vTaskDelayUntil driven task, independent of network
+                  load, and measures tick jitter and per stage time budgets.
+**************************************************************************************************/
+#pragma once
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "Histogram.h"
+
+#define CONTROL_TICK_MS         20          // control period
+#define CONTROL_TASK_STACK      6144
+#define CONTROL_TASK_PRIO       5           // above loopTask and async_tcp
+#define CONTROL_TASK_CORE       1
+#define CONTROL_MAX_STAGES      16
+#define CONTROL_URL             "/control"
+
+typedef void (*ControlStageFn_t)(void);
+
+struct ControlStage_t
+{
+	const char *name;
+	ControlStageFn_t fn;
+	uint32_t budget_us;						// time allowed to the stage each tick
+	uint32_t last_us;
+	uint32_t max_us;
+	uint32_t overruns;						// ticks where the stage exceeded its budget
+};
+
+class ControlTask
+{
+private:
+	ControlStage_t _stage[CONTROL_MAX_STAGES];
+	uint8_t _num_stages;
+	TaskHandle_t _task;
+
+	uint32_t _ticks;
+	uint32_t _overruns;						// ticks longer than the period
+	uint32_t _tick_us;						// duration of the last tick
+	uint32_t _tick_us_max;
+	Histogram _jitter;						// |actual - scheduled| start time, us
+	Histogram _busy;						// tick duration, us
+
+	static void _taskLoop(void *arg);
+	void _tick(int64_t scheduled_us);
+	void _sendJson(AsyncWebServerRequest *request);
+
+public:
+	ControlTask();
+	bool AddStage(const char *name, ControlStageFn_t fn, uint32_t budget_us);
+	void Begin(AsyncWebServer *server);
+	uint32_t GetTicks() { return _ticks; }
+	TaskHandle_t GetTask() { return _task; }
+};
+
+extern ControlTask g_Control;
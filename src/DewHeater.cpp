@@ -0,0 +1,144 @@
+/**************************************************************************************************
+  Filename:       DewHeater.cpp
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    dew heater control implementation
+**************************************************************************************************/
+#include "DewHeater.h"
+#include "WeatherMath.h"
+#include "LogRing.h"
+#include "Trace.h"
+
+DewHeater g_DewHeater;
+
+DewHeater::DewHeater()
+{
+	for(size_t i = 0; i < k_num_sw_pwm; i++) {
+		_manual[i] = 0;
+		_auto[i] = false;
+		_duty[i] = 0;
+		_target[i] = 0;
+		_fade_end[i] = 0;
+		_integral[i] = 0;
+		_pi_out[i] = 0;
+		_surface[i] = 0;
+		_surface_ms[i] = 0;
+		_closed[i] = false;
+	}
+	_tmr_pi = 0;
+	_ws_link = false;
+	_tair = 0;
+	_hum = 0;
+	_tuning.Reset({30, 20, 5});
+}
+
+// replaces analogWrite on the PWM pins: LEDC channels are owned here so the fade can be used
+void DewHeater::Begin()
+{
+	ledc_timer_config_t timer = {};
+	timer.speed_mode = DEW_LEDC_MODE;
+	timer.duty_resolution = DEW_LEDC_BITS;
+	timer.timer_num = DEW_LEDC_TIMER;
+	timer.freq_hz = DEW_LEDC_FREQ;
+	timer.clk_cfg = LEDC_AUTO_CLK;
+	ledc_timer_config(&timer);
+
+	for(size_t i = 0; i < k_num_sw_pwm; i++) {
+		ledc_channel_config_t ch = {};
+		ch.gpio_num = k_sw_pwm_pin[i];
+		ch.speed_mode = DEW_LEDC_MODE;
+		ch.channel = (ledc_channel_t)( DEW_LEDC_CHANNEL0 + i );
+		ch.intr_type = LEDC_INTR_DISABLE;
+		ch.timer_sel = DEW_LEDC_TIMER;
+		ch.duty = 0;
+		ch.hpoint = 0;
+		ledc_channel_config(&ch);
+	}
+
+	ledc_fade_func_install(0);
+	_tmr_pi = millis();
+
+	g_StateBus.Subscribe(Topic_t::kWeather, _onWeather, this);
+	g_StateBus.Subscribe(Topic_t::kWsLink, _onLink, this);
+}
+
+void DewHeater::_onWeather(const BusEvent_t &ev, void *ctx)
+{
+	DewHeater *self = (DewHeater *)ctx;
+
+	self->_tair = ev.ws.tair;
+	self->_hum = ev.ws.hum;
+}
+
+void DewHeater::_onLink(const BusEvent_t &ev, void *ctx)
+{
+	((DewHeater *)ctx)->_ws_link = ev.link;
+}
+
+// control task, from the Modbus stage: heatN field of the sensor map
+void DewHeater::SetSurface(uint8_t ch, int16_t t, uint32_t now)
+{
+	if( ch >= k_num_sw_pwm )
+		return;
+	_surface[ch] = t;
+	_surface_ms[ch] = now ? now : 1;
+}
+
+// one channel. With a fresh surface temperature e = dew point + margin - surface, heating raises
+// the surface and closes the loop. Without it e = margin - (air - dew point), which the heater
+// does not move: the integral only ramps the duty up or down between the clamps
+void DewHeater::_updatePi(uint8_t ch, int32_t dew, uint32_t now)
+{
+	const DewTuning_t &t = _tuning.Get();
+	int32_t err;										// 0.1C, > 0 too close to dew
+
+	_closed[ch] = ( _surface_ms[ch] != 0 ) && (( now - _surface_ms[ch] ) < DEW_SURFACE_STALE_MS );
+	if( _closed[ch] )
+		err = dew + (int32_t)t.margin - _surface[ch];
+	else
+		err = (int32_t)t.margin - ( (int32_t)_tair - dew );
+
+	// % * 1000 per period: ki [%/C/min] * err [0.1C] * 100 / 60 * period [s]
+	int32_t &integral = _integral[ch];
+	integral += ( (int32_t)t.ki * err * 100 * ( DEW_PI_PERIOD_MS / 1000 )) / 60;
+	if( integral < 0 ) integral = 0;
+	if( integral > DEW_INTEGRAL_MAX ) integral = DEW_INTEGRAL_MAX;
+
+	int32_t out = ((int32_t)t.kp * err ) / 10 + integral / 1000;
+	_pi_out[ch] = (uint8_t)(( out < 0 ) ? 0 : ( out > 100 ) ? 100 : out );
+}
+
+// control tick: pick each channel's duty and start a fade when it changes
+void DewHeater::Loop()
+{
+	uint32_t now = millis();
+
+	if(( now - _tmr_pi ) >= DEW_PI_PERIOD_MS ) {
+		_tmr_pi += DEW_PI_PERIOD_MS;
+		if( _ws_link ) {								// hold the last outputs until the station is back
+			int32_t dew = wm_dew_point(_tair, _hum);
+			for(uint8_t i = 0; i < k_num_sw_pwm; i++)
+				if( _auto[i] )
+					_updatePi(i, dew, now);
+		}
+	}
+
+	for(size_t i = 0; i < k_num_sw_pwm; i++) {
+		_target[i] = _auto[i] ? _pi_out[i] : _manual[i];
+
+		// a fade started on a fading channel blocks until the first one ends, don't stall the tick
+		if(( _target[i] == _duty[i] ) || ((int32_t)( now - _fade_end[i] ) < 0 ))
+			continue;
+
+		uint32_t duty = ((uint32_t)_target[i] * DEW_LEDC_MAX_DUTY ) / 100;
+		if( ledc_set_fade_time_and_start(DEW_LEDC_MODE, (ledc_channel_t)( DEW_LEDC_CHANNEL0 + i ), duty, DEW_FADE_MS, LEDC_FADE_NO_WAIT) == ESP_OK ) {
+			_duty[i] = _target[i];
+			_fade_end[i] = now + DEW_FADE_MS + 20;
+			TRACE_OUTPUT(TraceOut_t::kPwm);
+		} else {
+			RLOG_WARNING_PRINTF("WARNING. PWM %u fade failed\n", (uint32_t)( i + 1 ));
+			_fade_end[i] = now + DEW_FADE_MS;
+		}
+	}
+}
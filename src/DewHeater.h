@@ -0,0 +1,84 @@
+/**************************************************************************************************
+  Filename:       DewHeater.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    dew heaters on the PWM channels. Each channel takes the manual Switch duty or,
+                  in auto mode, the output of its own PI controller. With a surface temperature
+                  for the channel (Modbus field heatN) the PI holds that surface margin above the
+                  dew point, a closed loop through the heater. Without one the channel falls back
+                  to a feed-forward duty ramp on the ambient dew spread: the duty climbs while air
+                  is closer than margin to the dew point and falls back when it is not, the
+                  heater can't change that spread. Duty changes are ramped by the LEDC fade.
+**************************************************************************************************/
+#pragma once
+#include <Arduino.h>
+#include <driver/ledc.h>
+#include "ChannelMap.h"
+#include "StateBus.h"
+#include "ConfigSlot.h"
+
+#define DEW_LEDC_MODE           LEDC_HIGH_SPEED_MODE
+#define DEW_LEDC_TIMER          LEDC_TIMER_0
+#define DEW_LEDC_CHANNEL0       0           // PWM n uses LEDC channel DEW_LEDC_CHANNEL0 + n
+#define DEW_LEDC_BITS           LEDC_TIMER_10_BIT
+#define DEW_LEDC_MAX_DUTY       1023
+#define DEW_LEDC_FREQ           1000        // Hz
+#define DEW_FADE_MS             500         // ramp time of a duty change
+#define DEW_PI_PERIOD_MS        1000        // PI update period
+#define DEW_INTEGRAL_MAX        100000      // integral term clamp, % * 1000
+#define DEW_SURFACE_STALE_MS    10000       // surface temperature older than this, ramp on the spread
+
+// PI tuning, swapped whole so the loop never runs on a half written set
+struct DewTuning_t
+{
+	int16_t margin;							// wanted air - dew point, 0.1C
+	int16_t kp;								// % per C of error
+	int16_t ki;								// % per C of error per minute
+};
+
+class DewHeater
+{
+private:
+	uint8_t _manual[k_num_sw_pwm];			// Switch duty, %
+	bool _auto[k_num_sw_pwm];
+	uint8_t _duty[k_num_sw_pwm];			// applied duty, %
+	uint8_t _target[k_num_sw_pwm];
+	uint32_t _fade_end[k_num_sw_pwm];		// a new fade waits for the running one
+	int32_t _integral[k_num_sw_pwm];		// % * 1000
+	uint8_t _pi_out[k_num_sw_pwm];
+	int16_t _surface[k_num_sw_pwm];			// heater surface, 0.1C
+	uint32_t _surface_ms[k_num_sw_pwm];		// 0 = never received
+	bool _closed[k_num_sw_pwm];				// last update ran on the surface temperature
+	uint32_t _tmr_pi;
+	bool _ws_link;							// from kWsLink
+	int16_t _tair;							// from kWeather, 0.1C
+	int16_t _hum;							// %
+
+	ConfigSlot<DewTuning_t> _tuning;
+
+	void _updatePi(uint8_t ch, int32_t dew, uint32_t now);
+	static void _onWeather(const BusEvent_t &ev, void *ctx);
+	static void _onLink(const BusEvent_t &ev, void *ctx);
+
+public:
+	DewHeater();
+	void Begin();
+	void Loop();
+
+	void SetManual(uint8_t ch, uint8_t duty) { if( ch < k_num_sw_pwm ) _manual[ch] = ( duty > 100 ) ? 100 : duty; }
+	void SetAuto(uint8_t ch, bool on) { if( ch < k_num_sw_pwm ) _auto[ch] = on; }
+	bool GetAuto(uint8_t ch) { return ( ch < k_num_sw_pwm ) ? _auto[ch] : false; }
+	uint8_t GetDuty(uint8_t ch) { return ( ch < k_num_sw_pwm ) ? _duty[ch] : 0; }
+	bool GetClosed(uint8_t ch) { return ( ch < k_num_sw_pwm ) ? _closed[ch] : false; }
+	void SetSurface(uint8_t ch, int16_t t, uint32_t now);
+	// the hardware fade to duty has ended
+	bool Ramped(uint8_t ch, uint8_t duty) { return ( ch < k_num_sw_pwm ) && ( _duty[ch] == duty ) && ((int32_t)( millis() - _fade_end[ch] ) >= 0 ); }
+
+	void SetTuning(int16_t margin, int16_t kp, int16_t ki) { _tuning.Publish({margin, kp, ki}); }
+	int16_t GetMargin() { return _tuning.Get().margin; }
+	int16_t GetKp() { return _tuning.Get().kp; }
+	int16_t GetKi() { return _tuning.Get().ki; }
+};
+
+extern DewHeater g_DewHeater;
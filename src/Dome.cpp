@@ -6,42 +6,80 @@
   Description:    Dome Device implementation
 **************************************************************************************************/
 #include "Dome.h"
+#include "LogRing.h"
+#include "HeapMonitor.h"
+#include "Interlock.h"
+#include "Trace.h"
+#include "HttpStats.h"
+#include "Encoder.h"
+#include "Analog.h"
 
 const char *const Dome::k_shutter_state_str[5] = {"Open", "Closed", "Opening", "Closing", "Error"};
 
 Dome::Dome() : AlpacaDome()
 {
 	// constructor
+	d_switch_opened = false;
+	d_switch_closed = false;
+	d_relay_open = false;
+	d_relay_close = false;
+	d_interlock = 0;
+	d_safety = 0;
+	d_num = 0;
+	d_leased = false;
+	d_remote = false;
+	d_cfg.Reset({false, 60, 0, false, 0, DOME_ENC_STALL_MS, 0, DOME_INRUSH_MS});
+	d_pub_shutter = 0xFF;
+	d_pub_slewing = false;
+	d_shutter = AlpacaShutterStatus_t::kError;
+	d_slewing = false;
+	d_timer_ini = 0;
+	d_timer_end = 0;
+	d_restored = false;
+	d_pos = 0;
+	d_pos_ini = 0;
+	d_saved = {0xFF, 0, 0};
+	d_enc_state = {0, 0, 0, false, false};
+	d_route_stid = 0;
+	d_drive_ms = 0;
+	d_oc_trip = false;
 }
 
-void Dome::Begin()
+void Dome::Begin(const DomeHw_t &hw, uint8_t num)
 {
+	d_hw = hw;
+	d_num = num;
+
     // init Dome
     AlpacaDome::Begin();
 
-	// init shutter status
-	if( d_use_switch )
-	{
-		if( d_switch_closed )
-			d_shutter = AlpacaShutterStatus_t::kClosed;
-		else if( d_switch_opened )
-			d_shutter = AlpacaShutterStatus_t::kOpen;
-		else
-			d_shutter = AlpacaShutterStatus_t::kError;
-	}
-	else
-	{
-		d_shutter = AlpacaShutterStatus_t::kError;
-	}
+	g_StateBus.Subscribe(Topic_t::kSafety, _onSafety, this);
+	g_StateBus.Subscribe(Topic_t::kDomeCmd, _onCmd, this);
+
+	// shutter status is restored by the first Scan(), the limit switches are not read yet
+	d_shutter = AlpacaShutterStatus_t::kError;
 }
 
 void Dome::Loop()
 {
-	if( d_use_switch ) {
+	const DomeConfig_t &cfg = d_cfg.Get();					// one snapshot for the whole pass
+	bool leased = ( g_Sessions.Count(DevKind_t::kDome, d_num) > 0 );
+	if( leased != d_leased ) {
+		d_leased = leased;
+		if( !leased )
+			_leaseEnded();
+	}
+
+	if( d_interlock != ( d_safety & cfg.interlock_mask )) {		// interlock mask changed by the setup page
+		if( Interlock(d_safety) )
+			g_Interlock.Trip();
+	}
+
+	if( cfg.use_switch ) {
 		if(( d_shutter == AlpacaShutterStatus_t::kOpening ) || ( d_shutter == AlpacaShutterStatus_t::kClosing )) {
-			if(( millis() - d_timer_ini ) > (d_timeout * 1000 ))		// timeout!!!!!!!!!!!
+			if(( millis() - d_timer_ini ) > (cfg.timeout * 1000 ))		// timeout!!!!!!!!!!!
 			{
-				SLOG_ERROR_PRINTF("ERROR! Dome timeout!");
+				RLOG_ERROR_PRINTF("ERROR! Dome timeout!\n");
 				d_shutter = AlpacaShutterStatus_t::kError;			// set error status
 				d_slewing = false;
 				d_timer_ini = 0;
@@ -58,7 +96,7 @@ void Dome::Loop()
 			d_slewing = false;
 			d_relay_close = false;		// turn relays OFF
 			d_relay_open = false;
-			SLOG_INFO_PRINTF("Dome open.");
+			RLOG_INFO_PRINTF("Dome open.\n");
 		}
 		
 		if(( d_shutter == AlpacaShutterStatus_t::kClosing ) && ( d_switch_closed ))
@@ -67,7 +105,7 @@ void Dome::Loop()
 			d_slewing = false;
 			d_relay_close = false;		// turn relays OFF
 			d_relay_open = false;
-			SLOG_INFO_PRINTF("Dome closed.");
+			RLOG_INFO_PRINTF("Dome closed.\n");
 		}
 	} else {
 		if(( d_shutter == AlpacaShutterStatus_t::kOpening ) && ( millis() > d_timer_end ))
@@ -76,7 +114,7 @@ void Dome::Loop()
 			d_slewing = false;
 			d_relay_close = false;		// turn relays OFF
 			d_relay_open = false;
-			SLOG_INFO_PRINTF("Dome open.");
+			RLOG_INFO_PRINTF("Dome open.\n");
 		}
 		
 		if(( d_shutter == AlpacaShutterStatus_t::kClosing ) && ( millis() > d_timer_end ))
@@ -85,12 +123,425 @@ void Dome::Loop()
 			d_slewing = false;
 			d_relay_close = false;		// turn relays OFF
 			d_relay_open = false;
-			SLOG_INFO_PRINTF("Dome closed.");
+			RLOG_INFO_PRINTF("Dome closed.\n");
+		}
+	}
+}
+
+// safety bits changed, dispatched before the dome stage so Scan() drives the relay in this tick
+void Dome::_onSafety(const BusEvent_t &ev, void *ctx)
+{
+	Dome *self = (Dome *)ctx;
+
+	self->d_safety = ev.safety;
+	if( self->Interlock(ev.safety) )
+		g_Interlock.Trip();
+}
+
+// Action and SupportedActions, which the library answers with no actions, and the shutter PUTs,
+// whose handler must hold the request to trace its decision. Registered on the Alpaca server after
+// AddDevice() has numbered the dome, before the library routes: the first match wins
+void Dome::RegisterRoutes(AsyncWebServer *server)
+{
+	static const struct { const char *name; DomeCmdKind_t cmd; } k_shutter_route[] = {
+		{"openshutter", DomeCmdKind_t::kOpen}, {"closeshutter", DomeCmdKind_t::kClose}, {"abortslew", DomeCmdKind_t::kAbort}};
+	char url[64];
+
+	snprintf(url, sizeof(url), "/api/v1/dome/%u/action", (unsigned)GetDeviceNumber());
+	server->on(url, HTTP_PUT, [this](AsyncWebServerRequest *request) { _actionRequest(request, true); });
+	snprintf(url, sizeof(url), "/api/v1/dome/%u/supportedactions", (unsigned)GetDeviceNumber());
+	server->on(url, HTTP_GET, [this](AsyncWebServerRequest *request) { _actionRequest(request, false); });
+
+	for(const auto &r : k_shutter_route) {
+		DomeCmdKind_t cmd = r.cmd;
+		snprintf(url, sizeof(url), "/api/v1/dome/%u/%s", (unsigned)GetDeviceNumber(), r.name);
+		server->on(url, HTTP_PUT, [this, cmd](AsyncWebServerRequest *request) { _shutterRequest(request, cmd); });
+	}
+}
+
+// web server task. PercentOpen returns the estimated position, 0..100, as the action string;
+// any other action is ActionNotImplemented, a missing Action parameter a 400
+void Dome::_actionRequest(AsyncWebServerRequest *request, bool put)
+{
+	const char *action = nullptr;
+	uint32_t ctid = 0;
+
+	for(size_t i = 0; i < request->params(); i++) {
+		AsyncWebParameter *prm = request->getParam(i);
+		if( prm->isPost() != put )
+			continue;
+		const char *name = prm->name().c_str();
+		if( strcasecmp(name, "Action") == 0 )
+			action = prm->value().c_str();
+		else if( strcasecmp(name, "ClientTransactionID") == 0 )
+			ctid = (uint32_t)strtoul(prm->value().c_str(), nullptr, 10);
+	}
+
+	char value[24];
+	int err = 0;
+	const char *msg = "";
+
+	if( !put ) {
+		strcpy(value, "[\"PercentOpen\"]");
+	} else if( !action || ( action[0] == 0 )) {
+		g_HttpStats.Error(request);
+		request->send(400, "text/plain", "Missing parameter Action");
+		return;
+	} else if( strcasecmp(action, "PercentOpen") == 0 ) {
+		snprintf(value, sizeof(value), "\"%u\"", GetPercentOpen());
+	} else {
+		strcpy(value, "\"\"");
+		err = DOME_ERR_ACTION_NOT_IMPLEMENTED;
+		msg = "Action not implemented";
+	}
+
+	if( err != 0 )
+		g_HttpStats.Error(request);
+	AsyncResponseStream *response = request->beginResponseStream("application/json");
+	response->printf("{\"Value\":%s,\"ClientTransactionID\":%u,\"ServerTransactionID\":%u,\"ErrorNumber\":%d,\"ErrorMessage\":\"%s\"}",
+		value, ctid, ++d_route_stid, err, msg);
+	request->send(response);
+}
+
+// web server task. OpenShutter, CloseShutter and AbortSlew: the decision is traced to this request.
+// A refused command is InvalidOperation, as the library reports a false setter
+void Dome::_shutterRequest(AsyncWebServerRequest *request, DomeCmdKind_t cmd)
+{
+	uint32_t ctid = 0;
+
+	for(size_t i = 0; i < request->params(); i++) {
+		AsyncWebParameter *prm = request->getParam(i);
+		if( prm->isPost() && ( strcasecmp(prm->name().c_str(), "ClientTransactionID") == 0 ))
+			ctid = (uint32_t)strtoul(prm->value().c_str(), nullptr, 10);
+	}
+
+	uint16_t trace_id = TRACE_REQUEST_ID(request);
+	bool done = false;
+	int err = 0;
+	const char *msg = "";
+
+	if( g_Sessions.Count(DevKind_t::kDome, d_num) == 0 ) {
+		err = DOME_ERR_NOT_CONNECTED;
+		msg = "Not connected";
+	} else {
+		switch( cmd )
+		{
+			case DomeCmdKind_t::kOpen:	done = _open(trace_id); break;
+			case DomeCmdKind_t::kClose:	done = _close(trace_id); break;
+			case DomeCmdKind_t::kAbort:	done = _abort(trace_id); break;
+		}
+		if( !done ) {
+			err = DOME_ERR_INVALID_OPERATION;
+			msg = "Shutter command refused";
+		}
+	}
+
+	if( err != 0 )
+		g_HttpStats.Error(request);
+	AsyncResponseStream *response = request->beginResponseStream("application/json");
+	response->printf("{\"ClientTransactionID\":%u,\"ServerTransactionID\":%u,\"ErrorNumber\":%d,\"ErrorMessage\":\"%s\"}",
+		ctid, ++d_route_stid, err, msg);
+	request->send(response);
+}
+
+// remote command, as the Alpaca PUT would do. The remote client holds no session lease, the
+// move it started is driven by Scan() until it ends or is aborted
+void Dome::_onCmd(const BusEvent_t &ev, void *ctx)
+{
+	Dome *self = (Dome *)ctx;
+
+	if( ev.dome_cmd.num != self->d_num )
+		return;
+
+	uint16_t trace_id = TRACE_REMOTE_ID();
+	switch( ev.dome_cmd.cmd )
+	{
+		case DomeCmdKind_t::kOpen:	self->d_remote = self->_open(trace_id) && self->d_slewing; break;
+		case DomeCmdKind_t::kClose:	self->d_remote = self->_close(trace_id) && self->d_slewing; break;
+		case DomeCmdKind_t::kAbort:	self->_abort(trace_id); self->d_remote = false; break;
+	}
+}
+
+// last client session closed or expired. "stop" leaves the roof to the manual buttons, a running
+// move is halted as an abort does: its end is never reached, the timer must not report it. A
+// remote move holds no lease and runs on. "close" closes the roof unattended, as the interlock does
+void Dome::_leaseEnded()
+{
+	const DomeConfig_t &cfg = d_cfg.Get();
+
+	if( !cfg.expire_close ) {
+		if( !d_slewing || d_remote )
+			return;
+		d_shutter = AlpacaShutterStatus_t::kError;
+		d_slewing = false;
+		d_timer_ini = 0;
+		d_timer_end = 0;
+		d_relay_close = false;							// turn relays OFF
+		d_relay_open = false;
+		RLOG_WARNING_PRINTF("WARNING! Dome %u no client lease, halted\n", d_num);
+		return;
+	}
+	if( d_shutter == AlpacaShutterStatus_t::kClosed )
+		return;
+
+	if( d_shutter != AlpacaShutterStatus_t::kClosing ) {
+		d_shutter = AlpacaShutterStatus_t::kClosing;
+		d_timer_ini = millis();
+		d_timer_end = d_timer_ini + cfg.timeout * 1000;
+	}
+	d_slewing = true;
+	d_relay_close = true;
+	d_relay_open = false;
+	RLOG_WARNING_PRINTF("WARNING! Dome %u no client lease, closing\n", d_num);
+}
+
+// on-board interlock. On a safe -> unsafe transition of the selected safety bits the close is
+// commanded at once, without waiting for a client to poll issafe. Call before Scan() in the same tick.
+// Returns true if the roof was commanded to close
+bool Dome::Interlock(uint8_t safemon_inputs)
+{
+	const DomeConfig_t &cfg = d_cfg.Get();
+	uint8_t unsafe = safemon_inputs & cfg.interlock_mask;
+	bool trip = ( unsafe != 0 ) && ( d_interlock == 0 );
+
+	d_interlock = unsafe;
+
+	if( !trip || ( d_shutter == AlpacaShutterStatus_t::kClosed ) || ( d_shutter == AlpacaShutterStatus_t::kClosing ))
+		return false;
+
+	RLOG_WARNING_PRINTF("WARNING! Dome interlock 0x%02x, closing\n", unsafe);
+	d_slewing = true;								// a running open is overridden
+	d_shutter = AlpacaShutterStatus_t::kClosing;
+	d_timer_ini = millis();
+	d_timer_end = d_timer_ini + cfg.timeout * 1000;
+	d_relay_close = true;
+	d_relay_open = false;
+
+	return true;
+}
+
+// map this roof's inputs to its relays. Called every scan cycle for each roof
+void Dome::Scan(const SrIn_t &in, SrOut_t &out)
+{
+	const DomeConfig_t &cfg = d_cfg.Get();
+	bool relay_open, relay_close;
+
+	d_switch_closed = (bool)( in & d_hw.limit_closed );		// handle limit switch inputs
+	d_switch_opened = (bool)( in & d_hw.limit_opened );
+
+	if( !d_restored )
+		_restore();
+	if( d_enc.Attached() )
+		_encoder(out, cfg);
+	if( d_num == ADC_CURRENT_ROOF )
+		_current(out, cfg);
+
+	if( d_remote && !d_slewing )							// the remote move ended, buttons again
+		d_remote = false;
+
+	if( d_interlock != 0 ) {								// unsafe: only the close is allowed, with or without clients
+		relay_close = d_relay_close && !d_switch_closed;
+		relay_open = false;
+	} else if( !d_leased && d_relay_close ) {				// closing after the last lease ended
+		relay_close = !d_switch_closed;
+		relay_open = false;
+	} else if( d_leased || d_remote ) {
+		relay_close = d_relay_close && !d_switch_closed;	// relays driven by the shutter state machine
+		relay_open = d_relay_open && !d_switch_opened;
+
+		if( relay_open )									// never energise both relays
+			relay_close = false;
+	} else {
+		bool close_button = (bool)( in & d_hw.button_close );	// if no clients connected, handle manual buttons
+		bool open_button = (bool)( in & d_hw.button_open );
+
+		relay_close = close_button && !open_button && !d_switch_closed;
+		relay_open = !close_button && open_button && !d_switch_opened;
+
+		if( d_oc_trip ) {									// a jam under the buttons, until both are released
+			d_oc_trip = close_button || open_button;
+			relay_close = false;
+			relay_open = false;
+		}
+	}
+
+	out &= ~( d_hw.relay_open | d_hw.relay_close );
+	if( relay_close )
+		out |= d_hw.relay_close;
+	if( relay_open )
+		out |= d_hw.relay_open;
+
+	_track();
+
+	if(( (uint8_t)d_shutter != d_pub_shutter ) || ( d_slewing != d_pub_slewing )) {
+		BusEvent_t ev(Topic_t::kDomeState);
+		ev.dome = {d_num, (uint8_t)d_shutter, d_slewing};
+		if( g_StateBus.Publish(ev) ) {
+			d_pub_shutter = (uint8_t)d_shutter;
+			d_pub_slewing = d_slewing;
+		}
+	}
+}
+
+// first scan after boot: limit switches first, then the stored state. A movement cut by the reset
+// left the roof somewhere between the ends, that is an error with its estimated position kept
+void Dome::_restore()
+{
+	const DomeConfig_t &cfg = d_cfg.Get();
+	RoofRecord_t rec;
+	RoofSource_t src;
+	bool stored = g_RoofMem.Recall(d_num, rec, src);
+
+	d_shutter = AlpacaShutterStatus_t::kError;
+	d_pos = 0;
+	if( cfg.use_switch && ( d_switch_closed || d_switch_opened )) {
+		d_shutter = d_switch_closed ? AlpacaShutterStatus_t::kClosed : AlpacaShutterStatus_t::kOpen;
+		d_pos = d_switch_closed ? 0 : ROOF_POS_FULL;
+		src = RoofSource_t::kSwitches;
+	} else if( stored && ( rec.shutter <= (uint8_t)AlpacaShutterStatus_t::kError )) {
+		d_pos = ( rec.pos > ROOF_POS_FULL ) ? ROOF_POS_FULL : rec.pos;
+		if(( rec.shutter == (uint8_t)AlpacaShutterStatus_t::kOpen ) || ( rec.shutter == (uint8_t)AlpacaShutterStatus_t::kClosed )) {
+			if( !cfg.use_switch )								// with switches, an end without its switch moved
+				d_shutter = (AlpacaShutterStatus_t)rec.shutter;
 		}
+	} else {
+		src = RoofSource_t::kNone;
+	}
+
+	d_slewing = false;
+	d_timer_ini = 0;
+	d_timer_end = 0;
+	d_enc.SetPosition((int32_t)(( (int64_t)d_pos * cfg.enc_span ) / ROOF_POS_FULL ));
+	d_restored = true;
+	d_saved = {(uint8_t)d_shutter, 0, d_pos};
+	g_RoofMem.Restored(d_num, src, d_saved);
+}
+
+// encoder position and speed, from the relays energised during the last tick. Without limit
+// switches the encoder ends a commanded move at either end as a switch would, well before the
+// timer. A stall between the ends stops a commanded move in this tick, long before the timeout;
+// under the manual buttons it is only reported
+void Dome::_encoder(const SrOut_t &out, const DomeConfig_t &cfg)
+{
+	int8_t drive = (bool)( out & d_hw.relay_open ) ? 1 : (bool)( out & d_hw.relay_close ) ? -1 : 0;
+	bool stalled = d_enc.Stalled();
+
+	d_enc.Update(millis(), drive, cfg.enc_span, cfg.enc_stall_ms);
+	if( d_switch_closed )								// limit switches calibrate the count
+		d_enc.SetPosition(0);
+	else if( d_switch_opened && ( cfg.enc_span > 0 ))
+		d_enc.SetPosition(cfg.enc_span);
+
+	int8_t end = ( cfg.use_switch || !d_slewing ) ? 0 : d_enc.EndReached(drive, ENC_END_BAND);
+	if((( end > 0 ) && ( d_shutter == AlpacaShutterStatus_t::kOpening )) || (( end < 0 ) && ( d_shutter == AlpacaShutterStatus_t::kClosing ))) {
+		d_enc.SetPosition(( end > 0 ) ? cfg.enc_span : 0);	// the end stop calibrates the count
+		d_enc_state = d_enc.State();
+		d_shutter = ( end > 0 ) ? AlpacaShutterStatus_t::kOpen : AlpacaShutterStatus_t::kClosed;
+		d_slewing = false;
+		d_timer_ini = 0;
+		d_timer_end = 0;
+		d_relay_close = false;							// turn relays OFF
+		d_relay_open = false;
+		RLOG_INFO_PRINTF("Dome %s, encoder at the end.\n", ( end > 0 ) ? "open" : "closed");
+		return;
+	}
+	d_enc_state = d_enc.State();
+
+	if(( cfg.enc_span == 0 ) || !d_enc.Stalled() || stalled )
+		return;
+
+	if( d_slewing ) {
+		RLOG_ERROR_PRINTF("ERROR! Dome %u stalled, no encoder pulses for %u ms\n", d_num, cfg.enc_stall_ms);
+		d_shutter = AlpacaShutterStatus_t::kError;
+		d_slewing = false;
+		d_timer_ini = 0;
+		d_timer_end = 0;
+		d_relay_close = false;							// turn relays OFF
+		d_relay_open = false;
+	} else {
+		RLOG_WARNING_PRINTF("WARNING! Dome %u driven by the buttons without encoder pulses\n", d_num);
+	}
+}
+
+// motor current of the last block against the limit, after the inrush of a relay closing. Like a
+// stall, an overcurrent stops a commanded move in this tick; under the buttons the relays stay off
+// until both are released
+void Dome::_current(const SrOut_t &out, const DomeConfig_t &cfg)
+{
+	int32_t ma;
+
+	if( !(bool)( out & ( d_hw.relay_open | d_hw.relay_close ))) {
+		d_drive_ms = 0;
+		return;
+	}
+	if( d_drive_ms == 0 )
+		d_drive_ms = millis() | 1;
+	if(( cfg.current_limit == 0 ) || (( millis() - d_drive_ms ) < cfg.inrush_ms ) || !g_Analog.GetCurrent(ma) || ( ma <= cfg.current_limit ))
+		return;
+
+	RLOG_ERROR_PRINTF("ERROR! Dome %u overcurrent %d mA, limit %d mA\n", d_num, ma, cfg.current_limit);
+	d_drive_ms = 0;
+	if( d_slewing ) {
+		d_shutter = AlpacaShutterStatus_t::kError;
+		d_slewing = false;
+		d_timer_ini = 0;
+		d_timer_end = 0;
+		d_relay_close = false;							// turn relays OFF
+		d_relay_open = false;
+	} else {
+		d_oc_trip = true;
+	}
+}
+
+// estimated position from the movement time, and its persistence: RTC on every state change and
+// every ROOF_POS_STEP of travel, NVS on state changes only
+void Dome::_track()
+{
+	bool changed = ( (uint8_t)d_shutter != d_saved.shutter );
+
+	if( changed && (( d_shutter == AlpacaShutterStatus_t::kOpening ) || ( d_shutter == AlpacaShutterStatus_t::kClosing )))
+		d_pos_ini = d_pos;
+
+	if( d_enc.State().valid ) {								// measured
+		d_pos = d_enc.Permille();
+	} else if( d_shutter == AlpacaShutterStatus_t::kOpen ) {
+		d_pos = ROOF_POS_FULL;
+	} else if( d_shutter == AlpacaShutterStatus_t::kClosed ) {
+		d_pos = 0;
+	} else if( d_slewing && ( d_timer_end != d_timer_ini )) {	// travel time taken as the timeout
+		uint32_t span = (uint32_t)( d_timer_end - d_timer_ini );
+		uint32_t run = (uint32_t)( millis() - d_timer_ini );
+		uint32_t delta = ( run >= span ) ? ROOF_POS_FULL : (uint32_t)(( (uint64_t)run * ROOF_POS_FULL ) / span );
+
+		if( d_shutter == AlpacaShutterStatus_t::kOpening )
+			d_pos = (uint16_t)(( d_pos_ini + delta > ROOF_POS_FULL ) ? ROOF_POS_FULL : d_pos_ini + delta );
+		else
+			d_pos = (uint16_t)(( delta > d_pos_ini ) ? 0 : d_pos_ini - delta );
+	}
+
+	if( changed || ( abs((int)d_pos - (int)d_saved.pos) >= ROOF_POS_STEP )) {
+		d_saved = {(uint8_t)d_shutter, 0, d_pos};
+		g_RoofMem.Save(d_num, d_saved, changed);
 	}
 }
 
-const bool Dome::_putAbort()	// stops shutter motor, sets _shutter to error, set _slew to false
+// library setters, not reached over HTTP: RegisterRoutes() serves the shutter PUTs
+const bool Dome::_putAbort()
+{
+	return _abort(0);
+}
+
+const bool Dome::_putClose()
+{
+	return _close(0);
+}
+
+const bool Dome::_putOpen()
+{
+	return _open(0);
+}
+
+bool Dome::_abort(uint16_t trace_id)	// stops shutter motor, sets _shutter to error, set _slew to false
 {
     d_shutter = AlpacaShutterStatus_t::kError;
 	d_slewing = false;
@@ -98,52 +549,70 @@ const bool Dome::_putAbort()	// stops shutter motor, sets _shutter to error, set
 	d_timer_end = 0;
 	d_relay_close = false;		// turn relays OFF
 	d_relay_open = false;
-	SLOG_INFO_PRINTF("Dome Halted.");
+	TRACE_DECISION_ID(trace_id, TraceOut_t::kRelay);
+	RLOG_INFO_PRINTF("Dome Halted.\n");
 	
 	return true;
 }
 
-const bool Dome::_putClose()
+bool Dome::_close(uint16_t trace_id)
 {
+	if( !d_restored ) {
+		RLOG_WARNING_PRINTF("WARNING! Dome close command refused, state not restored yet\n");
+		return false;
+	}
+
     if( d_shutter == AlpacaShutterStatus_t::kOpening ) {
-		SLOG_WARNING_PRINTF("WARNING! Dome close command ignored while opening");
+		RLOG_WARNING_PRINTF("WARNING! Dome close command ignored while opening\n");
 		return false;
 	}
 	
 	if( d_shutter == AlpacaShutterStatus_t::kClosing ) {
-		SLOG_INFO_PRINTF("INFO Dome is already closing. Command ignored.");
+		RLOG_INFO_PRINTF("INFO Dome is already closing. Command ignored.\n");
 	} else {
 		d_slewing = true;
 		d_shutter = AlpacaShutterStatus_t::kClosing;
 		d_timer_ini = millis();
-		d_timer_end = d_timer_ini + d_timeout * 1000;
+		d_timer_end = d_timer_ini + d_cfg.Get().timeout * 1000;
 
 		d_relay_close = true;		// turn close relays ON
 		d_relay_open = false;		// turn open relays OFF
-		SLOG_INFO_PRINTF("Dome command close received.");
+		TRACE_DECISION_ID(trace_id, TraceOut_t::kRelay);
+		RLOG_INFO_PRINTF("Dome command close received.\n");
 	}
 	
 	return true;
 }
 
-const bool Dome::_putOpen()
+bool Dome::_open(uint16_t trace_id)
 {
+	if( !d_restored ) {
+		RLOG_WARNING_PRINTF("WARNING! Dome open command refused, state not restored yet\n");
+		return false;
+	}
+
+	if( d_interlock != 0 ) {
+		RLOG_WARNING_PRINTF("WARNING! Dome open command refused, interlock 0x%02x\n", d_interlock);
+		return false;
+	}
+
     if( d_shutter == AlpacaShutterStatus_t::kClosing ) {
-		SLOG_WARNING_PRINTF("WARNING! Dome open command ignored while closing");
+		RLOG_WARNING_PRINTF("WARNING! Dome open command ignored while closing\n");
 		return false;
 	}
 	
 	if( d_shutter == AlpacaShutterStatus_t::kOpening ) {
-		SLOG_INFO_PRINTF("INFO Dome is already opening. Command ignored.");
+		RLOG_INFO_PRINTF("INFO Dome is already opening. Command ignored.\n");
 	} else {
-		SLOG_INFO_PRINTF("Dome command open received.");
+		RLOG_INFO_PRINTF("Dome command open received.\n");
 		d_slewing = true;
 		d_shutter = AlpacaShutterStatus_t::kOpening;
 		d_timer_ini = millis();
-		d_timer_end = d_timer_ini + d_timeout * 1000;
+		d_timer_end = d_timer_ini + d_cfg.Get().timeout * 1000;
 
 		d_relay_close = false;			// turn close relays OFF
 		d_relay_open = true;			// turn open relays ON
+		TRACE_DECISION_ID(trace_id, TraceOut_t::kRelay);
 	}
 	
 	return true;
@@ -162,22 +631,38 @@ const bool Dome::_getSlewing()
 // read settings from flash
 void Dome::AlpacaReadJson(JsonObject &root)
 {
+	HEAP_SITE("Dome::AlpacaReadJson");
 	DBG_JSON_PRINTFJ(SLOG_NOTICE, root, "DOME READ BEGIN (root=<%s>) ...\n", _ser_json_);
 	AlpacaDome::AlpacaReadJson(root);
 
 	if (JsonObject obj_config = root["Dome_Configuration"]) {
+		DomeConfig_t cfg = d_cfg.Get();		// validated on the copy, the control tick keeps the old one meanwhile
 		String _str =(obj_config["Use_limit_switches"] | _str);
-		uint32_t _to = obj_config["Shutter_timeout"] | d_timeout;
+		uint32_t _to = obj_config["Shutter_timeout"] | cfg.timeout;
+		uint32_t _im = obj_config["Interlock_mask"] | cfg.interlock_mask;
+		String _ex = obj_config["Lease_expire"] | String("stop");
+		int32_t _es = obj_config["Encoder_span"] | cfg.enc_span;
+		uint32_t _ems = obj_config["Encoder_stall_ms"] | cfg.enc_stall_ms;
+		int32_t _cl = obj_config["Motor_current_limit"] | cfg.current_limit;
+		uint32_t _ir = obj_config["Motor_inrush_ms"] | cfg.inrush_ms;
 		
 		if((_to < 1) || (_to > 300)) {	// validate 0~300s
 			_to = 60;
 		}
 		
 		_str.toLowerCase();
-		d_use_switch = (_str == "true" ? true : false);
-		d_timeout = _to;
+		cfg.use_switch = (_str == "true" ? true : false);
+		cfg.timeout = _to;
+		cfg.interlock_mask = (uint8_t)( _im & INTERLOCK_MASK_ALL );	// SAFEMON_*_BIT, 0 disables the interlock
+		_ex.toLowerCase();
+		cfg.expire_close = ( _ex == "close" );
+		cfg.enc_span = ( _es > 0 ) ? _es : 0;
+		cfg.enc_stall_ms = ( _ems < DOME_ENC_STALL_MIN_MS ) ? DOME_ENC_STALL_MIN_MS : ( _ems > DOME_ENC_STALL_MAX_MS ) ? DOME_ENC_STALL_MAX_MS : _ems;
+		cfg.current_limit = ( _cl > 0 ) ? _cl : 0;
+		cfg.inrush_ms = ( _ir > DOME_INRUSH_MAX_MS ) ? DOME_INRUSH_MAX_MS : _ir;
+		d_cfg.Publish(cfg);
 
-		SLOG_PRINTF(SLOG_INFO, "...DOME READ END  _use_switch=%s _timeout=%i\n", (d_use_switch ? "true" : "false"), d_timeout);
+		SLOG_PRINTF(SLOG_INFO, "...DOME READ END  _use_switch=%s _timeout=%i _interlock_mask=0x%02x _lease_expire=%s _encoder_span=%d _encoder_stall_ms=%u\n", (cfg.use_switch ? "true" : "false"), cfg.timeout, cfg.interlock_mask, (cfg.expire_close ? "close" : "stop"), cfg.enc_span, cfg.enc_stall_ms);
 	} else {
 		SLOG_PRINTF(SLOG_WARNING, "...DOME READ END no configuration\n");
 	}
@@ -186,14 +671,22 @@ void Dome::AlpacaReadJson(JsonObject &root)
 // persist settings to flash
 void Dome::AlpacaWriteJson(JsonObject &root)
 {
+    HEAP_SITE("Dome::AlpacaWriteJson");
     SLOG_PRINTF(SLOG_NOTICE, "DOME WRITE BEGIN ...\n");
     AlpacaDome::AlpacaWriteJson(root);
 
     // Config
+    const DomeConfig_t &cfg = d_cfg.Get();
     JsonObject obj_config = root["Dome_Configuration"].to<JsonObject>();
-	obj_config["Use_limit_switches"] = (d_use_switch == true);
-    obj_config["Shutter_timeout"] = d_timeout;
+	obj_config["Use_limit_switches"] = (cfg.use_switch == true);
+    obj_config["Shutter_timeout"] = cfg.timeout;
+	obj_config["Interlock_mask"] = cfg.interlock_mask;
+	obj_config["Lease_expire"] = cfg.expire_close ? "close" : "stop";
+	obj_config["Encoder_span"] = cfg.enc_span;
+	obj_config["Encoder_stall_ms"] = cfg.enc_stall_ms;
+	obj_config["Motor_current_limit"] = cfg.current_limit;
+	obj_config["Motor_inrush_ms"] = cfg.inrush_ms;
 
-	Serial.print("AlpacaWrite "); Serial.println(d_use_switch);
+	RLOG_DEBUG_PRINTF("AlpacaWrite %d\n", cfg.use_switch);
     DBG_JSON_PRINTFJ(SLOG_NOTICE, root, "...DOME WRITE END root=<%s>\n", _ser_json_);
 }
\ No newline at end of file
@@ -6,6 +6,12 @@
 **************************************************************************************************/
 #pragma once
 #include "AlpacaDome.h"
+#include "ChannelMap.h"
+#include "StateBus.h"
+#include "Sessions.h"
+#include "ConfigSlot.h"
+#include "RoofMemory.h"
+#include "PulseCounter.h"
 
 // ASCOM / ALPACA ShutterStatus Enumeration
 /*
@@ -19,34 +25,91 @@ enum struct ShutterStatus_t
 };
 */
 
-extern bool d_switch_opened, d_switch_closed;
-extern bool d_relay_open, d_relay_close;
+#define DOME_ENC_STALL_MS       1500        // default, well under the shortest useful timeout
+#define DOME_ENC_STALL_MIN_MS   200
+#define DOME_ENC_STALL_MAX_MS   10000
+#define DOME_INRUSH_MS          500
+#define DOME_INRUSH_MAX_MS      5000
+
+#define DOME_ERR_NOT_CONNECTED          0x407
+#define DOME_ERR_INVALID_OPERATION      0x40B
+#define DOME_ERR_ACTION_NOT_IMPLEMENTED 0x40C
+
+// settings, swapped whole by AlpacaReadJson
+struct DomeConfig_t
+{
+	bool use_switch;						// if true, use limit switches, else use timeout
+	int32_t timeout;						// open/close timeout, s
+	uint8_t interlock_mask;					// safety bits that close this roof, 0 = interlock off
+	bool expire_close;						// close the roof when the last lease ends
+	int32_t enc_span;						// encoder counts closed -> open, 0 = no encoder
+	uint32_t enc_stall_ms;					// driven without encoder pulses this long = stall
+	int32_t current_limit;					// motor mA, block mean, 0 = no cut-off
+	uint32_t inrush_ms;						// after the relay closes, current not checked
+};
 
 class Dome : public AlpacaDome
 {
 private:
 
+	DomeHw_t d_hw;							// relay, limit switch and button bits of this roof
+	bool d_switch_opened, d_switch_closed;	// limit switches, updated by Scan()
+	bool d_relay_open, d_relay_close;		// relays requested by the shutter state machine
+	ConfigSlot<DomeConfig_t> d_cfg;
+	uint8_t d_interlock;					// masked safety bits seen on the last Interlock() call
+	uint8_t d_safety;						// SAFEMON_*_BIT, from kSafety
+	uint8_t d_num;							// device number, for the session table
+	bool d_leased;							// a client holds a session lease
+	bool d_remote;							// a move commanded over kDomeCmd, runs without a lease
+	uint8_t d_pub_shutter;					// last kDomeState published, 0xFF none yet
+	bool d_pub_slewing;
+
 	AlpacaShutterStatus_t d_shutter;		// shutter status
 	bool d_slewing;							// true when shutter is moving
-	bool d_use_switch;					// if true, use limit switches, else use timeout
-	int32_t d_timeout;					// open/close timeout
 	int32_t d_timer_ini;					// timer init of movement
 	int32_t d_timer_end;					// timer init of movement
+	bool d_restored;						// stored state applied, set by the first Scan()
+	uint16_t d_pos;							// estimated position, permille open
+	uint16_t d_pos_ini;						// at the start of the movement
+	RoofRecord_t d_saved;					// last given to g_RoofMem
+	EncoderTrack d_enc;						// optional position encoder
+	EncState_t d_enc_state;					// last d_enc.State(), written by the control task
+	uint32_t d_route_stid;					// ServerTransactionID of the routes served here
+	uint32_t d_drive_ms;					// relay energised since, 0 = off
+	bool d_oc_trip;							// overcurrent, relays held off until the buttons are released
 
 	const bool _putAbort();				// to be implemented here
 	const bool _putClose();
 	const bool _putOpen();
+	bool _abort(uint16_t trace_id);			// shutter commands, decisions traced to trace_id
+	bool _close(uint16_t trace_id);
+	bool _open(uint16_t trace_id);
 	const AlpacaShutterStatus_t _getShutter();
 	const bool _getSlewing();
 	void AlpacaReadJson(JsonObject &root);
 	void AlpacaWriteJson(JsonObject &root);
 
-	void _dome_use_limit(bool use_lim) { d_use_switch = use_lim; };
+	bool Interlock(uint8_t safemon_inputs);
+	void _leaseEnded();
+	void _restore();
+	void _track();
+	void _encoder(const SrOut_t &out, const DomeConfig_t &cfg);
+	void _current(const SrOut_t &out, const DomeConfig_t &cfg);
+	void _actionRequest(AsyncWebServerRequest *request, bool put);
+	void _shutterRequest(AsyncWebServerRequest *request, DomeCmdKind_t cmd);
+	static void _onSafety(const BusEvent_t &ev, void *ctx);
+	static void _onCmd(const BusEvent_t &ev, void *ctx);
 
 	static const char *const k_shutter_state_str[5];
 
 public:
 	Dome();
-	void Begin();
+	void Begin(const DomeHw_t &hw, uint8_t num);
+	void RegisterRoutes(AsyncWebServer *server);
 	void Loop();
+	uint8_t GetInterlockMask() { return d_cfg.Get().interlock_mask; }
+	bool AttachEncoder(PulseCounter *ctr) { return d_enc.Attach(ctr); }
+	uint8_t GetPercentOpen() { return (uint8_t)( d_pos / 10 ); }
+	EncState_t GetEncoderState() { return d_enc_state; }
+	void Scan(const SrIn_t &in, SrOut_t &out);
 };
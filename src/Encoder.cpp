@@ -0,0 +1,66 @@
+/**************************************************************************************************
+  Filename:       Encoder.cpp
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    roof encoder PCNT implementation
+**************************************************************************************************/
+#include "Encoder.h"
+#include "defines.h"
+#include "LogRing.h"
+#include "Dome.h"
+
+PcntCounter g_RoofPcnt(PCNT_UNIT_0, IN_PIN_ENC_A, IN_PIN_ENC_B);
+
+bool PcntCounter::Begin()
+{
+	pcnt_config_t cfg = {};
+
+	cfg.pulse_gpio_num = _pin_a;
+	cfg.ctrl_gpio_num = ( _pin_b >= 0 ) ? _pin_b : PCNT_PIN_NOT_USED;
+	cfg.channel = PCNT_CHANNEL_0;
+	cfg.unit = _unit;
+	cfg.pos_mode = PCNT_COUNT_INC;
+	cfg.neg_mode = ( _pin_b >= 0 ) ? PCNT_COUNT_DEC : PCNT_COUNT_DIS;
+	cfg.lctrl_mode = ( _pin_b >= 0 ) ? PCNT_MODE_REVERSE : PCNT_MODE_KEEP;
+	cfg.hctrl_mode = PCNT_MODE_KEEP;
+	cfg.counter_h_lim = ENC_LIMIT;
+	cfg.counter_l_lim = -ENC_LIMIT;
+
+	if( pcnt_unit_config(&cfg) != ESP_OK ) {
+		SLOG_ERROR_PRINTF("Encoder: PCNT unit %d config failed\n", (int)_unit);
+		return false;
+	}
+	pcnt_set_filter_value(_unit, ENC_FILTER_APB);
+	pcnt_filter_enable(_unit);
+	pcnt_counter_pause(_unit);
+	pcnt_counter_clear(_unit);
+	pcnt_counter_resume(_unit);
+
+	SLOG_INFO_PRINTF("Encoder: PCNT unit %d on GPIO %d%s\n", (int)_unit, _pin_a, ( _pin_b >= 0 ) ? ", quadrature" : "");
+	return true;
+}
+
+int16_t PcntCounter::Read()
+{
+	int16_t v = 0;
+
+	pcnt_get_counter_value(_unit, &v);
+	return v;
+}
+
+void enc_begin(AsyncWebServer *server, Dome *domes)
+{
+	server->on(ENC_URL, HTTP_GET, [domes](AsyncWebServerRequest *request) {
+		AsyncResponseStream *response = request->beginResponseStream("application/json");
+
+		response->printf("{\"pin_a\":%d,\"pin_b\":%d,\"roofs\":[", IN_PIN_ENC_A, IN_PIN_ENC_B);
+		for(size_t i = 0; i < k_num_of_domes; i++) {
+			EncState_t s = domes[i].GetEncoderState();
+			response->printf("%s{\"valid\":%s,\"pos\":%d,\"speed\":%d,\"percent_open\":%u,\"stalled\":%s}", ( i > 0 ) ? "," : "",
+				s.valid ? "true" : "false", s.pos, s.speed, s.permille / 10, s.stalled ? "true" : "false");
+		}
+		response->print("]}");
+		request->send(response);
+	});
+}
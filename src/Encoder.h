@@ -0,0 +1,41 @@
+/**************************************************************************************************
+  Filename:       Encoder.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    roof encoder input on the ESP32 PCNT peripheral, no CPU time per edge. A
+                  single-channel pulse input counts rising edges, with a B pin it decodes
+                  quadrature x2, both edges of A signed by B. The glitch filter drops pulses
+                  shorter than ENC_FILTER_APB APB cycles. Position, speed and stall are tracked by
+                  the dome in its Scan(), /encoder shows the last state of each dome.
+**************************************************************************************************/
+#pragma once
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <driver/pcnt.h>
+#include "PulseCounter.h"
+#include "ChannelMap.h"
+
+#define ENC_LIMIT               32000       // PCNT counts back to 0 here
+#define ENC_FILTER_APB          1000        // 12.5us at 80MHz, max 1023
+#define ENC_URL                 "/encoder"
+
+class PcntCounter : public PulseCounter
+{
+private:
+	pcnt_unit_t _unit;
+	int8_t _pin_a;
+	int8_t _pin_b;							// -1 single channel
+
+public:
+	PcntCounter(pcnt_unit_t unit, int8_t pin_a, int8_t pin_b) : _unit(unit), _pin_a(pin_a), _pin_b(pin_b) {}
+	bool Begin() override;
+	int16_t Read() override;
+	int16_t Limit() const override { return ENC_LIMIT; }
+	bool Quadrature() const override { return _pin_b >= 0; }
+};
+
+extern PcntCounter g_RoofPcnt;
+class Dome;
+
+void enc_begin(AsyncWebServer *server, Dome *domes);	// domes[k_num_of_domes], state read from each
@@ -0,0 +1,293 @@
+/**************************************************************************************************
+  Filename:       HeapMonitor.cpp
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    heap and stack watermark sampler implementation
+**************************************************************************************************/
+#include "HeapMonitor.h"
+#include "LogRing.h"
+#include "HttpProbe.h"
+#include <esp_heap_caps.h>
+
+HeapMonitor g_HeapMon;
+
+HeapMonitor::HeapMonitor()
+{
+	_count = 0;
+	_tmr_sample = 0;
+	_num_tasks = 0;
+	_mux = portMUX_INITIALIZER_UNLOCKED;
+#ifdef DEBUG_HEAP_SITES
+	_num_sites = 0;
+	_http = {HeapHttpState_t::kIdle, nullptr, 0, 0, 0};
+	_http_live = 0;
+	_http_idle_free = 0;
+	_http_idle_block = 0;
+#endif
+}
+
+// register the endpoint and take the first sample
+void HeapMonitor::Begin(AsyncWebServer *server)
+{
+	server->on(HEAP_URL, HTTP_GET, [this](AsyncWebServerRequest *request) { _sendJson(request); });
+
+#ifdef DEBUG_HEAP_SITES
+	// every request is a site too, from before it was created to after it was deleted
+	g_HttpProbe.AddHook(server,
+		[](AsyncWebServerRequest *request) -> uint32_t { return g_HeapMon._httpRecv(request); },
+		[](AsyncWebServerRequest *request, uint32_t cookie) { g_HeapMon._httpDone(request, cookie); });
+#endif
+
+	_tmr_sample = millis() - HEAP_SAMPLE_PERIOD;		// sample on the first Loop()
+}
+
+bool HeapMonitor::AddTask(TaskHandle_t task, const char *name)
+{
+	if(( task == nullptr ) || ( _num_tasks >= HEAP_MAX_TASKS ))
+		return false;
+
+	_task[_num_tasks] = task;
+	_task_name[_num_tasks] = name;
+	_num_tasks++;
+	return true;
+}
+
+void HeapMonitor::Loop()
+{
+#ifdef DEBUG_HEAP_SITES
+	_httpLoop();
+#endif
+
+	if(( millis() - _tmr_sample ) < HEAP_SAMPLE_PERIOD )
+		return;
+
+	_tmr_sample = millis();
+
+	HeapSample_t s;
+	_sample(s);
+
+	portENTER_CRITICAL(&_mux);
+	_history[_count % HEAP_HISTORY_SIZE] = s;
+	_count++;
+	portEXIT_CRITICAL(&_mux);
+
+	uint32_t frag = (s.free_heap > 0) ? 100 - (s.largest_block * 100) / s.free_heap : 0;
+	if( frag > HEAP_FRAG_WARNING )
+		RLOG_WARNING_PRINTF("WARNING. Heap fragmented %u%%, free %u largest %u\n", frag, s.free_heap, s.largest_block);
+}
+
+void HeapMonitor::_sample(HeapSample_t &s)
+{
+	s.uptime_s = millis() / 1000;
+	s.free_heap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+	s.largest_block = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+	s.min_free_heap = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+
+	for(uint8_t i = 0; i < HEAP_MAX_TASKS; i++)
+		s.stack_hwm[i] = (i < _num_tasks) ? (uint16_t)uxTaskGetStackHighWaterMark(_task[i]) : 0;
+}
+
+bool HeapMonitor::GetLast(HeapSample_t &s)
+{
+	if( _count == 0 )
+		return false;
+
+	portENTER_CRITICAL(&_mux);
+	s = _history[(_count - 1) % HEAP_HISTORY_SIZE];
+	portEXIT_CRITICAL(&_mux);
+	return true;
+}
+
+// the reply is streamed by hand, building a JsonDocument here would fragment the heap we are measuring
+void HeapMonitor::_sendJson(AsyncWebServerRequest *request)
+{
+	HeapSample_t now;
+	_sample(now);
+
+	AsyncResponseStream *response = request->beginResponseStream("application/json");
+
+	response->printf("{\"uptime_s\":%u,\"free_heap\":%u,\"largest_block\":%u,\"min_free_heap\":%u,\"fragmentation\":%u,\"tasks\":{",
+		now.uptime_s, now.free_heap, now.largest_block, now.min_free_heap,
+		(now.free_heap > 0) ? 100 - (now.largest_block * 100) / now.free_heap : 0);
+
+	for(uint8_t i = 0; i < _num_tasks; i++)
+		response->printf("%s\"%s\":%u", (i > 0) ? "," : "", _task_name[i], now.stack_hwm[i]);
+
+	response->print("},\"history\":[");
+
+	uint32_t n = (_count < HEAP_HISTORY_SIZE) ? _count : HEAP_HISTORY_SIZE;
+	for(uint32_t i = 0; i < n; i++) {
+		HeapSample_t s;
+
+		portENTER_CRITICAL(&_mux);
+		s = _history[(_count - n + i) % HEAP_HISTORY_SIZE];
+		portEXIT_CRITICAL(&_mux);
+
+		response->printf("%s[%u,%u,%u,%u", (i > 0) ? "," : "", s.uptime_s, s.free_heap, s.largest_block, s.min_free_heap);
+		for(uint8_t t = 0; t < _num_tasks; t++)
+			response->printf(",%u", s.stack_hwm[t]);
+		response->print("]");
+	}
+	response->print("]");
+
+#ifdef DEBUG_HEAP_SITES
+	// top allocators, sorted by retained bytes
+	uint8_t order[HEAP_MAX_SITES];
+	portENTER_CRITICAL(&_mux);
+	uint8_t num_sites = _num_sites;
+	HeapSite_t site[HEAP_MAX_SITES];
+	memcpy(site, _site, sizeof(site));
+	portEXIT_CRITICAL(&_mux);
+
+	for(uint8_t i = 0; i < num_sites; i++) {
+		uint8_t j = i;
+		order[i] = i;
+		while(( j > 0 ) && ( site[order[j - 1]].retained < site[order[j]].retained )) {
+			uint8_t t = order[j]; order[j] = order[j - 1]; order[j - 1] = t;
+			j--;
+		}
+	}
+
+	response->print(",\"sites\":[");
+	for(uint8_t i = 0; i < num_sites; i++) {
+		const HeapSite_t &s = site[order[i]];
+		response->printf("%s{\"name\":\"%s\",\"calls\":%u,\"retained\":%d,\"max_retained\":%d,\"block_drop\":%u}",
+			(i > 0) ? "," : "", s.name, s.calls, s.retained, s.max_retained, s.block_drop);
+	}
+	response->print("]");
+#endif
+
+	response->print("}");
+	request->send(response);
+}
+
+#ifdef DEBUG_HEAP_SITES
+void HeapMonitor::_chargeSite(const char *name, int32_t retained, uint32_t block_drop)
+{
+	portENTER_CRITICAL(&_mux);
+
+	uint8_t i;
+	for(i = 0; i < _num_sites; i++)					// sites are keyed by the literal's address
+		if( _site[i].name == name )
+			break;
+
+	if( i == _num_sites ) {
+		if( _num_sites >= HEAP_MAX_SITES ) {
+			portEXIT_CRITICAL(&_mux);
+			return;
+		}
+		_site[i] = {name, 0, 0, 0, 0};
+		_num_sites++;
+	}
+
+	_site[i].calls++;
+	_site[i].retained += retained;
+	if( retained > _site[i].max_retained )
+		_site[i].max_retained = retained;
+	_site[i].block_drop += block_drop;
+
+	portEXIT_CRITICAL(&_mux);
+}
+
+// web server task. Sites are keyed by address, so the request class picks one of these literals.
+// A request that finds the server idle is measured, from the idle level Loop() sampled last
+uint32_t HeapMonitor::_httpRecv(AsyncWebServerRequest *request)
+{
+	const char *url = request->url().c_str();
+	const char *site = "http_other";
+
+	if( strncmp(url, "/api/v1/dome/", 13) == 0 )
+		site = "http_api_dome";
+	else if( strncmp(url, "/api/v1/switch/", 15) == 0 )
+		site = "http_api_switch";
+	else if( strncmp(url, "/api/v1/safetymonitor/", 22) == 0 )
+		site = "http_api_safetymonitor";
+	else if( strncmp(url, "/api/v1/observingconditions/", 28) == 0 )
+		site = "http_api_obscond";
+	else if( strncmp(url, "/api/", 5) == 0 )
+		site = "http_api_unknown";
+	else if( strncmp(url, "/management/", 12) == 0 )
+		site = "http_management";
+	else if(( strcmp(url, "/setup") == 0 ) || ( strncmp(url, "/setup/", 7) == 0 ) || ( strcmp(url, "/save_settings") == 0 ))
+		site = "http_setup";
+
+	uint32_t cookie = 0;
+
+	portENTER_CRITICAL(&_mux);
+	if(( _http_live == 0 ) && ( _http.state == HeapHttpState_t::kIdle ) && ( _http_idle_free != 0 )) {
+		_http = {HeapHttpState_t::kOpen, site, _http_idle_free, _http_idle_block, 0};
+		cookie = 1;
+	} else if( _http.state != HeapHttpState_t::kIdle ) {
+		_http.state = HeapHttpState_t::kSpoiled;			// its allocations would be charged to the other
+	}
+	_http_live++;
+	portEXIT_CRITICAL(&_mux);
+
+	return cookie;
+}
+
+// response sent, the request and its buffers are still allocated: deleted when this returns
+void HeapMonitor::_httpDone(AsyncWebServerRequest *request, uint32_t cookie)
+{
+	portENTER_CRITICAL(&_mux);
+	if( _http_live > 0 )
+		_http_live--;
+	if(( cookie != 0 ) && ( _http.state == HeapHttpState_t::kOpen )) {
+		_http.state = HeapHttpState_t::kDone;
+		_http.done_ms = millis();
+	}
+	portEXIT_CRITICAL(&_mux);
+}
+
+// loop task. With no request in flight the heap is the idle level; once the measured request
+// has been deleted, what is still missing from the level before it stayed behind it.
+// Requests that overlap another are not charged
+void HeapMonitor::_httpLoop()
+{
+	uint32_t free_now = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+	uint32_t block_now = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+	HeapHttpSolo_t done = {HeapHttpState_t::kIdle, nullptr, 0, 0, 0};
+
+	portENTER_CRITICAL(&_mux);
+	if( _http_live == 0 ) {
+		switch( _http.state )
+		{
+			case HeapHttpState_t::kIdle:
+				_http_idle_free = free_now;
+				_http_idle_block = block_now;
+				break;
+			case HeapHttpState_t::kDone:
+				if(( millis() - _http.done_ms ) < HEAP_HTTP_SETTLE_MS )
+					break;
+				done = _http;
+				_http.state = HeapHttpState_t::kIdle;
+				break;
+			case HeapHttpState_t::kSpoiled:
+				_http.state = HeapHttpState_t::kIdle;
+				break;
+			default:
+				break;
+		}
+	}
+	portEXIT_CRITICAL(&_mux);
+
+	if( done.state == HeapHttpState_t::kDone )
+		_chargeSite(done.site, (int32_t)done.free_ini - (int32_t)free_now, (block_now < done.block_ini) ? done.block_ini - block_now : 0);
+}
+
+HeapSiteScope::HeapSiteScope(const char *name)
+{
+	_name = name;
+	_free_ini = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+	_block_ini = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+}
+
+HeapSiteScope::~HeapSiteScope()
+{
+	uint32_t free_end = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+	uint32_t block_end = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+
+	g_HeapMon._chargeSite(_name, (int32_t)_free_ini - (int32_t)free_end, (block_end < _block_ini) ? _block_ini - block_end : 0);
+}
+#endif
@@ -0,0 +1,116 @@
+/**************************************************************************************************
+  Filename:       HeapMonitor.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    heap and stack watermark sampler with fragmentation tracking
+**************************************************************************************************/
+#pragma once
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// comment/uncomment to enable/disable allocation-site tagging
+// #define DEBUG_HEAP_SITES
+
+#define HEAP_SAMPLE_PERIOD      60000       // ms between samples
+#define HEAP_HISTORY_SIZE       96          // samples kept in the history ring (96 min)
+#define HEAP_MAX_TASKS          6           // tasks whose stack high-water mark is tracked
+#define HEAP_MAX_SITES          24          // allocation sites tracked in debug builds, 8 are HTTP
+#define HEAP_HTTP_SETTLE_MS     20          // done hook to the request and its client deleted, debug builds
+#define HEAP_FRAG_WARNING       50          // % fragmentation that triggers a warning
+#define HEAP_URL                "/heap"
+
+struct HeapSample_t
+{
+	uint32_t uptime_s;
+	uint32_t free_heap;						// total free 8bit capable heap
+	uint32_t largest_block;					// largest allocatable block
+	uint32_t min_free_heap;					// min-ever free heap since boot
+	uint16_t stack_hwm[HEAP_MAX_TASKS];		// min free stack bytes, per task
+};
+
+#ifdef DEBUG_HEAP_SITES
+struct HeapSite_t
+{
+	const char *name;
+	uint32_t calls;
+	int32_t retained;						// bytes not given back when the scope ended
+	int32_t max_retained;
+	uint32_t block_drop;					// cumulative loss of largest free block
+};
+
+enum struct HeapHttpState_t : uint8_t
+{
+	kIdle = 0,								// no request measured
+	kOpen,									// the only request in flight, from its request line
+	kDone,									// its done hook ran, waits for the request to be deleted
+	kSpoiled								// another request overlapped, not charged
+};
+
+// an HTTP request alone on the server, measured from the heap before it was created to the
+// heap after it was deleted: its own buffers are given back by then. A connection still
+// reading its headers has no request line yet and is not seen, its buffers are charged too
+struct HeapHttpSolo_t
+{
+	HeapHttpState_t state;
+	const char *site;
+	uint32_t free_ini;						// idle level sampled by Loop() before the request line
+	uint32_t block_ini;
+	uint32_t done_ms;
+};
+
+// measures the heap around a scope and charges the difference to a named site.
+// Free heap is global: allocations made concurrently by other tasks are charged too
+class HeapSiteScope
+{
+private:
+	const char *_name;
+	uint32_t _free_ini;
+	uint32_t _block_ini;
+public:
+	HeapSiteScope(const char *name);
+	~HeapSiteScope();
+};
+
+#define HEAP_SITE(name)     HeapSiteScope _heap_site_scope_(name)
+#else
+#define HEAP_SITE(name)
+#endif
+
+class HeapMonitor
+{
+private:
+	HeapSample_t _history[HEAP_HISTORY_SIZE];
+	uint32_t _count;						// total samples taken
+	uint32_t _tmr_sample;
+	TaskHandle_t _task[HEAP_MAX_TASKS];
+	const char *_task_name[HEAP_MAX_TASKS];
+	uint8_t _num_tasks;
+	portMUX_TYPE _mux;
+
+#ifdef DEBUG_HEAP_SITES
+	HeapSite_t _site[HEAP_MAX_SITES];
+	uint8_t _num_sites;
+	HeapHttpSolo_t _http;
+	uint8_t _http_live;						// requests between their request line and done hook
+	uint32_t _http_idle_free;				// heap with no request in flight, 0 = not sampled yet
+	uint32_t _http_idle_block;
+	friend class HeapSiteScope;
+	void _chargeSite(const char *name, int32_t retained, uint32_t block_drop);
+	uint32_t _httpRecv(AsyncWebServerRequest *request);
+	void _httpDone(AsyncWebServerRequest *request, uint32_t cookie);
+	void _httpLoop();
+#endif
+
+	void _sample(HeapSample_t &s);
+	void _sendJson(AsyncWebServerRequest *request);
+
+public:
+	HeapMonitor();
+	void Begin(AsyncWebServer *server);
+	void Loop();
+	bool AddTask(TaskHandle_t task, const char *name);
+	bool GetLast(HeapSample_t &s);
+};
+
+extern HeapMonitor g_HeapMon;
@@ -0,0 +1,72 @@
+/**************************************************************************************************
+  Filename:       Histogram.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    fixed size log2 histogram for timings in microseconds.
+                  Bucket 0 holds 0~1us, bucket n holds 2^n ~ 2^(n+1)-1 us.
+**************************************************************************************************/
+#pragma once
+#include <Arduino.h>
+
+#define HIST_BUCKETS        24          // up to ~16s
+
+struct Histogram
+{
+	uint32_t bucket[HIST_BUCKETS];
+	uint32_t count;
+	uint32_t max;
+	uint64_t sum;
+
+	Histogram() { Clear(); }
+
+	void Clear()
+	{
+		memset(bucket, 0, sizeof(bucket));
+		count = 0;
+		max = 0;
+		sum = 0;
+	}
+
+	void Add(uint32_t us)
+	{
+		uint32_t b = ( us > 1 ) ? 31 - __builtin_clz(us) : 0;
+
+		bucket[( b < HIST_BUCKETS ) ? b : HIST_BUCKETS - 1]++;
+		count++;
+		sum += us;
+		if( us > max )
+			max = us;
+	}
+
+	uint32_t Mean() const { return count ? (uint32_t)( sum / count ) : 0; }
+
+	// upper bound of the bucket holding the p-th percentile
+	uint32_t Percentile(uint32_t p) const
+	{
+		uint32_t target = (uint32_t)(((uint64_t)count * p + 99) / 100);
+		uint32_t n = 0;
+
+		for(uint32_t b = 0; b < HIST_BUCKETS; b++) {
+			n += bucket[b];
+			if(( n >= target ) && ( n > 0 ))
+				return ( 2u << b ) - 1;
+		}
+		return max;
+	}
+
+	// {"count":..,"mean":..,"max":..,"p50":..,"p99":..,"buckets":[..]} trailing zero buckets trimmed
+	void PrintJson(Print &out) const
+	{
+		uint32_t last = 0;
+		for(uint32_t b = 0; b < HIST_BUCKETS; b++)
+			if( bucket[b] )
+				last = b + 1;
+
+		out.printf("{\"count\":%u,\"mean\":%u,\"max\":%u,\"p50\":%u,\"p99\":%u,\"buckets\":[",
+			count, Mean(), max, Percentile(50), Percentile(99));
+		for(uint32_t b = 0; b < last; b++)
+			out.printf("%s%u", (b > 0) ? "," : "", bucket[b]);
+		out.print("]}");
+	}
+};
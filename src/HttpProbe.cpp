@@ -0,0 +1,65 @@
+/**************************************************************************************************
+  Filename:       HttpProbe.cpp
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    request probe implementation
+**************************************************************************************************/
+#include "HttpProbe.h"
+#include <array>
+#include "LogRing.h"
+
+HttpProbe g_HttpProbe;
+
+// rewrites are matched on every request, whatever the handler order. It never rewrites anything
+class ProbeRewrite : public AsyncWebRewrite
+{
+public:
+	ProbeRewrite() : AsyncWebRewrite("", "") {}
+
+	bool match(AsyncWebServerRequest *request) override
+	{
+		g_HttpProbe.Match(request);
+		return false;
+	}
+};
+
+HttpProbe::HttpProbe()
+{
+	_num_hooks = 0;
+	_installed = false;
+}
+
+// call from setup() only, the hook table is not locked
+bool HttpProbe::AddHook(AsyncWebServer *server, ProbeRecvFn_t recv, ProbeDoneFn_t done)
+{
+	if( _num_hooks >= PROBE_MAX_HOOKS ) {
+		SLOG_ERROR_PRINTF("HttpProbe hook table full\n");
+		return false;
+	}
+
+	_recv[_num_hooks] = recv;
+	_done[_num_hooks] = done;
+	_num_hooks++;
+
+	if( !_installed ) {
+		server->addRewrite(new ProbeRewrite());
+		_installed = true;
+	}
+	return true;
+}
+
+// web server task. A request has a single disconnect callback, shared by all hooks
+void HttpProbe::Match(AsyncWebServerRequest *request)
+{
+	std::array<uint32_t, PROBE_MAX_HOOKS> cookie{};
+
+	for(uint8_t i = 0; i < _num_hooks; i++)
+		cookie[i] = _recv[i] ? _recv[i](request) : 0;
+
+	request->onDisconnect([this, request, cookie]() {
+		for(uint8_t i = 0; i < _num_hooks; i++)
+			if( _done[i] )
+				_done[i](request, cookie[i]);
+	});
+}
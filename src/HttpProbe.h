@@ -0,0 +1,36 @@
+/**************************************************************************************************
+  Filename:       HttpProbe.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    request probe on the web server. A rewrite that never rewrites sees every
+                  request as soon as the request line is parsed, before any handler, and hooks
+                  its disconnect, when the response is sent and all parameters are parsed.
+                  Subsystems (trace, client sessions) register a hook pair here.
+**************************************************************************************************/
+#pragma once
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+#define PROBE_MAX_HOOKS         4
+
+// request line parsed, returns a value handed back to the done hook. Body params not yet known
+typedef uint32_t (*ProbeRecvFn_t)(AsyncWebServerRequest *request);
+// response sent, the request is still valid
+typedef void (*ProbeDoneFn_t)(AsyncWebServerRequest *request, uint32_t cookie);
+
+class HttpProbe
+{
+private:
+	ProbeRecvFn_t _recv[PROBE_MAX_HOOKS];
+	ProbeDoneFn_t _done[PROBE_MAX_HOOKS];
+	uint8_t _num_hooks;
+	bool _installed;
+
+public:
+	HttpProbe();
+	bool AddHook(AsyncWebServer *server, ProbeRecvFn_t recv, ProbeDoneFn_t done);
+	void Match(AsyncWebServerRequest *request);
+};
+
+extern HttpProbe g_HttpProbe;
@@ -0,0 +1,276 @@
+/**************************************************************************************************
+  Filename:       HttpStats.cpp
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    per route request statistics implementation
+**************************************************************************************************/
+#include "HttpStats.h"
+#include "HttpProbe.h"
+#include "ChannelMap.h"
+
+HttpStats g_HttpStats;
+
+#define HTTP_VERB_GET           0x01
+#define HTTP_VERB_PUT           0x02
+
+// done hook cookie: route id, bad URL flag, start time in 4us units (wraps after 33s)
+#define HTTP_COOKIE_ROUTE_SHIFT 24
+#define HTTP_COOKIE_BAD_URL     0x00800000u
+#define HTTP_COOKIE_TIME_MASK   0x007FFFFFu
+#define HTTP_COOKIE_TIME_SHIFT  2
+
+struct HttpMethod_t
+{
+	const char *name;
+	uint8_t verbs;
+};
+
+// ASCOM common members, part of every device type
+static const HttpMethod_t k_common[] = {
+	{"action", HTTP_VERB_PUT}, {"commandblind", HTTP_VERB_PUT}, {"commandbool", HTTP_VERB_PUT},
+	{"commandstring", HTTP_VERB_PUT}, {"connect", HTTP_VERB_PUT}, {"connected", HTTP_VERB_GET | HTTP_VERB_PUT},
+	{"connecting", HTTP_VERB_GET}, {"description", HTTP_VERB_GET}, {"devicestate", HTTP_VERB_GET},
+	{"disconnect", HTTP_VERB_PUT}, {"driverinfo", HTTP_VERB_GET}, {"driverversion", HTTP_VERB_GET},
+	{"interfaceversion", HTTP_VERB_GET}, {"name", HTTP_VERB_GET}, {"supportedactions", HTTP_VERB_GET}};
+
+static const HttpMethod_t k_dome[] = {
+	{"abortslew", HTTP_VERB_PUT}, {"altitude", HTTP_VERB_GET}, {"athome", HTTP_VERB_GET}, {"atpark", HTTP_VERB_GET},
+	{"azimuth", HTTP_VERB_GET}, {"canfindhome", HTTP_VERB_GET}, {"canpark", HTTP_VERB_GET},
+	{"cansetaltitude", HTTP_VERB_GET}, {"cansetazimuth", HTTP_VERB_GET}, {"cansetpark", HTTP_VERB_GET},
+	{"cansetshutter", HTTP_VERB_GET}, {"canslave", HTTP_VERB_GET}, {"cansyncazimuth", HTTP_VERB_GET},
+	{"closeshutter", HTTP_VERB_PUT}, {"findhome", HTTP_VERB_PUT}, {"openshutter", HTTP_VERB_PUT},
+	{"park", HTTP_VERB_PUT}, {"setpark", HTTP_VERB_PUT}, {"shutterstatus", HTTP_VERB_GET},
+	{"slaved", HTTP_VERB_GET | HTTP_VERB_PUT}, {"slewing", HTTP_VERB_GET}, {"slewtoaltitude", HTTP_VERB_PUT},
+	{"slewtoazimuth", HTTP_VERB_PUT}, {"synctoazimuth", HTTP_VERB_PUT}};
+
+static const HttpMethod_t k_switch[] = {
+	{"canasync", HTTP_VERB_GET}, {"canwrite", HTTP_VERB_GET}, {"getswitch", HTTP_VERB_GET},
+	{"getswitchdescription", HTTP_VERB_GET}, {"getswitchname", HTTP_VERB_GET}, {"getswitchvalue", HTTP_VERB_GET},
+	{"maxswitch", HTTP_VERB_GET}, {"maxswitchvalue", HTTP_VERB_GET}, {"minswitchvalue", HTTP_VERB_GET},
+	{"setasync", HTTP_VERB_PUT}, {"setasyncvalue", HTTP_VERB_PUT}, {"setswitch", HTTP_VERB_PUT},
+	{"setswitchname", HTTP_VERB_PUT}, {"setswitchvalue", HTTP_VERB_PUT}, {"statechangecomplete", HTTP_VERB_GET},
+	{"switchstep", HTTP_VERB_GET}};
+
+static const HttpMethod_t k_safemon[] = {
+	{"issafe", HTTP_VERB_GET}};
+
+static const HttpMethod_t k_obscond[] = {
+	{"averageperiod", HTTP_VERB_GET | HTTP_VERB_PUT}, {"cloudcover", HTTP_VERB_GET}, {"dewpoint", HTTP_VERB_GET},
+	{"humidity", HTTP_VERB_GET}, {"pressure", HTTP_VERB_GET}, {"rainrate", HTTP_VERB_GET}, {"refresh", HTTP_VERB_PUT},
+	{"sensordescription", HTTP_VERB_GET}, {"skybrightness", HTTP_VERB_GET}, {"skyquality", HTTP_VERB_GET},
+	{"skytemperature", HTTP_VERB_GET}, {"starfwhm", HTTP_VERB_GET}, {"temperature", HTTP_VERB_GET},
+	{"timesincelastupdate", HTTP_VERB_GET}, {"winddirection", HTTP_VERB_GET}, {"windgust", HTTP_VERB_GET},
+	{"windspeed", HTTP_VERB_GET}};
+
+#define HTTP_NUM(a)             ( sizeof(a) / sizeof(a[0]) )
+
+// device types in URL order, each one a block of routes: common members, then its own
+struct HttpDevType_t
+{
+	const char *name;
+	const HttpMethod_t *methods;
+	uint8_t num_methods;
+	uint8_t num_devices;
+	uint8_t base;							// first route id
+};
+
+constexpr uint8_t k_dev_base0 = (uint8_t)HttpRoute_t::kNum;
+constexpr uint8_t k_dev_base1 = k_dev_base0 + HTTP_NUM(k_common) + HTTP_NUM(k_dome);
+constexpr uint8_t k_dev_base2 = k_dev_base1 + HTTP_NUM(k_common) + HTTP_NUM(k_switch);
+constexpr uint8_t k_dev_base3 = k_dev_base2 + HTTP_NUM(k_common) + HTTP_NUM(k_safemon);
+constexpr size_t k_num_routes = k_dev_base3 + HTTP_NUM(k_common) + HTTP_NUM(k_obscond);
+
+static_assert(k_num_routes <= HTTP_STATS_MAX_ROUTES, "HTTP_STATS_MAX_ROUTES");
+static_assert(HTTP_STATS_MAX_ROUTES <= 256, "route id is 8 bits in the cookie");
+
+static const HttpDevType_t k_dev_type[] = {
+	{"dome", k_dome, HTTP_NUM(k_dome), (uint8_t)k_num_of_domes, k_dev_base0},
+	{"switch", k_switch, HTTP_NUM(k_switch), 1, k_dev_base1},
+	{"safetymonitor", k_safemon, HTTP_NUM(k_safemon), 1, k_dev_base2},
+	{"observingconditions", k_obscond, HTTP_NUM(k_obscond), 1, k_dev_base3}};
+
+static const char *const k_route_str[(uint8_t)HttpRoute_t::kNum] = {"other", "api_unknown", "apiversions",
+	"description", "configureddevices", "setup", "jsondata", "links", "save_settings", "static"};
+
+// index of name in methods, or -1. Alpaca method names are lower case, clients may not be
+static int http_find_method(const HttpMethod_t *methods, size_t num, const char *name)
+{
+	for(size_t i = 0; i < num; i++)
+		if( strcasecmp(methods[i].name, name) == 0 )
+			return (int)i;
+	return -1;
+}
+
+static uint8_t http_verb(AsyncWebServerRequest *request)
+{
+	switch( request->method() )
+	{
+		case HTTP_GET: return HTTP_VERB_GET;
+		case HTTP_PUT: return HTTP_VERB_PUT;
+		default: return 0;
+	}
+}
+
+HttpStats::HttpStats()
+{
+	_clear();
+}
+
+void HttpStats::_clear()
+{
+	for(HttpRouteStats_t &r : _route) {
+		r.requests = 0;
+		r.bad_url = 0;
+		r.errors = 0;
+		r.bytes_in = 0;
+		r.us.Clear();
+	}
+	_start_ms = millis();
+}
+
+void HttpStats::Begin(AsyncWebServer *server)
+{
+	_start_ms = millis();					// the constructor runs before the clock
+	g_HttpProbe.AddHook(server,
+		[](AsyncWebServerRequest *request) -> uint32_t { return g_HttpStats._classify(request); },
+		[](AsyncWebServerRequest *request, uint32_t cookie) { g_HttpStats._done(request, cookie); });
+
+	server->on(HTTP_STATS_URL, HTTP_GET, [this](AsyncWebServerRequest *request) { _sendJson(request); });
+}
+
+// request line parsed: route id and bad URL flag from the URL and the verb, start time
+uint32_t HttpStats::_classify(AsyncWebServerRequest *request)
+{
+	const char *url = request->url().c_str();
+	const char *last = strrchr(url, '/');
+	uint32_t now = ((uint32_t)esp_timer_get_time() >> HTTP_COOKIE_TIME_SHIFT ) & HTTP_COOKIE_TIME_MASK;
+	HttpRoute_t route = HttpRoute_t::kOther;
+	uint8_t id;
+	bool bad_url = false;
+
+	if( strncmp(url, "/api/v1/", 8) == 0 ) {
+		const char *p = url + 8;
+		route = HttpRoute_t::kApiUnknown;
+		bad_url = true;
+		for(const HttpDevType_t &t : k_dev_type) {
+			size_t n = strlen(t.name);
+			if(( strncmp(p, t.name, n) != 0 ) || ( p[n] != '/' ))
+				continue;
+
+			char *end;
+			uint32_t num = strtoul(p + n + 1, &end, 10);
+			if(( end == p + n + 1 ) || ( *end != '/' ))
+				break;
+
+			const HttpMethod_t *m;
+			int i = http_find_method(k_common, HTTP_NUM(k_common), end + 1);
+			if( i >= 0 ) {
+				m = &k_common[i];
+			} else if(( i = http_find_method(t.methods, t.num_methods, end + 1) ) >= 0 ) {
+				m = &t.methods[i];
+				i += HTTP_NUM(k_common);
+			} else {
+				break;
+			}
+			id = (uint8_t)( t.base + i );
+			bad_url = ( num >= t.num_devices ) || !( m->verbs & http_verb(request) );
+			return ((uint32_t)id << HTTP_COOKIE_ROUTE_SHIFT ) | ( bad_url ? HTTP_COOKIE_BAD_URL : 0 ) | now;
+		}
+	} else if( strncmp(url, "/api/", 5) == 0 ) {
+		route = HttpRoute_t::kApiUnknown;
+		bad_url = true;
+	} else if( strcmp(url, "/management/apiversions") == 0 ) {
+		route = HttpRoute_t::kApiVersions;
+	} else if( strcmp(url, "/management/v1/description") == 0 ) {
+		route = HttpRoute_t::kDescription;
+	} else if( strcmp(url, "/management/v1/configureddevices") == 0 ) {
+		route = HttpRoute_t::kConfigured;
+	} else if(( strcmp(url, "/setup") == 0 ) || ( strncmp(url, "/setup/", 7) == 0 )) {
+		route = HttpRoute_t::kSetup;
+	} else if( strcmp(url, "/jsondata") == 0 ) {
+		route = HttpRoute_t::kJsondata;
+	} else if( strcmp(url, "/links") == 0 ) {
+		route = HttpRoute_t::kLinks;
+	} else if( strcmp(url, "/save_settings") == 0 ) {
+		route = HttpRoute_t::kSaveSettings;
+	} else if( strchr(last ? last : url, '.') ) {
+		route = HttpRoute_t::kStatic;		// a file name in the last path segment
+	}
+
+	id = (uint8_t)route;
+	return ((uint32_t)id << HTTP_COOKIE_ROUTE_SHIFT ) | ( bad_url ? HTTP_COOKIE_BAD_URL : 0 ) | now;
+}
+
+// web server task, from a route handler of this firmware: the request ends in an Alpaca error or
+// a 400. Counted on the route its URL names, as _classify() found it
+void HttpStats::Error(AsyncWebServerRequest *request)
+{
+	_route[_classify(request) >> HTTP_COOKIE_ROUTE_SHIFT].errors++;
+}
+
+// response sent
+void HttpStats::_done(AsyncWebServerRequest *request, uint32_t cookie)
+{
+	uint32_t now = ((uint32_t)esp_timer_get_time() >> HTTP_COOKIE_TIME_SHIFT ) & HTTP_COOKIE_TIME_MASK;
+	uint32_t us = (( now - cookie ) & HTTP_COOKIE_TIME_MASK ) << HTTP_COOKIE_TIME_SHIFT;
+	HttpRouteStats_t &r = _route[cookie >> HTTP_COOKIE_ROUTE_SHIFT];
+
+	r.requests++;
+	if( cookie & HTTP_COOKIE_BAD_URL )
+		r.bad_url++;
+	r.bytes_in += (uint32_t)request->contentLength();
+	r.us.Add(us);
+}
+
+void HttpStats::_routeName(uint8_t id, char *buf, size_t len)
+{
+	if( id < (uint8_t)HttpRoute_t::kNum ) {
+		snprintf(buf, len, "%s", k_route_str[id]);
+		return;
+	}
+	for(const HttpDevType_t &t : k_dev_type) {
+		uint8_t i = id - t.base;
+		if(( id < t.base ) || ( i >= HTTP_NUM(k_common) + t.num_methods ))
+			continue;
+		snprintf(buf, len, "%s/%s", t.name, ( i < HTTP_NUM(k_common) ) ? k_common[i].name : t.methods[i - HTTP_NUM(k_common)].name);
+		return;
+	}
+	snprintf(buf, len, "%u", id);
+}
+
+// routes never requested are left out
+void HttpStats::_sendJson(AsyncWebServerRequest *request)
+{
+	if( request->hasParam("reset") )
+		_clear();
+
+	AsyncResponseStream *response = request->beginResponseStream("application/json");
+	uint32_t requests = 0, bad_url = 0, errors = 0;
+
+	for(size_t i = 0; i < k_num_routes; i++) {
+		requests += _route[i].requests;
+		bad_url += _route[i].bad_url;
+		errors += _route[i].errors;
+	}
+	response->printf("{\"period_s\":%u,\"route_table\":%u,\"requests\":%u,\"bad_url\":%u,\"errors\":%u,\"routes\":[",
+		( millis() - _start_ms ) / 1000, k_num_routes, requests, bad_url, errors);
+
+	bool first = true;
+	for(size_t i = 0; i < k_num_routes; i++) {
+		const HttpRouteStats_t &r = _route[i];
+		if( r.requests == 0 )
+			continue;
+
+		char name[48];
+		_routeName((uint8_t)i, name, sizeof(name));
+		response->printf("%s{\"route\":\"%s\",\"requests\":%u,\"bad_url\":%u,\"errors\":%u,\"bytes_in\":%u,\"us\":",
+			first ? "" : ",", name, r.requests, r.bad_url, r.errors, r.bytes_in);
+		r.us.PrintJson(*response);
+		response->print("}");
+		first = false;
+	}
+	response->print("]}");
+
+	request->send(response);
+}
@@ -0,0 +1,68 @@
+/**************************************************************************************************
+  Filename:       HttpStats.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    per route request statistics of the web server: count, bad URLs, errors,
+                  request body bytes and service time from the request line to the response
+                  sent. The route is found once per request from the URL, by position in fixed
+                  tables (management, setup, settings pages, static files, every method of each
+                  Alpaca device type), and indexes a fixed array. Hooked on HttpProbe, all of it
+                  runs in the web server task. Served on /httpstats, ?reset clears.
+                  bad_url counts what the URL already rules out: wrong device number or verb,
+                  unknown method. errors counts the Alpaca errors and 400s the handlers of this
+                  firmware report through Error(); routes the library serves report none.
+                  Response bytes are not counted, the server keeps the response to itself.
+**************************************************************************************************/
+#pragma once
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "Histogram.h"
+
+#define HTTP_STATS_URL          "/httpstats"
+#define HTTP_STATS_MAX_ROUTES   136         // fixed routes and 118 Alpaca methods, checked in the .cpp
+
+// routes that are not an Alpaca device method, those follow from kNum on
+enum struct HttpRoute_t : uint8_t
+{
+	kOther = 0,								// diagnostics pages, and anything the server answers 404
+	kApiUnknown,							// /api/ path that is no known device method, a bad URL
+	kApiVersions,
+	kDescription,
+	kConfigured,
+	kSetup,
+	kJsondata,
+	kLinks,
+	kSaveSettings,
+	kStatic,								// files from the filesystem
+	kNum
+};
+
+struct HttpRouteStats_t
+{
+	uint32_t requests;
+	uint32_t bad_url;						// wrong device number or verb, unknown method
+	uint32_t errors;						// reported by the handler, Error()
+	uint32_t bytes_in;						// request bodies
+	Histogram us;							// request line parsed to response sent
+};
+
+class HttpStats
+{
+private:
+	HttpRouteStats_t _route[HTTP_STATS_MAX_ROUTES];
+	uint32_t _start_ms;						// since boot or the last reset
+
+	void _clear();
+	uint32_t _classify(AsyncWebServerRequest *request);
+	void _done(AsyncWebServerRequest *request, uint32_t cookie);
+	void _routeName(uint8_t id, char *buf, size_t len);
+	void _sendJson(AsyncWebServerRequest *request);
+
+public:
+	HttpStats();
+	void Begin(AsyncWebServer *server);
+	void Error(AsyncWebServerRequest *request);
+};
+
+extern HttpStats g_HttpStats;
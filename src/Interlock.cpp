@@ -0,0 +1,96 @@
+/**************************************************************************************************
+  Filename:       Interlock.cpp
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    safety to roof interlock latency implementation
+**************************************************************************************************/
+#include "Interlock.h"
+#include "LogRing.h"
+
+InterlockMonitor g_Interlock;
+
+static constexpr SrOut_t k_relay_close = ch_mask<SrOut_t>(ChKind_t::kRoofClose);
+static constexpr SrIn_t k_in_safety = BIT_SAFE_RAIN | BIT_SAFE_POWER;
+
+InterlockMonitor::InterlockMonitor()
+{
+	_sample_us = 0;
+	_edge_us = 0;
+	_trip_us = 0;
+	_edges = 0;
+	_trips = 0;
+	_trip_us_last = 0;
+}
+
+void InterlockMonitor::Begin(AsyncWebServer *server)
+{
+	server->on(INTERLOCK_URL, HTTP_GET, [this](AsyncWebServerRequest *request) { _sendJson(request); });
+}
+
+// call right after the input chain is read
+void InterlockMonitor::Sample(const SrIn_t &in)
+{
+	_sample_us = esp_timer_get_time();
+
+	if( in != _prev_in ) {
+		_edge_bits = ( in & ~_prev_in ) | ( _prev_in & ~in );
+		_prev_in = in;
+		_edge_us = _sample_us;
+		_edges++;
+	}
+}
+
+// a roof was commanded to close by the interlock in this tick
+void InterlockMonitor::Trip()
+{
+	if( _trip_us == 0 )
+		_trip_us = _sample_us;
+	_trips++;
+}
+
+// call right after the output chain is written. One edge sample per tick, from the first roof
+// that answered an edge of its own inputs
+void InterlockMonitor::Written(const SrOut_t &prev, const SrOut_t &out)
+{
+	int64_t now = esp_timer_get_time();
+
+	if( _edge_us != 0 ) {
+		for(const DomeHw_t &hw : k_dome_hw) {
+			SrIn_t inputs = k_in_safety | hw.limit_opened | hw.limit_closed | hw.button_open | hw.button_close;
+			SrOut_t relays = hw.relay_open | hw.relay_close;
+			if(( _edge_bits & inputs ) && (( prev & relays ) != ( out & relays ))) {
+				_edge_to_relay.Add((uint32_t)( now - _edge_us ));
+				break;
+			}
+		}
+	}
+
+	if(( _trip_us != 0 ) && (( out & k_relay_close ) & ~prev )) {
+		_trip_us_last = (uint32_t)( now - _trip_us );
+		_trip_to_relay.Add(_trip_us_last);
+		_trip_us = 0;
+		RLOG_WARNING_PRINTF("Interlock close relay on after %u us\n", _trip_us_last);
+	}
+}
+
+// responses are same tick only. A trip whose relay was already on is not a latency sample
+void InterlockMonitor::EndTick()
+{
+	_edge_us = 0;
+	_edge_bits = SrIn_t();
+	_trip_us = 0;
+}
+
+void InterlockMonitor::_sendJson(AsyncWebServerRequest *request)
+{
+	AsyncResponseStream *response = request->beginResponseStream("application/json");
+
+	response->printf("{\"edges\":%u,\"trips\":%u,\"trip_us_last\":%u,\"edge_to_relay_us\":", _edges, _trips, _trip_us_last);
+	_edge_to_relay.PrintJson(*response);
+	response->print(",\"trip_to_relay_us\":");
+	_trip_to_relay.PrintJson(*response);
+	response->print("}");
+
+	request->send(response);
+}
@@ -0,0 +1,48 @@
+/**************************************************************************************************
+  Filename:       Interlock.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    safety to roof interlock latency. Timestamps input samples and unsafe trips in
+                  the control tick and measures the time until the relay image reaches the 595.
+                  Inputs are polled, add up to one control period for the edge itself. An edge
+                  counts for a roof when it is on a safety input or on that roof's limit
+                  switches or buttons, and the roof's own relays change in the same tick.
+**************************************************************************************************/
+#pragma once
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "ChannelMap.h"
+#include "Histogram.h"
+
+#define INTERLOCK_URL           "/interlock"
+
+// safety bits that may close the roof, see SAFEMON_*_BIT
+#define INTERLOCK_MASK_ALL      0xFF
+
+class InterlockMonitor
+{
+private:
+	SrIn_t _prev_in;
+	int64_t _sample_us;						// time of this tick's input sample
+	int64_t _edge_us;						// input edge seen this tick, 0 if none
+	SrIn_t _edge_bits;						// inputs that changed this tick
+	int64_t _trip_us;						// unsafe transition waiting for the close relay, 0 if none
+	uint32_t _edges;
+	uint32_t _trips;
+	uint32_t _trip_us_last;
+	Histogram _edge_to_relay;				// safety or roof input edge -> that roof's relays, same tick
+	Histogram _trip_to_relay;				// unsafe transition -> close relay on
+
+	void _sendJson(AsyncWebServerRequest *request);
+
+public:
+	InterlockMonitor();
+	void Begin(AsyncWebServer *server);
+	void Sample(const SrIn_t &in);
+	void Trip();
+	void Written(const SrOut_t &prev, const SrOut_t &out);
+	void EndTick();
+};
+
+extern InterlockMonitor g_Interlock;
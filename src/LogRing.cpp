@@ -0,0 +1,138 @@
+/**************************************************************************************************
+  Filename:       LogRing.cpp
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    deferred-format logging ring buffer implementation
+**************************************************************************************************/
+#include "LogRing.h"
+
+static_assert((LOG_RING_SIZE & (LOG_RING_SIZE - 1)) == 0, "LOG_RING_SIZE must be a power of 2");
+
+LogRing g_LogRing;
+
+LogRing::LogRing()
+{
+	for(uint32_t i = 0; i < LOG_RING_SIZE; i++)
+		_rec[i].seq.store(0, std::memory_order_relaxed);
+
+	_head.store(0);
+	_tail.store(0);
+	_dropped.store(0);
+	_high_water.store(0);
+	_suppressed = 0;
+	_shipped = 0;
+	_last_fmt = nullptr;
+	_last_lvl = 0;
+	_last_ts = 0;
+	_repeat = 0;
+	_task = nullptr;
+}
+
+// start the consumer task. Records pushed before Begin() are kept and shipped on the first drain
+void LogRing::Begin()
+{
+	if( _task != nullptr )
+		return;
+
+	xTaskCreatePinnedToCore(_taskLoop, "log_ring", LOG_RING_TASK_STACK, this, LOG_RING_TASK_PRIO, &_task, 0);
+}
+
+void LogRing::_taskLoop(void *arg)
+{
+	LogRing *ring = (LogRing *)arg;
+
+	for(;;) {
+		ring->Drain();
+		vTaskDelay(pdMS_TO_TICKS(LOG_RING_TASK_PERIOD));
+	}
+}
+
+// producer side, may be called from any task. Never blocks: drops the record if the ring is full
+bool LogRing::_push(uint8_t lvl, const char *fmt, const uint32_t *args, uint8_t nargs)
+{
+	uint32_t head = _head.load(std::memory_order_relaxed);
+
+	do {
+		if(( head - _tail.load(std::memory_order_acquire)) >= LOG_RING_SIZE ) {
+			_dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+	} while( !_head.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel, std::memory_order_relaxed));
+
+	LogRecord_t &r = _rec[head & (LOG_RING_SIZE - 1)];
+	r.fmt = fmt;
+	r.ts_ms = millis();
+	r.lvl = lvl;
+	r.nargs = nargs;
+	for(uint8_t i = 0; i < LOG_RING_MAX_ARGS; i++)
+		r.args[i] = (i < nargs) ? args[i] : 0;
+
+	r.seq.store(head + 1, std::memory_order_release);		// publish the record
+
+	uint32_t pending = head + 1 - _tail.load(std::memory_order_relaxed);
+	uint32_t hw = _high_water.load(std::memory_order_relaxed);
+	while(( pending > hw ) && !_high_water.compare_exchange_weak(hw, pending, std::memory_order_relaxed));
+
+	return true;
+}
+
+// consumer side, only called from the log task. Returns the number of records taken from the ring
+uint32_t LogRing::Drain()
+{
+	uint32_t n = 0;
+
+	for(;;) {
+		uint32_t tail = _tail.load(std::memory_order_relaxed);
+		LogRecord_t &r = _rec[tail & (LOG_RING_SIZE - 1)];
+
+		if( r.seq.load(std::memory_order_acquire) != tail + 1 )		// empty or still being written
+			break;
+
+		_ship(r);
+		_tail.store(tail + 1, std::memory_order_release);			// free the slot
+		n++;
+	}
+
+	if(( _repeat > 0 ) && (( millis() - _last_ts ) > LOG_RING_REPEAT_MS ))
+		_flushRepeat();
+
+	return n;
+}
+
+// format a record and send it to SLog (serial and syslog), folding repeated messages
+void LogRing::_ship(const LogRecord_t &r)
+{
+	if(( r.fmt == _last_fmt ) && ( r.lvl == _last_lvl ) && (( r.ts_ms - _last_ts ) < LOG_RING_REPEAT_MS ) &&
+		( memcmp(r.args, _last_args, sizeof(_last_args)) == 0 )) {
+		_repeat++;
+		_suppressed++;
+		return;
+	}
+
+	_flushRepeat();
+
+	char msg[LOG_RING_MSG_SIZE];
+	int len = snprintf(msg, sizeof(msg), "[%lu.%03lu] ", (unsigned long)(r.ts_ms / 1000), (unsigned long)(r.ts_ms % 1000));
+
+	snprintf(msg + len, sizeof(msg) - len, r.fmt,
+		r.args[0], r.args[1], r.args[2], r.args[3], r.args[4], r.args[5], r.args[6], r.args[7]);
+
+	SLOG_PRINTF(r.lvl, "%s", msg);
+	_shipped++;
+
+	_last_fmt = r.fmt;
+	_last_lvl = r.lvl;
+	_last_ts = r.ts_ms;
+	memcpy(_last_args, r.args, sizeof(_last_args));
+}
+
+void LogRing::_flushRepeat()
+{
+	if( _repeat == 0 )
+		return;
+
+	SLOG_PRINTF(_last_lvl, "last message repeated %lu times\n", (unsigned long)_repeat);
+	_repeat = 0;
+	_last_fmt = nullptr;
+}
@@ -0,0 +1,97 @@
+/**************************************************************************************************
+  Filename:       LogRing.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    deferred-format logging. Log calls push a compact binary record
+                  (format pointer, timestamp, arguments) to a lock-free ring buffer,
+                  a low priority task formats them and ships to serial/syslog via SLog
+**************************************************************************************************/
+#pragma once
+#include <Arduino.h>
+#include <SLog.h>
+#include <atomic>
+#include <type_traits>
+
+#define LOG_RING_SIZE           64          // number of records, must be a power of 2
+#define LOG_RING_MAX_ARGS       8           // max arguments per record
+#define LOG_RING_MSG_SIZE       192         // size of the formatted message
+#define LOG_RING_REPEAT_MS      5000        // identical messages within this window are folded
+#define LOG_RING_TASK_STACK     4096
+#define LOG_RING_TASK_PRIO      1           // lower or equal to loopTask
+#define LOG_RING_TASK_PERIOD    20          // ms between drains
+
+// Arguments are stored as 32 bit words and passed back to snprintf as they are:
+// integers, bool, char and pointers to strings that outlive the call (literals, static
+// buffers). Floats and 64 bit values are rejected at compile time, log them as scaled integers.
+#define RLOG_ERROR_PRINTF(...)    g_LogRing.Push(SLOG_ERROR, __VA_ARGS__)
+#define RLOG_WARNING_PRINTF(...)  g_LogRing.Push(SLOG_WARNING, __VA_ARGS__)
+#define RLOG_NOTICE_PRINTF(...)   g_LogRing.Push(SLOG_NOTICE, __VA_ARGS__)
+#define RLOG_INFO_PRINTF(...)     g_LogRing.Push(SLOG_INFO, __VA_ARGS__)
+#define RLOG_DEBUG_PRINTF(...)    g_LogRing.Push(SLOG_DEBUG, __VA_ARGS__)
+
+struct LogRecord_t
+{
+	std::atomic<uint32_t> seq;				// ticket + 1 when the record is complete
+	const char *fmt;
+	uint32_t ts_ms;
+	uint8_t lvl;
+	uint8_t nargs;
+	uint32_t args[LOG_RING_MAX_ARGS];
+};
+
+class LogRing
+{
+private:
+	LogRecord_t _rec[LOG_RING_SIZE];
+	std::atomic<uint32_t> _head;			// next ticket for producers
+	std::atomic<uint32_t> _tail;			// next record for the consumer
+	std::atomic<uint32_t> _dropped;			// records lost because the ring was full
+	std::atomic<uint32_t> _high_water;		// max number of pending records
+	uint32_t _suppressed;					// repeated messages folded by the consumer
+	uint32_t _shipped;
+
+	// last shipped message, used to fold repetitions
+	const char *_last_fmt;
+	uint32_t _last_args[LOG_RING_MAX_ARGS];
+	uint8_t _last_lvl;
+	uint32_t _last_ts;
+	uint32_t _repeat;
+
+	TaskHandle_t _task;
+
+	template<typename T>
+	static typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, uint32_t>::type _arg(T v)
+	{
+		static_assert(sizeof(T) <= sizeof(uint32_t), "64 bit log arguments are not supported");
+		return (uint32_t)v;
+	}
+	static uint32_t _arg(const char *s) { return (uint32_t)(uintptr_t)s; }
+
+	bool _push(uint8_t lvl, const char *fmt, const uint32_t *args, uint8_t nargs);
+	void _ship(const LogRecord_t &r);
+	void _flushRepeat();
+	static void _taskLoop(void *arg);
+
+public:
+	LogRing();
+	void Begin();
+	uint32_t Drain();
+
+	template<typename... A>
+	bool Push(uint8_t lvl, const char *fmt, A... args)
+	{
+		static_assert(sizeof...(A) <= LOG_RING_MAX_ARGS, "too many log arguments");
+		const uint32_t a[sizeof...(A) + 1] = { _arg(args)..., 0 };
+		return _push(lvl, fmt, a, sizeof...(A));
+	}
+
+	uint32_t getDropped() { return _dropped.load(std::memory_order_relaxed); }
+	uint32_t getSuppressed() { return _suppressed; }
+	uint32_t getShipped() { return _shipped; }
+	uint32_t getHighWater() { return _high_water.load(std::memory_order_relaxed); }
+	uint32_t getPending() { return _head.load(std::memory_order_relaxed) - _tail.load(std::memory_order_relaxed); }
+	TaskHandle_t getTask() { return _task; }
+};
+
+extern LogRing g_LogRing;
@@ -0,0 +1,116 @@
+/**************************************************************************************************
+  Filename:       MedianFilter.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    ingest outlier filter for an integer signal. The last K raw samples are kept
+                  in arrival order and sorted; a sample is rejected if it is far from the median
+                  or if it moves faster than the rate limit while the median has not moved.
+                  A real step passes once it holds for K/2+1 samples. O(K) per sample, K fixed.
+                  No Arduino dependency, tools/filter_bench.cpp builds it on the host; the cost
+                  on the board is measured by the caller.
+**************************************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+template<size_t K>
+class MedianFilter
+{
+	static_assert(( K % 2 ) == 1, "median window must be odd");
+
+private:
+	int16_t _ring[K];						// arrival order
+	int16_t _sorted[K];
+	uint8_t _head;
+	uint8_t _n;
+
+	int16_t _dev_limit;						// max |sample - median|, 0 = off
+	int16_t _rate_limit;					// max change per second vs last accepted, 0 = off
+	int16_t _last;
+	uint32_t _last_ms;
+	bool _last_valid;
+
+	uint32_t _accepted;
+	uint32_t _rejected;
+
+	void _push(int16_t v)
+	{
+		uint8_t i;
+
+		if( _n == K ) {						// remove the oldest from the sorted array
+			int16_t old = _ring[_head];
+			for(i = 0; _sorted[i] != old; i++);
+			for(; i < K - 1; i++)
+				_sorted[i] = _sorted[i + 1];
+			_n--;
+		}
+
+		_ring[_head] = v;
+		_head = ( _head + 1 ) % K;
+
+		for(i = _n; ( i > 0 ) && ( _sorted[i - 1] > v ); i--)
+			_sorted[i] = _sorted[i - 1];
+		_sorted[i] = v;
+		_n++;
+	}
+
+	static int16_t _abs(int32_t v) { return (int16_t)(( v < 0 ) ? -v : v ); }
+
+public:
+	MedianFilter(int16_t dev_limit, int16_t rate_limit) : _dev_limit(dev_limit), _rate_limit(rate_limit)
+	{
+		_head = 0;
+		_n = 0;
+		_last = 0;
+		_last_ms = 0;
+		_last_valid = false;
+		_accepted = 0;
+		_rejected = 0;
+	}
+
+	// returns true if the sample may be used
+	bool Filter(int16_t v, uint32_t now)
+	{
+		bool reject = false;
+
+		_push(v);
+
+		if( _n == K ) {						// warm up: no median yet, accept
+			int16_t med = _sorted[K / 2];
+
+			if(( _dev_limit > 0 ) && ( _abs((int32_t)v - med) > _dev_limit ))
+				reject = true;
+
+			if(( _rate_limit > 0 ) && _last_valid ) {
+				uint32_t dt = now - _last_ms;
+				int32_t allowed = (int32_t)(((uint64_t)_rate_limit * ( dt < 1000 ? 1000 : dt )) / 1000);
+
+				if(( _abs((int32_t)v - _last) > allowed ) && ( _abs((int32_t)med - _last) <= allowed ))
+					reject = true;
+			}
+		}
+
+		if( reject ) {
+			_rejected++;
+		} else {
+			_accepted++;
+			_last = v;
+			_last_ms = now;
+			_last_valid = true;
+		}
+
+		return !reject;
+	}
+
+	int16_t Median() const { return _n ? _sorted[_n / 2] : 0; }
+	uint32_t GetAccepted() const { return _accepted; }
+	uint32_t GetRejected() const { return _rejected; }
+
+	// "median":..,"accepted":..,"rejected":.. the caller adds its fields and the braces
+	template<class P>
+	void PrintJson(P &out) const
+	{
+		out.printf("\"median\":%d,\"accepted\":%u,\"rejected\":%u", Median(), _accepted, _rejected);
+	}
+};
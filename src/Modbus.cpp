@@ -0,0 +1,425 @@
+/**************************************************************************************************
+  Filename:       Modbus.cpp
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    Modbus RTU master implementation
+**************************************************************************************************/
+#include "Modbus.h"
+#include "defines.h"
+#include "LogRing.h"
+#include "ControlTask.h"
+#include "WsLink.h"
+#include "DewHeater.h"
+
+ModbusMaster g_Modbus;
+
+static const char *const k_type_str[] = {"u16", "i16", "u32", "i32", "f32"};
+// weather fields, then the dew heater surface temperatures
+static const char *const k_field_str[MB_NUM_FIELDS] = {"tsky", "tair", "wind", "hum", "rain", "light", "clouds", "stars",
+	"heat1", "heat2", "heat3", "heat4"};
+
+static_assert(MB_NUM_FIELDS - WSP_NUM_FIELDS == k_num_sw_pwm, "one heatN field per PWM");
+
+ModbusMaster::ModbusMaster()
+{
+	memset(&_map, 0, sizeof(_map));
+	memset(&_staged, 0, sizeof(_staged));
+	_map.baud = 9600;
+	_map.poll_ms = 1000;
+	_staged_ready = false;
+	_taken_ready = false;
+	_stale = false;
+	memset(_src, 0, sizeof(_src));
+	memset(_err, 0, sizeof(_err));
+	_baud = 9600;
+	_poll_ms = 1000;
+	_state = kIdle;
+	_cur = 0;
+	_dev_failed = false;
+	_cycle_ms = 0;
+	_sent_ms = 0;
+	_rx_frames = 0;
+	_rx_us = 0;
+	_rx_seen = 0;
+	_mask = 0;
+	memset(_field, 0, sizeof(_field));
+	memset(_last, 0, sizeof(_last));
+}
+
+void ModbusMaster::Begin(AsyncWebServer *server)
+{
+	Serial2.begin(_map.baud, SERIAL_8N1, IN_PIN_RX2, OUT_PIN_TX2);
+	Serial2.setPins(IN_PIN_RX2, OUT_PIN_TX2, -1, OUT_PIN_DE2);		// RTS is DE
+	Serial2.setMode(UART_MODE_RS485_HALF_DUPLEX);
+	Serial2.setRxTimeout(MB_RX_TIMEOUT_SYM);
+	Serial2.onReceive([this]() {
+		_rx_us = (uint32_t)esp_timer_get_time();
+		_rx_frames = _rx_frames + 1;
+	}, true);												// only on the RX timeout, the frame end
+
+	server->on(MB_URL, HTTP_GET, [this](AsyncWebServerRequest *request) { _sendJson(request); });
+}
+
+void ModbusMaster::SetConfig(uint32_t baud, uint32_t poll_ms)
+{
+	static const uint32_t k_bauds[] = {4800, 9600, 19200, 38400, 57600, 115200};
+	bool ok = false;
+
+	for(uint32_t b : k_bauds)
+		ok |= ( b == baud );
+
+	_baud = ok ? baud : 9600;
+	_poll_ms = ( poll_ms < MB_MIN_POLL_MS ) ? MB_MIN_POLL_MS : ( poll_ms > MB_MAX_POLL_MS ) ? MB_MAX_POLL_MS : poll_ms;
+}
+
+void ModbusMaster::SetSource(uint8_t i, const char *src)
+{
+	if( i >= MB_MAX_ENTRIES )
+		return;
+
+	snprintf(_src[i], MB_SRC_LEN, "%s", src ? src : "");
+	for(char *c = _src[i]; *c; c++)
+		if(( *c == '"' ) || ( *c == '\\' ) || ((uint8_t)*c < 0x20 ))
+			*c = ' ';
+}
+
+// <slave> <fc> <reg> <type> <scale> <field>
+bool ModbusMaster::_compileEntry(uint8_t i, const char *src, MbMap_t &map, char *err)
+{
+	unsigned slave, fc, reg;
+	char type[8], field[8];
+	float scale;
+	MbEntry_t &e = map.entry[map.n_entries];
+
+	if( sscanf(src, "%u %u %u %7s %f %7s", &slave, &fc, &reg, type, &scale, field) != 6 ) {
+		snprintf(err, MB_ERR_LEN, "expected slave fc reg type scale field");
+		return false;
+	}
+	if(( slave < 1 ) || ( slave > 247 )) {
+		snprintf(err, MB_ERR_LEN, "slave %u not 1~247", slave);
+		return false;
+	}
+	if(( fc != MB_FC_HOLDING ) && ( fc != MB_FC_INPUT )) {
+		snprintf(err, MB_ERR_LEN, "fc %u not 3 or 4", fc);
+		return false;
+	}
+	if( reg > 0xFFFE ) {
+		snprintf(err, MB_ERR_LEN, "reg %u out of range", reg);
+		return false;
+	}
+	if( !isfinite(scale) || ( scale == 0 )) {
+		snprintf(err, MB_ERR_LEN, "bad scale");
+		return false;
+	}
+
+	e.type = MbType_t::kF32;
+	while(( (uint8_t)e.type > 0 ) && strcmp(type, k_type_str[(uint8_t)e.type]))
+		e.type = (MbType_t)((uint8_t)e.type - 1);
+	if( strcmp(type, k_type_str[(uint8_t)e.type]) ) {
+		snprintf(err, MB_ERR_LEN, "unknown type %s", type);
+		return false;
+	}
+
+	e.field = MB_NUM_FIELDS;
+	for(uint8_t f = 0; f < MB_NUM_FIELDS; f++)
+		if( strcmp(field, k_field_str[f]) == 0 )
+			e.field = f;
+	if( e.field == MB_NUM_FIELDS ) {
+		snprintf(err, MB_ERR_LEN, "unknown field %s", field);
+		return false;
+	}
+
+	e.slave = (uint8_t)slave;
+	e.fc = (uint8_t)fc;
+	e.reg = (uint16_t)reg;
+	e.scale = scale;
+	e.src = i;
+	map.n_entries++;
+	err[0] = 0;
+	return true;
+}
+
+// sort the entries, merge neighbours on the same slave and function into block reads
+void ModbusMaster::_build(MbMap_t &map)
+{
+	auto key = [](const MbEntry_t &e) { return ((uint32_t)e.slave << 24 ) | ((uint32_t)e.fc << 16 ) | e.reg; };
+
+	for(uint8_t i = 1; i < map.n_entries; i++) {
+		MbEntry_t e = map.entry[i];
+		uint8_t j = i;
+		for(; ( j > 0 ) && ( key(map.entry[j - 1]) > key(e) ); j--)
+			map.entry[j] = map.entry[j - 1];
+		map.entry[j] = e;
+	}
+
+	map.n_polls = 0;
+	map.n_devs = 0;
+	for(uint8_t i = 0; i < map.n_entries; i++) {
+		const MbEntry_t &e = map.entry[i];
+		uint8_t width = ( e.type >= MbType_t::kU32 ) ? 2 : 1;
+		MbPoll_t *p = map.n_polls ? &map.poll[map.n_polls - 1] : nullptr;
+
+		if(( p != nullptr ) && ( p->slave == e.slave ) && ( p->fc == e.fc ) && ( e.reg + width - p->reg <= MB_MAX_REGS )) {
+			if( e.reg + width - p->reg > p->count )
+				p->count = (uint8_t)( e.reg + width - p->reg );
+			p->n++;
+			continue;
+		}
+
+		if(( p == nullptr ) || ( p->slave != e.slave ))
+			map.dev_slave[map.n_devs++] = e.slave;
+		map.poll[map.n_polls++] = {e.slave, e.fc, e.reg, width, i, 1, (uint8_t)( map.n_devs - 1 )};
+	}
+}
+
+// API task: compile all entries and hand the map to the control task.
+// Returns the number of entries with errors, those are skipped. The control task copies a map in
+// its next tick, whatever the bus is doing. Never waits: MB_BUSY when it has not taken the last
+// one, nothing is compiled
+uint8_t ModbusMaster::Compile()
+{
+	uint8_t errors = 0;
+
+	if( _staged_ready.load(std::memory_order_acquire) && ( g_Control.GetTask() != nullptr )) {
+		RLOG_ERROR_PRINTF("ERROR! Modbus map not compiled, the control task has not taken the last one\n");
+		_stale = true;
+		return MB_BUSY;
+	}
+	_stale = false;
+
+	memset(&_staged, 0, sizeof(_staged));
+	for(uint8_t i = 0; i < MB_MAX_ENTRIES; i++) {
+		const char *s = _src[i];
+		while( *s == ' ' )
+			s++;
+		if( *s == 0 ) {
+			_err[i][0] = 0;
+			continue;
+		}
+		if( !_compileEntry(i, s, _staged, _err[i]) ) {
+			RLOG_WARNING_PRINTF("Mb_%u: %s\n", i + 1, _err[i]);
+			errors++;
+		}
+	}
+	_build(_staged);
+	_staged.baud = _baud;
+	_staged.poll_ms = _poll_ms;
+	_staged_ready.store(true, std::memory_order_release);
+
+	RLOG_INFO_PRINTF("Modbus map: %u entries, %u polls, %u devices, %u errors\n", _staged.n_entries, _staged.n_polls, _staged.n_devs, errors);
+	return errors;
+}
+
+// API task, from the settings of the observingconditions device. As WsLink::ReadJson(), settings
+// saved before Modbus had its own section are read from ObservingConditions_Configuration
+void ModbusMaster::ReadJson(JsonObject &root)
+{
+	JsonObject obj_config = root["Modbus_Configuration"];
+	if( !obj_config )
+		obj_config = root["ObservingConditions_Configuration"];
+	if( !obj_config )
+		return;
+
+	SetConfig(obj_config["Mb_baud"] | GetBaud(), obj_config["Mb_poll_ms"] | GetPollMs());
+
+	char key[8];
+	for(uint8_t i = 0; i < MB_MAX_ENTRIES; i++) {
+		snprintf(key, sizeof(key), "Mb_%u", i + 1);
+		SetSource(i, obj_config[key] | GetSource(i));
+	}
+	Compile();								// entries with errors are skipped, see GET /modbus
+}
+
+void ModbusMaster::WriteJson(JsonObject &root)
+{
+	JsonObject obj_config = root["Modbus_Configuration"].to<JsonObject>();
+
+	obj_config["Mb_baud"] = GetBaud();
+	obj_config["Mb_poll_ms"] = GetPollMs();
+
+	char key[8];
+	for(uint8_t i = 0; i < MB_MAX_ENTRIES; i++) {
+		snprintf(key, sizeof(key), "Mb_%u", i + 1);
+		obj_config[key] = GetSource(i);
+	}
+}
+
+// control tick stage: one request on the bus at a time, the next goes out in the tick its
+// answer or timeout is seen
+void ModbusMaster::Loop()
+{
+	uint32_t now = millis();
+
+	if( _staged_ready.load(std::memory_order_acquire) ) {	// frees _staged for the API task at once
+		_taken = _staged;
+		_staged_ready.store(false, std::memory_order_release);
+		_taken_ready = true;
+	}
+	if( _taken_ready && ( _state == kIdle )) {
+		if( _taken.baud != _map.baud )
+			Serial2.updateBaudRate(_taken.baud);
+		_map = _taken;
+		_taken_ready = false;
+		for(MbDevStats_t &d : _dev)
+			d = MbDevStats_t();
+		memset(_last, 0, sizeof(_last));
+	}
+
+	if( _map.n_polls == 0 )
+		return;
+
+	if( _state == kIdle ) {
+		if(( now - _cycle_ms ) >= _map.poll_ms ) {
+			_cycle_ms = now;
+			_cur = 0;
+			_mask = 0;
+			_send(now);
+		}
+		return;
+	}
+
+	if( _rx_frames != _rx_seen ) {
+		_rx_seen = _rx_frames;
+		_receive(now);
+	} else if(( now - _sent_ms ) > MB_TIMEOUT_MS ) {
+		_dev[_map.poll[_cur].dev].timeouts++;
+		_next(now, false);
+	}
+}
+
+void ModbusMaster::_send(uint32_t now)
+{
+	const MbPoll_t &p = _map.poll[_cur];
+	uint8_t buf[MB_REQ_LEN];
+
+	if(( _cur == 0 ) || ( _map.poll[_cur - 1].dev != p.dev )) {
+		_dev[p.dev].t0_us = (uint32_t)esp_timer_get_time();
+		_dev_failed = false;
+	}
+
+	while( Serial2.available() )							// a late answer to a timed out request
+		Serial2.read();
+	_rx_seen = _rx_frames;
+	Serial2.write(buf, mb_read_request(buf, p.slave, p.fc, p.reg, p.count));
+	_sent_ms = now;
+	_state = kWait;
+}
+
+void ModbusMaster::_receive(uint32_t now)
+{
+	const MbPoll_t &p = _map.poll[_cur];
+	MbDevStats_t &d = _dev[p.dev];
+	size_t n = Serial2.read(_rx, sizeof(_rx));
+
+	while( Serial2.available() )							// overlong, fails the length check
+		Serial2.read();
+
+	switch( mb_check_response(_rx, n, p.slave, p.fc, p.count) )
+	{
+		case MbResult_t::kOk:
+			break;
+		case MbResult_t::kMismatch:							// not ours, keep waiting until the timeout
+			d.mismatches++;
+			return;
+		case MbResult_t::kException:
+			d.exceptions++;
+			d.last_exception = _rx[2];
+			_next(now, false);
+			return;
+		default:
+			d.crc_errors++;
+			_next(now, false);
+			return;
+	}
+
+	d.ok++;
+	for(uint8_t i = p.first; i < p.first + p.n; i++) {
+		const MbEntry_t &e = _map.entry[i];
+		const uint8_t *r = &_rx[3 + ( e.reg - p.reg ) * 2];
+		uint32_t w = mb_get_u16(r);
+		float v;
+
+		if( e.type >= MbType_t::kU32 )
+			w = ( w << 16 ) | mb_get_u16(r + 2);
+		switch( e.type )
+		{
+			case MbType_t::kU16:	v = (float)w; break;
+			case MbType_t::kI16:	v = (float)(int16_t)w; break;
+			case MbType_t::kU32:	v = (float)w; break;
+			case MbType_t::kI32:	v = (float)(int32_t)w; break;
+			default:				memcpy(&v, &w, sizeof(v)); break;
+		}
+		v *= e.scale;
+		if( !isfinite(v) )
+			continue;
+		v = ( v > 32767 ) ? 32767 : ( v < -32768 ) ? -32768 : v;
+
+		_last[i] = (int16_t)lroundf(v);
+		if( e.field >= WSP_NUM_FIELDS ) {					// not weather, straight to the heater loop
+			g_DewHeater.SetSurface(e.field - WSP_NUM_FIELDS, _last[i], now);
+			continue;
+		}
+		_field[e.field] = _last[i];
+		_mask |= 1 << e.field;
+	}
+	_next(now, true);
+}
+
+// poll done or failed: close the device cycle, send the next one, or hand the cycle to the weather path
+void ModbusMaster::_next(uint32_t now, bool ok)
+{
+	const MbPoll_t &p = _map.poll[_cur];
+
+	_dev_failed |= !ok;
+	if(( _cur + 1 >= _map.n_polls ) || ( _map.poll[_cur + 1].dev != p.dev )) {
+		MbDevStats_t &d = _dev[p.dev];
+		d.cycles++;
+		if( !_dev_failed )
+			d.cycle_us.Add(_rx_us - d.t0_us);
+	}
+
+	if( ++_cur < _map.n_polls ) {
+		_send(now);
+		return;
+	}
+
+	_state = kIdle;
+	if( _mask )
+		g_WsLink.Accept(_field, _mask, now);					// same range checks and filters as the station
+}
+
+void ModbusMaster::_sendJson(AsyncWebServerRequest *request)
+{
+	AsyncResponseStream *response = request->beginResponseStream("application/json");
+	const MbMap_t &map = _map;
+
+	response->printf("{\"baud\":%u,\"poll_ms\":%u,\"polls\":%u,\"stale\":%s,\"entries\":[", map.baud, map.poll_ms, map.n_polls,
+		_stale ? "true" : "false");
+	for(uint8_t i = 0; i < map.n_entries; i++) {
+		const MbEntry_t &e = map.entry[i];
+		response->printf("%s{\"num\":%u,\"slave\":%u,\"fc\":%u,\"reg\":%u,\"type\":\"%s\",\"field\":\"%s\",\"value\":%d}",
+			i ? "," : "", e.src + 1, e.slave, e.fc, e.reg, k_type_str[(uint8_t)e.type], k_field_str[e.field], _last[i]);
+	}
+
+	response->print("],\"errors\":[");
+	bool first = true;
+	for(uint8_t i = 0; i < MB_MAX_ENTRIES; i++) {
+		if( _err[i][0] == 0 )
+			continue;
+		response->printf("%s{\"num\":%u,\"src\":\"%s\",\"err\":\"%s\"}", first ? "" : ",", i + 1, _src[i], _err[i]);
+		first = false;
+	}
+
+	response->print("],\"devices\":[");
+	for(uint8_t i = 0; i < map.n_devs; i++) {
+		const MbDevStats_t &d = _dev[i];
+		response->printf("%s{\"slave\":%u,\"cycles\":%u,\"ok\":%u,\"timeouts\":%u,\"bad_frames\":%u,\"exceptions\":%u,\"last_exception\":%u,\"mismatches\":%u,\"cycle_us\":",
+			i ? "," : "", map.dev_slave[i], d.cycles, d.ok, d.timeouts, d.crc_errors, d.exceptions, d.last_exception, d.mismatches);
+		d.cycle_us.PrintJson(*response);
+		response->print("}");
+	}
+	response->print("]}");
+
+	request->send(response);
+}
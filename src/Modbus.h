@@ -0,0 +1,148 @@
+/**************************************************************************************************
+  Filename:       Modbus.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    Modbus RTU master on the RS-485 port, Serial2. Reads a register map from up to
+                  MB_MAX_DEVS slaves every Mb_poll_ms and feeds the values to the weather path,
+                  as if the station had sent them. One map entry per setting Mb_1..Mb_8:
+                      <slave> <fc> <reg> <type> <scale> <field>
+                      2 4 0 u16 0.36 wind           anemometer, 0.1 m/s -> km/h
+                      3 3 0 u16 1 light             pyranometer
+                      4 4 10 i16 1 tsky             cloud sensor, 0.1°C
+                  type u16 | i16 | u32 | i32 | f32 (two registers, high word first), field one of
+                  tsky tair wind hum rain light clouds stars, the value is raw x scale, or heat1
+                  ~ heat4: surface temperature at dew heater PWM n, 0.1°C, for its closed loop.
+                  Entries on the same slave and function are merged into block reads. The UART
+                  drives DE and finds the frame end by its RX timeout, the control tick only
+                  moves whole frames. Settings are in Modbus_Configuration, a section of the
+                  observingconditions device settings that ReadJson() and WriteJson() own.
+**************************************************************************************************/
+#pragma once
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <ArduinoJson.h>
+#include <atomic>
+#include "ModbusRtu.h"
+#include "WsProto.h"
+#include "Histogram.h"
+
+#define MB_MAX_ENTRIES          8
+#define MB_NUM_FIELDS           ( WSP_NUM_FIELDS + 4 )	// weather, then heat1~heat4
+#define MB_MAX_DEVS             8
+#define MB_SRC_LEN              48
+#define MB_ERR_LEN              40
+#define MB_TIMEOUT_MS           200         // response timeout, slaves answer within 100ms
+#define MB_MIN_POLL_MS          200
+#define MB_MAX_POLL_MS          60000
+#define MB_RX_TIMEOUT_SYM       4           // t3.5 frame gap, in UART symbols
+#define MB_URL                  "/modbus"
+#define MB_BUSY                 0xFF        // Compile(): the last map is not taken yet, nothing done
+
+enum struct MbType_t : uint8_t
+{
+	kU16 = 0,
+	kI16,
+	kU32,
+	kI32,
+	kF32
+};
+
+struct MbEntry_t
+{
+	uint8_t slave;
+	uint8_t fc;
+	uint16_t reg;
+	MbType_t type;
+	uint8_t field;							// WsSample_t field, WspField_t order
+	uint8_t src;							// Mb_n - 1
+	float scale;
+};
+
+// one block read, covers entries first..first+n-1
+struct MbPoll_t
+{
+	uint8_t slave;
+	uint8_t fc;
+	uint16_t reg;
+	uint8_t count;
+	uint8_t first;
+	uint8_t n;
+	uint8_t dev;
+};
+
+struct MbMap_t
+{
+	MbEntry_t entry[MB_MAX_ENTRIES];		// sorted by slave, fc, reg
+	uint8_t n_entries;
+	MbPoll_t poll[MB_MAX_ENTRIES];			// device polls are contiguous
+	uint8_t n_polls;
+	uint8_t dev_slave[MB_MAX_DEVS];
+	uint8_t n_devs;
+	uint32_t baud;
+	uint32_t poll_ms;
+};
+
+struct MbDevStats_t
+{
+	uint32_t cycles;
+	uint32_t ok;
+	uint32_t timeouts;
+	uint32_t crc_errors;
+	uint32_t exceptions;					// last code in last_exception
+	uint32_t mismatches;
+	uint8_t last_exception;
+	uint32_t t0_us;							// first request of this cycle
+	Histogram cycle_us;						// first request -> last response, all polls of the device
+};
+
+class ModbusMaster
+{
+private:
+	MbMap_t _map;							// run by the control task
+	MbMap_t _staged;						// compiled by the API task, taken by the next Loop()
+	std::atomic<bool> _staged_ready;		// set by the API task, cleared once the control task copied it
+	MbMap_t _taken;							// taken from _staged, applied when the bus is idle
+	bool _taken_ready;
+	char _src[MB_MAX_ENTRIES][MB_SRC_LEN];
+	char _err[MB_MAX_ENTRIES][MB_ERR_LEN];
+	bool _stale;							// sources changed, not compiled: MB_BUSY
+	uint32_t _baud;
+	uint32_t _poll_ms;
+
+	enum : uint8_t { kIdle, kWait } _state;
+	uint8_t _cur;							// poll in flight
+	bool _dev_failed;						// a poll of the current device failed this cycle
+	uint32_t _cycle_ms;
+	uint32_t _sent_ms;
+	uint8_t _rx[MB_MAX_FRAME];
+	volatile uint32_t _rx_frames;			// UART RX timeouts, bumped by the uart event task
+	volatile uint32_t _rx_us;				// at the last one
+	uint32_t _rx_seen;
+	int16_t _field[WSP_NUM_FIELDS];			// this cycle, merged into the weather sample at its end
+	uint8_t _mask;
+	int16_t _last[MB_MAX_ENTRIES];			// last value per entry
+	MbDevStats_t _dev[MB_MAX_DEVS];
+
+	bool _compileEntry(uint8_t i, const char *src, MbMap_t &map, char *err);
+	void _build(MbMap_t &map);
+	void _send(uint32_t now);
+	void _receive(uint32_t now);
+	void _next(uint32_t now, bool ok);
+	void _sendJson(AsyncWebServerRequest *request);
+
+public:
+	ModbusMaster();
+	void Begin(AsyncWebServer *server);
+	void SetConfig(uint32_t baud, uint32_t poll_ms);
+	void SetSource(uint8_t i, const char *src);
+	const char *GetSource(uint8_t i) { return ( i < MB_MAX_ENTRIES ) ? _src[i] : ""; }
+	uint32_t GetBaud() { return _baud; }
+	uint32_t GetPollMs() { return _poll_ms; }
+	uint8_t Compile();
+	void ReadJson(JsonObject &root);
+	void WriteJson(JsonObject &root);
+	void Loop();
+};
+
+extern ModbusMaster g_Modbus;
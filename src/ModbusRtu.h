@@ -0,0 +1,90 @@
+/**************************************************************************************************
+  Filename:       ModbusRtu.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    Modbus RTU framing for the register reads of the sensor bus, no Arduino
+                  dependency so the slave simulator in tools/ builds it too.
+                      request   slave fc reg_hi reg_lo cnt_hi cnt_lo crc_lo crc_hi
+                      response  slave fc bytes data[bytes] crc_lo crc_hi
+                      exception slave fc|0x80 code crc_lo crc_hi
+                  fc 3 reads holding, fc 4 input registers. Frames are delimited by 3.5
+                  characters of silence, the UART RX timeout does that on the board.
+**************************************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#define MB_FC_HOLDING           3
+#define MB_FC_INPUT             4
+#define MB_MAX_REGS             32          // per request, response is 5 + 2 x 32 bytes
+#define MB_MAX_FRAME            ( 5 + 2 * MB_MAX_REGS )
+#define MB_REQ_LEN              8
+
+enum struct MbResult_t : uint8_t
+{
+	kOk = 0,
+	kShort,									// fewer bytes than the count asks for, or none
+	kCrc,
+	kException,								// code in frame[2]
+	kMismatch								// other slave, function or byte count
+};
+
+// CRC-16/MODBUS, sent low byte first
+inline uint16_t mb_crc16(const uint8_t *p, size_t n)
+{
+	uint16_t crc = 0xFFFF;
+
+	while( n-- ) {
+		crc ^= *p++;
+		for(uint8_t b = 0; b < 8; b++)
+			crc = ( crc & 1 ) ? (uint16_t)(( crc >> 1 ) ^ 0xA001 ) : (uint16_t)( crc >> 1 );
+	}
+	return crc;
+}
+
+inline void mb_put_crc(uint8_t *p, size_t n)
+{
+	uint16_t crc = mb_crc16(p, n);
+	p[n] = (uint8_t)crc;
+	p[n + 1] = (uint8_t)( crc >> 8 );
+}
+
+inline bool mb_crc_ok(const uint8_t *p, size_t n)
+{
+	return ( n >= 4 ) && ( mb_crc16(p, n - 2) == (uint16_t)( p[n - 2] | ( p[n - 1] << 8 )));
+}
+
+// read request into buf, MB_REQ_LEN bytes
+inline size_t mb_read_request(uint8_t *buf, uint8_t slave, uint8_t fc, uint16_t reg, uint16_t count)
+{
+	buf[0] = slave;
+	buf[1] = fc;
+	buf[2] = (uint8_t)( reg >> 8 );
+	buf[3] = (uint8_t)reg;
+	buf[4] = (uint8_t)( count >> 8 );
+	buf[5] = (uint8_t)count;
+	mb_put_crc(buf, 6);
+	return MB_REQ_LEN;
+}
+
+// checks a read response against its request, the registers start at p[3]
+inline MbResult_t mb_check_response(const uint8_t *p, size_t n, uint8_t slave, uint8_t fc, uint16_t count)
+{
+	if( n < 5 )
+		return MbResult_t::kShort;
+	if( !mb_crc_ok(p, n) )
+		return MbResult_t::kCrc;
+	if( p[0] != slave )
+		return MbResult_t::kMismatch;
+	if( p[1] == ( fc | 0x80 ))
+		return MbResult_t::kException;
+	if(( p[1] != fc ) || ( p[2] != count * 2 ))
+		return MbResult_t::kMismatch;
+	if( n != 5u + count * 2 )
+		return MbResult_t::kShort;
+	return MbResult_t::kOk;
+}
+
+inline uint16_t mb_get_u16(const uint8_t *p) { return (uint16_t)(( p[0] << 8 ) | p[1] ); }
+inline void mb_put_u16(uint8_t *p, uint16_t v) { p[0] = (uint8_t)( v >> 8 ); p[1] = (uint8_t)v; }
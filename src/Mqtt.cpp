@@ -0,0 +1,488 @@
+/**************************************************************************************************
+  Filename:       Mqtt.cpp
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    MQTT telemetry and commands implementation
+**************************************************************************************************/
+#include "Mqtt.h"
+#include <WiFi.h>
+#include <PubSubClient.h>
+#include "LogRing.h"
+
+MqttLink g_Mqtt;
+
+static WiFiClient s_net;
+static PubSubClient s_client(s_net);
+static char s_broker[MQTT_HOST_LEN];				// MQTT task copy, the client keeps the pointer
+static uint16_t s_port;
+static char s_prefix[MQTT_PREFIX_LEN];				// MQTT task copy, taken with the broker
+
+const char *const MqttLink::k_dev_str[3] = {"safetymonitor", "switch", "observingconditions"};
+static const char *const k_mqtt_shutter_str[5] = {"Open", "Closed", "Opening", "Closing", "Error"};
+
+MqttLink::MqttLink()
+{
+	_snap = MqttSnap_t();
+	_dirty = 0;
+	memset(_first_ms, 0, sizeof(_first_ms));
+	_head = 0;
+	_count = 0;
+	_count_max = 0;
+	_host[0] = 0;
+	_port = 1883;
+	snprintf(_prefix, sizeof(_prefix), "tsboard");
+	_window_ms = 500;
+	_rate = 20;
+	_reconfig = false;
+	_tokens_x1000 = 0;
+	_tokens_ms = 0;
+	_last_try_ms = 0;
+	_rate_ms = 0;
+	_rate_published = 0;
+	_rate_x10 = 0;
+	_connects = 0;
+	_published = 0;
+	_failed = 0;
+	_dropped = 0;
+	_commands = 0;
+	_rejected = 0;
+	_task = nullptr;
+	_mux = portMUX_INITIALIZER_UNLOCKED;
+}
+
+void MqttLink::Begin(AsyncWebServer *server)
+{
+	g_StateBus.Subscribe(Topic_t::kDomeState, _onDome, this);
+	g_StateBus.Subscribe(Topic_t::kSafety, _onSafety, this);
+	g_StateBus.Subscribe(Topic_t::kSrIn, _onInputs, this);
+	g_StateBus.Subscribe(Topic_t::kSwitchState, _onSwitch, this);
+	g_StateBus.Subscribe(Topic_t::kWeather, _onWeather, this);
+	g_StateBus.Subscribe(Topic_t::kWsLink, _onLink, this);
+
+	s_client.setBufferSize(MQTT_TOPIC_LEN + MQTT_PAYLOAD_LEN + 16);
+	s_client.setSocketTimeout(2);
+	s_client.setCallback([this](char *topic, uint8_t *payload, unsigned int len) { _onMessage(topic, payload, len); });
+
+	server->on(MQTT_URL, HTTP_GET, [this](AsyncWebServerRequest *request) { _sendJson(request); });
+
+	xTaskCreatePinnedToCore(_taskLoop, "mqtt", MQTT_TASK_STACK, this, MQTT_TASK_PRIO, &_task, 0);
+}
+
+// API task. An empty host turns MQTT off
+void MqttLink::SetConfig(const char *host, uint16_t port, const char *prefix, uint32_t window_ms, uint32_t rate)
+{
+	portENTER_CRITICAL(&_mux);
+	snprintf(_host, sizeof(_host), "%s", host);
+	snprintf(_prefix, sizeof(_prefix), "%s", prefix);
+	_port = port;
+	_window_ms = window_ms;
+	_rate = rate;
+	_reconfig = true;
+	portEXIT_CRITICAL(&_mux);
+}
+
+// API task, from the settings of the switch device. As RuleEngine::ReadJson(), settings saved
+// before MQTT had its own section are read from Switch_Configuration
+void MqttLink::ReadJson(JsonObject &root)
+{
+	JsonObject obj_config = root["Mqtt_Configuration"];
+	if( !obj_config )
+		obj_config = root["Switch_Configuration"];
+	if( !obj_config )
+		return;
+
+	uint32_t _mp = obj_config["Mqtt_port"] | GetPort();
+	uint32_t _mw = obj_config["Mqtt_window_ms"] | GetWindow();
+	uint32_t _mr = obj_config["Mqtt_rate"] | GetRate();
+
+	if(( _mp < 1 ) || ( _mp > 65535 ))		// validate
+		_mp = 1883;
+	if( _mw > 60000 )						// coalescing window 0~60s
+		_mw = 500;
+	if(( _mr < 1 ) || ( _mr > 100 ))		// messages/s
+		_mr = 20;
+	SetConfig(obj_config["Mqtt_host"] | GetHost(), (uint16_t)_mp, obj_config["Mqtt_prefix"] | GetPrefix(), _mw, _mr);
+}
+
+void MqttLink::WriteJson(JsonObject &root)
+{
+	JsonObject obj_config = root["Mqtt_Configuration"].to<JsonObject>();
+
+	obj_config["Mqtt_host"] = GetHost();
+	obj_config["Mqtt_port"] = GetPort();
+	obj_config["Mqtt_prefix"] = GetPrefix();
+	obj_config["Mqtt_window_ms"] = GetWindow();
+	obj_config["Mqtt_rate"] = GetRate();
+}
+
+// control task, bus handlers. Call with _mux held
+void MqttLink::_mark(uint8_t dev)
+{
+	if(( _dirty & ( 1u << dev )) == 0 ) {
+		_dirty |= 1u << dev;
+		_first_ms[dev] = millis();
+	}
+}
+
+void MqttLink::_onDome(const BusEvent_t &ev, void *ctx)
+{
+	MqttLink *self = (MqttLink *)ctx;
+
+	if( ev.dome.num >= k_num_of_domes )
+		return;
+	portENTER_CRITICAL(&self->_mux);
+	self->_snap.dome[ev.dome.num] = ev.dome;
+	self->_mark(ev.dome.num);
+	portEXIT_CRITICAL(&self->_mux);
+}
+
+void MqttLink::_onSafety(const BusEvent_t &ev, void *ctx)
+{
+	MqttLink *self = (MqttLink *)ctx;
+
+	portENTER_CRITICAL(&self->_mux);
+	self->_snap.safety = ev.safety;
+	self->_mark(k_mqtt_dev_safety);
+	portEXIT_CRITICAL(&self->_mux);
+}
+
+void MqttLink::_onInputs(const BusEvent_t &ev, void *ctx)
+{
+	MqttLink *self = (MqttLink *)ctx;
+
+	portENTER_CRITICAL(&self->_mux);
+	self->_snap.in = ev.in;
+	self->_mark(k_mqtt_dev_switch);
+	portEXIT_CRITICAL(&self->_mux);
+}
+
+void MqttLink::_onSwitch(const BusEvent_t &ev, void *ctx)
+{
+	MqttLink *self = (MqttLink *)ctx;
+
+	portENTER_CRITICAL(&self->_mux);
+	self->_snap.sw = ev.sw_state;
+	self->_mark(k_mqtt_dev_switch);
+	portEXIT_CRITICAL(&self->_mux);
+}
+
+void MqttLink::_onWeather(const BusEvent_t &ev, void *ctx)
+{
+	MqttLink *self = (MqttLink *)ctx;
+
+	portENTER_CRITICAL(&self->_mux);
+	self->_snap.ws = ev.ws;
+	self->_mark(k_mqtt_dev_weather);
+	portEXIT_CRITICAL(&self->_mux);
+}
+
+void MqttLink::_onLink(const BusEvent_t &ev, void *ctx)
+{
+	MqttLink *self = (MqttLink *)ctx;
+
+	portENTER_CRITICAL(&self->_mux);
+	self->_snap.link = ev.link;
+	self->_mark(k_mqtt_dev_weather);
+	portEXIT_CRITICAL(&self->_mux);
+}
+
+void MqttLink::_taskLoop(void *arg)
+{
+	MqttLink *self = (MqttLink *)arg;
+
+	for(;;) {
+		self->_step();
+		vTaskDelay(pdMS_TO_TICKS(MQTT_POLL_MS));
+	}
+}
+
+void MqttLink::_step()
+{
+	uint32_t now = millis();
+
+	if( _reconfig ) {
+		portENTER_CRITICAL(&_mux);
+		memcpy(s_broker, _host, sizeof(s_broker));
+		memcpy(s_prefix, _prefix, sizeof(s_prefix));
+		s_port = _port;
+		_reconfig = false;
+		portEXIT_CRITICAL(&_mux);
+
+		if( s_client.connected() )
+			s_client.disconnect();
+		if( s_broker[0] )
+			s_client.setServer(s_broker, s_port);
+		_last_try_ms = now - MQTT_RETRY_MS;
+		RLOG_INFO_PRINTF("MQTT broker %s:%u\n", s_broker[0] ? s_broker : "-", s_port);
+	}
+
+	if( s_broker[0] == 0 )
+		return;
+
+	_collect(now);									// queues while the broker is away too
+
+	if( !s_client.connected() ) {
+		if(( now - _last_try_ms ) >= MQTT_RETRY_MS ) {
+			_last_try_ms = now;
+			_connect(now);
+		}
+	} else {
+		s_client.loop();							// commands arrive here
+		_drain(now);
+	}
+
+	if(( now - _rate_ms ) >= MQTT_RATE_WINDOW_MS ) {
+		_rate_x10 = (( _published - _rate_published ) * 10000 ) / ( now - _rate_ms );
+		_rate_published = _published;
+		_rate_ms = now;
+	}
+}
+
+// close the windows that are due: one message per source with its latest state
+void MqttLink::_collect(uint32_t now)
+{
+	MqttSnap_t snap;
+	uint32_t due = 0;
+
+	portENTER_CRITICAL(&_mux);
+	for(uint8_t d = 0; d < k_mqtt_num_dev; d++)
+		if(( _dirty & ( 1u << d )) && (( now - _first_ms[d] ) >= _window_ms ))
+			due |= 1u << d;
+	if( due ) {
+		_dirty &= ~due;
+		snap = _snap;
+	}
+	portEXIT_CRITICAL(&_mux);
+
+	for(uint8_t d = 0; due && ( d < k_mqtt_num_dev ); d++) {
+		if( due & ( 1u << d )) {
+			MqttMsg_t m;
+			_format(d, snap, m);
+			m.ms = now;
+			_enqueue(m);
+		}
+	}
+}
+
+void MqttLink::_format(uint8_t dev, const MqttSnap_t &s, MqttMsg_t &m)
+{
+	char *p = m.payload;
+	size_t left = sizeof(m.payload);
+	int n;
+
+	#define MQTT_CAT(...)	do { n = snprintf(p, left, __VA_ARGS__); if(( n > 0 ) && ((size_t)n < left )) { p += n; left -= n; } } while(0)
+
+	if( dev < k_num_of_domes ) {
+		const DomeState_t &d = s.dome[dev];
+		snprintf(m.topic, sizeof(m.topic), "%s/dome/%u/state", s_prefix, dev);
+		MQTT_CAT("{\"shutter\":\"%s\",\"slewing\":%s}", ( d.shutter < 5 ) ? k_mqtt_shutter_str[d.shutter] : "Error", d.slewing ? "true" : "false");
+		return;
+	}
+
+	snprintf(m.topic, sizeof(m.topic), "%s/%s/0/state", s_prefix, k_dev_str[dev - k_num_of_domes]);
+
+	if( dev == k_mqtt_dev_safety ) {
+		MQTT_CAT("{\"safe\":%s,\"unsafe_bits\":%u}", s.safety ? "false" : "true", s.safety);
+	} else if( dev == k_mqtt_dev_switch ) {
+		bool in[k_num_sw_in];
+		ch_unpack_sw_in(s.in, in);
+
+		MQTT_CAT("{\"in\":[");
+		for(size_t i = 0; i < k_num_sw_in; i++)
+			MQTT_CAT("%s%u", i ? "," : "", in[i]);
+		MQTT_CAT("],\"out\":[");
+		for(size_t i = 0; i < k_num_sw_out; i++)
+			MQTT_CAT("%s%u", i ? "," : "", s.sw.out.test(i) ? 1 : 0);
+		MQTT_CAT("],\"pwm\":[");
+		for(size_t i = 0; i < k_num_sw_pwm; i++)
+			MQTT_CAT("%s%u", i ? "," : "", s.sw.pwm[i]);
+		MQTT_CAT("],\"heat_auto\":[");
+		for(size_t i = 0; i < k_num_sw_heat; i++)
+			MQTT_CAT("%s%u", i ? "," : "", ( s.sw.heat_auto >> i ) & 1);
+		MQTT_CAT("],\"heat_duty\":[");
+		for(size_t i = 0; i < k_num_sw_heat; i++)
+			MQTT_CAT("%s%u", i ? "," : "", s.sw.heat_duty[i]);
+		MQTT_CAT("]}");
+	} else {
+		const WsSample_t &w = s.ws;							// -1 = not reported, sent as null
+		const int16_t v[8] = {w.tsky, w.tair, w.wind, w.hum, w.rain, w.light, w.clouds, w.stars};
+		static const char *const k_name[8] = {"tsky", "tair", "wind", "hum", "rain", "light", "clouds", "stars"};
+
+		MQTT_CAT("{\"link\":%s", s.link ? "true" : "false");
+		for(uint8_t i = 0; i < 8; i++) {
+			if( v[i] == -1 )
+				MQTT_CAT(",\"%s\":null", k_name[i]);
+			else if( i < 2 )								// 0.1C
+				MQTT_CAT(",\"%s\":%s%d.%d", k_name[i], ( v[i] < 0 ) ? "-" : "", abs(v[i]) / 10, abs(v[i]) % 10);
+			else
+				MQTT_CAT(",\"%s\":%d", k_name[i], v[i]);
+		}
+		MQTT_CAT("}");
+	}
+	#undef MQTT_CAT
+}
+
+// MQTT task only. Full: the oldest message goes
+void MqttLink::_enqueue(const MqttMsg_t &m)
+{
+	if( _count >= MQTT_QUEUE ) {
+		_head = ( _head + 1 ) % MQTT_QUEUE;
+		_count--;
+		_dropped++;
+	}
+	_queue[( _head + _count ) % MQTT_QUEUE] = m;
+	_count++;
+	if( _count > _count_max )
+		_count_max = _count;
+}
+
+void MqttLink::_connect(uint32_t now)
+{
+	char id[32];
+	char status[MQTT_TOPIC_LEN];
+	char sub[MQTT_TOPIC_LEN];
+
+	snprintf(id, sizeof(id), "%s-%08x", s_prefix, (uint32_t)ESP.getEfuseMac());
+	snprintf(status, sizeof(status), "%s/status", s_prefix);
+
+	if( !s_client.connect(id, nullptr, nullptr, status, 0, true, "offline") ) {
+		RLOG_DEBUG_PRINTF("MQTT connect failed, state %d\n", s_client.state());
+		return;
+	}
+
+	_connects++;
+	s_client.publish(status, "online", true);
+	snprintf(sub, sizeof(sub), "%s/dome/+/set", s_prefix);
+	s_client.subscribe(sub);
+	snprintf(sub, sizeof(sub), "%s/switch/0/set/+", s_prefix);
+	s_client.subscribe(sub);
+
+	portENTER_CRITICAL(&_mux);						// refresh every retained state
+	for(uint8_t d = 0; d < k_mqtt_num_dev; d++)
+		_mark(d);
+	portEXIT_CRITICAL(&_mux);
+
+	_tokens_ms = now;
+	RLOG_INFO_PRINTF("MQTT connected to %s:%u\n", s_broker, s_port);
+}
+
+// token bucket, one second of burst
+void MqttLink::_drain(uint32_t now)
+{
+	_tokens_x1000 += ( now - _tokens_ms ) * _rate;
+	if( _tokens_x1000 > _rate * 1000 )
+		_tokens_x1000 = _rate * 1000;
+	_tokens_ms = now;
+
+	while(( _count > 0 ) && ( _tokens_x1000 >= 1000 )) {
+		const MqttMsg_t &m = _queue[_head];
+
+		if( !s_client.publish(m.topic, m.payload, true) ) {
+			_failed++;
+			break;
+		}
+		_wait_ms.Add(now - m.ms);
+		_published++;
+		_tokens_x1000 -= 1000;
+		_head = ( _head + 1 ) % MQTT_QUEUE;
+		_count--;
+	}
+}
+
+// MQTT task, from s_client.loop(). Device numbers and switch IDs are plain decimal digits. A
+// command the bus queue has no room for is refused like a bad one, counted and logged
+void MqttLink::_onMessage(char *topic, uint8_t *payload, unsigned int len)
+{
+	size_t np = strlen(s_prefix);
+	char val[16];
+	char *end;
+
+	len = ( len < sizeof(val) - 1 ) ? len : sizeof(val) - 1;
+	memcpy(val, payload, len);
+	val[len] = 0;
+	_commands++;
+
+	if(( strncmp(topic, s_prefix, np) != 0 ) || ( topic[np] != '/' )) {
+		_rejected++;
+		return;
+	}
+	topic += np + 1;
+
+	if( strncmp(topic, "dome/", 5) == 0 ) {
+		uint32_t num = isdigit((uint8_t)topic[5]) ? strtoul(topic + 5, &end, 10) : UINT32_MAX;
+		BusEvent_t ev(Topic_t::kDomeCmd);
+
+		if(( num >= k_num_of_domes ) || ( strcmp(end, "/set") != 0 )) {
+			_rejected++;
+			return;
+		}
+		ev.dome_cmd.num = (uint8_t)num;
+
+		if( strcasecmp(val, "open") == 0 )
+			ev.dome_cmd.cmd = DomeCmdKind_t::kOpen;
+		else if( strcasecmp(val, "close") == 0 )
+			ev.dome_cmd.cmd = DomeCmdKind_t::kClose;
+		else if( strcasecmp(val, "abort") == 0 )
+			ev.dome_cmd.cmd = DomeCmdKind_t::kAbort;
+		else {
+			_rejected++;
+			return;
+		}
+		if( !g_StateBus.Publish(ev) ) {				// applied by the dome as the Alpaca PUT
+			_rejected++;
+			RLOG_WARNING_PRINTF("WARNING. MQTT dome %u %s refused, bus queue full\n", num, val);
+		}
+		return;
+	}
+
+	if( strncmp(topic, "switch/0/set/", 13) == 0 ) {
+		uint32_t id = isdigit((uint8_t)topic[13]) ? strtoul(topic + 13, &end, 10) : UINT32_MAX;
+		double value;
+
+		if(( id >= k_num_of_switch_devices ) || ( *end != 0 )) {
+			_rejected++;
+			return;
+		}
+
+		if(( strcasecmp(val, "on") == 0 ) || ( strcasecmp(val, "true") == 0 )) {
+			value = ch_switch_max(k_channels[k_switch_ch[id]].kind);
+		} else if(( strcasecmp(val, "off") == 0 ) || ( strcasecmp(val, "false") == 0 )) {
+			value = 0;
+		} else {
+			value = strtod(val, &end);
+			if(( end == val ) || ( *end != 0 ))
+				value = -1;
+		}
+
+		if( ch_switch_check(id, value) != ChWrite_t::kOk ) {	// as Switch::_writeSwitchValue
+			_rejected++;
+			return;
+		}
+
+		BusEvent_t ev(Topic_t::kSwitchWrite);
+		ev.sw.id = (uint16_t)id;
+		ev.sw.value = (uint16_t)value;
+		if( !g_StateBus.Publish(ev) ) {
+			_rejected++;
+			RLOG_WARNING_PRINTF("WARNING. MQTT switch %u = %s refused, bus queue full\n", id, val);
+		}
+		return;
+	}
+
+	_rejected++;
+}
+
+void MqttLink::_sendJson(AsyncWebServerRequest *request)
+{
+	AsyncResponseStream *response = request->beginResponseStream("application/json");
+
+	response->printf("{\"host\":\"%s\",\"port\":%u,\"prefix\":\"%s\",\"window_ms\":%u,\"rate_limit\":%u,\"connected\":%s,\"connects\":%u,",
+		_host, _port, _prefix, _window_ms, _rate, s_client.connected() ? "true" : "false", _connects);
+	response->printf("\"published\":%u,\"rate_per_s\":%u.%u,\"failed\":%u,\"queue\":%u,\"queue_max\":%u,\"queue_size\":%u,\"dropped\":%u,\"commands\":%u,\"rejected\":%u,\"wait_ms\":",
+		_published, _rate_x10 / 10, _rate_x10 % 10, _failed, _count, _count_max, MQTT_QUEUE, _dropped, _commands, _rejected);
+	_wait_ms.PrintJson(*response);
+	response->print("}");
+
+	request->send(response);
+}
@@ -0,0 +1,133 @@
+/**************************************************************************************************
+  Filename:       Mqtt.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    MQTT telemetry and commands. Device state comes from the state bus; changes
+                  within Mqtt_window_ms are coalesced into one retained JSON message per device:
+                      <prefix>/dome/<n>/state, <prefix>/safetymonitor/0/state,
+                      <prefix>/switch/0/state, <prefix>/observingconditions/0/state
+                  Messages wait in a bounded RAM queue while the broker is unreachable and are
+                  sent at Mqtt_rate messages/s at most. Commands:
+                      <prefix>/dome/<n>/set          open | close | abort
+                      <prefix>/switch/0/set/<id>     0~100 | on | off
+                  go to the devices by the bus, as the Alpaca PUTs do. Runs in its own task,
+                  a broker that doesn't answer never stalls the control tick or the web server.
+                  Settings are in Mqtt_Configuration, a section of the switch device settings
+                  that ReadJson() and WriteJson() own.
+**************************************************************************************************/
+#pragma once
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <ArduinoJson.h>
+#include "ChannelMap.h"
+#include "StateBus.h"
+#include "Histogram.h"
+
+#define MQTT_QUEUE              16          // messages held while the broker is away
+#define MQTT_TOPIC_LEN          64
+#define MQTT_PAYLOAD_LEN        256
+#define MQTT_HOST_LEN           48
+#define MQTT_PREFIX_LEN         24
+#define MQTT_POLL_MS            20
+#define MQTT_RETRY_MS           5000        // between connect attempts
+#define MQTT_RATE_WINDOW_MS     10000       // publish rate measured over this
+#define MQTT_TASK_STACK         4096
+#define MQTT_TASK_PRIO          1
+#define MQTT_URL                "/mqtt"
+
+// telemetry sources, one message each
+constexpr uint8_t k_mqtt_dev_safety = k_num_of_domes;
+constexpr uint8_t k_mqtt_dev_switch = k_num_of_domes + 1;
+constexpr uint8_t k_mqtt_dev_weather = k_num_of_domes + 2;
+constexpr uint8_t k_mqtt_num_dev = k_num_of_domes + 3;
+
+// latest state, written by the bus handlers, read when a window closes
+struct MqttSnap_t
+{
+	DomeState_t dome[k_num_of_domes];
+	uint8_t safety;
+	SrIn_t in;
+	SwitchState_t sw;
+	WsSample_t ws;
+	bool link;
+};
+
+struct MqttMsg_t
+{
+	char topic[MQTT_TOPIC_LEN];
+	char payload[MQTT_PAYLOAD_LEN];
+	uint32_t ms;							// queued at
+};
+
+class MqttLink
+{
+private:
+	MqttSnap_t _snap;
+	uint32_t _dirty;						// bit per source, changed and not queued yet
+	uint32_t _first_ms[k_mqtt_num_dev];		// first change of the open window
+
+	MqttMsg_t _queue[MQTT_QUEUE];
+	uint8_t _head;
+	uint8_t _count;
+	uint8_t _count_max;
+
+	char _host[MQTT_HOST_LEN];
+	uint16_t _port;
+	char _prefix[MQTT_PREFIX_LEN];
+	uint32_t _window_ms;
+	uint32_t _rate;							// messages/s
+	volatile bool _reconfig;
+
+	uint32_t _tokens_x1000;					// publish token bucket, 1000 = one message
+	uint32_t _tokens_ms;
+	uint32_t _last_try_ms;
+	uint32_t _rate_ms;
+	uint32_t _rate_published;
+	uint32_t _rate_x10;						// measured messages/s x10
+
+	uint32_t _connects;
+	uint32_t _published;
+	uint32_t _failed;						// publish refused by the client, retried
+	uint32_t _dropped;						// oldest dropped, queue full
+	uint32_t _commands;
+	uint32_t _rejected;						// commands with a bad topic or value, or no room on the bus
+	Histogram _wait_ms;						// queued -> published
+	TaskHandle_t _task;
+	portMUX_TYPE _mux;
+
+	static const char *const k_dev_str[3];
+
+	void _mark(uint8_t dev);
+	void _collect(uint32_t now);
+	void _format(uint8_t dev, const MqttSnap_t &s, MqttMsg_t &m);
+	void _enqueue(const MqttMsg_t &m);
+	void _connect(uint32_t now);
+	void _drain(uint32_t now);
+	void _onMessage(char *topic, uint8_t *payload, unsigned int len);
+	void _step();
+	void _sendJson(AsyncWebServerRequest *request);
+
+	static void _taskLoop(void *arg);
+	static void _onDome(const BusEvent_t &ev, void *ctx);
+	static void _onSafety(const BusEvent_t &ev, void *ctx);
+	static void _onInputs(const BusEvent_t &ev, void *ctx);
+	static void _onSwitch(const BusEvent_t &ev, void *ctx);
+	static void _onWeather(const BusEvent_t &ev, void *ctx);
+	static void _onLink(const BusEvent_t &ev, void *ctx);
+
+public:
+	MqttLink();
+	void Begin(AsyncWebServer *server);
+	void SetConfig(const char *host, uint16_t port, const char *prefix, uint32_t window_ms, uint32_t rate);
+	void ReadJson(JsonObject &root);
+	void WriteJson(JsonObject &root);
+	const char *GetHost() { return _host; }
+	uint16_t GetPort() { return _port; }
+	const char *GetPrefix() { return _prefix; }
+	uint32_t GetWindow() { return _window_ms; }
+	uint32_t GetRate() { return _rate; }
+	TaskHandle_t GetTask() { return _task; }
+};
+
+extern MqttLink g_Mqtt;
@@ -0,0 +1,284 @@
+/**************************************************************************************************
+  Filename:       ObservingConditions.cpp
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+  Description:    Device Alpaca ObservingConditions implementation
+**************************************************************************************************/
+#include "ObservingConditions.h"
+#include "WeatherMath.h"
+#include "LogRing.h"
+#include "HeapMonitor.h"
+#include "WsLink.h"
+#include "Modbus.h"
+
+ObservingConditions::ObservingConditions() : AlpacaObservingConditions(),
+	_tsky(60000), _tair(60000), _hum(60000), _wind(60000), _light(60000), _gust(OC_GUST_BUCKET_MS)
+{
+	// constructor
+	_period_min = 0;
+	_period_min_new = 0;
+	_period_changed = false;
+	_cfg.Reset({-250, -50});
+	_last_frame = 0;
+	_ws_link = false;
+}
+
+void ObservingConditions::Begin()
+{
+	AlpacaObservingConditions::Begin();
+
+	g_StateBus.Subscribe(Topic_t::kWeather, _onWeather, this);
+	g_StateBus.Subscribe(Topic_t::kWsLink, _onLink, this);
+}
+
+// each weather station frame goes to the running averages
+void ObservingConditions::_onWeather(const BusEvent_t &ev, void *ctx)
+{
+	ObservingConditions *self = (ObservingConditions *)ctx;
+	uint32_t now = millis();
+
+	self->_ws = ev.ws;
+	self->_last_frame = now ? now : 1;
+	self->_tsky.Add(ev.ws.tsky, now);
+	self->_tair.Add(ev.ws.tair, now);
+	self->_hum.Add(ev.ws.hum, now);
+	self->_wind.Add(ev.ws.wind, now);
+	self->_light.Add(ev.ws.light, now);
+	self->_gust.Add(ev.ws.wind, now);
+}
+
+void ObservingConditions::_onLink(const BusEvent_t &ev, void *ctx)
+{
+	((ObservingConditions *)ctx)->_ws_link = ev.link;
+}
+
+// runs in the control tick: applies a new period and closes the buckets of a silent station
+void ObservingConditions::Loop()
+{
+	uint32_t now = millis();
+
+	if( _period_changed ) {
+		_period_changed = false;
+		_applyPeriod(_period_min_new, now);
+	}
+
+	_tsky.Update(now);
+	_tair.Update(now);
+	_hum.Update(now);
+	_wind.Update(now);
+	_light.Update(now);
+	_gust.Update(now);
+}
+
+// averages restart empty on a new period, until then the latest sample is reported
+void ObservingConditions::_applyPeriod(uint32_t period_min, uint32_t now)
+{
+	uint32_t bucket_ms = ( period_min ? period_min : 1 ) * 60000 / OC_AVG_BUCKETS;
+
+	_period_min = period_min;
+	_tsky.SetBucketMs(bucket_ms, now);
+	_tair.SetBucketMs(bucket_ms, now);
+	_hum.SetBucketMs(bucket_ms, now);
+	_wind.SetBucketMs(bucket_ms, now);
+	_light.SetBucketMs(bucket_ms, now);
+	RLOG_INFO_PRINTF("ObservingConditions average period %u min\n", period_min);
+}
+
+int16_t ObservingConditions::_avg(const WindowStats<OC_AVG_BUCKETS> &w, int16_t latest)
+{
+	if(( _period_min == 0 ) || ( w.Count() == 0 ))
+		return latest;
+
+	float m = w.Mean();
+	return (int16_t)(( m < 0 ) ? m - 0.5f : m + 0.5f );
+}
+
+const bool ObservingConditions::_putAveragePeriod(double period)
+{
+	if(( period < 0 ) || ( period > OC_MAX_AVG_PERIOD ))
+		return false;
+
+	_period_min_new = (uint32_t)( period * 60 + 0.5 );
+	_period_changed = true;
+	return true;
+}
+
+const double ObservingConditions::_getAveragePeriod()
+{
+	return (double)( _period_changed ? _period_min_new : _period_min ) / 60;
+}
+
+const bool ObservingConditions::_refresh()
+{
+	return true;								// the station pushes frames, nothing to poll
+}
+
+// station value when it reports one, else derived from the sky - air delta
+const bool ObservingConditions::_getCloudCover(double &value)
+{
+	const OcConfig_t &cfg = _cfg.Get();
+
+	if( !_ws_link )
+		return false;
+
+	if( _ws.clouds >= 0 )
+		value = _ws.clouds;
+	else
+		value = wm_cloud_cover(_avg(_tsky, _ws.tsky), _avg(_tair, _ws.tair), cfg.clear_delta, cfg.cloudy_delta);
+	return true;
+}
+
+const bool ObservingConditions::_getDewPoint(double &value)
+{
+	if( !_ws_link )
+		return false;
+
+	value = (double)wm_dew_point(_avg(_tair, _ws.tair), _avg(_hum, _ws.hum)) / 10;
+	return true;
+}
+
+const bool ObservingConditions::_getHumidity(double &value)
+{
+	if( !_ws_link )
+		return false;
+
+	value = _avg(_hum, _ws.hum);
+	return true;
+}
+
+const bool ObservingConditions::_getPressure(double &value) { return false; }
+const bool ObservingConditions::_getRainRate(double &value) { return false; }		// station reports rain yes/no only
+
+const bool ObservingConditions::_getSkyBrightness(double &value)
+{
+	if( !_ws_link )
+		return false;
+
+	value = _avg(_light, _ws.light);
+	return true;
+}
+
+const bool ObservingConditions::_getSkyQuality(double &value) { return false; }
+
+const bool ObservingConditions::_getSkyTemperature(double &value)
+{
+	if( !_ws_link )
+		return false;
+
+	value = (double)_avg(_tsky, _ws.tsky) / 10;
+	return true;
+}
+
+const bool ObservingConditions::_getStarFWHM(double &value) { return false; }
+
+const bool ObservingConditions::_getTemperature(double &value)
+{
+	if( !_ws_link )
+		return false;
+
+	value = (double)_avg(_tair, _ws.tair) / 10;
+	return true;
+}
+
+const bool ObservingConditions::_getWindDirection(double &value) { return false; }
+
+// peak over the last 2 minutes, m/s
+const bool ObservingConditions::_getWindGust(double &value)
+{
+	if( !_ws_link )
+		return false;
+
+	value = ( _gust.Count() ? _gust.Max() : _ws.wind ) / 3.6;
+	return true;
+}
+
+// m/s
+const bool ObservingConditions::_getWindSpeed(double &value)
+{
+	if( !_ws_link )
+		return false;
+
+	value = _avg(_wind, _ws.wind) / 3.6;
+	return true;
+}
+
+const char *ObservingConditions::_getSensorDescription(const char *sensor)
+{
+	static const char *const k_sensor_desc[][2] = {
+		{"cloudcover", "Weather station cloud sensor or sky-air temperature delta"},
+		{"dewpoint", "Derived from air temperature and humidity"},
+		{"humidity", "Weather station humidity"},
+		{"skybrightness", "Weather station ambient light"},
+		{"skytemperature", "Weather station IR sky temperature"},
+		{"temperature", "Weather station air temperature"},
+		{"windgust", "Peak wind speed over 2 minutes"},
+		{"windspeed", "Weather station wind speed"}
+	};
+
+	for(const auto &d : k_sensor_desc)
+		if( strcasecmp(sensor, d[0]) == 0 )
+			return d[1];
+
+	return nullptr;								// not implemented
+}
+
+const double ObservingConditions::_getTimeSinceLastUpdate(const char *sensor)
+{
+	if( _last_frame == 0 )
+		return -1;
+
+	return (double)( millis() - _last_frame ) / 1000;
+}
+
+// read settings from flash
+void ObservingConditions::AlpacaReadJson(JsonObject &root)
+{
+	HEAP_SITE("ObservingConditions::AlpacaReadJson");
+	DBG_JSON_PRINTFJ(SLOG_NOTICE, root, "OBSCOND READ BEGIN (root=<%s>) ...\n", _ser_json_);
+	AlpacaObservingConditions::AlpacaReadJson(root);
+	g_WsLink.ReadJson(root);					// own sections, hosted by this device
+	g_Modbus.ReadJson(root);
+
+	if (JsonObject obj_config = root["ObservingConditions_Configuration"]) {
+		uint32_t _ap = obj_config["Average_period_min"] | _period_min;
+		OcConfig_t cfg = _cfg.Get();
+		int32_t _cl = obj_config["Clear_sky_delta"] | cfg.clear_delta;
+		int32_t _cd = obj_config["Cloudy_sky_delta"] | cfg.cloudy_delta;
+
+		if( _ap > OC_MAX_AVG_PERIOD * 60 )		// validate 0~24h
+			_ap = 0;
+
+		if(( _cl < -500 ) || ( _cd > 100 ) || ( _cl >= _cd )) {		// validate -50C~10C, clear below cloudy
+			_cl = -250;
+			_cd = -50;
+		}
+
+		cfg.clear_delta = (int16_t)_cl;
+		cfg.cloudy_delta = (int16_t)_cd;
+		_cfg.Publish(cfg);
+		_period_min_new = _ap;
+		_period_changed = true;
+
+		SLOG_PRINTF(SLOG_INFO, "...OBSCOND READ END _period_min=%u _clear_delta=%i _cloudy_delta=%i ws_binary=%u ws_baud=%u\n", _ap, cfg.clear_delta, cfg.cloudy_delta,
+			g_WsLink.GetBinary(), g_WsLink.GetBaud());
+	} else {
+		SLOG_PRINTF(SLOG_WARNING, "...OBSCOND READ END no configuration\n");
+	}
+}
+
+// persist settings to flash
+void ObservingConditions::AlpacaWriteJson(JsonObject &root)
+{
+	HEAP_SITE("ObservingConditions::AlpacaWriteJson");
+	SLOG_PRINTF(SLOG_NOTICE, "OBSCOND WRITE BEGIN ...\n");
+	AlpacaObservingConditions::AlpacaWriteJson(root);
+
+	JsonObject obj_config = root["ObservingConditions_Configuration"].to<JsonObject>();
+	obj_config["Average_period_min"] = _period_changed ? _period_min_new : _period_min;
+	obj_config["Clear_sky_delta"] = _cfg.Get().clear_delta;
+	obj_config["Cloudy_sky_delta"] = _cfg.Get().cloudy_delta;
+	g_WsLink.WriteJson(root);
+	g_Modbus.WriteJson(root);
+
+	DBG_JSON_PRINTFJ(SLOG_NOTICE, root, "...OBSCOND WRITE END root=<%s>\n", _ser_json_);
+}
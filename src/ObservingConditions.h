@@ -0,0 +1,69 @@
+/**************************************************************************************************
+  Filename:       ObservingConditions.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+  Description:    Device Alpaca ObservingConditions, fed by the weather station
+**************************************************************************************************/
+#pragma once
+#include "AlpacaObservingConditions.h"
+#include "WindowStats.h"
+#include "StateBus.h"
+#include "ConfigSlot.h"
+
+#define OC_AVG_BUCKETS          12          // averages over averageperiod, in 12 buckets
+#define OC_MAX_AVG_PERIOD       24          // hours
+#define OC_GUST_BUCKETS         12          // wind gust = peak over 12 * 10s = 2 minutes
+#define OC_GUST_BUCKET_MS       10000
+
+// cloud cover model, swapped whole by AlpacaReadJson
+struct OcConfig_t
+{
+	int16_t clear_delta, cloudy_delta;		// sky - air at 0% and 100% cloud cover, 0.1C
+};
+
+class ObservingConditions : public AlpacaObservingConditions
+{
+private:
+	uint32_t _period_min;					// averageperiod, 0 = latest sample
+	volatile uint32_t _period_min_new;		// set by the API task, applied by Loop()
+	volatile bool _period_changed;
+	ConfigSlot<OcConfig_t> _cfg;
+	uint32_t _last_frame;					// millis() of the last frame added, 0 = none yet
+	bool _ws_link;							// from kWsLink
+	WsSample_t _ws;							// latest frame, from kWeather
+
+	WindowStats<OC_AVG_BUCKETS> _tsky, _tair, _hum, _wind, _light;
+	WindowStats<OC_GUST_BUCKETS> _gust;
+
+	int16_t _avg(const WindowStats<OC_AVG_BUCKETS> &w, int16_t latest);
+	void _applyPeriod(uint32_t period_min, uint32_t now);
+	static void _onWeather(const BusEvent_t &ev, void *ctx);
+	static void _onLink(const BusEvent_t &ev, void *ctx);
+
+	const bool _putAveragePeriod(double period);
+	const double _getAveragePeriod();
+	const bool _refresh();
+	const bool _getCloudCover(double &value);
+	const bool _getDewPoint(double &value);
+	const bool _getHumidity(double &value);
+	const bool _getPressure(double &value);
+	const bool _getRainRate(double &value);
+	const bool _getSkyBrightness(double &value);
+	const bool _getSkyQuality(double &value);
+	const bool _getSkyTemperature(double &value);
+	const bool _getStarFWHM(double &value);
+	const bool _getTemperature(double &value);
+	const bool _getWindDirection(double &value);
+	const bool _getWindGust(double &value);
+	const bool _getWindSpeed(double &value);
+	const char *_getSensorDescription(const char *sensor);
+	const double _getTimeSinceLastUpdate(const char *sensor);
+
+	void AlpacaReadJson(JsonObject &root);
+	void AlpacaWriteJson(JsonObject &root);
+
+public:
+	ObservingConditions();
+	void Begin();
+	void Loop();
+};
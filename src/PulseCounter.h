@@ -0,0 +1,169 @@
+/**************************************************************************************************
+  Filename:       PulseCounter.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    roof encoder: pulse counter HAL and the position, speed and stall tracking on
+                  top of it, no Arduino dependency so tools/enc_sim builds it with SimCounter.
+                  The counter is read once per control tick, edges are counted by the hardware.
+                  Like the ESP32 PCNT the counter goes back to 0 when it reaches +-Limit(), the
+                  tracker unwraps that. A single-channel pulse input only counts up, the tracker
+                  takes the direction from the relay that drives the motor.
+**************************************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#define ENC_POS_FULL            1000        // permille open
+#define ENC_SPEED_SHIFT         2           // speed EMA weight 1/4
+#define ENC_END_BAND            20          // permille, a stall this close to the end it drives to is its stop
+
+// hardware counter
+class PulseCounter
+{
+public:
+	virtual ~PulseCounter() {}
+	virtual bool Begin() = 0;
+	virtual int16_t Read() = 0;				// raw count
+	virtual int16_t Limit() const = 0;		// the count goes back to 0 at +-Limit()
+	virtual bool Quadrature() const = 0;	// true: signed counts, false: up only
+};
+
+// counter for the host, driven by the test
+class SimCounter : public PulseCounter
+{
+private:
+	int16_t _count;
+	int16_t _limit;
+	bool _quad;
+
+public:
+	SimCounter(int16_t limit = 32000, bool quad = false) : _count(0), _limit(limit), _quad(quad) {}
+	bool Begin() override { _count = 0; return true; }
+	int16_t Read() override { return _count; }
+	int16_t Limit() const override { return _limit; }
+	bool Quadrature() const override { return _quad; }
+
+	void Pulse(int32_t n)					// n edges, negative down on a quadrature counter
+	{
+		int32_t c = _count;
+
+		if( !_quad && ( n < 0 ))
+			n = -n;
+		while( n != 0 ) {
+			c += ( n > 0 ) ? 1 : -1;
+			n += ( n > 0 ) ? -1 : 1;
+			if(( c >= _limit ) || ( c <= -_limit ))
+				c = 0;
+		}
+		_count = (int16_t)c;
+	}
+};
+
+struct EncState_t
+{
+	int32_t pos;							// counts from closed
+	int32_t speed;							// counts/s, + opening
+	uint16_t permille;						// of span, clamped
+	bool stalled;							// driven without pulses for stall_ms
+	bool valid;								// counter running and span set
+};
+
+class EncoderTrack
+{
+private:
+	PulseCounter *_ctr;
+	int16_t _raw;							// last count read
+	int32_t _pos;
+	int32_t _speed;
+	int8_t _dir;							// last drive direction, for coasting on an up-only counter
+	int8_t _drive;
+	uint32_t _tick_ms;
+	uint32_t _move_ms;						// last pulse, or start of the drive
+	bool _stalled;
+	bool _valid;
+	int32_t _span;
+
+public:
+	EncoderTrack() : _ctr(nullptr), _raw(0), _pos(0), _speed(0), _dir(1), _drive(0), _tick_ms(0), _move_ms(0),
+		_stalled(false), _valid(false), _span(0) {}
+
+	bool Attach(PulseCounter *ctr)
+	{
+		_ctr = ( ctr && ctr->Begin() ) ? ctr : nullptr;
+		_raw = _ctr ? _ctr->Read() : 0;
+		return _ctr != nullptr;
+	}
+
+	bool Attached() const { return _ctr != nullptr; }
+
+	// calibration: 0 at the closed limit, span at the opened one
+	void SetPosition(int32_t pos) { _pos = pos; }
+
+	// once per tick. drive +1 opening, -1 closing, 0 relays off, as energised during the last tick
+	void Update(uint32_t now_ms, int8_t drive, int32_t span, uint32_t stall_ms)
+	{
+		_span = span;
+		_valid = ( _ctr != nullptr ) && ( span > 0 );
+		if( _ctr == nullptr )
+			return;
+
+		int16_t raw = _ctr->Read();
+		int32_t delta = (int32_t)raw - _raw;
+		int32_t lim = _ctr->Limit();
+
+		_raw = raw;
+		if( delta > lim / 2 )					// the counter went back to 0 at a limit
+			delta -= lim;
+		else if( delta < -lim / 2 )
+			delta += lim;
+
+		if( drive != 0 )
+			_dir = drive;
+		if( !_ctr->Quadrature() )
+			delta = ( delta < 0 ? -delta : delta ) * _dir;
+		_pos += delta;
+
+		uint32_t dt = now_ms - _tick_ms;
+		if(( dt > 0 ) && ( _tick_ms != 0 )) {
+			int32_t inst = (int32_t)(( (int64_t)delta * 1000 ) / (int32_t)dt );
+			_speed += ( inst - _speed ) >> ENC_SPEED_SHIFT;
+			if(( delta == 0 ) && ( _speed > -( 1 << ENC_SPEED_SHIFT )) && ( _speed < ( 1 << ENC_SPEED_SHIFT )))
+				_speed = 0;						// the EMA does not reach 0 by itself
+		}
+		_tick_ms = now_ms;
+
+		if(( drive != _drive ) || ( delta != 0 ))
+			_move_ms = now_ms;					// the motor gets stall_ms to start
+		_drive = drive;
+		_stalled = ( drive != 0 ) && (( now_ms - _move_ms ) >= stall_ms );
+	}
+
+	bool Stalled() const { return _stalled; }
+
+	// end of travel for a drive, as a limit switch would report it: +1 open, -1 closed, 0 between.
+	// The count reached the end, or the motor stalled within band of it against the end stop.
+	// A stall further away is a jam
+	int8_t EndReached(int8_t drive, uint16_t band) const
+	{
+		if( !_valid || ( drive == 0 ))
+			return 0;
+		uint16_t p = Permille();
+		if(( drive > 0 ) && (( _pos >= _span ) || ( _stalled && ( p + band >= ENC_POS_FULL ))))
+			return 1;
+		if(( drive < 0 ) && (( _pos <= 0 ) || ( _stalled && ( p <= band ))))
+			return -1;
+		return 0;
+	}
+
+	uint16_t Permille() const
+	{
+		if( _span <= 0 || _pos <= 0 )
+			return 0;
+		if( _pos >= _span )
+			return ENC_POS_FULL;
+		return (uint16_t)(( (int64_t)_pos * ENC_POS_FULL ) / _span );
+	}
+
+	EncState_t State() const { return {_pos, _speed, Permille(), _stalled, _valid}; }
+};
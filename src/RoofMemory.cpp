@@ -0,0 +1,185 @@
+/**************************************************************************************************
+  Filename:       RoofMemory.cpp
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    roof state persistence implementation
+**************************************************************************************************/
+#include "RoofMemory.h"
+#include "LogRing.h"
+#include <esp_system.h>
+
+RoofMemory g_RoofMem;
+
+// not cleared by the startup code, garbage after a power-on, the checksum tells
+struct RoofRtc_t
+{
+	uint32_t magic;
+	RoofRecord_t rec[k_num_of_domes];
+	uint32_t sum;
+};
+
+RTC_NOINIT_ATTR static RoofRtc_t s_rtc;
+
+static const char *const k_roof_source_str[] = {"none", "rtc", "nvs", "switches"};
+
+// FNV-1a over the magic and the records
+static uint32_t roof_rtc_sum(const RoofRtc_t &r)
+{
+	const uint8_t *p = (const uint8_t *)&r;
+	uint32_t h = 2166136261u;
+
+	for(size_t i = 0; i < offsetof(RoofRtc_t, sum); i++)
+		h = ( h ^ p[i] ) * 16777619u;
+	return h;
+}
+
+static void roof_nvs_key(char *key, uint8_t num)
+{
+	key[0] = 'd';
+	key[1] = (char)( '0' + num );
+	key[2] = 0;
+}
+
+RoofMemory::RoofMemory()
+{
+	memset(_rec, 0, sizeof(_rec));
+	memset(_nvs, 0, sizeof(_nvs));
+	_rtc_valid = false;
+	_nvs_dirty = 0;
+	_reset_reason = 0;
+	_rtc_writes = 0;
+	_nvs_writes = 0;
+	_nvs_errors = 0;
+	_prefs_open = false;
+	_mux = portMUX_INITIALIZER_UNLOCKED;
+	for(size_t i = 0; i < k_num_of_domes; i++) {
+		_nvs_valid[i] = false;
+		_source[i] = RoofSource_t::kNone;
+		_valid_ms[i] = 0;
+	}
+}
+
+// check the RTC copy and read the NVS one, before the control task runs
+void RoofMemory::Begin(AsyncWebServer *server)
+{
+	_reset_reason = (int)esp_reset_reason();
+	_rtc_valid = ( s_rtc.magic == ROOF_MAGIC ) && ( s_rtc.sum == roof_rtc_sum(s_rtc) );
+
+	_prefs_open = _prefs.begin(ROOF_NVS_NAMESPACE, false);
+	for(uint8_t i = 0; _prefs_open && ( i < k_num_of_domes ); i++) {
+		char key[4];
+		roof_nvs_key(key, i);
+		_nvs_valid[i] = ( _prefs.getBytes(key, &_nvs[i], sizeof(RoofRecord_t)) == sizeof(RoofRecord_t) );
+	}
+
+	SLOG_INFO_PRINTF("Roof memory: reset reason %d, RTC %s, NVS %s\n", _reset_reason, _rtc_valid ? "valid" : "lost",
+		_prefs_open ? "open" : "failed");
+
+	server->on(ROOF_URL, HTTP_GET, [this](AsyncWebServerRequest *request) { _sendJson(request); });
+}
+
+// stored state of a roof, the RTC copy is newer than NVS when both are there
+bool RoofMemory::Recall(uint8_t num, RoofRecord_t &rec, RoofSource_t &src)
+{
+	if( num >= k_num_of_domes )
+		return false;
+
+	if( _rtc_valid ) {
+		rec = s_rtc.rec[num];
+		src = RoofSource_t::kRtc;
+		return true;
+	}
+	if( _nvs_valid[num] ) {
+		rec = _nvs[num];
+		src = RoofSource_t::kNvs;
+		return true;
+	}
+	src = RoofSource_t::kNone;
+	return false;
+}
+
+// control task. RTC on every call, NVS later from the loop task when the shutter state changed
+void RoofMemory::Save(uint8_t num, const RoofRecord_t &rec, bool changed)
+{
+	if( num >= k_num_of_domes )
+		return;
+
+	portENTER_CRITICAL(&_mux);
+	_rec[num] = rec;
+	s_rtc.rec[num] = rec;
+	s_rtc.magic = ROOF_MAGIC;
+	s_rtc.sum = roof_rtc_sum(s_rtc);
+	_rtc_writes++;
+	if( changed )
+		_nvs_dirty |= (uint8_t)( 1 << num );
+	portEXIT_CRITICAL(&_mux);
+}
+
+// control task, first Scan() of a dome: its shutterstatus is valid from now
+void RoofMemory::Restored(uint8_t num, RoofSource_t src, const RoofRecord_t &rec)
+{
+	if( num >= k_num_of_domes )
+		return;
+
+	_source[num] = src;
+	_valid_ms[num] = millis();
+	Save(num, rec, !_nvs_valid[num] || ( _nvs[num].shutter != rec.shutter ) || ( _nvs[num].pos != rec.pos ));
+
+	RLOG_INFO_PRINTF("Roof %u restored from %s: shutter %u position %u, valid %u ms after power-on\n", num,
+		k_roof_source_str[(uint8_t)src], rec.shutter, rec.pos, _valid_ms[num]);
+}
+
+// loop task: state changes to flash, off the control tick
+void RoofMemory::Loop()
+{
+	if(( _nvs_dirty == 0 ) || !_prefs_open )
+		return;
+
+	RoofRecord_t rec[k_num_of_domes];
+	uint8_t dirty;
+
+	portENTER_CRITICAL(&_mux);
+	dirty = _nvs_dirty;
+	_nvs_dirty = 0;
+	memcpy(rec, _rec, sizeof(rec));
+	portEXIT_CRITICAL(&_mux);
+
+	for(uint8_t i = 0; i < k_num_of_domes; i++) {
+		if( !( dirty & ( 1 << i )))
+			continue;
+
+		char key[4];
+		roof_nvs_key(key, i);
+		if( _prefs.putBytes(key, &rec[i], sizeof(RoofRecord_t)) == sizeof(RoofRecord_t) ) {
+			_nvs[i] = rec[i];
+			_nvs_valid[i] = true;
+			_nvs_writes++;
+		} else {
+			_nvs_errors++;
+			RLOG_WARNING_PRINTF("WARNING. Roof %u state not saved to NVS\n", i);
+		}
+	}
+}
+
+void RoofMemory::_sendJson(AsyncWebServerRequest *request)
+{
+	RoofRecord_t rec[k_num_of_domes];
+
+	portENTER_CRITICAL(&_mux);
+	memcpy(rec, _rec, sizeof(rec));
+	portEXIT_CRITICAL(&_mux);
+
+	AsyncResponseStream *response = request->beginResponseStream("application/json");
+
+	response->printf("{\"reset_reason\":%d,\"rtc_valid\":%s,\"nvs_open\":%s,\"rtc_writes\":%u,\"nvs_writes\":%u,\"nvs_errors\":%u,\"roofs\":[",
+		_reset_reason, _rtc_valid ? "true" : "false", _prefs_open ? "true" : "false", _rtc_writes, _nvs_writes, _nvs_errors);
+
+	for(uint8_t i = 0; i < k_num_of_domes; i++)
+		response->printf("%s{\"shutter\":%u,\"pos\":%u,\"source\":\"%s\",\"boot_to_valid_ms\":%u,\"nvs_shutter\":%d}",
+			( i > 0 ) ? "," : "", rec[i].shutter, rec[i].pos, k_roof_source_str[(uint8_t)_source[i]], _valid_ms[i],
+			_nvs_valid[i] ? (int)_nvs[i].shutter : -1);
+
+	response->print("]}");
+	request->send(response);
+}
@@ -0,0 +1,69 @@
+/**************************************************************************************************
+  Filename:       RoofMemory.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    last known shutter state and estimated position of each roof, kept across
+                  reboots. The control task saves to RTC slow memory, which survives software,
+                  watchdog and brown-out resets; the loop task copies state changes to NVS for
+                  power cycles, flash is never written from the control tick. Each dome restores
+                  at its first Scan(), when the limit switches have been read once, and the time
+                  from power-on to a valid shutterstatus is reported on /roof.
+**************************************************************************************************/
+#pragma once
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <Preferences.h>
+#include "ChannelMap.h"
+
+#define ROOF_MAGIC              0x52464D31  // "RFM1"
+#define ROOF_NVS_NAMESPACE      "roof"
+#define ROOF_POS_FULL           1000        // position in permille, 0 closed
+#define ROOF_POS_STEP           20          // RTC save while moving, permille
+#define ROOF_URL                "/roof"
+
+struct RoofRecord_t
+{
+	uint8_t shutter;						// AlpacaShutterStatus_t
+	uint8_t reserved;
+	uint16_t pos;							// permille open
+};
+
+enum struct RoofSource_t : uint8_t
+{
+	kNone = 0,								// nothing stored, the roof starts in error
+	kRtc,
+	kNvs,
+	kSwitches								// a limit switch is active, stored state not needed
+};
+
+class RoofMemory
+{
+private:
+	RoofRecord_t _rec[k_num_of_domes];		// last saved, written by the control task
+	RoofRecord_t _nvs[k_num_of_domes];		// as read from NVS at boot, then as written
+	bool _rtc_valid;						// RTC copy passed magic and checksum at boot
+	bool _nvs_valid[k_num_of_domes];
+	uint8_t _nvs_dirty;						// bit per dome, state changed since the last NVS write
+	RoofSource_t _source[k_num_of_domes];
+	uint32_t _valid_ms[k_num_of_domes];		// power-on to a valid shutterstatus, 0 not yet
+	int _reset_reason;
+	uint32_t _rtc_writes;
+	uint32_t _nvs_writes;
+	uint32_t _nvs_errors;
+	Preferences _prefs;
+	bool _prefs_open;
+	portMUX_TYPE _mux;
+
+	void _sendJson(AsyncWebServerRequest *request);
+
+public:
+	RoofMemory();
+	void Begin(AsyncWebServer *server);
+	bool Recall(uint8_t num, RoofRecord_t &rec, RoofSource_t &src);
+	void Save(uint8_t num, const RoofRecord_t &rec, bool changed);
+	void Restored(uint8_t num, RoofSource_t src, const RoofRecord_t &rec);
+	void Loop();
+};
+
+extern RoofMemory g_RoofMem;
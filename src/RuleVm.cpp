@@ -0,0 +1,388 @@
+/**************************************************************************************************
+  Filename:       RuleVm.cpp
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    automation rule compiler, host buildable
+**************************************************************************************************/
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+#include "RuleVm.h"
+#include "SafetyBits.h"
+
+static constexpr auto k_rule_opened_pos = ch_positions<ChKind_t::kLimitOpened>();
+static constexpr auto k_rule_closed_pos = ch_positions<ChKind_t::kLimitClosed>();
+
+// safety conditions, SAFE is NOT UNSAFE
+static const struct { const char *name; uint8_t mask; } k_rule_safe[] = {
+	{"UNSAFE", 0xFF},
+	{"RAIN", SAFEMON_RAIN_BIT},
+	{"POWER", SAFEMON_POWER_BIT},
+	{"SKY", SAFEMON_TSKY_BIT},
+	{"WIND", SAFEMON_WIND_BIT},
+	{"HUMIDITY", SAFEMON_HUM_BIT},
+	{"LIGHT", SAFEMON_LIGHT_BIT},
+	{"GUST", SAFEMON_GUST_BIT},
+	{"TREND", SAFEMON_TREND_BIT}
+};
+
+/*
+	compiler. Grammar, case insensitive:
+
+	rule    := IF expr [FOR n [S|SEC|M|MIN|H]] THEN actions [ELSE actions]
+	expr    := term {OR term}
+	term    := factor {AND factor}
+	factor  := NOT factor | ( expr ) | IN n | OPENED n | CLOSED n | LINK | SAFE | UNSAFE | RAIN | ...
+	actions := action {, action}
+	action  := OUT n|* ON|OFF | PWM n|* 0~100|ON|OFF | HEAT n|* AUTO|MANUAL
+*/
+enum struct RuleTok_t : uint8_t
+{
+	kEnd = 0,
+	kWord,
+	kNum,
+	kLParen,
+	kRParen,
+	kComma,
+	kStar,
+	kBad
+};
+
+struct RuleParser_t
+{
+	const char *src;
+	const char *p;
+	RuleTok_t tok;
+	char word[12];
+	int32_t num;
+	uint16_t col;							// of the current token, 1 based
+	uint8_t depth;
+	RuleProgram_t *prog;
+	const char *err;
+};
+
+static void rp_next(RuleParser_t &rp)
+{
+	while(( *rp.p == ' ' ) || ( *rp.p == '\t' ))
+		rp.p++;
+
+	rp.col = (uint16_t)( rp.p - rp.src + 1 );
+	char c = *rp.p;
+
+	if( c == 0 ) {
+		rp.tok = RuleTok_t::kEnd;
+	} else if( isalpha(c) ) {
+		size_t n = 0;
+		while( isalpha(*rp.p) ) {
+			if( n < sizeof(rp.word) - 1 )
+				rp.word[n++] = (char)toupper(*rp.p);
+			rp.p++;
+		}
+		rp.word[n] = 0;
+		rp.tok = RuleTok_t::kWord;
+	} else if( isdigit(c) ) {
+		rp.num = 0;
+		while( isdigit(*rp.p) ) {
+			if( rp.num < 100000 )
+				rp.num = rp.num * 10 + ( *rp.p - '0' );
+			rp.p++;
+		}
+		rp.tok = RuleTok_t::kNum;
+	} else {
+		rp.p++;
+		switch(c) {
+			case '(':	rp.tok = RuleTok_t::kLParen; break;
+			case ')':	rp.tok = RuleTok_t::kRParen; break;
+			case ',':	rp.tok = RuleTok_t::kComma; break;
+			case '*':	rp.tok = RuleTok_t::kStar; break;
+			default:	rp.tok = RuleTok_t::kBad; break;
+		}
+	}
+}
+
+static bool rp_is(const RuleParser_t &rp, const char *w)
+{
+	return ( rp.tok == RuleTok_t::kWord ) && ( strcmp(rp.word, w) == 0 );
+}
+
+static bool rp_fail(RuleParser_t &rp, const char *msg)
+{
+	if( rp.err == nullptr )
+		rp.err = msg;
+	return false;
+}
+
+static bool rp_emit(RuleParser_t &rp, uint8_t b)
+{
+	if( rp.prog->code_len >= RULES_CODE_SIZE )
+		return rp_fail(rp, "program too long");
+	rp.prog->code[rp.prog->code_len++] = b;
+	return true;
+}
+
+// leaf: one value on the VM stack
+static bool rp_leaf(RuleParser_t &rp, uint8_t op, int16_t operand)
+{
+	if( ++rp.depth > RULES_STACK )
+		return rp_fail(rp, "expression too deep");
+	if( !rp_emit(rp, op) )
+		return false;
+	return ( operand < 0 ) || rp_emit(rp, (uint8_t)operand);
+}
+
+// channel number 1 ~ n
+static bool rp_channel(RuleParser_t &rp, size_t n, size_t &ch)
+{
+	if(( rp.tok != RuleTok_t::kNum ) || ( rp.num < 1 ) || ((size_t)rp.num > n ))
+		return rp_fail(rp, "channel out of range");
+	ch = (size_t)rp.num - 1;
+	rp_next(rp);
+	return true;
+}
+
+static bool rp_expr(RuleParser_t &rp);
+
+static bool rp_factor(RuleParser_t &rp)
+{
+	size_t ch;
+
+	if( rp_is(rp, "NOT") ) {
+		rp_next(rp);
+		return rp_factor(rp) && rp_emit(rp, kOpNot);
+	}
+
+	if( rp.tok == RuleTok_t::kLParen ) {
+		rp_next(rp);
+		if( !rp_expr(rp) )
+			return false;
+		if( rp.tok != RuleTok_t::kRParen )
+			return rp_fail(rp, "')' expected");
+		rp_next(rp);
+		return true;
+	}
+
+	if( rp.tok != RuleTok_t::kWord )
+		return rp_fail(rp, "condition expected");
+
+	if( rp_is(rp, "IN") ) {
+		rp_next(rp);
+		return rp_channel(rp, k_num_sw_in, ch) && rp_leaf(rp, kOpIn, k_sw_in_pos[ch]);
+	}
+	if( rp_is(rp, "OPENED") ) {
+		rp_next(rp);
+		return rp_channel(rp, k_num_of_domes, ch) && rp_leaf(rp, kOpIn, k_rule_opened_pos[ch]);
+	}
+	if( rp_is(rp, "CLOSED") ) {
+		rp_next(rp);
+		return rp_channel(rp, k_num_of_domes, ch) && rp_leaf(rp, kOpIn, k_rule_closed_pos[ch]);
+	}
+	if( rp_is(rp, "LINK") ) {
+		rp_next(rp);
+		return rp_leaf(rp, kOpLink, -1);
+	}
+	if( rp_is(rp, "SAFE") ) {
+		rp_next(rp);
+		return rp_leaf(rp, kOpSafe, 0xFF) && rp_emit(rp, kOpNot);
+	}
+	for(const auto &s : k_rule_safe) {
+		if( rp_is(rp, s.name) ) {
+			rp_next(rp);
+			return rp_leaf(rp, kOpSafe, s.mask);
+		}
+	}
+
+	return rp_fail(rp, "unknown condition");
+}
+
+static bool rp_term(RuleParser_t &rp)
+{
+	if( !rp_factor(rp) )
+		return false;
+
+	while( rp_is(rp, "AND") ) {
+		rp_next(rp);
+		if( !rp_factor(rp) || !rp_emit(rp, kOpAnd) )
+			return false;
+		rp.depth--;
+	}
+	return true;
+}
+
+static bool rp_expr(RuleParser_t &rp)
+{
+	if( !rp_term(rp) )
+		return false;
+
+	while( rp_is(rp, "OR") ) {
+		rp_next(rp);
+		if( !rp_term(rp) || !rp_emit(rp, kOpOr) )
+			return false;
+		rp.depth--;
+	}
+	return true;
+}
+
+static bool rp_action(RuleParser_t &rp)
+{
+	const uint8_t *ids;
+	size_t n_ids, ch;
+	int32_t value;
+	bool all = false;
+
+	if( rp_is(rp, "OUT") ) {
+		ids = k_sw_out_id.data();
+		n_ids = k_num_sw_out;
+	} else if( rp_is(rp, "PWM") ) {
+		ids = k_sw_pwm_id.data();
+		n_ids = k_num_sw_pwm;
+	} else if( rp_is(rp, "HEAT") ) {
+		ids = k_sw_heat_auto_id.data();
+		n_ids = k_num_sw_heat;
+	} else {
+		return rp_fail(rp, "OUT, PWM or HEAT expected");
+	}
+	bool pwm = rp_is(rp, "PWM");
+	bool heat = rp_is(rp, "HEAT");
+	rp_next(rp);
+
+	if( rp.tok == RuleTok_t::kStar ) {
+		all = true;
+		ch = 0;
+		rp_next(rp);
+	} else if( !rp_channel(rp, n_ids, ch) ) {
+		return false;
+	}
+
+	if( pwm && ( rp.tok == RuleTok_t::kNum )) {
+		if( rp.num > 100 )
+			return rp_fail(rp, "duty 0~100 expected");
+		value = rp.num;
+	} else if( !heat && rp_is(rp, "ON") ) {
+		value = pwm ? 100 : 1;
+	} else if( !heat && rp_is(rp, "OFF") ) {
+		value = 0;
+	} else if( heat && rp_is(rp, "AUTO") ) {
+		value = 1;
+	} else if( heat && rp_is(rp, "MANUAL") ) {
+		value = 0;
+	} else {
+		return rp_fail(rp, heat ? "AUTO or MANUAL expected" : "ON or OFF expected");
+	}
+	rp_next(rp);
+
+	for(size_t i = all ? 0 : ch; i < ( all ? n_ids : ch + 1 ); i++) {
+		if( rp.prog->n_act >= RULES_MAX_ACTIONS )
+			return rp_fail(rp, "too many actions");
+		rp.prog->act[rp.prog->n_act++] = {ids[i], (uint16_t)value};
+	}
+	return true;
+}
+
+static bool rp_actions(RuleParser_t &rp, uint8_t &n)
+{
+	uint8_t first = rp.prog->n_act;
+
+	do {
+		if( rp.tok == RuleTok_t::kComma )
+			rp_next(rp);
+		if( !rp_action(rp) )
+			return false;
+	} while( rp.tok == RuleTok_t::kComma );
+
+	n = rp.prog->n_act - first;
+	return true;
+}
+
+int rule_compile_actions(const char *line, const char *actions, RuleAction_t *act, uint8_t max, char *err)
+{
+	RuleProgram_t prog;
+	RuleParser_t rp = {line, actions, RuleTok_t::kEnd, "", 0, 1, 0, &prog, nullptr};
+	uint8_t n = 0;
+
+	prog.code_len = 0;
+	prog.n_act = 0;
+	rp_next(rp);
+	if( rp_actions(rp, n) && ( rp.tok != RuleTok_t::kEnd ))
+		rp_fail(rp, "end of actions expected");
+	if(( rp.err == nullptr ) && ( n > max ))
+		rp_fail(rp, "too many actions");
+
+	if( rp.err != nullptr ) {
+		snprintf(err, RULES_ERR_LEN, "col %u: %s", rp.col, rp.err);
+		return -1;
+	}
+	memcpy(act, prog.act, n * sizeof(RuleAction_t));
+	return n;
+}
+
+bool rule_compile(uint8_t num, const char *src, RuleProgram_t &prog, char *err)
+{
+	RuleParser_t rp = {src, src, RuleTok_t::kEnd, "", 0, 1, 0, &prog, nullptr};
+	Rule_t r = {};
+	uint16_t code0 = prog.code_len;
+	uint8_t act0 = prog.n_act;
+
+	r.num = num;
+	r.code_ofs = code0;
+	r.act_ofs = act0;
+
+	rp_next(rp);
+	if( !rp_is(rp, "IF") ) {
+		rp_fail(rp, "IF expected");
+	} else {
+		rp_next(rp);
+		if( rp_expr(rp) ) {
+			r.code_len = prog.code_len - code0;
+
+			if( rp_is(rp, "FOR") ) {
+				rp_next(rp);
+				if( rp.tok != RuleTok_t::kNum ) {
+					rp_fail(rp, "time expected");
+				} else {
+					uint32_t n = (uint32_t)rp.num;
+					uint32_t unit = 1000;
+					rp_next(rp);
+					if( rp_is(rp, "M") || rp_is(rp, "MIN") ) {
+						unit = 60000;
+						rp_next(rp);
+					} else if( rp_is(rp, "H") ) {
+						unit = 3600000;
+						rp_next(rp);
+					} else if( rp_is(rp, "S") || rp_is(rp, "SEC") ) {
+						rp_next(rp);
+					}
+					if( n > 86400000 / unit )						// before the multiply, it would wrap
+						rp_fail(rp, "FOR 24H max");
+					else
+						r.for_ms = n * unit;
+				}
+			}
+
+			if( rp.err == nullptr ) {
+				if( !rp_is(rp, "THEN") ) {
+					rp_fail(rp, "THEN expected");
+				} else {
+					rp_next(rp);
+					if( rp_actions(rp, r.n_then ) && rp_is(rp, "ELSE") ) {
+						rp_next(rp);
+						rp_actions(rp, r.n_else);
+					}
+					if(( rp.err == nullptr ) && ( rp.tok != RuleTok_t::kEnd ))
+						rp_fail(rp, "end of rule expected");
+				}
+			}
+		}
+	}
+
+	if( rp.err != nullptr ) {
+		prog.code_len = code0;
+		prog.n_act = act0;
+		snprintf(err, RULES_ERR_LEN, "col %u: %s", rp.col, rp.err);
+		return false;
+	}
+
+	prog.rule[prog.n_rules++] = r;
+	err[0] = 0;
+	return true;
+}
@@ -0,0 +1,92 @@
+/**************************************************************************************************
+  Filename:       RuleVm.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    compiler and VM of the automation rules, no Arduino dependency so the rule
+                  tool in tools/ builds it too. A rule compiles to bytecode over the input image,
+                  the safety bits and the link state, plus a list of Switch writes for THEN and
+                  ELSE. RuleEngine runs them on the control tick.
+**************************************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "ChannelMap.h"
+
+#define RULES_MAX               8           // Rule_1 ~ Rule_8 in Rules_Configuration
+#define RULES_ERR_LEN           48
+#define RULES_CODE_SIZE         256         // bytecode of all rules
+#define RULES_MAX_ACTIONS       48          // THEN and ELSE actions of all rules
+#define RULES_STACK             32          // expression depth, bits of the VM stack
+
+// VM opcodes, kOpIn and kOpSafe take a one byte operand
+enum RuleOp_t : uint8_t
+{
+	kOpIn = 0,								// push input image bit
+	kOpSafe,								// push (safety bits & mask) != 0
+	kOpLink,								// push weather station link up
+	kOpNot,
+	kOpAnd,
+	kOpOr
+};
+
+struct RuleAction_t
+{
+	uint16_t id;							// Switch ID
+	uint16_t value;
+};
+
+struct Rule_t
+{
+	uint16_t code_ofs;
+	uint16_t code_len;
+	uint8_t act_ofs;						// THEN actions, then ELSE actions
+	uint8_t n_then;
+	uint8_t n_else;
+	uint8_t num;							// 1 ~ RULES_MAX, as in the settings
+	uint32_t for_ms;
+	uint32_t since;							// condition true since, while timing
+	uint8_t pend_ofs;						// next action of THEN or ELSE not queued yet
+	uint8_t pend_n;							// actions left to queue
+	bool timing;
+	bool fired;
+};
+
+struct RuleProgram_t
+{
+	uint8_t code[RULES_CODE_SIZE];
+	uint16_t code_len;
+	RuleAction_t act[RULES_MAX_ACTIONS];
+	uint8_t n_act;
+	Rule_t rule[RULES_MAX];
+	uint8_t n_rules;
+};
+
+// appends rule num, source src, to prog. On error prog is left as it was and err tells where
+bool rule_compile(uint8_t num, const char *src, RuleProgram_t &prog, char *err);
+
+// action list as after THEN, starting at actions inside line. Used by the scheduler.
+// Returns the number of actions, -1 with err set on error
+int rule_compile_actions(const char *line, const char *actions, RuleAction_t *act, uint8_t max, char *err);
+
+// stack machine over one bit per level, top of stack is bit 0
+inline bool rule_eval(const RuleProgram_t &prog, const Rule_t &r, const SrIn_t &in, uint8_t safety, bool link)
+{
+	const uint8_t *pc = &prog.code[r.code_ofs];
+	const uint8_t *end = pc + r.code_len;
+	uint32_t st = 0;
+	uint32_t a;
+
+	while( pc < end ) {
+		switch( *pc++ ) {
+			case kOpIn:		st = ( st << 1 ) | (uint32_t)in.test(*pc++); break;
+			case kOpSafe:	st = ( st << 1 ) | (uint32_t)(( safety & *pc++ ) != 0 ); break;
+			case kOpLink:	st = ( st << 1 ) | (uint32_t)link; break;
+			case kOpNot:	st ^= 1; break;
+			case kOpAnd:	a = st & 1; st >>= 1; st = ( st & ~1u ) | ( st & a ); break;
+			case kOpOr:		a = st & 1; st >>= 1; st |= a; break;
+			default:		return false;
+		}
+	}
+	return ( st & 1 ) != 0;
+}
@@ -0,0 +1,267 @@
+/**************************************************************************************************
+  Filename:       Rules.cpp
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    user automation rules, run by the control tick. Compiler in RuleVm.cpp
+**************************************************************************************************/
+#include "Rules.h"
+#include "ControlTask.h"
+#include "LogRing.h"
+
+RuleEngine g_Rules;
+
+RuleEngine::RuleEngine()
+{
+	memset(&_prog, 0, sizeof(_prog));
+	memset(&_staged, 0, sizeof(_staged));
+	_staged_ready = false;
+	_stale = false;
+	memset(_src, 0, sizeof(_src));
+	memset(_err, 0, sizeof(_err));
+	_safety = 0;
+	_link = false;
+	_dirty = true;
+	_timing = false;
+	_pending = false;
+	_evals = 0;
+	_fires = 0;
+}
+
+void RuleEngine::Begin(AsyncWebServer *server)
+{
+	g_StateBus.Subscribe(Topic_t::kSrIn, _onInputs, this);
+	g_StateBus.Subscribe(Topic_t::kSafety, _onSafety, this);
+	g_StateBus.Subscribe(Topic_t::kWsLink, _onLink, this);
+
+	server->on(RULES_URL, HTTP_GET, [this](AsyncWebServerRequest *request) { _sendJson(request); });
+}
+
+void RuleEngine::_onInputs(const BusEvent_t &ev, void *ctx)
+{
+	RuleEngine *self = (RuleEngine *)ctx;
+
+	self->_in = ev.in;
+	self->_dirty = true;
+}
+
+void RuleEngine::_onSafety(const BusEvent_t &ev, void *ctx)
+{
+	RuleEngine *self = (RuleEngine *)ctx;
+
+	self->_safety = ev.safety;
+	self->_dirty = true;
+}
+
+void RuleEngine::_onLink(const BusEvent_t &ev, void *ctx)
+{
+	RuleEngine *self = (RuleEngine *)ctx;
+
+	self->_link = ev.link;
+	self->_dirty = true;
+}
+
+// API task. Quotes and control chars are blanked, the source is echoed in JSON
+void RuleEngine::SetSource(uint8_t i, const char *src)
+{
+	if( i >= RULES_MAX )
+		return;
+
+	snprintf(_src[i], RULES_SRC_LEN, "%s", src ? src : "");
+	for(char *c = _src[i]; *c; c++)
+		if(( *c == '"' ) || ( *c == '\\' ) || ((uint8_t)*c < 0x20 ))
+			*c = ' ';
+}
+
+// API task: compile all sources and hand the program to the control task.
+// Returns the number of rules with errors, those are skipped. The control task takes a program
+// in its next tick; if it has not taken the last one it may be copying it, then nothing is
+// compiled and RULES_BUSY returned. Never waits, this runs in the web server task
+uint8_t RuleEngine::Compile()
+{
+	uint8_t errors = 0;
+
+	if( _staged_ready.load(std::memory_order_acquire) && ( g_Control.GetTask() != nullptr )) {
+		RLOG_ERROR_PRINTF("ERROR! Rules not compiled, the control task has not taken the last program\n");
+		_stale = true;
+		return RULES_BUSY;
+	}
+	_stale = false;
+
+	memset(&_staged, 0, sizeof(_staged));
+	for(uint8_t i = 0; i < RULES_MAX; i++) {
+		const char *s = _src[i];
+		while( *s == ' ' )
+			s++;
+		if( *s == 0 ) {
+			_err[i][0] = 0;
+			continue;
+		}
+		if( !rule_compile(i + 1, s, _staged, _err[i] )) {
+			RLOG_WARNING_PRINTF("Rule_%u: %s\n", i + 1, _err[i]);
+			errors++;
+		}
+	}
+	_staged_ready.store(true, std::memory_order_release);
+
+	RLOG_INFO_PRINTF("Rules compiled: %u rules, %u code bytes, %u actions, %u errors\n", _staged.n_rules, _staged.code_len, _staged.n_act, errors);
+	return errors;
+}
+
+// API task, from the settings of the switch device. Settings saved before the rules had their
+// own section keep them in Switch_Configuration, read from there until the next save
+void RuleEngine::ReadJson(JsonObject &root)
+{
+	JsonObject obj_config = root["Rules_Configuration"];
+	if( !obj_config )
+		obj_config = root["Switch_Configuration"];
+	if( !obj_config )
+		return;
+
+	char key[8];
+	for(uint8_t i = 0; i < RULES_MAX; i++) {
+		snprintf(key, sizeof(key), "Rule_%u", i + 1);
+		SetSource(i, obj_config[key] | GetSource(i));
+	}
+	Compile();								// rules with errors are skipped, see GET /rules
+}
+
+void RuleEngine::WriteJson(JsonObject &root)
+{
+	JsonObject obj_config = root["Rules_Configuration"].to<JsonObject>();
+
+	char key[8];
+	for(uint8_t i = 0; i < RULES_MAX; i++) {
+		snprintf(key, sizeof(key), "Rule_%u", i + 1);
+		obj_config[key] = GetSource(i);
+	}
+}
+
+// actions are Switch writes, applied by the Switch like a client write on the next tick. Queues
+// what fits above STATEBUS_RESERVE, returns false while actions are left for the next tick
+bool RuleEngine::_run(Rule_t &r)
+{
+	while( r.pend_n ) {
+		if( g_StateBus.Room() <= STATEBUS_RESERVE )
+			return false;
+
+		BusEvent_t ev(Topic_t::kSwitchWrite);
+		ev.sw.id = _prog.act[r.pend_ofs].id;
+		ev.sw.value = _prog.act[r.pend_ofs].value;
+		if( !g_StateBus.Publish(ev) )
+			return false;
+		r.pend_ofs++;
+		r.pend_n--;
+	}
+	return true;
+}
+
+// control tick stage: evaluates only when an input changed or a FOR delay is counting
+void RuleEngine::Exec()
+{
+	if( _staged_ready.load(std::memory_order_acquire) ) {
+		_prog = _staged;
+		_staged_ready.store(false, std::memory_order_release);
+		_dirty = true;
+	}
+
+	if( !_dirty && !_timing && !_pending )
+		return;
+
+	uint32_t t0 = (uint32_t)esp_timer_get_time();
+	uint32_t now = millis();
+
+	_dirty = false;
+	_timing = false;
+	_pending = false;
+	_evals++;
+
+	for(uint8_t i = 0; i < _prog.n_rules; i++) {
+		Rule_t &r = _prog.rule[i];
+
+		if( !_run(r) ) {									// THEN or ELSE not all queued, no new transition
+			_pending = true;
+			continue;
+		}
+
+		if( rule_eval(_prog, r, _in, _safety, _link) ) {
+			if( !r.fired && !r.timing ) {
+				r.timing = true;
+				r.since = now;
+			}
+			if( r.timing && (( now - r.since ) >= r.for_ms )) {
+				r.timing = false;
+				r.fired = true;
+				_fires++;
+				r.pend_ofs = r.act_ofs;
+				r.pend_n = r.n_then;
+				_pending |= !_run(r);
+				RLOG_DEBUG_PRINTF("Rule_%u THEN\n", r.num);
+			}
+		} else {
+			r.timing = false;
+			if( r.fired ) {
+				r.fired = false;
+				r.pend_ofs = r.act_ofs + r.n_then;
+				r.pend_n = r.n_else;
+				_pending |= !_run(r);
+				RLOG_DEBUG_PRINTF("Rule_%u ELSE\n", r.num);
+			}
+		}
+		_timing |= r.timing;
+	}
+
+	_exec.Add((uint32_t)esp_timer_get_time() - t0);
+}
+
+// GET /rules, ?bench runs the conditions RULES_BENCH_PASSES times on the current state. It reads
+// the program without locking, a swap in the middle only spoils that measurement
+void RuleEngine::_sendJson(AsyncWebServerRequest *request)
+{
+	AsyncResponseStream *response = request->beginResponseStream("application/json");
+	const RuleProgram_t &prog = _prog;
+
+	response->printf("{\"code_bytes\":%u,\"code_size\":%u,\"actions\":%u,\"evals\":%u,\"fires\":%u,\"stale\":%s,\"rules\":[",
+		prog.code_len, RULES_CODE_SIZE, prog.n_act, _evals, _fires, _stale ? "true" : "false");
+
+	bool first = true;
+	for(uint8_t i = 0; i < RULES_MAX; i++) {
+		if( _src[i][0] == 0 )
+			continue;
+
+		const Rule_t *r = nullptr;
+		for(uint8_t j = 0; j < prog.n_rules; j++)
+			if( prog.rule[j].num == i + 1 )
+				r = &prog.rule[j];
+
+		response->printf("%s{\"num\":%u,\"src\":\"%s\",\"err\":\"%s\"", first ? "" : ",", i + 1, _src[i], _err[i]);
+		if( r != nullptr ) {
+			response->printf(",\"for_ms\":%u,\"then\":%u,\"else\":%u,\"fired\":%s,\"pending\":%u,\"code\":\"",
+				r->for_ms, r->n_then, r->n_else, r->fired ? "true" : "false", r->pend_n);
+			for(uint16_t k = 0; k < r->code_len; k++)
+				response->printf("%02x", prog.code[r->code_ofs + k]);
+			response->print("\"");
+		}
+		response->print("}");
+		first = false;
+	}
+
+	response->print("],\"exec_us\":");
+	_exec.PrintJson(*response);
+
+	if( request->hasParam("bench") && prog.n_rules ) {
+		volatile bool sink = false;
+		uint32_t c0 = ESP.getCycleCount();
+		for(uint32_t n = 0; n < RULES_BENCH_PASSES; n++)
+			for(uint8_t j = 0; j < prog.n_rules; j++)
+				sink = sink ^ rule_eval(prog, prog.rule[j], _in, _safety, _link);
+		uint32_t per_pass = ( ESP.getCycleCount() - c0 ) / RULES_BENCH_PASSES;
+		uint32_t per_rule = per_pass / prog.n_rules;
+
+		response->printf(",\"bench\":{\"passes\":%u,\"cycles_per_pass\":%u,\"cycles_per_rule\":%u,\"rules_per_ms\":%u}",
+			RULES_BENCH_PASSES, per_pass, per_rule, per_rule ? ( ESP.getCpuFreqMHz() * 1000 ) / per_rule : 0);
+	}
+	response->print("}");
+
+	request->send(response);
+}
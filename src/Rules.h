@@ -0,0 +1,71 @@
+/**************************************************************************************************
+  Filename:       Rules.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    user automation rules. One rule per line, e.g.
+                      IF IN 3 THEN OUT 1 ON ELSE OUT 1 OFF
+                      IF UNSAFE THEN PWM * 0
+                      IF CLOSED 1 FOR 10 MIN THEN OUT 5 OFF
+                  Rules come from Rules_Configuration, a section of the switch device settings
+                  that ReadJson() and WriteJson() own. They are compiled to a small bytecode over the
+                  input image, safety bits and link state, and run by the control tick. THEN runs
+                  once when the condition has held for the FOR time, ELSE once when it drops.
+                  Actions that don't fit the bus queue, less STATEBUS_RESERVE, wait for the next
+                  tick and the rule isn't evaluated again until all of them are queued.
+                  Each rule is bounded by its code length, the program by RULES_CODE_SIZE.
+**************************************************************************************************/
+#pragma once
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <ArduinoJson.h>
+#include <atomic>
+#include "RuleVm.h"
+#include "StateBus.h"
+#include "Histogram.h"
+
+#define RULES_SRC_LEN           96          // chars per rule
+#define RULES_BENCH_PASSES      1000
+#define RULES_BUSY              0xFF        // Compile(): the last program is not taken yet, nothing done
+#define RULES_URL               "/rules"
+
+class RuleEngine
+{
+private:
+	RuleProgram_t _prog;					// run by the control task
+	RuleProgram_t _staged;					// compiled by the API task, taken by the next Exec()
+	std::atomic<bool> _staged_ready;		// set by the API task, cleared once the control task copied it
+	char _src[RULES_MAX][RULES_SRC_LEN];
+	char _err[RULES_MAX][RULES_ERR_LEN];
+	bool _stale;							// sources changed, not compiled: RULES_BUSY
+
+	SrIn_t _in;								// from kSrIn
+	uint8_t _safety;						// from kSafety
+	bool _link;								// from kWsLink
+	bool _dirty;							// state changed since the last Exec()
+	bool _timing;							// a FOR delay is counting
+	bool _pending;							// a rule has actions left to queue
+
+	uint32_t _evals;
+	uint32_t _fires;
+	Histogram _exec;						// Exec() passes that evaluated, us
+
+	bool _run(Rule_t &r);
+	void _sendJson(AsyncWebServerRequest *request);
+
+	static void _onInputs(const BusEvent_t &ev, void *ctx);
+	static void _onSafety(const BusEvent_t &ev, void *ctx);
+	static void _onLink(const BusEvent_t &ev, void *ctx);
+
+public:
+	RuleEngine();
+	void Begin(AsyncWebServer *server);
+	void SetSource(uint8_t i, const char *src);
+	const char *GetSource(uint8_t i) { return ( i < RULES_MAX ) ? _src[i] : ""; }
+	uint8_t Compile();
+	void ReadJson(JsonObject &root);
+	void WriteJson(JsonObject &root);
+	void Exec();
+};
+
+extern RuleEngine g_Rules;
@@ -0,0 +1,19 @@
+/**************************************************************************************************
+  Filename:       SafetyBits.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    SafetyMonitor condition bits as published on kSafety, no Arduino dependency
+                  so the rule compiler builds on the host too.
+**************************************************************************************************/
+#pragma once
+
+#define SAFEMON_RAIN_BIT        1
+#define SAFEMON_POWER_BIT       2
+
+#define SAFEMON_TSKY_BIT        4
+#define SAFEMON_WIND_BIT        8
+#define SAFEMON_HUM_BIT         16
+#define SAFEMON_LIGHT_BIT       32
+#define SAFEMON_GUST_BIT        64          // max wind over the stats window
+#define SAFEMON_TREND_BIT       128         // sky temperature rising, clouds coming
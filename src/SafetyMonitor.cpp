@@ -6,6 +6,11 @@
 **************************************************************************************************/
 
 #include "SafetyMonitor.h"
+#include "LogRing.h"
+#include "HeapMonitor.h"
+#include "WeatherStats.h"
+#include "Sessions.h"
+#include "Analog.h"
 
 const char *const k_safemon_state_str[2] = {"Safe", "Unsafe"};
 
@@ -13,67 +18,199 @@ SafetyMonitor::SafetyMonitor() : AlpacaSafetyMonitor()
 {
 	// constructor
 	_is_safe = true;
+	_inputs = 0;
+	_active = false;
+	_cfg_version = 0;
+	_rain_in = false;
+	_power_in = false;
+	_ws_link = false;
+	_supply_low = false;
+	_supply_ms = 0;
+	_cfg.Reset({2, 0, 10, 0, 100, 95, 0, false, false, false, false, 50, 5, false, false, 0});
+	tmr_ws_sky_ini = 0; tmr_ws_sky_len = 0;
+	tmr_ws_wind_ini = 0; tmr_ws_wind_len = 0;
+	tmr_rain_ini = 0; tmr_rain_len = 0;
+	tmr_power_ini = 0; tmr_power_len = 0;
 }
 
 void SafetyMonitor::Begin()
 {
 	AlpacaSafetyMonitor::Begin();
+	_supply_ms = millis();						// the ADC has its first block within the stale time
+
+	g_StateBus.Subscribe(Topic_t::kSrIn, _onInputs, this);
+	g_StateBus.Subscribe(Topic_t::kWeather, _onWeather, this);
+	g_StateBus.Subscribe(Topic_t::kWsLink, _onLink, this);
 }
 
-void SafetyMonitor::Loop()
+void SafetyMonitor::_onInputs(const BusEvent_t &ev, void *ctx)
 {
-	if( is_ws_connected ) {
-		if( _use_tsky ) {
-			if( weather_tsky > _tsky_limit ) {
-				if(tmr_ws_sky_ini == 0) {
-					tmr_ws_sky_ini = millis();
-					tmr_ws_sky_len = _weather_delay * 1000;
-				}
+	SafetyMonitor *self = (SafetyMonitor *)ctx;
+
+	self->_rain_in = (bool)( ev.in & BIT_SAFE_RAIN );
+	self->_power_in = (bool)( ev.in & BIT_SAFE_POWER );
+	self->_evaluate();
+}
+
+void SafetyMonitor::_onWeather(const BusEvent_t &ev, void *ctx)
+{
+	SafetyMonitor *self = (SafetyMonitor *)ctx;
+
+	self->_ws = ev.ws;
+	self->_evaluate();
+}
+
+void SafetyMonitor::_onLink(const BusEvent_t &ev, void *ctx)
+{
+	SafetyMonitor *self = (SafetyMonitor *)ctx;
+
+	self->_ws_link = ev.link;
+	self->_evaluate();
+}
+
+// control tick. Inputs and weather are evaluated when they change, here only while a delay is
+// counting, the stats window is sliding or the configuration or the active state changed.
+// The roof interlock needs rain and power without clients. The supply block was taken by the
+// analog stage of this tick, an undervoltage reaches the roofs through the bus in the same tick.
+// A late block keeps the last supply state; with none for SAFEMON_SUPPLY_STALE_MS the check fails
+// closed, an unmeasured supply is an undervoltage
+void SafetyMonitor::Loop(bool interlock)
+{
+	const SafeConfig_t &cfg = _cfg.Get();
+	bool active = ( g_Sessions.Count(DevKind_t::kSafetyMonitor, 0) > 0 ) || interlock;
+	bool supply_low = false;
+	bool stale = false;
+	int32_t mv = 0;
+
+	if( cfg.supply_min_mv == 0 ) {
+		_supply_ms = millis();
+	} else if( g_Analog.GetSupply(mv) ) {
+		_supply_ms = millis();
+		supply_low = ( mv < (int32_t)cfg.supply_min_mv ) || ( _supply_low && ( mv < (int32_t)( cfg.supply_min_mv + SAFEMON_SUPPLY_HYST_MV )));
+	} else if(( millis() - _supply_ms ) < SAFEMON_SUPPLY_STALE_MS ) {
+		supply_low = _supply_low;
+	} else {
+		supply_low = true;
+		stale = true;
+	}
+
+	if( supply_low != _supply_low ) {
+		_supply_low = supply_low;
+		if( stale )
+			RLOG_WARNING_PRINTF("WARNING. Supply not measured for %u ms, taken as undervoltage\n", millis() - _supply_ms);
+		else
+			RLOG_WARNING_PRINTF("WARNING. Supply %s, %d mV\n", supply_low ? "undervoltage" : "back", mv);
+		_evaluate();
+	}
 
-				if(( weather_tsky > _tsky_limit ) && (tmr_ws_sky_ini != 0) && ((millis() - tmr_ws_sky_ini) > tmr_ws_sky_len))
-					_safemon_inputs |= SAFEMON_TSKY_BIT;
+	if(( active != _active ) || ( _cfg.Version() != _cfg_version )) {
+		_active = active;
+		_cfg_version = _cfg.Version();
+		_evaluate();
+	} else if( tmr_rain_ini || tmr_power_ini || tmr_ws_sky_ini || tmr_ws_wind_ini || cfg.use_gust || cfg.use_trend ) {
+		_evaluate();
+	}
+}
+
+void SafetyMonitor::_evaluate()
+{
+	const SafeConfig_t &cfg = _cfg.Get();
+	uint8_t inputs = _inputs;
+	uint32_t now = millis();
+
+	if( !_active ) {
+		inputs = 0;
+		tmr_rain_ini = 0;
+		tmr_power_ini = 0;
+		tmr_ws_sky_ini = 0;
+		tmr_ws_wind_ini = 0;
+	} else {
+		if( _rain_in ) {											// rain signal
+			if( tmr_rain_ini == 0 ) {								// if it's the first event, start counting the rain delay
+				tmr_rain_ini = now;
+				tmr_rain_len = 1000 * cfg.rain_delay;
 			}
-			else
-			{
-				_safemon_inputs &= ~SAFEMON_TSKY_BIT;
-				tmr_ws_sky_ini = 0;
+
+			if(( now - tmr_rain_ini ) > tmr_rain_len )				// if alarm persists for rain_delay, set UNSAFE
+				inputs |= SAFEMON_RAIN_BIT;
+		} else {
+			tmr_rain_ini = 0;										// clear timer and flag
+			inputs &= ~SAFEMON_RAIN_BIT;
+		}
+
+		bool power = _supply_low;									// the block mean filters already, no delay
+		if(( cfg.power_delay > 0 ) && _power_in ) {					// enter only if power delay is > 0
+			if( tmr_power_ini == 0 ) {
+				tmr_power_ini = now;
+				tmr_power_len = 1000 * cfg.power_delay;
 			}
+
+			if(( now - tmr_power_ini ) > tmr_power_len )
+				power = true;
 		} else {
-			_safemon_inputs &= ~SAFEMON_TSKY_BIT;
-			tmr_ws_sky_ini = 0;
+			tmr_power_ini = 0;
 		}
 
-		if( _use_wind ) {
-			if( weather_wind > _wind_limit ) {
-				if(tmr_ws_wind_ini == 0) {
-					tmr_ws_wind_ini = millis();
-					tmr_ws_wind_len = _weather_delay * 1000;
+		if( power )
+			inputs |= SAFEMON_POWER_BIT;
+		else
+			inputs &= ~SAFEMON_POWER_BIT;
+
+		if( _ws_link ) {
+			if( cfg.use_tsky && ( _ws.tsky > cfg.tsky_limit )) {
+				if( tmr_ws_sky_ini == 0 ) {
+					tmr_ws_sky_ini = now;
+					tmr_ws_sky_len = cfg.weather_delay * 1000;
 				}
 
-				if(( weather_wind > _wind_limit ) && (tmr_ws_wind_ini != 0) && ((millis() - tmr_ws_wind_ini) > tmr_ws_wind_len))
-					_safemon_inputs |= SAFEMON_WIND_BIT;
+				if(( now - tmr_ws_sky_ini ) > tmr_ws_sky_len )
+					inputs |= SAFEMON_TSKY_BIT;
+			} else {
+				inputs &= ~SAFEMON_TSKY_BIT;
+				tmr_ws_sky_ini = 0;
 			}
-			else
-			{
-				_safemon_inputs &= ~SAFEMON_WIND_BIT;
+
+			if( cfg.use_wind && ( _ws.wind > cfg.wind_limit )) {
+				if( tmr_ws_wind_ini == 0 ) {
+					tmr_ws_wind_ini = now;
+					tmr_ws_wind_len = cfg.weather_delay * 1000;
+				}
+
+				if(( now - tmr_ws_wind_ini ) > tmr_ws_wind_len )
+					inputs |= SAFEMON_WIND_BIT;
+			} else {
+				inputs &= ~SAFEMON_WIND_BIT;
 				tmr_ws_wind_ini = 0;
 			}
+
+			// windowed rules, the window already filters single samples so no delay is applied
+			if( cfg.use_gust && ( g_WeatherStats.wind.Max() > cfg.gust_limit ))
+				inputs |= SAFEMON_GUST_BIT;
+			else
+				inputs &= ~SAFEMON_GUST_BIT;
+
+			if( cfg.use_trend && ( g_WeatherStats.tsky.Slope() > (float)cfg.trend_limit ))
+				inputs |= SAFEMON_TREND_BIT;
+			else
+				inputs &= ~SAFEMON_TREND_BIT;
+
 		} else {
-			_safemon_inputs &= ~SAFEMON_WIND_BIT;
+			inputs &= 0x3;										// mask all weather bits
+			tmr_ws_sky_ini = 0;
 			tmr_ws_wind_ini = 0;
 		}
-
-	} else {
-		_safemon_inputs &= 0x3;						// mask all weather bits
-		tmr_ws_sky_ini = 0;
-		tmr_ws_wind_ini = 0;
 	}
-	
-	if( _safemon_inputs == 0 )
-		_is_safe = true;
-	else
-		_is_safe = false;
 
+	if( inputs == _inputs )
+		return;
+
+	BusEvent_t ev(Topic_t::kSafety);
+	ev.safety = inputs;
+	if( !g_StateBus.PublishChange(ev) )						// state slot, not expected; retried next tick
+		return;
+
+	_inputs = inputs;
+	_is_safe = ( inputs == 0 );
 }
 
 const bool SafetyMonitor::_getIsSafe()
@@ -83,24 +220,31 @@ const bool SafetyMonitor::_getIsSafe()
 
 void SafetyMonitor::AlpacaReadJson(JsonObject &root)
 {
+	HEAP_SITE("SafetyMonitor::AlpacaReadJson");
 	DBG_JSON_PRINTFJ(SLOG_NOTICE, root, "SAFEMON READ BEGIN (root=<%s>) ...\n", _ser_json_);
 	AlpacaSafetyMonitor::AlpacaReadJson(root);
 	bool _valid;
 
 	if (JsonObject obj_config = root["SafetyMonitor_Configuration"])
 	{
-		uint32_t _rd = obj_config["Rain_delay"] | _rain_delay;
-		uint32_t _pd = obj_config["Power_off_delay"] | _power_delay;
-		uint32_t _wd = obj_config["Weather_delay"] | _weather_delay;
+		SafeConfig_t cfg = _cfg.Get();				// validated on the copy, the control tick keeps the old one meanwhile
+		uint32_t _rd = obj_config["Rain_delay"] | cfg.rain_delay;
+		uint32_t _pd = obj_config["Power_off_delay"] | cfg.power_delay;
+		uint32_t _wd = obj_config["Weather_delay"] | cfg.weather_delay;
 
 		String _str_st =(obj_config["Use_sky_temp"] | _str_st);
-		int32_t _ts = obj_config["Sky_temp_limit"] | _tsky_limit;
+		int32_t _ts = obj_config["Sky_temp_limit"] | cfg.tsky_limit;
 		String _str_wi =(obj_config["Use_wind"] | _str_wi);
-		uint32_t _wi = obj_config["Wind_limit"] | _wind_limit;
+		uint32_t _wi = obj_config["Wind_limit"] | cfg.wind_limit;
 		String _str_hu =(obj_config["Use_humidity"] | _str_hu);
-		uint32_t _hu = obj_config["Humidity"] | _hum_limit;
+		uint32_t _hu = obj_config["Humidity"] | cfg.hum_limit;
 		String _str_li =(obj_config["Use_light"] | _str_li);
-		uint32_t _lig = obj_config["Ambient_light"] | _light_limit;
+		uint32_t _lig = obj_config["Ambient_light"] | cfg.light_limit;
+		String _str_gu =(obj_config["Use_gust"] | _str_gu);
+		int32_t _gu = obj_config["Gust_limit"] | cfg.gust_limit;
+		String _str_tr =(obj_config["Use_sky_trend"] | _str_tr);
+		int32_t _tr = obj_config["Sky_trend_limit"] | cfg.trend_limit;
+		uint32_t _sm = obj_config["Supply_min_mv"] | cfg.supply_min_mv;
 
 		if((_rd < 2) || (_rd > 60))       	// validate dalay on rain signal 2~60s
 			_rd = 2;
@@ -111,53 +255,74 @@ void SafetyMonitor::AlpacaReadJson(JsonObject &root)
 		if((_wd < 0) || (_wd > 600))		// validate delay for weather station (0 means not in use)
 			_wd = 10;
 		
-		_rain_delay = _rd;
-		_power_delay = _pd;
-		_weather_delay = _wd;
+		cfg.rain_delay = _rd;
+		cfg.power_delay = _pd;
+		cfg.weather_delay = _wd;
 
 		if( !_str_st.isEmpty() ) {						// check if tsky is in use
 			_str_st.toLowerCase();
-			_use_tsky = (_str_st == "true" ? true : false);
+			cfg.use_tsky = (_str_st == "true" ? true : false);
 		}
 
 		if(!((_ts < -50) || (_ts > 50))) {			// check if tsky is valid and save
-			_tsky_limit = (int16_t)_ts;
+			cfg.tsky_limit = (int16_t)_ts;
 		}
 
 		if( !_str_wi.isEmpty() ) {						// check if wind is in use
 			_str_wi.toLowerCase();
-			_use_wind = (_str_wi == "true" ? true : false);
+			cfg.use_wind = (_str_wi == "true" ? true : false);
 		}
 
 		if(!((_wi < 0) || (_wi > 100))) {			// check if wind is valid and save
-			_wind_limit = (int16_t)_wi;
+			cfg.wind_limit = (int16_t)_wi;
 		}
 
 		if( !_str_hu.isEmpty() ) {						// check if humidity is in use
 			_str_hu.toLowerCase();
-			_use_hum = (_str_hu == "true" ? true : false);
+			cfg.use_hum = (_str_hu == "true" ? true : false);
 		}
 
 		if(!((_hu < 0) || (_hu > 100))) {
-			_hum_limit = (int16_t)_hu;
+			cfg.hum_limit = (int16_t)_hu;
 		}		
 
 		if( !_str_li.isEmpty() ) {						// check if light is in use
 			_str_li.toLowerCase();
-			_use_light = (_str_li == "true" ? true : false);
+			cfg.use_light = (_str_li == "true" ? true : false);
 		}
 
 		if(!((_lig < 0) || (_lig > 100))) {
-			_light_limit = (int16_t)_lig;
+			cfg.light_limit = (int16_t)_lig;
 		}
 
-		char _msg[256];
-		snprintf(_msg, sizeof(_msg), "ReadJson tsky limit %i, tsky in use %s, wind limit %i, wind in use %s", _tsky_limit, _use_tsky ? "Yes" : "No", _wind_limit, _use_wind ? "Yes" : "No");
-		Serial.println(_msg);
-		snprintf(_msg, sizeof(_msg), "         hum limit %i, hum in use %s, light limit %i, light in use %s", _hum_limit, _use_hum ? "Yes" : "No", _light_limit, _use_light ? "Yes" : "No");
-		Serial.println(_msg);
+		if( !_str_gu.isEmpty() ) {						// check if gust is in use
+			_str_gu.toLowerCase();
+			cfg.use_gust = (_str_gu == "true" ? true : false);
+		}
+
+		if(!((_gu < 0) || (_gu > 150))) {			// 10 min max wind 0~150km/h
+			cfg.gust_limit = (int16_t)_gu;
+		}
 
-		SLOG_PRINTF(SLOG_INFO, "...SAFEMON READ END _rain_delay=%i _power_delay=%i\n", (int)_rain_delay, (int)_power_delay);
+		if( !_str_tr.isEmpty() ) {						// check if sky trend is in use
+			_str_tr.toLowerCase();
+			cfg.use_trend = (_str_tr == "true" ? true : false);
+		}
+
+		if(!((_tr < 1) || (_tr > 100))) {			// sky temp rise 0.1~10C/min
+			cfg.trend_limit = (int16_t)_tr;
+		}
+
+		if( _sm <= 60000 )							// measured supply 0~60V, 0 means not in use
+			cfg.supply_min_mv = _sm;
+
+		_cfg.Publish(cfg);								// whole, evaluated by the next Loop()
+
+		RLOG_INFO_PRINTF("ReadJson tsky limit %i, tsky in use %s, wind limit %i, wind in use %s\n", cfg.tsky_limit, cfg.use_tsky ? "Yes" : "No", cfg.wind_limit, cfg.use_wind ? "Yes" : "No");
+		RLOG_INFO_PRINTF("         hum limit %i, hum in use %s, light limit %i, light in use %s\n", cfg.hum_limit, cfg.use_hum ? "Yes" : "No", cfg.light_limit, cfg.use_light ? "Yes" : "No");
+		RLOG_INFO_PRINTF("         gust limit %i, gust in use %s, sky trend limit %i, sky trend in use %s\n", cfg.gust_limit, cfg.use_gust ? "Yes" : "No", cfg.trend_limit, cfg.use_trend ? "Yes" : "No");
+
+		SLOG_PRINTF(SLOG_INFO, "...SAFEMON READ END cfg.rain_delay=%i cfg.power_delay=%i\n", (int)cfg.rain_delay, (int)cfg.power_delay);
 	} else {
 		SLOG_PRINTF(SLOG_WARNING, "...SAFEMON READ END no configuration\n");
 	}
@@ -165,30 +330,34 @@ void SafetyMonitor::AlpacaReadJson(JsonObject &root)
 
 void SafetyMonitor::AlpacaWriteJson(JsonObject &root)
 {
+	HEAP_SITE("SafetyMonitor::AlpacaWriteJson");
 	SLOG_PRINTF(SLOG_NOTICE, "SAFEMON WRITE BEGIN ...\n");
 	AlpacaSafetyMonitor::AlpacaWriteJson(root);
 	char buff[16];
+	const SafeConfig_t &cfg = _cfg.Get();
 
 	// Config
 	JsonObject obj_config = root["SafetyMonitor_Configuration"].to<JsonObject>();
-	obj_config["Rain_delay"] = _rain_delay;
-	obj_config["Power_off_delay"] = _power_delay;
-	obj_config["Weather_delay"] = _weather_delay;
-
-	obj_config["Use_sky_temp"] = (_use_tsky == true);
-	obj_config["Sky_temp_limit"] = _tsky_limit;
-	obj_config["Use_wind"] = (_use_wind == true);
-	obj_config["Wind_limit"] = _wind_limit;
-	obj_config["Use_humidity"] = (_use_hum == true);
-	obj_config["Humidity"] = _hum_limit;
-	obj_config["Use_light"] = (_use_light == true);
-	obj_config["Ambient_light"] = _light_limit;
-
-	char _msg[256];
-	snprintf(_msg, sizeof(_msg), "WriteJson tsky limit %i, tsky in use %s, wind limit %i, wind in use %s", _tsky_limit, _use_tsky ? "Yes" : "No", _wind_limit, _use_wind ? "Yes" : "No");
-	Serial.println(_msg);
-	snprintf(_msg, sizeof(_msg), "          hum limit %i, hum in use %s, light limit %i, light in use %s", _hum_limit, _use_hum ? "Yes" : "No", _light_limit, _use_light ? "Yes" : "No");
-	Serial.println(_msg);
+	obj_config["Rain_delay"] = cfg.rain_delay;
+	obj_config["Power_off_delay"] = cfg.power_delay;
+	obj_config["Weather_delay"] = cfg.weather_delay;
+
+	obj_config["Use_sky_temp"] = (cfg.use_tsky == true);
+	obj_config["Sky_temp_limit"] = cfg.tsky_limit;
+	obj_config["Use_wind"] = (cfg.use_wind == true);
+	obj_config["Wind_limit"] = cfg.wind_limit;
+	obj_config["Use_humidity"] = (cfg.use_hum == true);
+	obj_config["Humidity"] = cfg.hum_limit;
+	obj_config["Use_light"] = (cfg.use_light == true);
+	obj_config["Ambient_light"] = cfg.light_limit;
+	obj_config["Use_gust"] = (cfg.use_gust == true);
+	obj_config["Gust_limit"] = cfg.gust_limit;
+	obj_config["Use_sky_trend"] = (cfg.use_trend == true);
+	obj_config["Sky_trend_limit"] = cfg.trend_limit;
+	obj_config["Supply_min_mv"] = cfg.supply_min_mv;
+
+	RLOG_INFO_PRINTF("WriteJson tsky limit %i, tsky in use %s, wind limit %i, wind in use %s\n", cfg.tsky_limit, cfg.use_tsky ? "Yes" : "No", cfg.wind_limit, cfg.use_wind ? "Yes" : "No");
+	RLOG_INFO_PRINTF("          hum limit %i, hum in use %s, light limit %i, light in use %s\n", cfg.hum_limit, cfg.use_hum ? "Yes" : "No", cfg.light_limit, cfg.use_light ? "Yes" : "No");
 
 	DBG_JSON_PRINTFJ(SLOG_NOTICE, root, "...SAFEMON WRITE END root=<%s>\n", _ser_json_);
 }
@@ -7,36 +7,50 @@
 
 #pragma once
 #include "AlpacaSafetyMonitor.h"
+#include "ChannelMap.h"
+#include "StateBus.h"
+#include "ConfigSlot.h"
+#include "SafetyBits.h"
 
-#define SAFEMON_RAIN_BIT        1
-#define SAFEMON_POWER_BIT       2
-
-#define SAFEMON_TSKY_BIT        4
-#define SAFEMON_WIND_BIT        8
-#define SAFEMON_HUM_BIT         16
-#define SAFEMON_LIGHT_BIT       32
-
-extern u_int8_t _safemon_inputs;
-
-extern bool is_ws_connected;
-extern int16_t		weather_tsky;					              // readings from weather station
-extern int16_t		weather_tair;
-extern int16_t		weather_wind;
-extern int16_t		weather_hum;
-extern int16_t		weather_light;
+#define SAFEMON_SUPPLY_HYST_MV  300         // undervoltage clears above the limit plus this
+#define SAFEMON_SUPPLY_STALE_MS 5000        // supply not measured this long is an undervoltage
 
+// settings, swapped whole by AlpacaReadJson
+struct SafeConfig_t
+{
+  uint32_t rain_delay;                                  // s
+  uint32_t power_delay;                                 // s, 0 = not in use
+  uint32_t weather_delay;                               // s
+  int16_t tsky_limit, wind_limit, hum_limit, light_limit;
+  bool use_tsky, use_wind, use_hum, use_light;
+  int16_t gust_limit;                                   // 1adu = 1km/h, on the 10 min max
+  int16_t trend_limit;                                  // 1adu = 0.1C/min, on the sky temperature slope
+  bool use_gust, use_trend;
+  uint32_t supply_min_mv;                               // measured supply below this sets the power bit, 0 = off
+};
 
 class SafetyMonitor : public AlpacaSafetyMonitor
 {
 private:
   bool _is_safe;
-  uint32_t _rain_delay;
-  uint32_t _power_delay;
-  uint32_t _weather_delay;
-  int16_t _tsky_limit, _wind_limit, _hum_limit, _light_limit;
-  bool _use_tsky, _use_wind, _use_hum, _use_light;
+  uint8_t _inputs;                                      // SAFEMON_*_BIT, 0->safe, published on kSafety
+  bool _active;                                         // clients connected or a roof interlock in use
+  ConfigSlot<SafeConfig_t> _cfg;
+  uint32_t _cfg_version;                                // of the snapshot last evaluated
+  bool _rain_in, _power_in;                             // rain and power inputs, from kSrIn
+  bool _ws_link;                                        // from kWsLink
+  bool _supply_low;                                     // measured undervoltage, from g_Analog
+  uint32_t _supply_ms;                                  // last fresh supply block, or check off
+  WsSample_t _ws;                                       // last weather station frame, from kWeather
   uint32_t tmr_ws_sky_ini, tmr_ws_sky_len;		          // weather station timer and alarm duration
   uint32_t tmr_ws_wind_ini, tmr_ws_wind_len;
+  uint32_t tmr_rain_ini, tmr_rain_len;                  // rain delay and alarm duration
+  uint32_t tmr_power_ini, tmr_power_len;                // power
+
+  void _evaluate();
+  static void _onInputs(const BusEvent_t &ev, void *ctx);
+  static void _onWeather(const BusEvent_t &ev, void *ctx);
+  static void _onLink(const BusEvent_t &ev, void *ctx);
 
   const bool _getIsSafe();
 
@@ -48,8 +62,9 @@ private:
 public:
 	SafetyMonitor();
 	void Begin();
-	void Loop();
-  uint32_t getRainDelay() {return _rain_delay;}
-  uint32_t getPowerDelay() {return _power_delay;}
+	void Loop(bool interlock);
+  uint8_t GetInputs() {return _inputs;}
+  uint32_t getRainDelay() {return _cfg.Get().rain_delay;}
+  uint32_t getPowerDelay() {return _cfg.Get().power_delay;}
 
 };
@@ -0,0 +1,578 @@
+/**************************************************************************************************
+  Filename:       Schedule.cpp
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    on-board schedule implementation
+**************************************************************************************************/
+#include "Schedule.h"
+#include <time.h>
+#include <sys/time.h>
+#include <esp_sntp.h>
+#include "ControlTask.h"
+#include "LogRing.h"
+
+Scheduler g_Scheduler;
+
+#define SCHED_CLOCK_VALID       1600000000  // wall clock not set before this, 2020-09
+#define SCHED_MAX_S             86400       // EVERY and FOR limit
+
+/*
+	entry grammar, case insensitive:
+
+	entry   := when [FOR n unit] DO actions
+	when    := AT hh:mm | AT yyyy-mm-dd hh:mm | EVERY n unit
+	unit    := [S|SEC|M|MIN|H]
+	actions := as in rules, OUT n|* ON|OFF | PWM n|* 0~100|ON|OFF | HEAT n|* AUTO|MANUAL
+*/
+static void sc_blank(const char *&p)
+{
+	while(( *p == ' ' ) || ( *p == '\t' ))
+		p++;
+}
+
+static bool sc_word(const char *&p, const char *w)
+{
+	size_t n = strlen(w);
+
+	sc_blank(p);
+	if(( strncasecmp(p, w, n) != 0 ) || isalpha(p[n]))
+		return false;
+	p += n;
+	return true;
+}
+
+static bool sc_num(const char *&p, uint32_t &n)
+{
+	sc_blank(p);
+	if( !isdigit(*p) )
+		return false;
+	for(n = 0; isdigit(*p); p++)
+		if( n < 1000000 )
+			n = n * 10 + ( *p - '0' );
+	return true;
+}
+
+static bool sc_duration(const char *&p, uint32_t &s)
+{
+	uint32_t n;
+
+	if( !sc_num(p, n) )
+		return false;
+	if( sc_word(p, "M") || sc_word(p, "MIN") )
+		s = n * 60;
+	else if( sc_word(p, "H") )
+		s = n * 3600;
+	else {
+		s = n;
+		if( !sc_word(p, "S") )
+			sc_word(p, "SEC");
+	}
+	return ( s > 0 ) && ( s <= SCHED_MAX_S );
+}
+
+// appends one entry to prog. On error prog is left as it was and err tells where
+bool Scheduler::_compileEntry(uint8_t num, const char *src, SchedProgram_t &prog, char *err)
+{
+	SchedEntry_t e = {};
+	const char *p = src;
+	const char *msg = nullptr;
+	uint32_t a, b, c;
+
+	e.num = num;
+	e.act_ofs = prog.n_act;
+
+	if( sc_word(p, "AT") ) {
+		if( !sc_num(p, a) ) {
+			msg = "time expected";
+		} else if( *p == '-' ) {
+			e.kind = SchedKind_t::kOnce;
+			p++;
+			if( !sc_num(p, b) || ( *p++ != '-' ) || !sc_num(p, c) || ( a < 2020 ) || ( a > 2099 ) || ( b < 1 ) || ( b > 12 ) || ( c < 1 ) || ( c > 31 ))
+				msg = "yyyy-mm-dd expected";
+			e.year = (uint16_t)a;
+			e.mon = (uint8_t)b;
+			e.day = (uint8_t)c;
+			if(( msg == nullptr ) && ( !sc_num(p, a) || ( *p != ':' )))
+				msg = "hh:mm expected";
+		} else {
+			e.kind = SchedKind_t::kDaily;
+		}
+		if( msg == nullptr ) {
+			e.hour = (uint8_t)a;
+			if(( *p++ != ':' ) || !sc_num(p, b) || ( a > 23 ) || ( b > 59 ))
+				msg = "hh:mm expected";
+			e.min = (uint8_t)b;
+		}
+	} else if( sc_word(p, "EVERY") ) {
+		e.kind = SchedKind_t::kEvery;
+		if( !sc_duration(p, e.every_s) || ( e.every_s < 10 ))
+			msg = "period 10S~24H expected";
+	} else {
+		msg = "AT or EVERY expected";
+	}
+
+	if(( msg == nullptr ) && sc_word(p, "FOR" )) {
+		if( !sc_duration(p, e.for_s) )
+			msg = "FOR 1S~24H expected";
+		else if(( e.kind == SchedKind_t::kEvery ) && ( e.for_s >= e.every_s ))
+			msg = "FOR shorter than EVERY expected";
+		else if(( e.kind == SchedKind_t::kDaily ) && ( e.for_s >= SCHED_MAX_S ))
+			msg = "FOR shorter than 24H expected";
+	}
+
+	if(( msg == nullptr ) && !sc_word(p, "DO" ))
+		msg = "DO expected";
+
+	if( msg != nullptr ) {
+		sc_blank(p);
+		snprintf(err, RULES_ERR_LEN, "col %u: %s", (unsigned)( p - src + 1 ), msg);
+		return false;
+	}
+
+	int n = rule_compile_actions(src, p, &prog.act[prog.n_act], SCHED_MAX_ACTIONS - prog.n_act, err);
+	if( n < 0 )
+		return false;
+
+	e.n_act = (uint8_t)n;
+	prog.n_act += (uint8_t)n;
+	prog.entry[prog.n_entries++] = e;
+	err[0] = 0;
+	return true;
+}
+
+Scheduler::Scheduler()
+{
+	memset(&_prog, 0, sizeof(_prog));
+	memset(&_staged, 0, sizeof(_staged));
+	_staged_ready = false;
+	_stale = false;
+	_resync = false;
+	_synced = false;
+	_wall_valid = false;
+	_wall_ofs_ms = 0;
+	memset(_src, 0, sizeof(_src));
+	memset(_err, 0, sizeof(_err));
+	snprintf(_tz, sizeof(_tz), "UTC0");
+	_ntp[0] = 0;
+	_n_heap = 0;
+	_fires = 0;
+	_syncs = 0;
+	_jumps = 0;
+}
+
+void Scheduler::Begin(AsyncWebServer *server)
+{
+	sntp_set_time_sync_notification_cb(_onSync);
+
+	server->on(SCHED_URL, HTTP_GET, [this](AsyncWebServerRequest *request) { _sendJson(request); });
+}
+
+// SNTP task, on every sync. Most only trim the clock, Exec() decides whether to replan
+void Scheduler::_onSync(struct timeval *tv)
+{
+	g_Scheduler._syncs++;
+	g_Scheduler._synced = true;
+}
+
+// API task. POSIX TZ string, e.g. "CET-1CEST,M3.5.0,M10.5.0/3". No NTP server keeps the clock unset
+void Scheduler::SetClock(const char *tz, const char *ntp)
+{
+	if(( strcmp(tz, _tz) == 0 ) && ( strcmp(ntp, _ntp) == 0 ))
+		return;
+
+	snprintf(_tz, sizeof(_tz), "%s", tz);
+	snprintf(_ntp, sizeof(_ntp), "%s", ntp);
+	for(char *c = _tz; *c; c++)
+		if(( *c == '"' ) || ( *c == '\\' ))
+			*c = ' ';
+	for(char *c = _ntp; *c; c++)
+		if(( *c == '"' ) || ( *c == '\\' ))
+			*c = ' ';
+
+	if( _ntp[0] ) {
+		configTzTime(_tz, _ntp);
+	} else {
+		setenv("TZ", _tz, 1);
+		tzset();
+	}
+	_resync = true;
+	RLOG_INFO_PRINTF("Schedule clock TZ %s NTP %s\n", _tz, _ntp[0] ? _ntp : "-");
+}
+
+// API task. Quotes and control chars are blanked, the source is echoed in JSON
+void Scheduler::SetSource(uint8_t i, const char *src)
+{
+	if( i >= SCHED_MAX )
+		return;
+
+	snprintf(_src[i], SCHED_SRC_LEN, "%s", src ? src : "");
+	for(char *c = _src[i]; *c; c++)
+		if(( *c == '"' ) || ( *c == '\\' ) || ((uint8_t)*c < 0x20 ))
+			*c = ' ';
+}
+
+// API task: compile all entries and hand them to the control task, which plans them again.
+// Returns the number of entries with errors, those are skipped. As RuleEngine::Compile(), never
+// waits: SCHED_BUSY when the control task has not taken the last program, nothing is compiled
+uint8_t Scheduler::Compile()
+{
+	uint8_t errors = 0;
+
+	if( _staged_ready.load(std::memory_order_acquire) && ( g_Control.GetTask() != nullptr )) {
+		RLOG_ERROR_PRINTF("ERROR! Schedule not compiled, the control task has not taken the last program\n");
+		_stale = true;
+		return SCHED_BUSY;
+	}
+	_stale = false;
+
+	memset(&_staged, 0, sizeof(_staged));
+	for(uint8_t i = 0; i < SCHED_MAX; i++) {
+		const char *s = _src[i];
+		while( *s == ' ' )
+			s++;
+		if( *s == 0 ) {
+			_err[i][0] = 0;
+			continue;
+		}
+		if( !_compileEntry(i + 1, s, _staged, _err[i] )) {
+			RLOG_WARNING_PRINTF("Sched_%u: %s\n", i + 1, _err[i]);
+			errors++;
+		}
+	}
+	_staged_ready.store(true, std::memory_order_release);
+
+	RLOG_INFO_PRINTF("Schedule compiled: %u entries, %u actions, %u errors\n", _staged.n_entries, _staged.n_act, errors);
+	return errors;
+}
+
+// API task, from the settings of the switch device. As RuleEngine::ReadJson(), settings saved
+// before the schedule had its own section are read from Switch_Configuration
+void Scheduler::ReadJson(JsonObject &root)
+{
+	JsonObject obj_config = root["Schedule_Configuration"];
+	if( !obj_config )
+		obj_config = root["Switch_Configuration"];
+	if( !obj_config )
+		return;
+
+	SetClock(obj_config["Sched_tz"] | GetTz(), obj_config["Sched_ntp"] | GetNtp());
+
+	char key[10];
+	for(uint8_t i = 0; i < SCHED_MAX; i++) {
+		snprintf(key, sizeof(key), "Sched_%u", i + 1);
+		SetSource(i, obj_config[key] | GetSource(i));
+	}
+	Compile();								// entries with errors are skipped, see GET /schedule
+}
+
+void Scheduler::WriteJson(JsonObject &root)
+{
+	JsonObject obj_config = root["Schedule_Configuration"].to<JsonObject>();
+
+	obj_config["Sched_tz"] = GetTz();
+	obj_config["Sched_ntp"] = GetNtp();
+
+	char key[10];
+	for(uint8_t i = 0; i < SCHED_MAX; i++) {
+		snprintf(key, sizeof(key), "Sched_%u", i + 1);
+		obj_config[key] = GetSource(i);
+	}
+}
+
+bool Scheduler::_clockSet(time_t &now)
+{
+	now = time(nullptr);
+	return now > SCHED_CLOCK_VALID;
+}
+
+// wall clock ahead of the scheduler clock, ms
+int64_t Scheduler::_wallOfs()
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, nullptr);
+	return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000 - _now_ms();
+}
+
+// control task, after a sync: the clock was set the first time or stepped past SCHED_JUMP_MS
+bool Scheduler::_jumped()
+{
+	time_t wall;
+
+	if( !_clockSet(wall) )
+		return false;
+	if( !_wall_valid )
+		return true;
+
+	int64_t d = _wallOfs() - _wall_ofs_ms;
+	return ( d > SCHED_JUMP_MS ) || ( d < -SCHED_JUMP_MS );
+}
+
+void Scheduler::_push(const SchedNode_t &n)
+{
+	uint8_t i = _n_heap++;
+
+	while( i > 0 ) {
+		uint8_t parent = ( i - 1 ) / 2;
+		if( _heap[parent].due_ms <= n.due_ms )
+			break;
+		_heap[i] = _heap[parent];
+		i = parent;
+	}
+	_heap[i] = n;
+}
+
+void Scheduler::_pop()
+{
+	SchedNode_t last = _heap[--_n_heap];
+	uint8_t i = 0;
+
+	for(;;) {
+		uint8_t child = 2 * i + 1;
+		if( child >= _n_heap )
+			break;
+		if(( child + 1 < _n_heap ) && ( _heap[child + 1].due_ms < _heap[child].due_ms ))
+			child++;
+		if( last.due_ms <= _heap[child].due_ms )
+			break;
+		_heap[i] = _heap[child];
+		i = child;
+	}
+	if( _n_heap )
+		_heap[i] = last;
+}
+
+// next ON of an AT entry from the wall clock. Inside a FOR window the ON is due now and base_ms
+// is the window start, so the OFF keeps its time; if that ON ran already only the OFF is
+// queued. skip_s steps over the occurrence just run
+void Scheduler::_plan(uint8_t i, int64_t now_ms, time_t wall, uint32_t skip_s)
+{
+	SchedEntry_t &e = _prog.entry[i];
+	time_t ref = wall + skip_s;
+	time_t start, next;
+	struct tm t;
+
+	if( e.kind == SchedKind_t::kOnce ) {
+		t = {};
+		t.tm_year = e.year - 1900;
+		t.tm_mon = e.mon - 1;
+		t.tm_mday = e.day;
+		t.tm_hour = e.hour;
+		t.tm_min = e.min;
+		t.tm_isdst = -1;
+		start = next = mktime(&t);
+	} else {
+		localtime_r(&wall, &t);
+		t.tm_hour = e.hour;
+		t.tm_min = e.min;
+		t.tm_sec = 0;
+		t.tm_isdst = -1;
+		time_t today = mktime(&t);
+		t.tm_mday += ( today <= ref ) ? 1 : -1;				// mktime normalises, DST included
+		t.tm_isdst = -1;
+		time_t other = mktime(&t);
+		start = ( today <= ref ) ? today : other;
+		next = ( today <= ref ) ? other : today;
+		if( next == e.ran ) {								// ran before the clock stepped back
+			localtime_r(&next, &t);
+			t.tm_mday++;
+			t.tm_isdst = -1;
+			next = mktime(&t);
+		}
+	}
+
+	if(( start <= ref ) && ( ref < start + (time_t)e.for_s )) {
+		e.start = start;
+		e.base_ms = now_ms - (int64_t)( wall - start ) * 1000;
+		if( e.ran == start )								// ON ran in this window, only its OFF is left
+			_push({e.base_ms + (int64_t)e.for_s * 1000, i, true});
+		else
+			_push({now_ms, i, false});
+	} else if(( next > ref ) && ( next != e.ran )) {
+		e.start = next;
+		e.base_ms = now_ms + (int64_t)( next - wall ) * 1000;
+		_push({e.base_ms, i, false});
+	} else {
+		e.done = true;
+	}
+}
+
+// control task. A new program plans everything, a clock change only the AT entries
+void Scheduler::_rebuild()
+{
+	SchedNode_t keep[SCHED_MAX];
+	uint8_t n_keep = 0;
+	int64_t now_ms = _now_ms();
+	time_t wall;
+	bool set = _clockSet(wall);
+
+	for(uint8_t i = 0; i < _n_heap; i++)
+		if( _prog.entry[_heap[i].entry].kind == SchedKind_t::kEvery )
+			keep[n_keep++] = _heap[i];
+
+	_n_heap = 0;
+	for(uint8_t i = 0; i < n_keep; i++)
+		_push(keep[i]);
+
+	for(uint8_t i = 0; i < _prog.n_entries; i++) {
+		SchedEntry_t &e = _prog.entry[i];
+		bool queued = false;
+		for(uint8_t k = 0; k < n_keep; k++)
+			queued |= ( keep[k].entry == i );
+
+		if( e.kind == SchedKind_t::kEvery ) {
+			if( !queued ) {
+				e.base_ms = now_ms;
+				_push({now_ms, i, false});
+			}
+		} else if( set ) {
+			e.done = false;
+			e.sent = 0;
+			_plan(i, now_ms, wall, 0);
+		}
+	}
+
+	_wall_valid = set;
+	_wall_ofs_ms = set ? _wallOfs() : 0;
+}
+
+// actions are Switch writes, applied by the Switch like a client write on the next tick. Queues
+// what fits above STATEBUS_RESERVE, returns false while actions are left for the next tick
+bool Scheduler::_run(SchedEntry_t &e, bool off)
+{
+	for(; e.sent < e.n_act; e.sent++) {
+		if( g_StateBus.Room() <= STATEBUS_RESERVE )
+			return false;
+
+		BusEvent_t ev(Topic_t::kSwitchWrite);
+		ev.sw.id = _prog.act[e.act_ofs + e.sent].id;
+		ev.sw.value = off ? 0 : _prog.act[e.act_ofs + e.sent].value;
+		if( !g_StateBus.Publish(ev) )
+			return false;
+	}
+	e.sent = 0;
+	return true;
+}
+
+// control tick stage: compares the head of the heap, runs what is due and plans its next write
+void Scheduler::Exec()
+{
+	if( _staged_ready.load(std::memory_order_acquire) ) {
+		_prog = _staged;
+		_staged_ready.store(false, std::memory_order_release);
+		_n_heap = 0;
+		_resync = false;
+		_rebuild();
+	} else if( _resync ) {
+		_resync = false;
+		_synced = false;
+		_rebuild();
+	} else if( _synced ) {
+		_synced = false;
+		if( _jumped() ) {
+			_jumps++;
+			RLOG_INFO_PRINTF("Schedule clock stepped, AT entries planned again\n");
+			_rebuild();
+		}
+	}
+
+	int64_t now_ms = _now_ms();
+
+	for(uint8_t n = 0; ( n < SCHED_MAX ) && _n_heap && ( _heap[0].due_ms <= now_ms ); n++) {
+		SchedNode_t node = _heap[0];
+		SchedEntry_t &e = _prog.entry[node.entry];
+		time_t wall;
+
+		if( !_run(e, node.off) )							// the rest next tick, the node stays at the head
+			break;
+		_pop();
+		if( !node.off && ( e.kind != SchedKind_t::kEvery ))
+			e.ran = e.start;
+		_late_ms.Add((uint32_t)( now_ms - node.due_ms ));
+		_fires++;
+		RLOG_DEBUG_PRINTF("Sched_%u %s\n", e.num, node.off ? "OFF" : "ON");
+
+		if( !node.off && e.for_s ) {
+			_push({e.base_ms + (int64_t)e.for_s * 1000, node.entry, true});
+		} else if( e.kind == SchedKind_t::kEvery ) {
+			e.base_ms += (int64_t)e.every_s * 1000;
+			if( e.base_ms < now_ms )							// late by more than a period, restart from now
+				e.base_ms = now_ms;
+			_push({e.base_ms, node.entry, false});
+		} else if(( e.kind == SchedKind_t::kDaily ) && _clockSet(wall)) {
+			_plan(node.entry, now_ms, wall, 60);
+		} else {
+			e.done = true;
+		}
+	}
+}
+
+// GET /schedule. Reads the heap without locking, a tick in the middle only spoils this listing
+void Scheduler::_sendJson(AsyncWebServerRequest *request)
+{
+	AsyncResponseStream *response = request->beginResponseStream("application/json");
+	SchedNode_t pend[SCHED_MAX];
+	uint8_t n_pend = _n_heap;
+	int64_t now_ms = _now_ms();
+	time_t wall;
+	bool set = _clockSet(wall);
+	char buf[24];
+	struct tm t;
+
+	memcpy(pend, _heap, sizeof(pend));
+	for(uint8_t i = 1; i < n_pend; i++)							// heap order to due order
+		for(uint8_t j = i; ( j > 0 ) && ( pend[j].due_ms < pend[j - 1].due_ms ); j--) {
+			SchedNode_t x = pend[j];
+			pend[j] = pend[j - 1];
+			pend[j - 1] = x;
+		}
+
+	if( set ) {
+		localtime_r(&wall, &t);
+		strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &t);
+		response->printf("{\"clock\":\"%s\"", buf);
+	} else {
+		response->print("{\"clock\":null");
+	}
+	response->printf(",\"tz\":\"%s\",\"ntp\":\"%s\",\"syncs\":%u,\"jumps\":%u,\"fires\":%u,\"stale\":%s,\"pending\":[",
+		_tz, _ntp, _syncs, _jumps, _fires, _stale ? "true" : "false");
+
+	for(uint8_t i = 0; i < n_pend; i++) {
+		int64_t in_ms = pend[i].due_ms - now_ms;
+		response->printf("%s{\"num\":%u,\"write\":\"%s\",\"due_in_s\":%d", i ? "," : "",
+			_prog.entry[pend[i].entry].num, pend[i].off ? "off" : "on", (int32_t)(( in_ms > 0 ? in_ms : 0 ) / 1000 ));
+		if( set ) {
+			time_t due = wall + (time_t)( in_ms / 1000 );
+			localtime_r(&due, &t);
+			strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &t);
+			response->printf(",\"at\":\"%s\"", buf);
+		}
+		response->print("}");
+	}
+
+	response->print("],\"entries\":[");
+	bool first = true;
+	for(uint8_t i = 0; i < SCHED_MAX; i++) {
+		if( _src[i][0] == 0 )
+			continue;
+
+		const SchedEntry_t *e = nullptr;
+		for(uint8_t j = 0; j < _prog.n_entries; j++)
+			if( _prog.entry[j].num == i + 1 )
+				e = &_prog.entry[j];
+
+		response->printf("%s{\"num\":%u,\"src\":\"%s\",\"err\":\"%s\"", first ? "" : ",", i + 1, _src[i], _err[i]);
+		if( e != nullptr )
+			response->printf(",\"actions\":%u,\"done\":%s,\"waits_clock\":%s", e->n_act, e->done ? "true" : "false",
+				(( e->kind != SchedKind_t::kEvery ) && !set ) ? "true" : "false");
+		response->print("}");
+		first = false;
+	}
+
+	response->print("],\"late_ms\":");
+	_late_ms.PrintJson(*response);
+	response->print("}");
+
+	request->send(response);
+}
@@ -0,0 +1,129 @@
+/**************************************************************************************************
+  Filename:       Schedule.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    on-board schedule of Switch writes. One entry per line, e.g.
+                      AT 18:30 FOR 10 H DO HEAT * AUTO        daily, local time
+                      AT 2026-11-02 06:15 DO OUT 4 OFF        once
+                      EVERY 10 MIN FOR 2 MIN DO OUT 3 ON      duty cycle
+                  FOR writes the same switches back to OFF / 0 / MANUAL when it runs out.
+                  Entries come from Schedule_Configuration, a section of the switch device
+                  settings that ReadJson() and WriteJson() own. Pending writes sit in a min-heap keyed
+                  by due time on the scheduler clock, the control tick only compares the head.
+                  A due write whose actions don't all fit the bus queue stays at the head and
+                  goes on with the rest on the next tick.
+                  AT entries need the wall clock from SNTP and are planned once it is set. A
+                  sync replans them only when the wall clock moved against the scheduler clock by
+                  more than SCHED_JUMP_MS; an ON that already ran is not run again for its window.
+**************************************************************************************************/
+#pragma once
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <ArduinoJson.h>
+#include <atomic>
+#include "Rules.h"
+#include "Histogram.h"
+
+#define SCHED_MAX               8           // Sched_1 ~ Sched_8 in Schedule_Configuration
+#define SCHED_SRC_LEN           RULES_SRC_LEN
+#define SCHED_MAX_ACTIONS       32          // actions of all entries
+#define SCHED_TZ_LEN            48
+#define SCHED_NTP_LEN           48
+#define SCHED_JUMP_MS           2000        // wall clock step that replans the AT entries
+#define SCHED_BUSY              0xFF        // Compile(): the last program is not taken yet, nothing done
+#define SCHED_URL               "/schedule"
+
+enum struct SchedKind_t : uint8_t
+{
+	kOnce = 0,								// AT date time
+	kDaily,									// AT time
+	kEvery									// EVERY period
+};
+
+struct SchedEntry_t
+{
+	SchedKind_t kind;
+	uint8_t num;							// 1 ~ SCHED_MAX, as in the settings
+	uint8_t act_ofs;
+	uint8_t n_act;
+	uint16_t year;
+	uint8_t mon, day, hour, min;
+	uint32_t every_s;
+	uint32_t for_s;							// 0 = no OFF write
+	int64_t base_ms;						// start of the current ON, scheduler clock
+	time_t start;							// AT occurrence planned, wall clock
+	time_t ran;								// AT occurrence whose ON ran, 0 none
+	uint8_t sent;							// actions of the due write queued so far
+	bool done;								// once entry past
+};
+
+struct SchedProgram_t
+{
+	SchedEntry_t entry[SCHED_MAX];
+	uint8_t n_entries;
+	RuleAction_t act[SCHED_MAX_ACTIONS];
+	uint8_t n_act;
+};
+
+// one pending write per entry
+struct SchedNode_t
+{
+	int64_t due_ms;
+	uint8_t entry;
+	bool off;
+};
+
+class Scheduler
+{
+private:
+	SchedProgram_t _prog;					// run by the control task
+	SchedProgram_t _staged;					// compiled by the API task, taken by the next Exec()
+	std::atomic<bool> _staged_ready;		// set by the API task, cleared once the control task copied it
+	volatile bool _resync;					// time zone changed, plan AT entries again
+	volatile bool _synced;					// SNTP sync, replan if the clock jumped
+	bool _wall_valid;						// AT entries planned on a set wall clock
+	int64_t _wall_ofs_ms;					// wall clock - scheduler clock when planned
+	char _src[SCHED_MAX][SCHED_SRC_LEN];
+	char _err[SCHED_MAX][RULES_ERR_LEN];
+	bool _stale;							// sources changed, not compiled: SCHED_BUSY
+	char _tz[SCHED_TZ_LEN];
+	char _ntp[SCHED_NTP_LEN];
+
+	SchedNode_t _heap[SCHED_MAX];
+	uint8_t _n_heap;
+
+	uint32_t _fires;
+	uint32_t _syncs;
+	uint32_t _jumps;						// syncs that replanned
+	Histogram _late_ms;						// due -> run
+
+	static int64_t _now_ms() { return esp_timer_get_time() / 1000; }
+	static bool _clockSet(time_t &now);
+	static int64_t _wallOfs();
+	bool _jumped();
+	bool _compileEntry(uint8_t num, const char *src, SchedProgram_t &prog, char *err);
+	void _push(const SchedNode_t &n);
+	void _pop();
+	void _plan(uint8_t i, int64_t now_ms, time_t wall, uint32_t skip_s);
+	void _rebuild();
+	bool _run(SchedEntry_t &e, bool off);
+	void _sendJson(AsyncWebServerRequest *request);
+
+	static void _onSync(struct timeval *tv);
+
+public:
+	Scheduler();
+	void Begin(AsyncWebServer *server);
+	void SetSource(uint8_t i, const char *src);
+	const char *GetSource(uint8_t i) { return ( i < SCHED_MAX ) ? _src[i] : ""; }
+	void SetClock(const char *tz, const char *ntp);
+	const char *GetTz() { return _tz; }
+	const char *GetNtp() { return _ntp; }
+	uint8_t Compile();
+	void ReadJson(JsonObject &root);
+	void WriteJson(JsonObject &root);
+	void Exec();
+};
+
+extern Scheduler g_Scheduler;
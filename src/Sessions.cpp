@@ -0,0 +1,263 @@
+/**************************************************************************************************
+  Filename:       Sessions.cpp
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    client sessions implementation
+**************************************************************************************************/
+#include "Sessions.h"
+#include "HttpProbe.h"
+#include "LogRing.h"
+
+SessionTable g_Sessions;
+
+// URL names in /api/v1/<kind>/<num>/<method>
+const char *const SessionTable::k_kind_str[(uint8_t)DevKind_t::kNum] = {"dome", "switch", "safetymonitor", "observingconditions"};
+
+SessionTable::SessionTable()
+{
+	memset(_slot, 0, sizeof(_slot));
+	memset(_count, 0, sizeof(_count));
+	_used = 0;
+	_lease_ms = SESSION_LEASE_S * 1000;
+	_opened = 0;
+	_closed = 0;
+	_expired = 0;
+	_full = 0;
+	_probe_max = 0;
+	_mux = portMUX_INITIALIZER_UNLOCKED;
+}
+
+void SessionTable::Begin(AsyncWebServer *server)
+{
+	// the remote address is taken while the connection is up, it is gone when the response is sent
+	g_HttpProbe.AddHook(server,
+		[](AsyncWebServerRequest *request) -> uint32_t { return (uint32_t)request->client()->remoteIP(); },
+		[](AsyncWebServerRequest *request, uint32_t remote_ip) { g_Sessions.Request(request, remote_ip); });
+
+	server->on(SESSION_URL, HTTP_GET, [this](AsyncWebServerRequest *request) { _sendJson(request); });
+}
+
+uint32_t SessionTable::_home(DevKind_t kind, uint8_t num, uint32_t client_id, bool by_ip)
+{
+	uint32_t h = ( client_id ^ ((uint32_t)kind << 24 ) ^ ((uint32_t)num << 16 ) ^ ( by_ip ? 0x5A5A : 0 )) * 2654435761u;	// Knuth multiplicative
+	return h >> 27;											// top 5 bits, SESSION_SLOTS = 32
+}
+
+static_assert(SESSION_SLOTS == 32, "_home() takes the top 5 bits");
+static_assert(SESSION_MAX_USED < SESSION_SLOTS, "a free slot ends every probe chain");
+
+// call with _mux held. Returns the slot or -1
+int SessionTable::_find(DevKind_t kind, uint8_t num, uint32_t client_id, bool by_ip)
+{
+	uint32_t i = _home(kind, num, client_id, by_ip);
+	uint8_t n;
+
+	for(n = 0; _slot[i].used; n++) {
+		const Session_t &s = _slot[i];
+		if(( s.client_id == client_id ) && ( s.by_ip == by_ip ) && ( s.kind == kind ) && ( s.num == num )) {
+			if( n > _probe_max ) _probe_max = n;
+			return (int)i;
+		}
+		i = ( i + 1 ) & ( SESSION_SLOTS - 1 );
+	}
+	if( n > _probe_max ) _probe_max = n;
+	return -1;
+}
+
+// call with _mux held. Backward shift deletion, no tombstones
+void SessionTable::_remove(uint32_t i, uint32_t now)
+{
+	Session_t &s = _slot[i];
+	uint32_t j = i;
+
+	_length_s.Add(( now - s.open_ms ) / 1000);
+	_count[(uint8_t)s.kind][s.num]--;
+	_used--;
+	s.used = false;
+
+	for(;;) {
+		j = ( j + 1 ) & ( SESSION_SLOTS - 1 );
+		if( !_slot[j].used )
+			break;
+
+		uint32_t k = _home(_slot[j].kind, _slot[j].num, _slot[j].client_id, _slot[j].by_ip);
+		bool stays = ( i <= j ) ? (( i < k ) && ( k <= j )) : (( i < k ) || ( k <= j ));
+		if( stays )
+			continue;
+
+		_slot[i] = _slot[j];
+		_slot[j].used = false;
+		i = j;
+	}
+}
+
+// web server task, from the probe once the response is sent and the body params are parsed
+void SessionTable::Request(AsyncWebServerRequest *request, uint32_t remote_ip)
+{
+	const char *url = request->url().c_str();
+	DevKind_t kind = DevKind_t::kNum;
+	const char *p;
+	char *end;
+
+	if( strncmp(url, "/api/v1/", 8 ) != 0 )
+		return;
+
+	p = url + 8;
+	for(uint8_t k = 0; k < (uint8_t)DevKind_t::kNum; k++) {
+		size_t n = strlen(k_kind_str[k]);
+		if(( strncmp(p, k_kind_str[k], n) == 0 ) && ( p[n] == '/' )) {
+			kind = (DevKind_t)k;
+			p += n + 1;
+			break;
+		}
+	}
+	if( kind == DevKind_t::kNum )
+		return;
+
+	uint32_t num = strtoul(p, &end, 10);
+	if(( end == p ) || ( *end != '/' ) || ( num >= SESSION_MAX_DEVICES ))
+		return;
+	const char *method = end + 1;
+
+	// Alpaca parameter names are case insensitive
+	bool has_id = false;
+	uint32_t client_id = 0;
+	int connect = -1;										// -1 no change, 0 disconnect, 1 connect
+	for(size_t i = 0; i < request->params(); i++) {
+		AsyncWebParameter *prm = request->getParam(i);
+		if( strcasecmp(prm->name().c_str(), "ClientID") == 0 ) {
+			client_id = strtoul(prm->value().c_str(), nullptr, 10);
+			has_id = true;
+		} else if(( strcasecmp(prm->name().c_str(), "Connected") == 0 ) && prm->isPost() && ( strcasecmp(method, "connected") == 0 )) {
+			connect = ( strcasecmp(prm->value().c_str(), "true") == 0 ) ? 1 : 0;
+		}
+	}
+	bool by_ip = !has_id;									// ClientID is optional, key by address then
+	if( by_ip ) {
+		if( remote_ip == 0 )
+			return;
+		client_id = remote_ip;
+	}
+
+	uint32_t now = millis();
+	bool full = false;
+
+	portENTER_CRITICAL(&_mux);
+	int i = _find(kind, (uint8_t)num, client_id, by_ip);
+	if( i >= 0 ) {
+		Session_t &s = _slot[i];
+		if( connect == 0 ) {
+			_remove((uint32_t)i, now);
+			_closed++;
+		} else {
+			_gap_ms.Add(now - s.last_ms);
+			s.last_ms = now;
+			s.requests++;
+		}
+	} else if( connect == 1 ) {
+		if( _used >= SESSION_MAX_USED ) {
+			_full++;
+			full = true;
+		} else {
+			uint32_t j = _home(kind, (uint8_t)num, client_id, by_ip);
+			while( _slot[j].used )
+				j = ( j + 1 ) & ( SESSION_SLOTS - 1 );
+			_slot[j] = {client_id, now, now, 1, kind, (uint8_t)num, by_ip, true};
+			_count[(uint8_t)kind][num]++;
+			_used++;
+			_opened++;
+		}
+	}
+	portEXIT_CRITICAL(&_mux);
+
+	if( full )
+		RLOG_WARNING_PRINTF("Session table full, client %u not tracked\n", client_id);
+}
+
+// control tick: drop sessions whose lease ran out
+void SessionTable::Expire()
+{
+	uint32_t now = millis();
+
+	portENTER_CRITICAL(&_mux);
+	for(uint32_t i = 0; i < SESSION_SLOTS; i++) {
+		while( _slot[i].used && (( now - _slot[i].last_ms ) > _lease_ms )) {	// a shifted entry may land on i
+			RLOG_NOTICE_PRINTF("Session %s/%u client %u expired\n", k_kind_str[(uint8_t)_slot[i].kind], _slot[i].num, _slot[i].client_id);
+			_remove(i, now);
+			_expired++;
+		}
+	}
+	portEXIT_CRITICAL(&_mux);
+}
+
+// read without locking, may be one request stale
+uint8_t SessionTable::Count(DevKind_t kind, uint8_t num) const
+{
+	if(( kind >= DevKind_t::kNum ) || ( num >= SESSION_MAX_DEVICES ))
+		return 0;
+	return _count[(uint8_t)kind][num];
+}
+
+// API task. As RuleEngine::ReadJson(), settings saved before the sessions had their own section
+// are read from Switch_Configuration
+void SessionTable::ReadJson(JsonObject &root)
+{
+	JsonObject obj_config = root["Sessions_Configuration"];
+	if( !obj_config )
+		obj_config = root["Switch_Configuration"];
+	if( !obj_config )
+		return;
+
+	uint32_t _ls = obj_config["Client_lease_s"] | GetLease();
+	if(( _ls < 5 ) || ( _ls > 3600 ))		// validate 5s~1h
+		_ls = SESSION_LEASE_S;
+	SetLease(_ls);
+	RLOG_INFO_PRINTF("Client lease %us\n", _ls);
+}
+
+void SessionTable::WriteJson(JsonObject &root)
+{
+	JsonObject obj_config = root["Sessions_Configuration"].to<JsonObject>();
+
+	obj_config["Client_lease_s"] = GetLease();
+}
+
+void SessionTable::_sendJson(AsyncWebServerRequest *request)
+{
+	AsyncResponseStream *response = request->beginResponseStream("application/json");
+	Session_t s[SESSION_SLOTS];
+	uint32_t now = millis();
+
+	portENTER_CRITICAL(&_mux);
+	memcpy(s, _slot, sizeof(s));
+	portEXIT_CRITICAL(&_mux);
+
+	response->printf("{\"lease_s\":%u,\"active\":%u,\"opened\":%u,\"closed\":%u,\"expired\":%u,\"full\":%u,\"probe_max\":%u,\"sessions\":[",
+		_lease_ms / 1000, _used, _opened, _closed, _expired, _full, _probe_max);
+
+	bool first = true;
+	for(uint32_t i = 0; i < SESSION_SLOTS; i++) {
+		if( !s[i].used )
+			continue;
+		uint32_t idle = now - s[i].last_ms;
+		char client[20];
+		if( s[i].by_ip )										// lwIP keeps the first octet in the low byte
+			snprintf(client, sizeof(client), "\"%u.%u.%u.%u\"", s[i].client_id & 0xFF, ( s[i].client_id >> 8 ) & 0xFF,
+				( s[i].client_id >> 16 ) & 0xFF, s[i].client_id >> 24);
+		else
+			snprintf(client, sizeof(client), "%u", s[i].client_id);
+		response->printf("%s{\"device\":\"%s/%u\",\"client_id\":%s,\"age_s\":%u,\"idle_ms\":%u,\"lease_left_ms\":%u,\"requests\":%u}",
+			first ? "" : ",", k_kind_str[(uint8_t)s[i].kind], s[i].num, client, ( now - s[i].open_ms ) / 1000,
+			idle, ( idle < _lease_ms ) ? _lease_ms - idle : 0, s[i].requests);
+		first = false;
+	}
+
+	response->print("],\"gap_ms\":");
+	_gap_ms.PrintJson(*response);
+	response->print(",\"length_s\":");
+	_length_s.PrintJson(*response);
+	response->print("}");
+
+	request->send(response);
+}
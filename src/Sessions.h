@@ -0,0 +1,85 @@
+/**************************************************************************************************
+  Filename:       Sessions.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    client sessions per device, keyed by the Alpaca ClientID, or by the remote IPv4
+                  address for a client that sends none (ClientID is optional). A PUT connected=true
+                  opens a session, every request of the client renews its lease, connected=false
+                  or a lease with no requests ends it. Devices drive their outputs from the
+                  session count instead of the connect/disconnect counter, so a client that
+                  vanishes without a goodbye is dropped and the count can't drift.
+                  Open addressing table, O(1) lookup, fixed memory. The lease, common to all
+                  devices, is in Sessions_Configuration, a section that ReadJson() and WriteJson()
+                  own, hosted by the switch device settings: the library persists devices only.
+**************************************************************************************************/
+#pragma once
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <ArduinoJson.h>
+#include "Histogram.h"
+
+#define SESSION_SLOTS           32          // power of 2
+#define SESSION_MAX_USED        24          // load limit, keeps probe chains short
+#define SESSION_MAX_DEVICES     4           // device numbers per kind
+#define SESSION_LEASE_S         60          // default lease
+#define SESSION_URL             "/sessions"
+
+enum struct DevKind_t : uint8_t
+{
+	kDome = 0,
+	kSwitch,
+	kSafetyMonitor,
+	kObsCond,
+	kNum
+};
+
+struct Session_t
+{
+	uint32_t client_id;						// or the IPv4 address when by_ip
+	uint32_t open_ms;
+	uint32_t last_ms;						// last request, the lease runs from here
+	uint32_t requests;
+	DevKind_t kind;
+	uint8_t num;
+	bool by_ip;								// the client sent no ClientID
+	bool used;
+};
+
+class SessionTable
+{
+private:
+	Session_t _slot[SESSION_SLOTS];
+	uint8_t _count[(uint8_t)DevKind_t::kNum][SESSION_MAX_DEVICES];
+	uint8_t _used;
+	uint32_t _lease_ms;
+
+	uint32_t _opened;
+	uint32_t _closed;						// connected=false
+	uint32_t _expired;
+	uint32_t _full;							// connects refused, table at SESSION_MAX_USED
+	uint8_t _probe_max;						// longest chain walked by a lookup
+	Histogram _gap_ms;						// between two requests of a session
+	Histogram _length_s;					// session length at close or expiry
+	portMUX_TYPE _mux;
+
+	static const char *const k_kind_str[(uint8_t)DevKind_t::kNum];
+
+	static uint32_t _home(DevKind_t kind, uint8_t num, uint32_t client_id, bool by_ip);
+	int _find(DevKind_t kind, uint8_t num, uint32_t client_id, bool by_ip);
+	void _remove(uint32_t i, uint32_t now);
+	void _sendJson(AsyncWebServerRequest *request);
+
+public:
+	SessionTable();
+	void Begin(AsyncWebServer *server);
+	void Request(AsyncWebServerRequest *request, uint32_t remote_ip);
+	void Expire();
+	uint8_t Count(DevKind_t kind, uint8_t num) const;
+	void SetLease(uint32_t lease_s) { _lease_ms = lease_s * 1000; }
+	uint32_t GetLease() const { return _lease_ms / 1000; }
+	void ReadJson(JsonObject &root);
+	void WriteJson(JsonObject &root);
+};
+
+extern SessionTable g_Sessions;
@@ -0,0 +1,138 @@
+/**************************************************************************************************
+  Filename:       ShiftReg.cpp
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    74HC165 / 74HC595 chain transfer. The whole chain is clocked in one burst
+                  with direct GPIO register access, scan time grows linearly with the length.
+**************************************************************************************************/
+#include <Arduino.h>
+#include <soc/gpio_struct.h>
+#include <ESPAsyncWebServer.h>
+#include "ShiftReg.h"
+
+static_assert(SR_OUT_PIN_OE < 32 && SR_OUT_PIN_STCP < 32 && SR_OUT_PIN_MR < 32 && SR_OUT_PIN_SHCP < 32 && SR_OUT_PIN_SDOUT < 32 &&
+			  SR_IN_PIN_CE < 32 && SR_IN_PIN_CP < 32 && SR_IN_PIN_PL < 32 && SR_IN_PIN_SDIN < 32,
+			  "shift register pins must be GPIO0~31 for direct register access");
+
+SrStats_t g_sr_stats;
+
+static inline void sr_hi(uint8_t pin) { GPIO.out_w1ts = ( 1u << pin ); }
+static inline void sr_lo(uint8_t pin) { GPIO.out_w1tc = ( 1u << pin ); }
+static inline uint32_t sr_get(uint8_t pin) { return ( GPIO.in >> pin ) & 1; }
+
+// ~50ns at 240MHz, covers the 74HC clock pulse width at 3.3V
+static inline void sr_delay(void) { __asm__ __volatile__("nop; nop; nop; nop; nop; nop; nop; nop; nop; nop; nop; nop"); }
+
+// The base board reads its two 165 high byte first; expansion boards hang on the serial input
+// of the last one, so they are clocked after it. Keep base bits 0~15 where they are.
+static inline size_t sr_in_byte(size_t c)
+{
+	return (( SR_IN_BYTES >= 2 ) && ( c < 2 )) ? 1 - c : c;
+}
+
+static inline void sr_account(uint32_t cycles, uint32_t &last, uint32_t &max, uint32_t &count)
+{
+	last = cycles;
+	if( cycles > max )
+		max = cycles;
+	count++;
+}
+
+uint32_t sr_cycles_to_ns(uint32_t cycles)
+{
+	return (uint32_t)(((uint64_t)cycles * 1000) / ESP.getCpuFreqMHz());
+}
+
+// chain length and transfer times, the cost per byte should stay flat as boards are added
+void sr_begin(AsyncWebServer *server)
+{
+	server->on(SR_URL, HTTP_GET, [](AsyncWebServerRequest *request) {
+		uint32_t rd = sr_cycles_to_ns(g_sr_stats.read_cycles);
+		uint32_t wr = sr_cycles_to_ns(g_sr_stats.write_cycles);
+
+		AsyncResponseStream *response = request->beginResponseStream("application/json");
+		response->printf("{\"in_bytes\":%u,\"out_bytes\":%u,\"reads\":%u,\"writes\":%u,"
+						 "\"read_ns\":%u,\"read_ns_max\":%u,\"read_ns_per_byte\":%u,"
+						 "\"write_ns\":%u,\"write_ns_max\":%u,\"write_ns_per_byte\":%u}",
+			SR_IN_BYTES, SR_OUT_BYTES, g_sr_stats.reads, g_sr_stats.writes,
+			rd, sr_cycles_to_ns(g_sr_stats.read_cycles_max), rd / SR_IN_BYTES,
+			wr, sr_cycles_to_ns(g_sr_stats.write_cycles_max), wr / SR_OUT_BYTES);
+		request->send(response);
+	});
+}
+
+// read inputs from the 165 chain. Inputs are active low, the image holds 1 for an active input
+void read_shift_register(SrIn_t &v)
+{
+	uint32_t t0 = ESP.getCycleCount();
+
+	sr_lo(SR_IN_PIN_CP);    				// be sure CP is low
+	sr_lo(SR_IN_PIN_PL);    				// latch parallel inputs
+	sr_delay();
+	sr_hi(SR_IN_PIN_PL);
+	sr_delay();
+	sr_lo(SR_IN_PIN_CE);    				// on CE -> low, D7 is available on serial out Q7
+	sr_delay();
+
+	for(size_t c = 0; c < SR_IN_BYTES; c++) {
+		uint8_t x = 0;
+
+		for(uint8_t i = 0; i < 8; i++) {
+			x = (uint8_t)(( x << 1 ) | sr_get(SR_IN_PIN_SDIN));
+
+			sr_hi(SR_IN_PIN_CP);			// shift to the left
+			sr_delay();
+			sr_lo(SR_IN_PIN_CP);
+			sr_delay();
+		}
+
+		v.b[sr_in_byte(c)] = (uint8_t)~x;
+	}
+
+	sr_hi(SR_IN_PIN_CE);
+
+	sr_account(ESP.getCycleCount() - t0, g_sr_stats.read_cycles, g_sr_stats.read_cycles_max, g_sr_stats.reads);
+}
+
+// put the image on the 595 chain, last byte first so bit 0 ends on the board nearest to the CPU
+void write_shift_register(const SrOut_t &v)
+{
+	uint32_t t0 = ESP.getCycleCount();
+
+	sr_lo(SR_OUT_PIN_SDOUT);				// 14 serial data low
+	sr_lo(SR_OUT_PIN_MR);					// 10 clear previous data
+	sr_delay();
+	sr_hi(SR_OUT_PIN_SHCP);					// 11 shift register clock
+	sr_delay();
+	sr_lo(SR_OUT_PIN_SHCP);
+	sr_delay();
+	sr_hi(SR_OUT_PIN_MR);
+	sr_delay();
+
+	for(size_t c = SR_OUT_BYTES; c-- > 0; ) {
+		uint8_t x = v.b[c];
+
+		for(uint8_t i = 0; i < 8; i++) {
+			if(( x & 0x80 ) == 0 )
+				sr_lo(SR_OUT_PIN_SDOUT);
+			else
+				sr_hi(SR_OUT_PIN_SDOUT);
+
+			sr_delay();
+			sr_hi(SR_OUT_PIN_SHCP);
+			sr_delay();
+			sr_lo(SR_OUT_PIN_SHCP);
+
+			x = (uint8_t)( x << 1 );
+		}
+	}
+
+	sr_delay();
+	sr_hi(SR_OUT_PIN_STCP);					// transfer serial data to parallel output
+	sr_delay();
+	sr_lo(SR_OUT_PIN_STCP);					// 12
+	sr_lo(SR_OUT_PIN_OE);					// 13 enable output
+
+	sr_account(ESP.getCycleCount() - t0, g_sr_stats.write_cycles, g_sr_stats.write_cycles_max, g_sr_stats.writes);
+}
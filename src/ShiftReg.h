@@ -0,0 +1,96 @@
+/**************************************************************************************************
+  Filename:       ShiftReg.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    daisy-chained 74HC165 / 74HC595 shift registers of any length.
+                  The chain is held in a byte image, bit n is in byte n/8.
+**************************************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "defines.h"
+
+class AsyncWebServer;
+
+#define SR_URL              "/shiftreg"
+
+template<size_t N>
+struct SrImage
+{
+	uint8_t b[N];
+
+	constexpr SrImage() : b{} {}
+
+	static constexpr size_t bits() { return N * 8; }
+
+	constexpr bool test(size_t pos) const { return (( b[pos >> 3] >> ( pos & 7 )) & 1 ) != 0; }
+
+	constexpr void set(size_t pos) { b[pos >> 3] |= (uint8_t)( 1u << ( pos & 7 )); }
+
+	constexpr SrImage operator|(const SrImage &o) const
+	{
+		SrImage v;
+		for(size_t i = 0; i < N; i++) v.b[i] = b[i] | o.b[i];
+		return v;
+	}
+
+	constexpr SrImage operator&(const SrImage &o) const
+	{
+		SrImage v;
+		for(size_t i = 0; i < N; i++) v.b[i] = b[i] & o.b[i];
+		return v;
+	}
+
+	constexpr SrImage operator~() const
+	{
+		SrImage v;
+		for(size_t i = 0; i < N; i++) v.b[i] = (uint8_t)~b[i];
+		return v;
+	}
+
+	SrImage &operator|=(const SrImage &o) { for(size_t i = 0; i < N; i++) b[i] |= o.b[i]; return *this; }
+	SrImage &operator&=(const SrImage &o) { for(size_t i = 0; i < N; i++) b[i] &= o.b[i]; return *this; }
+
+	constexpr bool operator==(const SrImage &o) const
+	{
+		for(size_t i = 0; i < N; i++)
+			if( b[i] != o.b[i] )
+				return false;
+		return true;
+	}
+
+	constexpr bool operator!=(const SrImage &o) const { return !(*this == o); }
+
+	constexpr explicit operator bool() const
+	{
+		for(size_t i = 0; i < N; i++)
+			if( b[i] )
+				return true;
+		return false;
+	}
+};
+
+static_assert(SR_IN_BYTES >= 1 && SR_IN_BYTES <= 32, "SR_IN_BYTES out of range");
+static_assert(SR_OUT_BYTES >= 1 && SR_OUT_BYTES <= 32, "SR_OUT_BYTES out of range");
+
+typedef SrImage<SR_IN_BYTES> SrIn_t;		// image of the 165 input chain
+typedef SrImage<SR_OUT_BYTES> SrOut_t;		// image of the 595 output chain
+
+// timing of the last transfers, in CPU cycles
+struct SrStats_t
+{
+	uint32_t read_cycles;
+	uint32_t read_cycles_max;
+	uint32_t write_cycles;
+	uint32_t write_cycles_max;
+	uint32_t reads;
+	uint32_t writes;
+};
+
+extern SrStats_t g_sr_stats;
+
+void sr_begin(AsyncWebServer *server);
+void read_shift_register(SrIn_t &v);
+void write_shift_register(const SrOut_t &v);
+uint32_t sr_cycles_to_ns(uint32_t cycles);
@@ -0,0 +1,181 @@
+/**************************************************************************************************
+  Filename:       StateBus.cpp
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    publish/subscribe state bus implementation
+**************************************************************************************************/
+#include "StateBus.h"
+#include "LogRing.h"
+
+StateBus g_StateBus;
+
+const char *const StateBus::k_topic_str[(uint8_t)Topic_t::kNum] = {"sr_in", "weather", "ws_link", "safety", "switch_write", "dome_state", "dome_cmd", "switch_state"};
+
+StateBus::StateBus()
+{
+	_head = 0;
+	_count = 0;
+	_count_max = 0;
+	_pending = 0;
+	for(uint8_t t = 0; t < (uint8_t)Topic_t::kNum; t++) {
+		_last_valid[t] = false;
+		_num_subs[t] = 0;
+		_stats[t] = {0, 0, 0, 0, 0};
+	}
+	_mux = portMUX_INITIALIZER_UNLOCKED;
+}
+
+void StateBus::Begin(AsyncWebServer *server)
+{
+	server->on(STATEBUS_URL, HTTP_GET, [this](AsyncWebServerRequest *request) { _sendJson(request); });
+}
+
+// call from setup() only, the tables are not locked
+bool StateBus::Subscribe(Topic_t topic, BusHandler_t handler, void *ctx)
+{
+	uint8_t t = (uint8_t)topic;
+
+	if(( t >= (uint8_t)Topic_t::kNum ) || ( _num_subs[t] >= STATEBUS_MAX_SUBS )) {
+		SLOG_ERROR_PRINTF("StateBus subscriber table full, topic %u\n", t);
+		return false;
+	}
+
+	_handler[t][_num_subs[t]] = handler;
+	_ctx[t][_num_subs[t]] = ctx;
+	_num_subs[t]++;
+	return true;
+}
+
+bool StateBus::_same(const BusEvent_t &a, const BusEvent_t &b)
+{
+	switch(a.topic)
+	{
+		case Topic_t::kSrIn:		return a.in == b.in;
+		case Topic_t::kWeather:		return memcmp(&a.ws, &b.ws, sizeof(WsSample_t)) == 0;
+		case Topic_t::kWsLink:		return a.link == b.link;
+		case Topic_t::kSafety:		return a.safety == b.safety;
+		case Topic_t::kSwitchState:	return memcmp(&a.sw_state, &b.sw_state, sizeof(SwitchState_t)) == 0;
+		default:					return false;		// commands are never coalesced
+	}
+}
+
+static_assert((uint8_t)Topic_t::kNum <= 16, "_pending bits");
+
+// topics whose subscribers need the current value, not every value on the way
+bool StateBus::_isState(Topic_t topic)
+{
+	switch(topic)
+	{
+		case Topic_t::kSrIn:
+		case Topic_t::kWsLink:
+		case Topic_t::kSafety:
+		case Topic_t::kSwitchState:	return true;
+		default:					return false;
+	}
+}
+
+// any task. Returns false only if the event was dropped, never for a state topic
+bool StateBus::_push(const BusEvent_t &ev, bool on_change)
+{
+	uint8_t t = (uint8_t)ev.topic;
+	bool ok = true;
+
+	if( t >= (uint8_t)Topic_t::kNum )
+		return false;
+
+	portENTER_CRITICAL(&_mux);
+	if( on_change && _last_valid[t] && _same(ev, _last[t] )) {
+		_stats[t].unchanged++;
+	} else if( _isState(ev.topic) ) {
+		if( _pending & ( 1 << t ))
+			_stats[t].coalesced++;
+		_last[t] = ev;
+		_last[t].us = (uint32_t)esp_timer_get_time();
+		_last_valid[t] = true;
+		_pending |= (uint16_t)( 1 << t );
+		_stats[t].published++;
+	} else if( _count >= STATEBUS_QUEUE ) {
+		_stats[t].dropped++;
+		ok = false;
+	} else {
+		BusEvent_t &q = _queue[( _head + _count ) % STATEBUS_QUEUE];
+		q = ev;
+		q.us = (uint32_t)esp_timer_get_time();
+		_count++;
+		if( _count > _count_max )
+			_count_max = _count;
+		_last[t] = ev;
+		_last_valid[t] = true;
+		_stats[t].published++;
+	}
+	portEXIT_CRITICAL(&_mux);
+
+	if( !ok )
+		RLOG_WARNING_PRINTF("StateBus queue full, %s event dropped\n", k_topic_str[t]);
+
+	return ok;
+}
+
+// next event to deliver: pending state slots in topic order, then the queue. False when idle
+bool StateBus::_next(BusEvent_t &ev)
+{
+	bool found = true;
+
+	portENTER_CRITICAL(&_mux);
+	if( _pending ) {
+		uint8_t t = (uint8_t)__builtin_ctz(_pending);
+		ev = _last[t];
+		_pending &= (uint16_t)~( 1 << t );
+	} else if( _count ) {
+		ev = _queue[_head];
+		_head = ( _head + 1 ) % STATEBUS_QUEUE;
+		_count--;
+	} else {
+		found = false;
+	}
+	portEXIT_CRITICAL(&_mux);
+
+	return found;
+}
+
+// control task: deliver the state slots, then the queued events in order. Events published by a
+// handler are delivered in the same call, bounded so a feedback loop can't hold the tick
+void StateBus::Dispatch()
+{
+	BusEvent_t ev;
+
+	for(uint32_t n = 0; n < 2 * STATEBUS_QUEUE; n++) {
+		if( !_next(ev) )
+			break;
+
+		uint8_t t = (uint8_t)ev.topic;
+		uint32_t t0 = (uint32_t)esp_timer_get_time();
+
+		_latency.Add(t0 - ev.us);
+		for(uint8_t s = 0; s < _num_subs[t]; s++)
+			_handler[t][s](ev, _ctx[t][s]);
+		_stats[t].delivered += _num_subs[t];
+		_dispatch.Add((uint32_t)esp_timer_get_time() - t0);
+	}
+}
+
+void StateBus::_sendJson(AsyncWebServerRequest *request)
+{
+	AsyncResponseStream *response = request->beginResponseStream("application/json");
+
+	response->printf("{\"queue\":%u,\"queue_max\":%u,\"queue_size\":%u,\"topics\":{", _count, _count_max, STATEBUS_QUEUE);
+	for(uint8_t t = 0; t < (uint8_t)Topic_t::kNum; t++) {
+		const BusTopicStats_t &s = _stats[t];
+		response->printf("%s\"%s\":{\"slot\":%s,\"subscribers\":%u,\"published\":%u,\"unchanged\":%u,\"dropped\":%u,\"coalesced\":%u,\"delivered\":%u}",
+			( t > 0 ) ? "," : "", k_topic_str[t], _isState((Topic_t)t) ? "true" : "false", _num_subs[t], s.published, s.unchanged,
+			s.dropped, s.coalesced, s.delivered);
+	}
+	response->print("},\"dispatch_us\":");
+	_dispatch.PrintJson(*response);
+	response->print(",\"latency_us\":");
+	_latency.PrintJson(*response);
+	response->print("}");
+
+	request->send(response);
+}
@@ -0,0 +1,155 @@
+/**************************************************************************************************
+  Filename:       StateBus.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    in-process publish/subscribe bus between the producers (input scan, weather
+                  station link, safety monitor, HTTP commands) and the devices. Events go to a
+                  fixed queue from any task and are dispatched to the topic subscribers in the
+                  control tick. State topics (inputs, link, safety, switch state) have a latest
+                  value slot instead of queue entries: a publish can't be dropped, a newer value
+                  replaces one not yet dispatched, and they are delivered before queued events.
+**************************************************************************************************/
+#pragma once
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "ShiftReg.h"
+#include "Histogram.h"
+
+#define STATEBUS_QUEUE          32          // events waiting for dispatch
+#define STATEBUS_RESERVE        8           // queue entries the rules and the schedule leave to others
+#define STATEBUS_MAX_SUBS       6           // subscribers per topic
+#define STATEBUS_URL            "/bus"
+
+enum struct Topic_t : uint8_t
+{
+	kSrIn = 0,								// input chain image, on change
+	kWeather,								// accepted weather station frame, every frame
+	kWsLink,								// weather station link up/down, on change
+	kSafety,								// SAFEMON_*_BIT, on change
+	kSwitchWrite,							// Switch value written by a client
+	kDomeState,								// shutter status of one roof, on change
+	kDomeCmd,								// open / close / abort from a remote client
+	kSwitchState,							// Switch outputs and heaters, on change
+	kNum
+};
+
+// weather station frame, 1adu as in the frame: 0.1C, km/h, %, lux. -1 = not reported
+struct WsSample_t
+{
+	int16_t tsky;
+	int16_t tair;
+	int16_t wind;
+	int16_t hum;
+	int16_t rain;
+	int16_t light;
+	int16_t clouds;
+	int16_t stars;
+};
+
+struct SwitchWrite_t
+{
+	uint16_t id;
+	uint16_t value;
+	uint16_t seq;							// SetAsync request, 0 = synchronous write
+};
+
+struct DomeState_t
+{
+	uint8_t num;
+	uint8_t shutter;						// AlpacaShutterStatus_t
+	bool slewing;
+};
+
+enum struct DomeCmdKind_t : uint8_t
+{
+	kOpen = 0,
+	kClose,
+	kAbort
+};
+
+struct DomeCmd_t
+{
+	uint8_t num;
+	DomeCmdKind_t cmd;
+};
+
+// bit n = OUT n+1, heater n+1 in auto
+struct SwitchState_t
+{
+	SrOut_t out;							// relay outputs, expansion boards included: fewer than the 595 bits
+	uint8_t heat_auto;
+	uint8_t pwm[4];							// manual duty, 0~100
+	uint8_t heat_duty[4];					// applied duty
+};
+
+struct BusEvent_t
+{
+	Topic_t topic;
+	uint32_t us;							// esp_timer at publish
+	union {
+		WsSample_t ws;
+		SrIn_t in;
+		bool link;
+		uint8_t safety;
+		SwitchWrite_t sw;
+		DomeState_t dome;
+		DomeCmd_t dome_cmd;
+		SwitchState_t sw_state;
+	};
+
+	BusEvent_t() : topic(Topic_t::kNum), us(0), ws{} {}
+	explicit BusEvent_t(Topic_t t) : topic(t), us(0), ws{} {}
+};
+
+// runs in the control task, must not block
+typedef void (*BusHandler_t)(const BusEvent_t &ev, void *ctx);
+
+struct BusTopicStats_t
+{
+	uint32_t published;
+	uint32_t unchanged;						// publish on change skipped, same value
+	uint32_t dropped;						// queue full
+	uint32_t coalesced;						// state slot replaced before dispatch
+	uint32_t delivered;						// handler calls
+};
+
+class StateBus
+{
+private:
+	BusEvent_t _queue[STATEBUS_QUEUE];
+	uint8_t _head;							// next to dispatch
+	uint8_t _count;
+	uint8_t _count_max;						// queue high water
+	BusEvent_t _last[(uint8_t)Topic_t::kNum];	// last published value, for publish on change; the slot of state topics
+	bool _last_valid[(uint8_t)Topic_t::kNum];
+	uint16_t _pending;						// bit per state topic, slot not dispatched yet
+
+	BusHandler_t _handler[(uint8_t)Topic_t::kNum][STATEBUS_MAX_SUBS];
+	void *_ctx[(uint8_t)Topic_t::kNum][STATEBUS_MAX_SUBS];
+	uint8_t _num_subs[(uint8_t)Topic_t::kNum];
+
+	BusTopicStats_t _stats[(uint8_t)Topic_t::kNum];
+	Histogram _dispatch;					// all handlers of one event, us
+	Histogram _latency;						// publish -> dispatch, us
+	portMUX_TYPE _mux;
+
+	static const char *const k_topic_str[(uint8_t)Topic_t::kNum];
+
+	static bool _same(const BusEvent_t &a, const BusEvent_t &b);
+	static bool _isState(Topic_t topic);
+	bool _push(const BusEvent_t &ev, bool on_change);
+	bool _next(BusEvent_t &ev);
+	void _sendJson(AsyncWebServerRequest *request);
+
+public:
+	StateBus();
+	void Begin(AsyncWebServer *server);
+	bool Subscribe(Topic_t topic, BusHandler_t handler, void *ctx);
+	bool Publish(const BusEvent_t &ev) { return _push(ev, false); }
+	bool PublishChange(const BusEvent_t &ev) { return _push(ev, true); }
+	uint8_t Room() const { return STATEBUS_QUEUE - _count; }	// free queue entries, may be stale
+	void Dispatch();
+};
+
+extern StateBus g_StateBus;
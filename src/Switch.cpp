@@ -6,55 +6,54 @@
   Description:    ASCOM Alpaca ESP32 TSBoard implementation
 **************************************************************************************************/
 #include "Switch.h"
-
-const uint32_t k_num_of_switch_devices = 20;
-
-SwitchDevice_t init_switch_device[k_num_of_switch_devices] = {
-    {false, false, "Switch_0", "IN 1 (R)", 0.0, 0.0, 1.0, 1.0},
-    {false, false, "Switch_1", "IN 2 (R)", 0.0, 0.0, 1.0, 1.0},
-    {false, false, "Switch_2", "IN 3 (R)", 0.0, 0.0, 1.0, 1.0},
-    {false, false, "Switch_3", "IN 4 (R)", 0.0, 0.0, 1.0, 1.0},
-    {false, false, "Switch_4", "IN 5 (R)", 0.0, 0.0, 1.0, 1.0},
-    {false, false, "Switch_5", "IN 6 (R)", 0.0, 0.0, 1.0, 1.0},
-    {false, false, "Switch_6", "IN 7 (R)", 0.0, 0.0, 1.0, 1.0},
-    {false, false, "Switch_7", "IN 8 (R)", 0.0, 0.0, 1.0, 1.0},
-    {false, true, "Switch_8", "OUT 1 (RW)", 0.0, 0.0, 1.0, 1.0},
-    {false, true, "Switch_9", "OUT 2 (RW)", 0.0, 0.0, 1.0, 1.0},
-    {false, true, "Switch_10", "OUT 3 (RW)", 0.0, 0.0, 1.0, 1.0},
-    {false, true, "Switch_11", "OUT 4 (RW)", 0.0, 0.0, 1.0, 1.0},
-    {false, true, "Switch_12", "OUT 5 (RW)", 0.0, 0.0, 1.0, 1.0},
-    {false, true, "Switch_13", "OUT 6 (RW)", 0.0, 0.0, 1.0, 1.0},
-    {false, true, "Switch_14", "OUT 7 (RW)", 0.0, 0.0, 1.0, 1.0},
-    {false, true, "Switch_15", "OUT 8 (RW)", 0.0, 0.0, 1.0, 1.0},
-
-    {false, true, "Switch_16", "PWM 1 (RW)", 0.0, 0.0, 100.0, 1.0},
-    {false, true, "Switch_17", "PWM 2 (RW)", 0.0, 0.0, 100.0, 1.0},
-    {false, true, "Switch_18", "PWM 3 (RW)", 0.0, 0.0, 100.0, 1.0},
-    {false, true, "Switch_19", "PWM 4 (RW)", 0.0, 0.0, 100.0, 1.0}
-    };
+#include "LogRing.h"
+#include "HeapMonitor.h"
+#include "Trace.h"
+#include "HttpStats.h"
+#include "DewHeater.h"
+#include "Rules.h"
+#include "Schedule.h"
+#include "Mqtt.h"
 
 Switch::Switch() : AlpacaSwitch(k_num_of_switch_devices)
 {
   // constructor
   //_p_swtc = AlpacaSwitch::_p_switch_devices;
+  for(size_t i=0; i<k_num_sw_in; i++)
+    _in[i] = false;
+  for(size_t i=0; i<k_num_sw_out; i++)
+    _out[i] = false;
+  for(size_t i=0; i<k_num_sw_pwm; i++)
+    _pwm[i] = 0;
+  _cfg.Reset(SwitchConfig_t());               // all off, no settle time
+  _leased = false;
+  _dirty = true;
+  memset(_async, 0, sizeof(_async));
+  _route_stid = 0;
 }
 
 void Switch::Begin()
 {
+  // Switch metadata comes from the channel table, see ChannelMap.h
   for (uint32_t u = 0; u < k_num_of_switch_devices; u++)
   {
-    InitSwitchInitBySetup(u, init_switch_device[u].init_by_setup);
-    InitSwitchCanWrite(u, init_switch_device[u].can_write);
-    InitSwitchName(u, init_switch_device[u].name);
-    InitSwitchDescription(u, init_switch_device[u].description);
-    InitSwitchValue(u, init_switch_device[u].value);
-    InitSwitchMinValue(u, init_switch_device[u].min_value);
-    InitSwitchMaxValue(u, init_switch_device[u].max_value);
-    InitSwitchStep(u, init_switch_device[u].step);
+    const Channel_t &ch = k_channels[k_switch_ch[u]];
+
+    InitSwitchInitBySetup(u, false);
+    InitSwitchCanWrite(u, ch_switch_writable(ch.kind));
+    InitSwitchName(u, ch.name);
+    InitSwitchDescription(u, ch.description);
+    InitSwitchValue(u, 0.0);
+    InitSwitchMinValue(u, 0.0);
+    InitSwitchMaxValue(u, (double)ch_switch_max(ch.kind));
+    InitSwitchStep(u, 1.0);
   }
 
   AlpacaSwitch::Begin();
 
+  g_StateBus.Subscribe(Topic_t::kSrIn, _onInputs, this);
+  g_StateBus.Subscribe(Topic_t::kSwitchWrite, _onWrite, this);
+
   // SLOG_PRINTF(SLOG_INFO, "REGISTER handler for \"%s\"\n", "/setup/v1/switch/0/setup");
   // _p_alpaca_server->getServerTCP()->on("/setup/v1/switch/0/setup", HTTP_GET, [this](AsyncWebServerRequest *request)
   //                                      { DBG_REQ; _alpacaGetPage(request, FOCUSER_SETUP_URL); DBG_END; });
@@ -67,64 +66,336 @@ void Switch::Begin()
 #endif
 }
 
+static_assert(( k_num_sw_out <= SrOut_t::bits() ) && ( k_num_sw_pwm <= 4 ), "SwitchState_t bit and duty fields");
+
 void Switch::Loop()
 {
-  // copy inputs to AlpacaSwitch::_p_switch_devices
-  for(int i=0; i<8; i++)
-  {
-    if(_sw_in[i])                             // set input value to AlpacaSwitch::_p_switch_devices[] array. Value is read from shift register
-      AlpacaSwitch::SetSwitch(i, true);
-    else
-      AlpacaSwitch::SetSwitch(i, false);
-  
-    if( AlpacaSwitch::GetValue(i + 8) )       // set OUTs and PWMs to HW
-      _sw_out[i] = true;
-    else
-      _sw_out[i] = false;
+  BusEvent_t ev(Topic_t::kSwitchState);
+
+  ev.sw_state = SwitchState_t();                           // the union clears only its first member
+  for(size_t i=0; i<k_num_sw_heat; i++) {                 // dew heater mode and applied duty
+    AlpacaSwitch::SetSwitch(k_sw_heat_auto_id[i], g_DewHeater.GetAuto(i));
+    AlpacaSwitch::SetSwitchValue(k_sw_heat_duty_id[i], (double)g_DewHeater.GetDuty(i));
+    ev.sw_state.heat_auto |= (uint8_t)( g_DewHeater.GetAuto(i) << i );
+    ev.sw_state.heat_duty[i] = g_DewHeater.GetDuty(i);
+  }
+  for(size_t i=0; i<k_num_sw_out; i++)
+    if( _out[i] )
+      ev.sw_state.out.set(i);
+  for(size_t i=0; i<k_num_sw_pwm; i++)
+    ev.sw_state.pwm[i] = _pwm[i];
+  g_StateBus.PublishChange(ev);                            // for telemetry
+
+  for(uint32_t id=0; id<k_num_of_switch_devices; id++)     // SetAsync writes still settling
+    if( _async[id].applied != _async[id].done )
+      _settle(id);
+}
+
+// an async write is complete when the output has its value and the load had its settle time.
+// PWMs fade in hardware, the settle time counts from the end of the fade
+void Switch::_settle(uint32_t id)
+{
+  const SwitchConfig_t &cfg = _cfg.Get();
+  SwitchAsync_t &a = _async[id];
+  uint32_t ord = k_switch_ord[id];
+  uint32_t wait_ms;
+
+  if( k_channels[k_switch_ch[id]].kind == ChKind_t::kSwPwm ) {
+    wait_ms = cfg.settle_pwm[ord];
+    if( !g_DewHeater.GetAuto(ord) && !g_DewHeater.Ramped(ord, (uint8_t)a.value) ) {
+      a.applied_ms = millis();                             // in auto the dew stage owns the duty
+      return;
+    }
+  } else {
+    wait_ms = cfg.settle_out[ord];
   }
+  if(( millis() - a.applied_ms ) >= wait_ms )
+    a.done = a.applied;
+}
+
+// input chain changed: copy inputs to AlpacaSwitch::_p_switch_devices
+void Switch::_onInputs(const BusEvent_t &ev, void *ctx)
+{
+  Switch *self = (Switch *)ctx;
 
-  for(int i=0; i<4; i++)
+  ch_unpack_sw_in(ev.in, self->_in);
+  for(size_t i=0; i<k_num_sw_in; i++)
+    self->SetSwitch(k_sw_in_id[i], self->_in[i]);
+}
+
+// a client wrote a switch, applied in the control task
+void Switch::_onWrite(const BusEvent_t &ev, void *ctx)
+{
+  Switch *self = (Switch *)ctx;
+  uint32_t ord = k_switch_ord[ev.sw.id];
+
+  switch(k_channels[k_switch_ch[ev.sw.id]].kind)
   {
-    _sw_pwm[i + 16] = (uint8_t)AlpacaSwitch::GetSwitchValue(i + 16);
+    case ChKind_t::kSwOut:
+      self->_out[ord] = ( ev.sw.value != 0 );
+      break;
+    case ChKind_t::kSwPwm:
+      self->_pwm[ord] = (uint8_t)ev.sw.value;
+      break;
+    case ChKind_t::kSwHeatAuto:
+      g_DewHeater.SetAuto(ord, ev.sw.value != 0);
+      break;
+    default:
+      return;
+  }
+  self->SetSwitchValue(ev.sw.id, (double)ev.sw.value);   // rule writes show to clients too
+  self->_dirty = true;
+
+  SwitchAsync_t &a = self->_async[ev.sw.id];
+  if( ev.sw.seq != 0 )
+    a.applied = ev.sw.seq;
+  if( a.applied != a.done ) {                            // any write moves the target of a pending one
+    a.value = ev.sw.value;
+    a.applied_ms = millis();
+  }
+}
+
+// last client session closed or expired: outputs with the "off" policy are switched off, "keep"
+// outputs hold their value. Rules may drive outputs without clients
+void Switch::_leaseEnded()
+{
+  const SwitchConfig_t &cfg = _cfg.Get();
+
+  for(size_t i=0; i<k_num_sw_out; i++) {
+    if( !cfg.keep_out[i] && _out[i] ) {
+      _out[i] = false;
+      SetSwitchValue(k_sw_out_id[i], 0.0);
+    }
+  }
+  for(size_t i=0; i<k_num_sw_pwm; i++) {
+    if( !cfg.keep_pwm[i] && _pwm[i] ) {
+      _pwm[i] = 0;
+      SetSwitchValue(k_sw_pwm_id[i], 0.0);
+    }
+  }
+  for(size_t id=0; id<k_num_of_switch_devices; id++) {   // nobody left to poll StateChangeComplete
+    _async[id].applied = _async[id].req;
+    _async[id].done = _async[id].req;
+  }
+  _dirty = true;
+  RLOG_NOTICE_PRINTF("Switch no client lease, outputs to their expiry policy\n");
+}
+
+// map OUTs and PWMs to HW, heaters in auto are driven by the dew stage.
+// The images are rebuilt only on a write or when the last lease ends
+void Switch::Scan(SrOut_t &out)
+{
+  bool leased = ( g_Sessions.Count(DevKind_t::kSwitch, 0) > 0 );
+
+  if( leased != _leased ) {
+    _leased = leased;
+    if( !leased )
+      _leaseEnded();
+  }
+
+  if( _dirty ) {
+    _dirty = false;
+    _out_image = ch_pack_sw_out(_out);
+    for(size_t i=0; i<k_num_sw_pwm; i++)
+      g_DewHeater.SetManual(i, _pwm[i]);                 // applied by the dew stage, unless in auto
   }
+
+  out = (out & BIT_OUT_CLEAR) | _out_image;
+}
+
+// output a write of switch id ends up on, for the trace
+static inline TraceOut_t sw_trace_out(uint32_t id)
+{
+  return ( k_channels[k_switch_ch[id]].kind == ChKind_t::kSwOut ) ? TraceOut_t::kRelay : TraceOut_t::kPwm;
 }
 
 /**
- * This methode is called by AlpacaSwitch to manipulate physical device
+ * This methode is called by AlpacaSwitch to manipulate physical device.
+ * SetSwitch and SetSwitchValue are served by _switchRequest(), the library does not reach it over HTTP
  */
 const bool Switch::_writeSwitchValue(uint32_t id, double value)
 {
   // TODO write to physical device, GPIO, etc
   bool result = false; // wrong id or invalid value
 
-  // TODO check id
-  if(id < 8) {
-    SLOG_WARNING_PRINTF("WARNING. Attempt to write to a read-only switch.")
-    return false;
-  }
-
-  if(id > (k_num_of_switch_devices-1)) {
-    SLOG_WARNING_PRINTF("WARNING. Invalid switch ID.")
-    return false;
+  switch(ch_switch_check(id, value))                      // same check as MQTT writes
+  {
+    case ChWrite_t::kOk:
+      break;
+    case ChWrite_t::kBadId:
+      RLOG_WARNING_PRINTF("WARNING. Invalid switch ID.\n");
+      return false;
+    case ChWrite_t::kReadOnly:
+      RLOG_WARNING_PRINTF("WARNING. Attempt to write to a read-only switch.\n");
+      return false;
+    case ChWrite_t::kRange:
+      RLOG_WARNING_PRINTF("WARNING. Switch value out of range.\n");
+      return false;
   }
 
-  if((id > 7 ) && ( id < 16 ))
-    _sw_out[id - 8] = (value != 0 ? true : false);
-  else
-    _sw_pwm[id - 16] = (uint8_t)value;
+  BusEvent_t ev(Topic_t::kSwitchWrite);
+  ev.sw.id = (uint16_t)id;
+  ev.sw.value = (uint16_t)value;
+  result = g_StateBus.Publish(ev);            // applied by the next control tick
 
 #ifdef DEBUG_SWITCH
   DebugSwitchDevice(id);
 #endif
-  result = true;
-  SLOG_DEBUG_PRINTF("id=%d value=%f result=%s", id, value, result ? "true" : "false");
+  RLOG_DEBUG_PRINTF("id=%d value=%d result=%s\n", id, (int32_t)value, result ? "true" : "false");
 
   return result;
 }
 
+bool Switch::_canAsync(uint32_t id)
+{
+  if( id >= k_num_of_switch_devices )
+    return false;
+  ChKind_t kind = k_channels[k_switch_ch[id]].kind;
+  return ( kind == ChKind_t::kSwOut ) || ( kind == ChKind_t::kSwPwm );
+}
+
+// ISwitchV3 members the library does not serve, and InterfaceVersion that announces them: clients
+// only use the async members from version 3 on. SetSwitch and SetSwitchValue too, their handler
+// must hold the request to trace its decision. Registered on the Alpaca server before the library
+// routes, the first handler that matches a request gets it
+void Switch::RegisterRoutes(AsyncWebServer *server)
+{
+  static const struct { const char *name; WebRequestMethodComposite method; } k_route[] = {
+    {"canasync", HTTP_GET}, {"statechangecomplete", HTTP_GET}, {"setasync", HTTP_PUT}, {"setasyncvalue", HTTP_PUT},
+    {"setswitch", HTTP_PUT}, {"setswitchvalue", HTTP_PUT}};
+  char url[64];
+
+  for(uint8_t m=0; m<sizeof(k_route)/sizeof(k_route[0]); m++) {
+    snprintf(url, sizeof(url), "/api/v1/switch/%u/%s", (unsigned)GetDeviceNumber(), k_route[m].name);
+    server->on(url, k_route[m].method, [this, m](AsyncWebServerRequest *request) { _switchRequest(request, m); });
+  }
+
+  snprintf(url, sizeof(url), "/api/v1/switch/%u/interfaceversion", (unsigned)GetDeviceNumber());
+  server->on(url, HTTP_GET, [this](AsyncWebServerRequest *request) {
+    uint32_t ctid = 0;
+    for(size_t i=0; i<request->params(); i++) {
+      AsyncWebParameter *prm = request->getParam(i);
+      if( !prm->isPost() && ( strcasecmp(prm->name().c_str(), "ClientTransactionID") == 0 ))
+        ctid = (uint32_t)strtoul(prm->value().c_str(), nullptr, 10);
+    }
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    response->printf("{\"Value\":%u,\"ClientTransactionID\":%u,\"ServerTransactionID\":%u,\"ErrorNumber\":0,\"ErrorMessage\":\"\"}",
+      SWITCH_INTERFACE_VERSION, ctid, ++_route_stid);
+    request->send(response);
+  });
+}
+
+// parameter names are case insensitive, GET takes them from the query and PUT from the form body.
+// A missing or malformed parameter is a 400, everything else an Alpaca error in the reply
+void Switch::_switchRequest(AsyncWebServerRequest *request, uint8_t method)
+{
+  enum { kCanAsync = 0, kComplete, kSetAsync, kSetAsyncValue, kSetSwitch, kSetSwitchValue };
+  const bool put = ( method >= kSetAsync );
+  const bool state = ( method == kSetAsync ) || ( method == kSetSwitch );
+  const bool async = ( method == kSetAsync ) || ( method == kSetAsyncValue );
+  const char *id_str = nullptr;
+  const char *arg = nullptr;
+  uint32_t ctid = 0;
+
+  for(size_t i=0; i<request->params(); i++) {
+    AsyncWebParameter *prm = request->getParam(i);
+    if( prm->isPost() != put )
+      continue;
+    const char *name = prm->name().c_str();
+    if( strcasecmp(name, "Id") == 0 )
+      id_str = prm->value().c_str();
+    else if( strcasecmp(name, "ClientTransactionID") == 0 )
+      ctid = (uint32_t)strtoul(prm->value().c_str(), nullptr, 10);
+    else if( strcasecmp(name, state ? "State" : "Value") == 0 )
+      arg = prm->value().c_str();
+  }
+
+  char *end = nullptr;
+  uint32_t id = id_str ? (uint32_t)strtoul(id_str, &end, 10) : 0;
+  double value = 0.0;
+
+  if( !id_str || ( end == id_str ) || ( *end != 0 )) {
+    g_HttpStats.Error(request);
+    request->send(400, "text/plain", "Missing or invalid parameter Id");
+    return;
+  }
+  if( put && state ) {
+    if( !arg || (( strcasecmp(arg, "true") != 0 ) && ( strcasecmp(arg, "false") != 0 ))) {
+      g_HttpStats.Error(request);
+      request->send(400, "text/plain", "Missing or invalid parameter State");
+      return;
+    }
+  } else if( put ) {
+    value = arg ? strtod(arg, &end) : 0.0;
+    if( !arg || ( end == arg ) || ( *end != 0 )) {
+      g_HttpStats.Error(request);
+      request->send(400, "text/plain", "Missing or invalid parameter Value");
+      return;
+    }
+  }
+
+  char reply[8] = "";
+  int err = 0;
+  const char *msg = "";
+
+  if( id >= k_num_of_switch_devices ) {
+    err = SWITCH_ERR_INVALID_VALUE;
+    msg = "Invalid switch id";
+  } else if( method == kCanAsync ) {
+    strcpy(reply, _canAsync(id) ? "true" : "false");
+  } else if( g_Sessions.Count(DevKind_t::kSwitch, 0) == 0 ) {
+    err = SWITCH_ERR_NOT_CONNECTED;
+    msg = "Not connected";
+  } else if( method == kComplete ) {
+    strcpy(reply, ( _async[id].done == _async[id].req ) ? "true" : "false");
+  } else if( async && !_canAsync(id) ) {
+    err = SWITCH_ERR_NOT_IMPLEMENTED;
+    msg = "Switch can not be written asynchronously";
+  } else if( !ch_switch_writable(k_channels[k_switch_ch[id]].kind) ) {
+    err = SWITCH_ERR_NOT_IMPLEMENTED;
+    msg = "Switch can not be written";
+  } else {
+    if( state )
+      value = ( strcasecmp(arg, "true") == 0 ) ? (double)ch_switch_max(k_channels[k_switch_ch[id]].kind) : 0.0;
+    if( ch_switch_check(id, value) != ChWrite_t::kOk ) {   // writable, checked above
+      err = SWITCH_ERR_INVALID_VALUE;
+      msg = "Value out of range";
+    } else {
+      uint16_t seq = 0;                                    // 0 is a synchronous write
+      if( async ) {
+        seq = (uint16_t)( _async[id].req + 1 );
+        if( seq == 0 )
+          seq = 1;
+      }
+
+      BusEvent_t ev(Topic_t::kSwitchWrite);
+      ev.sw.id = (uint16_t)id;
+      ev.sw.value = (uint16_t)value;
+      ev.sw.seq = seq;
+      if( g_StateBus.Publish(ev) ) {                       // applied, and settled if async, by the control task
+        if( async )
+          _async[id].req = seq;
+        TRACE_DECISION_REQUEST(request, sw_trace_out(id));
+      } else {
+        err = SWITCH_ERR_UNSPECIFIED;
+        msg = "Switch write queue full";
+      }
+      RLOG_DEBUG_PRINTF("write id=%u value=%d seq=%u err=%d\n", id, (int32_t)value, seq, err);
+    }
+  }
+
+  if( err != 0 )
+    g_HttpStats.Error(request);
+  AsyncResponseStream *response = request->beginResponseStream("application/json");
+  response->printf("{%s%s%s\"ClientTransactionID\":%u,\"ServerTransactionID\":%u,\"ErrorNumber\":%d,\"ErrorMessage\":\"%s\"}",
+    reply[0] ? "\"Value\":" : "", reply, reply[0] ? "," : "", ctid, ++_route_stid, err, msg);
+  request->send(response);
+}
+
 // read settings from flash
 void Switch::AlpacaReadJson(JsonObject &root)
 {
+	HEAP_SITE("Switch::AlpacaReadJson");
 	DBG_JSON_PRINTFJ(SLOG_NOTICE, root, "SWITCH READ BEGIN (root=<%s>) ...\n", _ser_json_);
 	AlpacaSwitch::AlpacaReadJson(root);
 
@@ -138,13 +409,71 @@ void Switch::AlpacaReadJson(JsonObject &root)
       InitSwitchName(u, obj_config[sw_name] | GetSwitchName(u));
       DBG_JSON_PRINTFJ(SLOG_NOTICE, obj_config, "... title=%s obj_config=<%s> \n", sw_name, _ser_json_);
     }
+
+    int32_t _hm = obj_config["Heat_margin"] | g_DewHeater.GetMargin();
+    int32_t _kp = obj_config["Heat_kp"] | g_DewHeater.GetKp();
+    int32_t _ki = obj_config["Heat_ki"] | g_DewHeater.GetKi();
+
+    if((_hm < 0) || (_hm > 200))         // validate margin above dew point 0~20C
+      _hm = 30;
+    if((_kp < 0) || (_kp > 100))         // validate gains
+      _kp = 20;
+    if((_ki < 0) || (_ki > 100))
+      _ki = 5;
+
+    g_DewHeater.SetTuning((int16_t)_hm, (int16_t)_kp, (int16_t)_ki);
+
+    for (size_t i = 0; i < k_num_sw_heat; i++)
+    {
+      snprintf(sw_name, sizeof(sw_name), "Heat_%d_auto", (int)i + 1);
+      g_DewHeater.SetAuto(i, obj_config[sw_name] | g_DewHeater.GetAuto(i));
+    }
+    RLOG_INFO_PRINTF("Dew heater margin %i kp %i ki %i\n", _hm, _kp, _ki);
+
+    SwitchConfig_t cfg = _cfg.Get();
+    for (size_t i = 0; i < k_num_sw_out; i++)
+    {
+      snprintf(sw_name, sizeof(sw_name), "Out_%d_expire", (int)i + 1);
+      String _ex = obj_config[sw_name] | String(cfg.keep_out[i] ? "keep" : "off");
+      _ex.toLowerCase();
+      cfg.keep_out[i] = ( _ex == "keep" );
+    }
+    for (size_t i = 0; i < k_num_sw_pwm; i++)
+    {
+      snprintf(sw_name, sizeof(sw_name), "Pwm_%d_expire", (int)i + 1);
+      String _ex = obj_config[sw_name] | String(cfg.keep_pwm[i] ? "keep" : "off");
+      _ex.toLowerCase();
+      cfg.keep_pwm[i] = ( _ex == "keep" );
+    }
+    for (size_t i = 0; i < k_num_sw_out; i++)
+    {
+      snprintf(sw_name, sizeof(sw_name), "Out_%d_settle_ms", (int)i + 1);
+      uint32_t _st = obj_config[sw_name] | (uint32_t)cfg.settle_out[i];
+      if(_st > SWITCH_SETTLE_MAX_MS)       // validate 0~60s
+        _st = SWITCH_SETTLE_MAX_MS;
+      cfg.settle_out[i] = (uint16_t)_st;
+    }
+    for (size_t i = 0; i < k_num_sw_pwm; i++)
+    {
+      snprintf(sw_name, sizeof(sw_name), "Pwm_%d_settle_ms", (int)i + 1);
+      uint32_t _st = obj_config[sw_name] | (uint32_t)cfg.settle_pwm[i];
+      if(_st > SWITCH_SETTLE_MAX_MS)       // validate 0~60s
+        _st = SWITCH_SETTLE_MAX_MS;
+      cfg.settle_pwm[i] = (uint16_t)_st;
+    }
+    _cfg.Publish(cfg);
   }
+  g_Rules.ReadJson(root);                 // own sections, hosted by the switch device
+  g_Scheduler.ReadJson(root);
+  g_Mqtt.ReadJson(root);
+  g_Sessions.ReadJson(root);              // the lease of every device
 	SLOG_PRINTF(SLOG_NOTICE, "...SWITCH READ END\n");
 }
 
 // persist settings to flash
 void Switch::AlpacaWriteJson(JsonObject &root)
 {
+  HEAP_SITE("Switch::AlpacaWriteJson");
   DBG_JSON_PRINTFJ(SLOG_NOTICE, root, "SWITCH WRITE BEGIN root=%s ...\n", _ser_json_);
   AlpacaSwitch::AlpacaWriteJson(root);
 
@@ -157,6 +486,39 @@ void Switch::AlpacaWriteJson(JsonObject &root)
     obj_config[sw_name] = (String)GetSwitchName(u);
     DBG_JSON_PRINTFJ(SLOG_NOTICE, obj_config, "... title=%s obj_config=<%s> \n", sw_name, _ser_json_);
   }
+
+  obj_config["Heat_margin"] = g_DewHeater.GetMargin();
+  obj_config["Heat_kp"] = g_DewHeater.GetKp();
+  obj_config["Heat_ki"] = g_DewHeater.GetKi();
+  for (size_t i = 0; i < k_num_sw_heat; i++)
+  {
+    snprintf(sw_name, sizeof(sw_name), "Heat_%d_auto", (int)i + 1);
+    obj_config[sw_name] = g_DewHeater.GetAuto(i);
+  }
+  for (size_t i = 0; i < k_num_sw_out; i++)
+  {
+    snprintf(sw_name, sizeof(sw_name), "Out_%d_expire", (int)i + 1);
+    obj_config[sw_name] = _cfg.Get().keep_out[i] ? "keep" : "off";
+  }
+  for (size_t i = 0; i < k_num_sw_pwm; i++)
+  {
+    snprintf(sw_name, sizeof(sw_name), "Pwm_%d_expire", (int)i + 1);
+    obj_config[sw_name] = _cfg.Get().keep_pwm[i] ? "keep" : "off";
+  }
+  for (size_t i = 0; i < k_num_sw_out; i++)
+  {
+    snprintf(sw_name, sizeof(sw_name), "Out_%d_settle_ms", (int)i + 1);
+    obj_config[sw_name] = _cfg.Get().settle_out[i];
+  }
+  for (size_t i = 0; i < k_num_sw_pwm; i++)
+  {
+    snprintf(sw_name, sizeof(sw_name), "Pwm_%d_settle_ms", (int)i + 1);
+    obj_config[sw_name] = _cfg.Get().settle_pwm[i];
+  }
+  g_Rules.WriteJson(root);
+  g_Scheduler.WriteJson(root);
+  g_Mqtt.WriteJson(root);
+  g_Sessions.WriteJson(root);
   DBG_JSON_PRINTFJ(SLOG_NOTICE, root, "...SWITCH WRITE END \"%s\"\n", _ser_json_);
 }
 
@@ -7,17 +7,63 @@
 **************************************************************************************************/
 #pragma once
 #include "AlpacaSwitch.h"
+#include "ChannelMap.h"
+#include "StateBus.h"
+#include "Sessions.h"
+#include "ConfigSlot.h"
 
 // comment/uncomment to enable/disable debugging
 // #define DEBUG_SWITCH
 
-extern bool _sw_in[8], _sw_out[8];
-extern u_int8_t _sw_pwm[4];
+#define SWITCH_SETTLE_MAX_MS    60000
+#define SWITCH_INTERFACE_VERSION    3       // ISwitchV3, with the async members served here
+
+// Alpaca error numbers of the async routes
+#define SWITCH_ERR_NOT_IMPLEMENTED  0x400
+#define SWITCH_ERR_INVALID_VALUE    0x401
+#define SWITCH_ERR_NOT_CONNECTED    0x407
+#define SWITCH_ERR_UNSPECIFIED      0x4FF
+
+// output policies when the last lease ends and settle times, swapped whole by AlpacaReadJson
+struct SwitchConfig_t
+{
+    bool keep_out[k_num_sw_out];            // keep or off
+    bool keep_pwm[k_num_sw_pwm];
+    uint16_t settle_out[k_num_sw_out];      // ms after the relay moved until the load is ready
+    uint16_t settle_pwm[k_num_sw_pwm];      // ms after the fade ended
+};
+
+// ISwitchV3 asynchronous write of one switch. req is bumped by the API task, applied and done are
+// written by the control task; StateChangeComplete is done == req
+struct SwitchAsync_t
+{
+    volatile uint16_t req;                  // last SetAsync / SetAsyncValue accepted
+    volatile uint16_t done;                 // last one settled
+    uint16_t applied;                       // reached the output, settling
+    uint16_t value;
+    uint32_t applied_ms;
+};
 
 class Switch : public AlpacaSwitch
 {
 private:
+    bool _in[k_num_sw_in];                  // from kSrIn
+    bool _out[k_num_sw_out];                // from kSwitchWrite
+    uint8_t _pwm[k_num_sw_pwm];
+    SrOut_t _out_image;                     // OUT bits, rebuilt on change
+    ConfigSlot<SwitchConfig_t> _cfg;
+    bool _leased;                           // a client holds a session lease
+    bool _dirty;                            // outputs changed since the last Scan()
+    SwitchAsync_t _async[k_num_of_switch_devices];
+    uint32_t _route_stid;                   // ServerTransactionID of the routes served here
+
     const bool _writeSwitchValue(uint32_t id, double value);
+    void _leaseEnded();
+    static void _onInputs(const BusEvent_t &ev, void *ctx);
+    static void _onWrite(const BusEvent_t &ev, void *ctx);
+    bool _canAsync(uint32_t id);
+    void _settle(uint32_t id);
+    void _switchRequest(AsyncWebServerRequest *request, uint8_t method);
 
     void AlpacaReadJson(JsonObject &root);
     void AlpacaWriteJson(JsonObject &root);
@@ -29,5 +75,7 @@ private:
 public:
     Switch();
     void Begin();
+    void RegisterRoutes(AsyncWebServer *server);
     void Loop();
+    void Scan(SrOut_t &out);
 };
\ No newline at end of file
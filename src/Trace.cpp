@@ -0,0 +1,199 @@
+/**************************************************************************************************
+  Filename:       Trace.cpp
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    event to actuation tracing implementation
+**************************************************************************************************/
+#include "Trace.h"
+#include "HttpProbe.h"
+
+Trace g_Trace;
+
+static const char *const k_trace_point_str[5] = {"in_sample", "decision", "out_write", "http_recv", "http_resp"};
+
+Trace::Trace()
+{
+	_head = 0;
+	_next_id = 0;
+	_in_id = 0;
+	memset(_req, 0, sizeof(_req));
+	_num_pending = 0;
+	_tick = 0;
+	_mux = portMUX_INITIALIZER_UNLOCKED;
+}
+
+void Trace::Begin(AsyncWebServer *server)
+{
+#ifdef TRACE_EVENTS
+	g_HttpProbe.AddHook(server,
+		[](AsyncWebServerRequest *request) -> uint32_t { return g_Trace.HttpRecv(request); },
+		[](AsyncWebServerRequest *request, uint32_t id) { g_Trace.HttpResp(request, (uint16_t)id); });
+#endif
+	server->on(TRACE_URL, HTTP_GET, [this](AsyncWebServerRequest *request) { _sendJson(request); });
+}
+
+uint16_t Trace::_newId(uint16_t flags)
+{
+	uint16_t id;
+
+	portENTER_CRITICAL(&_mux);
+	_next_id = ( _next_id + 1 ) & TRACE_ID_MASK;
+	if( _next_id == 0 )
+		_next_id = 1;
+	id = _next_id | flags;
+	portEXIT_CRITICAL(&_mux);
+
+	return id;
+}
+
+void Trace::_record(uint16_t id, TracePoint_t point)
+{
+	uint32_t us = (uint32_t)esp_timer_get_time();
+	uint8_t core = (uint8_t)xPortGetCoreID();
+
+	portENTER_CRITICAL(&_mux);
+	_ring[_head % TRACE_BUFFER_SIZE] = {us, id, point, core};
+	_head++;
+	portEXIT_CRITICAL(&_mux);
+}
+
+// control task: the input image changed in this tick
+void Trace::InputEdge()
+{
+	_in_id = _newId(0);
+	_record(_in_id, TracePoint_t::kInSample);
+}
+
+// an output was changed on behalf of event id, the write is traced by the next Output() of that kind
+void Trace::Decision(uint16_t id, TraceOut_t out)
+{
+	if( id == 0 )
+		return;
+
+	_record(id, TracePoint_t::kDecision);
+
+	portENTER_CRITICAL(&_mux);
+	if( _num_pending == TRACE_MAX_PENDING ) {				// drop the oldest
+		memmove(&_pending[0], &_pending[1], sizeof(_pending[0]) * ( TRACE_MAX_PENDING - 1 ));
+		memmove(&_pending_tick[0], &_pending_tick[1], sizeof(_pending_tick[0]) * ( TRACE_MAX_PENDING - 1 ));
+		memmove(&_pending_out[0], &_pending_out[1], sizeof(_pending_out[0]) * ( TRACE_MAX_PENDING - 1 ));
+		_num_pending--;
+	}
+	_pending[_num_pending] = id;
+	_pending_tick[_num_pending] = _tick;
+	_pending_out[_num_pending] = out;
+	_num_pending++;
+	portEXIT_CRITICAL(&_mux);
+}
+
+// control task: outputs of one kind were written, close the decisions waiting for them
+void Trace::Output(TraceOut_t out)
+{
+	uint16_t id[TRACE_MAX_PENDING];
+	uint8_t n = 0, k = 0;
+
+	portENTER_CRITICAL(&_mux);
+	for(uint8_t i = 0; i < _num_pending; i++) {
+		if( _pending_out[i] == out ) {
+			id[n++] = _pending[i];
+		} else {
+			_pending[k] = _pending[i];
+			_pending_tick[k] = _pending_tick[i];
+			_pending_out[k] = _pending_out[i];
+			k++;
+		}
+	}
+	_num_pending = k;
+	portEXIT_CRITICAL(&_mux);
+
+	for(uint8_t i = 0; i < n; i++)
+		_record(id[i], TracePoint_t::kOutWrite);
+}
+
+// control task: decisions that did not change the outputs expire after a few ticks
+void Trace::EndTick()
+{
+	uint8_t n = 0;
+
+	portENTER_CRITICAL(&_mux);
+	_tick++;
+	for(uint8_t i = 0; i < _num_pending; i++) {
+		if(( _tick - _pending_tick[i] ) <= TRACE_PENDING_TICKS ) {
+			_pending[n] = _pending[i];
+			_pending_tick[n] = _pending_tick[i];
+			_pending_out[n] = _pending_out[i];
+			n++;
+		}
+	}
+	_num_pending = n;
+	portEXIT_CRITICAL(&_mux);
+
+	_in_id = 0;
+}
+
+// web server task: a new ID per request, kept with the request until its response is sent.
+// A full table leaves the request untracked, its recv and resp are still recorded
+uint16_t Trace::HttpRecv(AsyncWebServerRequest *request)
+{
+	uint16_t id = _newId(TRACE_ID_HTTP);
+
+	for(auto &r : _req) {
+		if( r.request == nullptr ) {
+			r = {request, id};
+			break;
+		}
+	}
+	_record(id, TracePoint_t::kHttpRecv);
+	return id;
+}
+
+void Trace::HttpResp(AsyncWebServerRequest *request, uint16_t id)
+{
+	for(auto &r : _req)
+		if( r.request == request )
+			r.request = nullptr;
+	_record(id, TracePoint_t::kHttpResp);
+}
+
+// web server task: ID of a request the caller holds, 0 if not tracked. Device setters get it
+// from the route handler that owns the request, the Alpaca library passes them none
+uint16_t Trace::GetHttpId(AsyncWebServerRequest *request)
+{
+	for(auto &r : _req)
+		if( r.request == request )
+			return r.id;
+	return 0;
+}
+
+// events are read without stopping the writers, the oldest may be overwritten while streaming
+void Trace::_sendJson(AsyncWebServerRequest *request)
+{
+	AsyncResponseStream *response = request->beginResponseStream("application/json");
+	uint32_t head = _head;
+	uint32_t first = ( head > TRACE_BUFFER_SIZE ) ? head - TRACE_BUFFER_SIZE : 0;
+
+	response->print("{\"traceEvents\":[");
+	response->print("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"core 0\"}},");
+	response->print("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"core 1\"}}");
+
+	for(uint32_t i = first; i < head; i++) {
+		TraceEvent_t ev;
+
+		portENTER_CRITICAL(&_mux);
+		bool valid = ( _head - i ) <= TRACE_BUFFER_SIZE;
+		ev = _ring[i % TRACE_BUFFER_SIZE];
+		portEXIT_CRITICAL(&_mux);
+
+		if( !valid )
+			continue;
+
+		response->printf(",{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%u,\"pid\":1,\"tid\":%u,\"args\":{\"id\":%u}}",
+			k_trace_point_str[(uint8_t)ev.point],
+			( ev.id & TRACE_ID_HTTP ) ? "http" : ( ev.id & TRACE_ID_REMOTE ) ? "remote" : "input",
+			ev.us, ev.core, ev.id & TRACE_ID_MASK);
+	}
+
+	response->printf("],\"otherData\":{\"events\":%u,\"dropped\":%u}}", head, first);
+	request->send(response);
+}
@@ -0,0 +1,115 @@
+/**************************************************************************************************
+  Filename:       Trace.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    event to actuation tracing. Trace points at input sample, decision, output
+                  write and HTTP receive/respond share an event ID and go to a bounded ring,
+                  dumped as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+                  An event starts at an input edge, an HTTP request or a bus command (MQTT),
+                  each with its own ID space. A decision waits for the write of its own output
+                  kind: relays on the 595 chain or a PWM channel.
+**************************************************************************************************/
+#pragma once
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// comment/uncomment to enable/disable the trace points
+#define TRACE_EVENTS
+
+#define TRACE_BUFFER_SIZE       256         // events kept, oldest are overwritten
+#define TRACE_MAX_PENDING       8           // decisions waiting for the output write
+#define TRACE_PENDING_TICKS     2           // control ticks a decision may wait for its write
+#define TRACE_MAX_REQUESTS      8           // HTTP requests in flight, tracked for their ID
+#define TRACE_ID_HTTP           0x8000      // event ID started by an HTTP request
+#define TRACE_ID_REMOTE         0x4000      // event ID started by a bus command, MQTT
+#define TRACE_ID_MASK           0x3FFF
+#define TRACE_URL               "/trace"
+
+enum struct TracePoint_t : uint8_t
+{
+	kInSample = 0,							// input edge seen on the 165 chain
+	kDecision,								// device logic changed an output
+	kOutWrite,								// output latched on the 595 chain or PWM pin
+	kHttpRecv,								// request line parsed
+	kHttpResp								// response sent, connection closed
+};
+
+// the output a decision waits for
+enum struct TraceOut_t : uint8_t
+{
+	kRelay = 0,								// 595 chain
+	kPwm									// LEDC channel
+};
+
+// HTTP request between its request line and its response
+struct TraceRequest_t
+{
+	AsyncWebServerRequest *request;
+	uint16_t id;
+};
+
+struct TraceEvent_t
+{
+	uint32_t us;							// esp_timer, common to both cores
+	uint16_t id;
+	TracePoint_t point;
+	uint8_t core;
+};
+
+class Trace
+{
+private:
+	TraceEvent_t _ring[TRACE_BUFFER_SIZE];
+	uint32_t _head;							// total events recorded
+	uint16_t _next_id;
+	uint16_t _in_id;						// input event of the current control tick, 0 if none
+	TraceRequest_t _req[TRACE_MAX_REQUESTS];	// web server task only
+	uint16_t _pending[TRACE_MAX_PENDING];
+	uint32_t _pending_tick[TRACE_MAX_PENDING];
+	TraceOut_t _pending_out[TRACE_MAX_PENDING];
+	uint8_t _num_pending;
+	uint32_t _tick;
+	portMUX_TYPE _mux;
+
+	uint16_t _newId(uint16_t flags);
+	void _record(uint16_t id, TracePoint_t point);
+	void _sendJson(AsyncWebServerRequest *request);
+
+public:
+	Trace();
+	void Begin(AsyncWebServer *server);
+
+	void InputEdge();
+	void Decision(uint16_t id, TraceOut_t out);
+	void Output(TraceOut_t out);
+	void EndTick();
+
+	uint16_t HttpRecv(AsyncWebServerRequest *request);
+	void HttpResp(AsyncWebServerRequest *request, uint16_t id);
+	uint16_t GetInputId() { return _in_id; }
+	uint16_t GetHttpId(AsyncWebServerRequest *request);
+	uint16_t GetRemoteId() { return _newId(TRACE_ID_REMOTE); }
+};
+
+extern Trace g_Trace;
+
+#ifdef TRACE_EVENTS
+#define TRACE_INPUT_EDGE()              g_Trace.InputEdge()
+#define TRACE_DECISION_INPUT(out)       g_Trace.Decision(g_Trace.GetInputId(), out)
+#define TRACE_DECISION_REQUEST(r, out)  g_Trace.Decision(g_Trace.GetHttpId(r), out)
+#define TRACE_DECISION_ID(id, out)      g_Trace.Decision(id, out)
+#define TRACE_REQUEST_ID(r)             g_Trace.GetHttpId(r)
+#define TRACE_REMOTE_ID()               g_Trace.GetRemoteId()
+#define TRACE_OUTPUT(out)               g_Trace.Output(out)
+#define TRACE_END_TICK()                g_Trace.EndTick()
+#else
+#define TRACE_INPUT_EDGE()
+#define TRACE_DECISION_INPUT(out)
+#define TRACE_DECISION_REQUEST(r, out)
+#define TRACE_DECISION_ID(id, out)
+#define TRACE_REQUEST_ID(r)             0
+#define TRACE_REMOTE_ID()               0
+#define TRACE_OUTPUT(out)
+#define TRACE_END_TICK()
+#endif
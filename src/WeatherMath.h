@@ -0,0 +1,55 @@
+/**************************************************************************************************
+  Filename:       WeatherMath.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    fixed point weather derivations on weather station units (1adu = 0.1C, 1%).
+                  Dew point by the Magnus formula with a ln() table, cloud cover from the
+                  sky minus air temperature delta.
+**************************************************************************************************/
+#pragma once
+#include <Arduino.h>
+
+// ln(rh / 100) * 4096 for rh = 0~100%, rh 0 is taken as 1%
+static const int16_t k_ln_rh_q12[101] = {
+	-18863, -18863, -16024, -14363, -13185, -12271, -11524, -10892, -10345, -9863,
+	-9431, -9041, -8685, -8357, -8053, -7771, -7506, -7258, -7024, -6802,
+	-6592, -6392, -6202, -6020, -5845, -5678, -5518, -5363, -5214, -5070,
+	-4931, -4797, -4667, -4541, -4419, -4300, -4185, -4072, -3963, -3857,
+	-3753, -3652, -3553, -3457, -3363, -3271, -3181, -3093, -3006, -2922,
+	-2839, -2758, -2678, -2600, -2524, -2449, -2375, -2302, -2231, -2161,
+	-2092, -2025, -1958, -1892, -1828, -1764, -1702, -1640, -1580, -1520,
+	-1461, -1403, -1346, -1289, -1233, -1178, -1124, -1071, -1018, -966,
+	-914, -863, -813, -763, -714, -666, -618, -570, -524, -477,
+	-432, -386, -342, -297, -253, -210, -167, -125, -83, -41,
+	0
+};
+
+// Magnus: g = ln(rh/100) + b*t/(c+t), td = c*g/(b-g), b = 17.62, c = 243.12C.
+// t in 0.1C, rh in %, returns td in 0.1C. Within ~0.1C of the float formula for t = -40~60C
+inline int16_t wm_dew_point(int16_t t, int16_t rh)
+{
+	if( rh < 0 ) rh = 0;
+	if( rh > 100 ) rh = 100;
+
+	// b*t/(c+t) with t in 0.1C: 1762*t / (243120 + 100*t), in Q12
+	int64_t g = k_ln_rh_q12[rh] + ((int64_t)1762 * t * 4096) / ( 243120 + 100 * (int32_t)t );
+
+	// td[0.1C] = 2431.2*g / (17.62 - g) = 24312*G / (721715 - 10*G), G = g in Q12
+	return (int16_t)(( 24312 * g ) / ( 721715 - 10 * g ));
+}
+
+// linear between the clear and the overcast sky-air delta, both in 0.1C. Returns 0~100%
+inline int16_t wm_cloud_cover(int16_t tsky, int16_t tair, int16_t clear_delta, int16_t cloudy_delta)
+{
+	int32_t d = (int32_t)tsky - tair;
+
+	if( cloudy_delta <= clear_delta )
+		return 0;
+	if( d <= clear_delta )
+		return 0;
+	if( d >= cloudy_delta )
+		return 100;
+
+	return (int16_t)(( 100 * ( d - clear_delta )) / ( cloudy_delta - clear_delta ));
+}
@@ -0,0 +1,87 @@
+/**************************************************************************************************
+  Filename:       WeatherStats.cpp
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    weather station statistics implementation
+**************************************************************************************************/
+#include "WeatherStats.h"
+#include "LogRing.h"
+
+WeatherStats g_WeatherStats;
+
+const char *const WeatherStats::k_channel_str[(uint8_t)WsChannel_t::kNum] = {"tsky", "tair", "wind", "hum"};
+
+// filter limits: max distance from the median, max change per second. Wind spikes are real
+// gusts, the gust rule needs them, so wind only drops samples far off the median
+WeatherStats::WeatherStats() : _filter{{80, 10}, {50, 5}, {80, 0}, {30, 5}},
+	tsky(WSTAT_BUCKET_MS), tair(WSTAT_BUCKET_MS), wind(WSTAT_BUCKET_MS), hum(WSTAT_BUCKET_MS)
+{
+	_stats[(uint8_t)WsChannel_t::kTsky] = &tsky;
+	_stats[(uint8_t)WsChannel_t::kTair] = &tair;
+	_stats[(uint8_t)WsChannel_t::kWind] = &wind;
+	_stats[(uint8_t)WsChannel_t::kHum] = &hum;
+	memset(_filter_cycles, 0, sizeof(_filter_cycles));
+	memset(_filter_cycles_max, 0, sizeof(_filter_cycles_max));
+	memset(_add_cycles, 0, sizeof(_add_cycles));
+}
+
+void WeatherStats::Begin(AsyncWebServer *server)
+{
+	server->on(WSTAT_URL, HTTP_GET, [this](AsyncWebServerRequest *request) { _sendJson(request); });
+}
+
+// age the windows when the station stops sending
+void WeatherStats::Update(uint32_t now)
+{
+	tsky.Update(now);
+	tair.Update(now);
+	wind.Update(now);
+	hum.Update(now);
+}
+
+// range checked sample from the station. Returns false if the outlier filter rejected it
+bool WeatherStats::Ingest(WsChannel_t ch, int16_t v, uint32_t now)
+{
+	uint8_t c = (uint8_t)ch;
+
+	uint32_t t0 = ESP.getCycleCount();
+	bool ok = _filter[c].Filter(v, now);
+	uint32_t dc = ESP.getCycleCount() - t0;
+	_filter_cycles[c] += dc;
+	if( dc > _filter_cycles_max[c] )
+		_filter_cycles_max[c] = dc;
+
+	if( !ok ) {
+		RLOG_WARNING_PRINTF("WARNING. WS %s %d rejected, median %d\n", k_channel_str[c], v, _filter[c].Median());
+		return false;
+	}
+
+	t0 = ESP.getCycleCount();
+	_stats[c]->Add(v, now);
+	_add_cycles[c] += ESP.getCycleCount() - t0;
+
+	return true;
+}
+
+// windows are updated by the control task, a reply may mix two consecutive samples
+void WeatherStats::_sendJson(AsyncWebServerRequest *request)
+{
+	AsyncResponseStream *response = request->beginResponseStream("application/json");
+
+	response->printf("{\"window_s\":%u,\"bucket_s\":%u", tsky.WindowMs() / 1000, WSTAT_BUCKET_MS / 1000);
+	for(uint8_t c = 0; c < (uint8_t)WsChannel_t::kNum; c++) {
+		uint32_t n = _filter[c].GetAccepted();
+		uint32_t all = n + _filter[c].GetRejected();
+
+		response->printf(",\"%s\":{\"stats\":", k_channel_str[c]);
+		_stats[c]->PrintJson(*response);
+		response->print(",\"filter\":{");
+		_filter[c].PrintJson(*response);
+		response->printf(",\"cycles_avg\":%u,\"cycles_max\":%u}", all ? (uint32_t)( _filter_cycles[c] / all ) : 0, _filter_cycles_max[c]);
+		response->printf(",\"add_cycles_avg\":%u}", n ? (uint32_t)( _add_cycles[c] / n ) : 0);
+	}
+	response->print("}");
+
+	request->send(response);
+}
@@ -0,0 +1,54 @@
+/**************************************************************************************************
+  Filename:       WeatherStats.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    ingest filter and rolling window statistics of the weather station channels,
+                  used by the safety rules (max gust, sky temperature trend) and readable via HTTP
+**************************************************************************************************/
+#pragma once
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "WindowStats.h"
+#include "MedianFilter.h"
+
+#define WSTAT_BUCKET_MS         10000       // bucket length
+#define WSTAT_BUCKETS           60          // window = 60 * 10s = 10 minutes
+#define WSTAT_MEDIAN            5           // samples in the outlier filter window
+#define WSTAT_URL               "/wstats"
+
+enum struct WsChannel_t : uint8_t
+{
+	kTsky = 0,
+	kTair,
+	kWind,
+	kHum,
+	kNum
+};
+
+class WeatherStats
+{
+private:
+	WindowStats<WSTAT_BUCKETS> *_stats[(uint8_t)WsChannel_t::kNum];
+	MedianFilter<WSTAT_MEDIAN> _filter[(uint8_t)WsChannel_t::kNum];
+	uint64_t _filter_cycles[(uint8_t)WsChannel_t::kNum];	// spent in the filter, per channel
+	uint32_t _filter_cycles_max[(uint8_t)WsChannel_t::kNum];
+	uint64_t _add_cycles[(uint8_t)WsChannel_t::kNum];	// cost of the unfiltered path, to compare with the filter
+
+	static const char *const k_channel_str[(uint8_t)WsChannel_t::kNum];
+
+	void _sendJson(AsyncWebServerRequest *request);
+
+public:
+	WindowStats<WSTAT_BUCKETS> tsky;		// 1adu = 0.1C
+	WindowStats<WSTAT_BUCKETS> tair;		// 1adu = 0.1C
+	WindowStats<WSTAT_BUCKETS> wind;		// 1adu = 1km/h
+	WindowStats<WSTAT_BUCKETS> hum;			// 1adu = 1%
+
+	WeatherStats();
+	void Begin(AsyncWebServer *server);
+	void Update(uint32_t now);
+	bool Ingest(WsChannel_t ch, int16_t v, uint32_t now);
+};
+
+extern WeatherStats g_WeatherStats;
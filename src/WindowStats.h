@@ -0,0 +1,246 @@
+/**************************************************************************************************
+  Filename:       WindowStats.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    rolling window aggregates of an integer signal. Samples go into fixed time
+                  buckets, the window is the last N buckets plus the one being filled.
+                  Mean, variance and least squares slope are kept as running sums, min/max as
+                  monotonic deques of bucket indexes, EMA per sample. O(1) per sample
+                  (amortized per bucket), fixed memory. No Arduino dependency, the filter
+                  benchmark in tools/ builds it too.
+**************************************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+#define WSTAT_EMA_SHIFT         3           // EMA alpha = 1/8 per sample
+
+template<size_t N>
+class WindowStats
+{
+private:
+	struct Bucket_t
+	{
+		int32_t sum;
+		int32_t sumsq;
+		int16_t min;
+		int16_t max;
+		uint16_t count;
+	};
+
+	Bucket_t _b[N];							// closed buckets, ring indexed by sequence % N
+	uint32_t _seq;							// sequence of the bucket being filled
+	uint32_t _first;						// oldest closed bucket still in the window
+	Bucket_t _cur;
+	uint32_t _cur_ini;						// ms the current bucket was opened
+	uint32_t _bucket_ms;
+
+	int64_t _sum;							// closed buckets in the window
+	int64_t _sumsq;
+	uint32_t _count;
+
+	float _sy;								// slope over bucket means, i = 0 for the oldest
+	float _siy;
+	uint32_t _ny;							// buckets with samples among the closed ones
+
+	uint32_t _dq_max[N], _dq_min[N];		// bucket sequences, values decreasing / increasing
+	uint32_t _max_h, _max_n, _min_h, _min_n;
+
+	int32_t _ema_q8;						// value * 256
+	bool _ema_valid;
+
+	static void _clear(Bucket_t &b) { b = {0, 0, INT16_MAX, INT16_MIN, 0}; }
+	float _mean(const Bucket_t &b) const { return (float)b.sum / b.count; }
+	uint32_t _dq(const uint32_t *dq, uint32_t h, uint32_t i) const { return dq[( h + i ) % N]; }
+
+	// drop the oldest closed bucket
+	void _evict()
+	{
+		const Bucket_t &b = _b[_first % N];
+
+		if( b.count ) {
+			float y = _mean(b);
+			_sum -= b.sum;
+			_sumsq -= b.sumsq;
+			_count -= b.count;
+			_ny--;
+			_sy -= y;
+			_siy -= _sy;						// remaining buckets move down one place
+		}
+
+		if( _max_n && ( _dq_max[_max_h] == _first )) { _max_h = ( _max_h + 1 ) % N; _max_n--; }
+		if( _min_n && ( _dq_min[_min_h] == _first )) { _min_h = ( _min_h + 1 ) % N; _min_n--; }
+		_first++;
+	}
+
+	// close the current bucket and open the next one
+	void _close()
+	{
+		if(( _seq - _first ) == N )
+			_evict();
+
+		_b[_seq % N] = _cur;
+
+		if( _cur.count ) {
+			float y = _mean(_cur);
+			_sum += _cur.sum;
+			_sumsq += _cur.sumsq;
+			_count += _cur.count;
+			_siy += y * _ny;
+			_sy += y;
+			_ny++;
+
+			while( _max_n && ( _b[_dq(_dq_max, _max_h, _max_n - 1) % N].max <= _cur.max ))
+				_max_n--;
+			_dq_max[( _max_h + _max_n++ ) % N] = _seq;
+
+			while( _min_n && ( _b[_dq(_dq_min, _min_h, _min_n - 1) % N].min >= _cur.min ))
+				_min_n--;
+			_dq_min[( _min_h + _min_n++ ) % N] = _seq;
+		}
+
+		_seq++;
+		_clear(_cur);
+
+		if(( _seq % N ) == 0 )					// once per window, drop the float rounding drift
+			_resync();
+	}
+
+	void _resync()
+	{
+		_sy = 0;
+		_siy = 0;
+		_ny = 0;
+		for(uint32_t s = _first; s != _seq; s++) {
+			const Bucket_t &b = _b[s % N];
+			if( b.count ) {
+				float y = _mean(b);
+				_siy += y * _ny;
+				_sy += y;
+				_ny++;
+			}
+		}
+	}
+
+public:
+	WindowStats(uint32_t bucket_ms) : _bucket_ms(bucket_ms) { Reset(0); }
+
+	// new bucket length, the window restarts empty at now
+	void SetBucketMs(uint32_t bucket_ms, uint32_t now)
+	{
+		_bucket_ms = bucket_ms;
+		Reset(now);
+	}
+
+	void Reset(uint32_t now)
+	{
+		_seq = 0;
+		_first = 0;
+		_clear(_cur);
+		_cur_ini = now;
+		_sum = 0;
+		_sumsq = 0;
+		_count = 0;
+		_sy = 0;
+		_siy = 0;
+		_ny = 0;
+		_max_h = _max_n = _min_h = _min_n = 0;
+		_ema_q8 = 0;
+		_ema_valid = false;
+	}
+
+	// close buckets whose time is over, empty ones if samples stopped. Bounded to one window
+	void Update(uint32_t now)
+	{
+		uint32_t n = 0;
+
+		while((( now - _cur_ini ) >= _bucket_ms ) && ( n++ <= N )) {
+			_close();
+			_cur_ini += _bucket_ms;
+		}
+
+		if(( now - _cur_ini ) >= _bucket_ms )		// gap longer than the window
+			_cur_ini = now;
+	}
+
+	void Add(int16_t v, uint32_t now)
+	{
+		Update(now);
+
+		_cur.sum += v;
+		_cur.sumsq += (int32_t)v * v;
+		_cur.count++;
+		if( v < _cur.min ) _cur.min = v;
+		if( v > _cur.max ) _cur.max = v;
+
+		if( _ema_valid ) {
+			_ema_q8 += ((int32_t)v * 256 - _ema_q8 ) >> WSTAT_EMA_SHIFT;
+		} else {
+			_ema_q8 = (int32_t)v * 256;
+			_ema_valid = true;
+		}
+	}
+
+	uint32_t Count() const { return _count + _cur.count; }
+	uint32_t WindowMs() const { return N * _bucket_ms; }
+
+	float Mean() const
+	{
+		uint32_t n = Count();
+		return n ? (float)( _sum + _cur.sum ) / n : 0;
+	}
+
+	float Variance() const
+	{
+		uint32_t n = Count();
+		if( n < 2 )
+			return 0;
+
+		float m = Mean();
+		float v = (float)( _sumsq + _cur.sumsq ) / n - m * m;
+		return ( v > 0 ) ? v : 0;
+	}
+
+	int16_t Max() const
+	{
+		int16_t m = _cur.count ? _cur.max : INT16_MIN;
+		if( _max_n && ( _b[_dq_max[_max_h] % N].max > m ))
+			m = _b[_dq_max[_max_h] % N].max;
+		return ( m == INT16_MIN && !Count() ) ? 0 : m;
+	}
+
+	int16_t Min() const
+	{
+		int16_t m = _cur.count ? _cur.min : INT16_MAX;
+		if( _min_n && ( _b[_dq_min[_min_h] % N].min < m ))
+			m = _b[_dq_min[_min_h] % N].min;
+		return ( m == INT16_MAX && !Count() ) ? 0 : m;
+	}
+
+	float Ema() const { return (float)_ema_q8 / 256; }
+
+	// least squares slope of the closed bucket means, units per minute. Empty buckets are
+	// skipped, so after a gap the slope spans the buckets that have data
+	float Slope() const
+	{
+		if( _ny < 2 )
+			return 0;
+
+		float n = (float)_ny;
+		float si = n * ( n - 1 ) / 2;
+		float sii = ( n - 1 ) * n * ( 2 * n - 1 ) / 6;
+		float d = n * sii - si * si;
+
+		return (( n * _siy - si * _sy ) / d ) * ( 60000.0f / _bucket_ms );
+	}
+
+	// {"n":..,"mean":..,"sd":..,"min":..,"max":..,"ema":..,"slope_min":..}
+	template<class P>
+	void PrintJson(P &out) const
+	{
+		out.printf("{\"n\":%u,\"mean\":%.2f,\"sd\":%.2f,\"min\":%d,\"max\":%d,\"ema\":%.2f,\"slope_min\":%.3f}",
+			Count(), Mean(), sqrtf(Variance()), Min(), Max(), Ema(), Slope());
+	}
+};
@@ -0,0 +1,320 @@
+/**************************************************************************************************
+  Filename:       WsLink.cpp
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    weather station link implementation
+**************************************************************************************************/
+#include "WsLink.h"
+#include "defines.h"
+#include "LogRing.h"
+#include "WeatherStats.h"
+
+WsLink g_WsLink;
+
+static const char *const k_mode_str[] = {"ascii", "hello", "baud", "binary"};
+
+WsLink::WsLink() : _sample(), _mode(WsMode_t::kAscii), _mode_ms(0), _baud(WSP_BASE_BAUD), _baud_next(0),
+	_hello_ms(0), _poll_ms_last(0), _frame_ms(0), _link_ms(0), _link(false),
+	_binary(false), _baud_cfg(115200), _poll_ms(1000), _reconfig(false),
+	_ascii_frames(0), _ascii_bad(0), _bin_frames(0), _crc_errors(0), _bad_length(0), _bad_seq(0),
+	_polls(0), _timeouts(0), _upgrades(0), _fallbacks(0)
+{
+}
+
+void WsLink::Begin(AsyncWebServer *server)
+{
+	Serial1.begin(WSP_BASE_BAUD, SERIAL_8N1, IN_PIN_RX1, OUT_PIN_TX1);
+	server->on(WSLINK_URL, HTTP_GET, [this](AsyncWebServerRequest *request) { _sendJson(request); });
+}
+
+// from the settings, applied by the next Loop
+void WsLink::SetConfig(bool binary, uint32_t baud, uint32_t poll_ms)
+{
+	static const uint32_t k_bauds[] = {9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600};
+	bool ok = false;
+
+	for(uint32_t b : k_bauds)
+		ok |= ( b == baud );
+	if( !ok )
+		baud = 115200;
+
+	if( poll_ms < WSLINK_MIN_POLL_MS )
+		poll_ms = WSLINK_MIN_POLL_MS;
+	if( poll_ms > WSLINK_MAX_POLL_MS )		// the station must see a poll before it falls back
+		poll_ms = WSLINK_MAX_POLL_MS;
+
+	_binary = binary;
+	_baud_cfg = baud;
+	_poll_ms = poll_ms;
+	_reconfig = true;
+}
+
+// API task, from the settings of the observingconditions device. Settings saved before the link
+// had its own section keep it in ObservingConditions_Configuration, read from there until the next save
+void WsLink::ReadJson(JsonObject &root)
+{
+	JsonObject obj_config = root["WsLink_Configuration"];
+	if( !obj_config )
+		obj_config = root["ObservingConditions_Configuration"];
+	if( !obj_config )
+		return;
+
+	SetConfig(obj_config["Ws_binary"] | GetBinary(), obj_config["Ws_baud"] | GetBaud(), obj_config["Ws_poll_ms"] | GetPollMs());
+}
+
+void WsLink::WriteJson(JsonObject &root)
+{
+	JsonObject obj_config = root["WsLink_Configuration"].to<JsonObject>();
+
+	obj_config["Ws_binary"] = GetBinary();
+	obj_config["Ws_baud"] = GetBaud();
+	obj_config["Ws_poll_ms"] = GetPollMs();
+}
+
+// control tick stage: receive, negotiate and poll
+void WsLink::Loop()
+{
+	uint32_t now = millis();
+
+	if( _reconfig ) {
+		_reconfig = false;
+		if( _mode != WsMode_t::kAscii )		// renegotiate with the new baud, or stay ASCII
+			_fallback("reconfigured");
+	}
+
+	while( Serial1.available() ) {
+		switch( _dec.Feed((uint8_t)Serial1.read()) )
+		{
+			case WspResult_t::kAscii:		_onAscii(now); break;
+			case WspResult_t::kFrame:		_onFrame(now); break;
+			case WspResult_t::kCrcError:	_crc_errors++; break;
+			case WspResult_t::kBadLength:	_bad_length++; break;
+			default: break;
+		}
+	}
+
+	if( _binary || ( _mode != WsMode_t::kAscii ))
+		_negotiate(now);
+
+	if( _link && (( now - _link_ms ) > WS_TIMEOUT * 1000 )) {	// no frames, station offline
+		BusEvent_t ev(Topic_t::kWsLink);
+		ev.link = false;
+		if( g_StateBus.PublishChange(ev) ) {					// retried next tick otherwise
+			_link = false;
+			RLOG_WARNING_PRINTF("Weather station timeout\n");
+		}
+	}
+}
+
+void WsLink::_send(uint8_t type, uint8_t seq, const uint8_t *payload, uint8_t len)
+{
+	uint8_t buf[WSP_MAX_FRAME];
+
+	Serial1.write(buf, wsp_encode(buf, type, seq, payload, len));
+}
+
+void WsLink::_linkUp(uint32_t now)
+{
+	_link_ms = now;									// refresh connection timer
+	if( !_link ) {
+		BusEvent_t ev(Topic_t::kWsLink);
+		ev.link = true;
+		if( g_StateBus.PublishChange(ev) )						// retried on the next frame otherwise
+			_link = true;
+	}
+}
+
+// %WS, skytemp, airtemp, wind, humidity, rain, light, clouds, stars #
+// typical message			%WS,-175,-120,24,85,1,1270,-1,-1#
+void WsLink::_onAscii(uint32_t now)
+{
+	int16_t field[WSP_NUM_FIELDS];
+
+	_linkUp(now);									// any frame shows the station alive, as before
+	uint8_t n = wsp_parse_ascii(_dec.ascii, field);
+	if( n == 0 ) {
+		_ascii_bad++;
+		return;
+	}
+	_ascii_frames++;
+	Accept(field, ( 1u << n ) - 1, now);
+}
+
+void WsLink::_onFrame(uint32_t now)
+{
+	const WspFrame_t &f = _dec.frame;
+
+	_bin_frames++;
+	switch( f.type )
+	{
+		case kWspHelloAck:							// ver, max baud
+			if(( _mode != WsMode_t::kHello ) || ( f.len < 5 ))
+				break;
+			{
+				uint32_t max = wsp_get_u32(&f.payload[1]);
+				uint8_t p[4];
+
+				_baud_next = ( _baud_cfg < max ) ? _baud_cfg : max;
+				wsp_put_u32(p, _baud_next);
+				_send(kWspBaud, f.seq, p, sizeof(p));
+				_mode = WsMode_t::kBaud;
+				_mode_ms = now;
+			}
+			break;
+
+		case kWspBaudAck:
+			if(( _mode != WsMode_t::kBaud ) || ( f.len < 4 ) || ( wsp_get_u32(f.payload) != _baud_next ))
+				break;
+			Serial1.flush();
+			Serial1.updateBaudRate(_baud_next);
+			_baud = _baud_next;
+			_mode = WsMode_t::kBinary;
+			_mode_ms = now;
+			_frame_ms = now;
+			_poll_ms_last = now - _poll_ms;			// first poll right away
+			_poll.Reset();
+			_upgrades++;
+			RLOG_INFO_PRINTF("Weather station binary link at %u baud\n", _baud);
+			break;
+
+		case kWspSample:
+			{
+				uint32_t lat;
+				int16_t field[WSP_NUM_FIELDS];
+				uint8_t n = f.len / 2;
+
+				if( _poll.Complete(f.seq, (uint32_t)esp_timer_get_time(), lat) )
+					_latency_us.Add(lat);
+				else
+					_bad_seq++;					// late, its poll already timed out, the data is still good
+
+				if( n > WSP_NUM_FIELDS )
+					n = WSP_NUM_FIELDS;
+				for(uint8_t i = 0; i < n; i++)
+					field[i] = wsp_get_i16(&f.payload[i * 2]);
+				_frame_ms = now;
+				_linkUp(now);
+				Accept(field, ( 1u << n ) - 1, now);
+			}
+			break;
+
+		default:
+			break;
+	}
+}
+
+// range check the fields in mask, bit per field, the others keep their last value.
+// Also the entry for the Modbus sensors, they run in the same control tick
+void WsLink::Accept(const int16_t *field, uint8_t mask, uint32_t now)
+{
+	if(( mask & ( 1 << 0 )) && !(( field[0] < -500 ) || ( field[0] > 500 ))) {	// sky temp -500 -> 500			1adu = 0,1°C
+		if( g_WeatherStats.Ingest(WsChannel_t::kTsky, field[0], now) )		// outliers are dropped
+			_sample.tsky = field[0];
+	}
+
+	if(( mask & ( 1 << 1 )) && !(( field[1] < -500 ) || ( field[1] > 500 ))) {	// air temp -500 -> 500			1adu = 0,1°C
+		if( g_WeatherStats.Ingest(WsChannel_t::kTair, field[1], now) )		// outliers are dropped
+			_sample.tair = field[1];
+	}
+
+	if(( mask & ( 1 << 2 )) && !(( field[2] < 0 ) || ( field[2] > 100 ))) {		// wind 0 -> 100				1adu = 1km/h
+		if( g_WeatherStats.Ingest(WsChannel_t::kWind, field[2], now) )		// outliers are dropped
+			_sample.wind = field[2];
+	}
+
+	if(( mask & ( 1 << 3 )) && !(( field[3] < 0 ) || ( field[3] > 110 ))) {		// humidity 0 -> 110			1adu = 1%
+		if( g_WeatherStats.Ingest(WsChannel_t::kHum, field[3], now) )		// outliers are dropped
+			_sample.hum = field[3];
+	}
+
+	if(( mask & ( 1 << 4 )) && !(( field[4] < 0 ) || ( field[4] > 9999 )))		// rain 0 -> 1					0 safe, 1 rain
+		_sample.rain = field[4];
+
+	if(( mask & ( 1 << 5 )) && !(( field[5] < 0 ) || ( field[5] > 9999 )))		// light 0 -> 9999				1adu = 1lux
+		_sample.light = field[5];
+
+	if(( mask & ( 1 << 6 )) && !(( field[6] < -1 ) || ( field[6] > 100 )))		// cloud coverage -1 -> 100		-1 not used, 0~100 percentage
+		_sample.clouds = field[6];
+
+	if(( mask & ( 1 << 7 )) && !(( field[7] < -1 ) || ( field[7] > 9999 )))		// stars -1 -> 9999				-1 not used, 0~9999 number of stars in sight
+		_sample.stars = field[7];
+
+	BusEvent_t ev(Topic_t::kWeather);
+	ev.ws = _sample;
+	g_StateBus.Publish(ev);								// every frame is a sample for the averages
+
+	RLOG_DEBUG_PRINTF("WS frame %d,%d,%d,%d,%d,%d,%d,%d\n", _sample.tsky, _sample.tair, _sample.wind, _sample.hum,
+		_sample.rain, _sample.light, _sample.clouds, _sample.stars);
+}
+
+// offer the binary protocol, poll once it runs, give it up when the station goes quiet
+void WsLink::_negotiate(uint32_t now)
+{
+	switch( _mode )
+	{
+		case WsMode_t::kAscii:
+			if( _binary && (( now - _hello_ms ) >= WSLINK_HELLO_MS )) {
+				_hello_ms = now;
+				_send(kWspHello, 0, nullptr, 0);
+				_mode = WsMode_t::kHello;
+				_mode_ms = now;
+			}
+			break;
+
+		case WsMode_t::kHello:
+		case WsMode_t::kBaud:
+			if(( now - _mode_ms ) > WSLINK_REPLY_MS )	// old firmware or a lost ack, the station still talks 9600
+				_mode = WsMode_t::kAscii;
+			break;
+
+		case WsMode_t::kBinary:
+			{
+				uint32_t now_us = (uint32_t)esp_timer_get_time();
+				uint8_t seq;
+
+				_timeouts += _poll.Expire(now_us, WSLINK_REPLY_MS * 1000);
+				if(( now - _frame_ms ) > WSP_FALLBACK_MS) {
+					_fallback("no frames");
+					break;
+				}
+				if((( now - _poll_ms_last ) >= _poll_ms ) && _poll.Issue(now_us, seq)) {
+					_poll_ms_last = now;
+					_send(kWspPoll, seq, nullptr, 0);
+					_polls++;
+				}
+			}
+			break;
+	}
+}
+
+void WsLink::_fallback(const char *why)
+{
+	if( _mode == WsMode_t::kBinary ) {
+		Serial1.flush();
+		Serial1.updateBaudRate(WSP_BASE_BAUD);
+		_fallbacks++;
+		RLOG_WARNING_PRINTF("Weather station back to ASCII, %s\n", why);
+	}
+	_baud = WSP_BASE_BAUD;
+	_mode = WsMode_t::kAscii;
+	_hello_ms = millis();							// give the station time to fall back too
+	_poll.Reset();
+}
+
+void WsLink::_sendJson(AsyncWebServerRequest *request)
+{
+	AsyncResponseStream *response = request->beginResponseStream("application/json");
+
+	response->printf("{\"connected\":%s,\"mode\":\"%s\",\"baud\":%u,\"binary\":%s,\"cfg_baud\":%u,\"poll_ms\":%u",
+		_link ? "true" : "false", k_mode_str[(uint8_t)_mode], _baud, _binary ? "true" : "false", _baud_cfg, _poll_ms);
+	response->printf(",\"ascii_frames\":%u,\"ascii_bad\":%u,\"bin_frames\":%u,\"crc_errors\":%u,\"bad_length\":%u",
+		_ascii_frames, _ascii_bad, _bin_frames, _crc_errors, _bad_length);
+	response->printf(",\"bad_seq\":%u,\"noise_bytes\":%u,\"polls\":%u,\"in_flight\":%u,\"timeouts\":%u,\"upgrades\":%u,\"fallbacks\":%u",
+		_bad_seq, _dec.noise, _polls, _poll.InFlight(), _timeouts, _upgrades, _fallbacks);
+	response->print(",\"latency_us\":");
+	_latency_us.PrintJson(*response);
+	response->print("}");
+
+	request->send(response);
+}
@@ -0,0 +1,93 @@
+/**************************************************************************************************
+  Filename:       WsLink.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    weather station link on Serial1, see WsProto.h for the wire format.
+                  ASCII frames pushed at 9600 baud are always accepted. With Ws_binary set the
+                  board offers the binary protocol: HELLO every WSLINK_HELLO_MS, on the answer
+                  both ends move to Ws_baud and the board polls every Ws_poll_ms with up to
+                  WSP_PIPELINE requests in flight. Without a valid frame for WSP_FALLBACK_MS it
+                  drops back to 9600 baud ASCII, an old station firmware never answers HELLO
+                  and keeps working as before. Runs in the control tick. Settings are in
+                  WsLink_Configuration, a section of the observingconditions device settings
+                  that ReadJson() and WriteJson() own.
+**************************************************************************************************/
+#pragma once
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <ArduinoJson.h>
+#include "WsProto.h"
+#include "StateBus.h"
+#include "Histogram.h"
+
+#define WSLINK_HELLO_MS         10000       // between offers while the station talks ASCII
+#define WSLINK_REPLY_MS         500         // HELLO, BAUD and POLL answer timeout
+#define WSLINK_MIN_POLL_MS      100
+#define WSLINK_MAX_POLL_MS      ( WSP_FALLBACK_MS / 2 )
+#define WSLINK_URL              "/wslink"
+
+enum struct WsMode_t : uint8_t
+{
+	kAscii = 0,								// 9600 baud, station pushes
+	kHello,									// HELLO sent, waiting the ack
+	kBaud,									// BAUD sent, waiting the ack
+	kBinary									// Ws_baud, board polls
+};
+
+class WsLink
+{
+private:
+	WspDecoder _dec;
+	WspPoller _poll;
+	WsSample_t _sample;						// last accepted readings, published on kWeather
+	WsMode_t _mode;
+	uint32_t _mode_ms;						// entered _mode at
+	uint32_t _baud;							// current line speed
+	uint32_t _baud_next;					// offered in BAUD
+	uint32_t _hello_ms;
+	uint32_t _poll_ms_last;
+	uint32_t _frame_ms;						// last valid binary frame
+	uint32_t _link_ms;						// last frame of any kind
+	bool _link;
+
+	bool _binary;
+	uint32_t _baud_cfg;
+	uint32_t _poll_ms;
+	volatile bool _reconfig;
+
+	uint32_t _ascii_frames;
+	uint32_t _ascii_bad;					// not %WS or malformed fields
+	uint32_t _bin_frames;
+	uint32_t _crc_errors;
+	uint32_t _bad_length;
+	uint32_t _bad_seq;						// reply to no poll in flight, late or duplicated
+	uint32_t _polls;
+	uint32_t _timeouts;
+	uint32_t _upgrades;
+	uint32_t _fallbacks;
+	Histogram _latency_us;					// POLL -> SAMPLE
+
+	void _send(uint8_t type, uint8_t seq, const uint8_t *payload, uint8_t len);
+	void _onAscii(uint32_t now);
+	void _onFrame(uint32_t now);
+	void _linkUp(uint32_t now);
+	void _negotiate(uint32_t now);
+	void _fallback(const char *why);
+	void _sendJson(AsyncWebServerRequest *request);
+
+public:
+	WsLink();
+	void Begin(AsyncWebServer *server);
+	void Loop();
+	void Accept(const int16_t *field, uint8_t mask, uint32_t now);
+	void SetConfig(bool binary, uint32_t baud, uint32_t poll_ms);
+	void ReadJson(JsonObject &root);
+	void WriteJson(JsonObject &root);
+	bool GetBinary() { return _binary; }
+	uint32_t GetBaud() { return _baud_cfg; }
+	uint32_t GetPollMs() { return _poll_ms; }
+	bool IsConnected() { return _link; }
+};
+
+extern WsLink g_WsLink;
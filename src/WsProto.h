@@ -0,0 +1,290 @@
+/**************************************************************************************************
+  Filename:       WsProto.h
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    weather station link protocol, no Arduino dependency so the host bench in
+                  tools/ builds it too. Two framings share the line:
+
+                  ASCII, pushed by the station, unchanged:
+                      %WS,tsky,tair,wind,hum,rain,light,clouds,stars#
+
+                  binary, request/response:
+                      A5 5A type seq len payload[len] crc16
+                      crc16 CRC-16/CCITT-FALSE over type..payload, little endian on the wire
+                      board -> station                    station -> board
+                      kWspHello                           kWspHelloAck  ver, max baud u32
+                      kWspBaud   baud u32                 kWspBaudAck   baud u32, then both switch
+                      kWspPoll                            kWspSample    8 x i16 as the ASCII fields
+                  Replies echo the request seq, the board keeps up to WSP_PIPELINE polls in flight.
+                  The station falls back to 9600 baud ASCII after WSP_FALLBACK_MS without a poll,
+                  the board after the same time without a valid frame.
+**************************************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define WSP_SYNC0               0xA5
+#define WSP_SYNC1               0x5A
+#define WSP_VERSION             1
+#define WSP_MAX_PAYLOAD         32
+#define WSP_MAX_FRAME           ( WSP_MAX_PAYLOAD + 7 )
+#define WSP_ASCII_LEN           64          // longest ASCII frame
+#define WSP_NUM_FIELDS          8
+#define WSP_PIPELINE            4           // polls in flight, power of 2
+#define WSP_BASE_BAUD           9600
+#define WSP_FALLBACK_MS         3000
+
+enum WspType_t : uint8_t
+{
+	kWspHello = 0x01,
+	kWspBaud = 0x02,
+	kWspPoll = 0x03,
+	kWspHelloAck = 0x81,
+	kWspBaudAck = 0x82,
+	kWspSample = 0x83
+};
+
+// field order of the ASCII frame, the SAMPLE payload and WsSample_t
+enum WspField_t : uint8_t
+{
+	kWspTsky = 0,
+	kWspTair,
+	kWspWind,
+	kWspHum,
+	kWspRain,
+	kWspLight,
+	kWspClouds,
+	kWspStars
+};
+
+struct WspFrame_t
+{
+	uint8_t type;
+	uint8_t seq;
+	uint8_t len;
+	uint8_t payload[WSP_MAX_PAYLOAD];
+};
+
+enum struct WspResult_t : uint8_t
+{
+	kNone = 0,								// need more bytes
+	kFrame,									// binary frame in frame
+	kAscii,									// ASCII frame in ascii, '%' to '#'
+	kCrcError,
+	kBadLength
+};
+
+inline uint16_t wsp_crc16(const uint8_t *p, size_t n, uint16_t crc = 0xFFFF)
+{
+	while( n-- ) {
+		crc ^= (uint16_t)( *p++ ) << 8;
+		for(uint8_t b = 0; b < 8; b++)
+			crc = ( crc & 0x8000 ) ? (uint16_t)(( crc << 1 ) ^ 0x1021 ) : (uint16_t)( crc << 1 );
+	}
+	return crc;
+}
+
+// returns the frame size in buf, WSP_MAX_FRAME bytes at most
+inline size_t wsp_encode(uint8_t *buf, uint8_t type, uint8_t seq, const uint8_t *payload, uint8_t len)
+{
+	if( len > WSP_MAX_PAYLOAD )
+		len = WSP_MAX_PAYLOAD;
+
+	buf[0] = WSP_SYNC0;
+	buf[1] = WSP_SYNC1;
+	buf[2] = type;
+	buf[3] = seq;
+	buf[4] = len;
+	if( len )
+		memcpy(&buf[5], payload, len);
+	uint16_t crc = wsp_crc16(&buf[2], 3 + len);
+	buf[5 + len] = (uint8_t)crc;
+	buf[6 + len] = (uint8_t)( crc >> 8 );
+	return 7 + len;
+}
+
+inline void wsp_put_u32(uint8_t *p, uint32_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)( v >> 8 ); p[2] = (uint8_t)( v >> 16 ); p[3] = (uint8_t)( v >> 24 ); }
+inline uint32_t wsp_get_u32(const uint8_t *p) { return p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ((uint32_t)p[3] << 24 ); }
+inline void wsp_put_i16(uint8_t *p, int16_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)((uint16_t)v >> 8 ); }
+inline int16_t wsp_get_i16(const uint8_t *p) { return (int16_t)( p[0] | ( p[1] << 8 )); }
+
+// %WS,f0,...,f7#. Returns the number of fields, 0 if not a valid frame. Extra fields and numbers
+// out of int16 fail the frame
+inline uint8_t wsp_parse_ascii(const char *s, int16_t *field)
+{
+	uint8_t n = 0;
+
+	if( strncmp(s, "%WS,", 4) != 0 )
+		return 0;
+	s += 4;
+
+	while( *s && ( *s != '#' )) {
+		char *end;
+		long v = strtol(s, &end, 10);
+
+		if(( end == s ) || ( n >= WSP_NUM_FIELDS ) || ( v < -32768 ) || ( v > 32767 ))
+			return 0;
+		field[n++] = (int16_t)v;
+		s = end;
+		if( *s == ',' )
+			s++;
+		else if( *s != '#' )
+			return 0;
+	}
+	return ( *s == '#' ) ? n : 0;
+}
+
+// byte stream demux: binary frames by sync, ASCII frames by '%'...'#', noise is counted
+class WspDecoder
+{
+private:
+	enum : uint8_t { kIdle, kSync1, kHeader, kPayload, kCrc, kAscii } _st = kIdle;
+	uint8_t _hdr[3 + WSP_MAX_PAYLOAD];
+	uint8_t _n = 0;
+	uint8_t _crc[2];
+
+public:
+	WspFrame_t frame;
+	char ascii[WSP_ASCII_LEN];
+	uint32_t noise = 0;						// bytes outside any frame
+
+	WspResult_t Feed(uint8_t c)
+	{
+		switch( _st )
+		{
+			case kIdle:
+				if( c == WSP_SYNC0 )
+					_st = kSync1;
+				else if( c == '%' ) {
+					ascii[0] = '%';
+					_n = 1;
+					_st = kAscii;
+				} else
+					noise++;
+				return WspResult_t::kNone;
+
+			case kSync1:
+				if( c == WSP_SYNC1 ) {
+					_n = 0;
+					_st = kHeader;
+				} else {
+					noise++;
+					_st = kIdle;
+					return Feed(c);
+				}
+				return WspResult_t::kNone;
+
+			case kHeader:
+				_hdr[_n++] = c;
+				if( _n == 3 ) {
+					if( _hdr[2] > WSP_MAX_PAYLOAD ) {
+						_st = kIdle;
+						return WspResult_t::kBadLength;
+					}
+					_st = _hdr[2] ? kPayload : kCrc;
+					_crc[0] = 0;
+				}
+				return WspResult_t::kNone;
+
+			case kPayload:
+				_hdr[_n++] = c;
+				if( _n == 3 + _hdr[2] )
+					_st = kCrc;
+				return WspResult_t::kNone;
+
+			case kCrc:
+				_crc[_n++ - 3 - _hdr[2]] = c;
+				if( _n < 5 + _hdr[2] )
+					return WspResult_t::kNone;
+				_st = kIdle;
+				if( wsp_crc16(_hdr, 3 + _hdr[2]) != (uint16_t)( _crc[0] | ( _crc[1] << 8 )))
+					return WspResult_t::kCrcError;
+				frame.type = _hdr[0];
+				frame.seq = _hdr[1];
+				frame.len = _hdr[2];
+				memcpy(frame.payload, &_hdr[3], frame.len);
+				return WspResult_t::kFrame;
+
+			case kAscii:
+				if( c == '%' ) {							// restart, as the old receiver did
+					_n = 1;
+					return WspResult_t::kNone;
+				}
+				if( _n >= WSP_ASCII_LEN - 1 ) {				// overlong frame, drop it
+					noise += _n;
+					_st = kIdle;
+					return WspResult_t::kNone;
+				}
+				ascii[_n++] = (char)c;
+				if( c == '#' ) {
+					ascii[_n] = 0;
+					_st = kIdle;
+					return WspResult_t::kAscii;
+				}
+				return WspResult_t::kNone;
+		}
+		return WspResult_t::kNone;
+	}
+};
+
+// polls in flight. A reply is matched by seq; unknown or late replies are counted by the caller
+class WspPoller
+{
+private:
+	struct { uint32_t t_us; uint8_t seq; bool busy; } _slot[WSP_PIPELINE] = {};
+	uint8_t _seq = 0;
+	uint8_t _busy = 0;
+
+public:
+	uint8_t InFlight() const { return _busy; }
+
+	// returns false when the window is full
+	bool Issue(uint32_t now_us, uint8_t &seq)
+	{
+		uint8_t i = _seq & ( WSP_PIPELINE - 1 );
+
+		if( _slot[i].busy )
+			return false;
+		_slot[i] = {now_us, _seq, true};
+		_busy++;
+		seq = _seq++;
+		return true;
+	}
+
+	bool Complete(uint8_t seq, uint32_t now_us, uint32_t &latency_us)
+	{
+		uint8_t i = seq & ( WSP_PIPELINE - 1 );
+
+		if( !_slot[i].busy || ( _slot[i].seq != seq ))
+			return false;
+		_slot[i].busy = false;
+		_busy--;
+		latency_us = now_us - _slot[i].t_us;
+		return true;
+	}
+
+	// frees polls older than timeout_us, returns how many
+	uint8_t Expire(uint32_t now_us, uint32_t timeout_us)
+	{
+		uint8_t n = 0;
+
+		for(uint8_t i = 0; i < WSP_PIPELINE; i++) {
+			if( _slot[i].busy && (( now_us - _slot[i].t_us ) > timeout_us )) {
+				_slot[i].busy = false;
+				_busy--;
+				n++;
+			}
+		}
+		return n;
+	}
+
+	void Reset()
+	{
+		for(uint8_t i = 0; i < WSP_PIPELINE; i++)
+			_slot[i].busy = false;
+		_busy = 0;
+	}
+};
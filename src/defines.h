@@ -41,49 +41,27 @@ CONFIGURATION NEEDED BY LAN8720 CHIP DO NOT EDIT!
 #define SR_IN_PIN_PL        19          // parallel load
 #define SR_IN_PIN_SDIN      4           // serial data in
 
+#define SR_IN_BYTES         2           // number of 74HC165 in the input chain (base board 2)
+#define SR_OUT_BYTES        2           // number of 74HC595 in the output chain (base board 2)
+
+#define DOME_NUM_ROOFS      1           // roll-off roofs, the second one needs both expansion boards
+
 #define IN_PIN_AP_SET       34          // net config button pin
 #define OUT_PIN_AP_LED      13          // net config LED
 
 #define WS_TIMEOUT          30          // 30s timeout if no data received from WS
 #define IN_PIN_RX1          16          // usart RX from weather station
 #define OUT_PIN_TX1         17          // usart TX to weather station
-#define UART1_BUFFER        64          // size of uart buffers
-
-// bit mask for output shif register 595
-#define BIT_OUT_CLEAR       0xff00      // 0b1111 1111 0000 0000
-
-#define BIT_OUT_0           0x0080      // 0bx000 0000 1000 0000
-#define BIT_OUT_1           0x0040      // 0bx000 0000 0100 0000
-#define BIT_OUT_2           0x0020      // 0bx000 0000 0010 0000
-#define BIT_OUT_3           0x0010      // 0bx000 0000 0001 0000
-#define BIT_OUT_4           0x0008      // 0bx000 0000 0000 1000
-#define BIT_OUT_5           0x0004      // 0bx000 0000 0000 0100
-#define BIT_OUT_6           0x0002      // 0bx000 0000 0000 0010
-#define BIT_OUT_7           0x0001      // 0bx000 0000 0000 0001
-
-#define BIT_ROOF_CLOSE      0x0100      // bx000 0001 0000 0000
-#define BIT_ROOF_OPEN       0x0200      // bx000 0010 0000 0000
-#define BIT_CPU_OK          0x0400      // b0000 0100 0000 0000
-#define BIT_WS_OK           0x0800      // b0000 1000 0000 0000
-#define BIT_DOME            0x1000      // b0001 0000 0000 0000
-#define BIT_SWITCH          0x2000      // b0010 0000 0000 0000
-#define BIT_SAFEMON         0x4000      // b0100 0000 0000 0000
-
-
-// bit mask for input shif register 165
-#define BIT_IN_0            0x0001      // bxx00 0000 0000 0001
-#define BIT_IN_1            0x0002      // bxx00 0000 0000 0010
-#define BIT_IN_2            0x0004      // bxx00 0000 0000 0100
-#define BIT_IN_3            0x0008      // bxx00 0000 0000 1000
-#define BIT_IN_4            0x0010      // bxx00 0000 0001 0000
-#define BIT_IN_5            0x0020      // bxx00 0000 0010 0000
-#define BIT_IN_6            0x0040      // bxx00 0000 0100 0000
-#define BIT_IN_7            0x0080      // bxx00 0000 1000 0000
-
-#define BIT_FC_CLOSE        0x0100      // bx000 0001 0000 0000
-#define BIT_FC_OPEN         0x0200      // bx000 0010 0000 0000
-#define BIT_BUTTON_OPEN     0x0400      // bx000 0100 0000 0000
-#define BIT_BUTTON_CLOSE    0x0800      // bx000 1000 0000 0000
+#define IN_PIN_RX2          23          // RS-485 RO, Modbus sensor bus
+#define OUT_PIN_TX2         21          // RS-485 DI
+#define OUT_PIN_DE2         22          // RS-485 DE and /RE, driven by the UART as RTS
+#define IN_PIN_ENC_A        36          // roof encoder pulses on PCNT, input only, external pull-up
+#define IN_PIN_ENC_B        -1          // quadrature B, -1 single channel
+#define ADC_CH_CURRENT      ADC1_CHANNEL_7  // GPIO 35, roof motor current sense
+#define ADC_CH_SUPPLY       ADC1_CHANNEL_3  // GPIO 39, supply voltage divider
+#define ADC_CURRENT_MA_PER_V 2000       // current sense gain, mA per V at the pin
+#define ADC_CURRENT_ZERO_MV 0           // sense output at 0A
+#define ADC_CURRENT_ROOF    0           // roof whose motor the current sense is on
+#define ADC_SUPPLY_DIVIDER  11          // 100k/10k, 12V -> 1.09V at the pin
 
-#define BIT_SAFE_RAIN       0x1000      // bxx01 0000 0000 0000
-#define BIT_SAFE_POWER      0x2000      // bxx10 0000 0000 0000
+// bit masks for the shift registers 595/165 are generated from the channel table in ChannelMap.h
@@ -10,67 +10,72 @@
 
 
 // #define TEST_RESTART             // only for testing
-#include "defines.h"                // pins and bitmasks
+#include "defines.h"                // pins
+#include "ChannelMap.h"             // I/O channels and bitmasks
 #include <ETH.h>
 
 #include <SLog.h>
 #include <AlpacaDebug.h>
 #include <AlpacaServer.h>
+#include "LogRing.h"
+#include "HeapMonitor.h"
+#include "ControlTask.h"
+#include "Interlock.h"
+#include "Trace.h"
+#include "WeatherStats.h"
+#include "DewHeater.h"
+#include "StateBus.h"
+#include "Rules.h"
+#include "Sessions.h"
+#include "HttpStats.h"
+#include "Schedule.h"
+#include "Mqtt.h"
+#include "WsLink.h"
+#include "Modbus.h"
+#include "RoofMemory.h"
+#include "Encoder.h"
+#include "Analog.h"
 
 #include <Dome.h>
 #include <Switch.h>
 #include <SafetyMonitor.h>
+#include <ObservingConditions.h>
 
-Dome domeDevice;
+Dome domeDevice[k_num_of_domes];
 Switch switchDevice;
 SafetyMonitor safemonDevice;
+ObservingConditions obscondDevice;
 
 #define VERSION "1.0.0"
 
 // ASCOM Alpaca server with discovery
 AlpacaServer alpaca_server(ALPACA_MNG_SERVER_NAME, ALPACA_MNG_MANUFACTURE, ALPACA_MNG_MANUFACTURE_VERSION, ALPACA_MNG_LOCATION);
 
-uint16_t _shift_reg_in, _shift_reg_out, _prev_shift_reg_out;
-bool d_open_button, d_close_button, d_switch_opened, d_switch_closed;
-bool d_relay_open, d_relay_close;
-
-uint8_t _safemon_inputs;						// status of safety monitor 0->safe
-uint32_t tmr_rain_ini, tmr_rain_len;			// timers for rain delay and alarm duration
-uint32_t tmr_power_ini, tmr_power_len;			// power
-//uint32_t tmr_wstat_ini, tmr_wstat_len;		// weather station
-
-uint32_t tmr_ws_connected;						// timout for weather station connection. If elapses, ws is considered offline
-bool is_ws_connected;							// true when weather station is connected
-int rx_1_idx;									// index of pointed char in ws_message[]
-bool rx_1_complete;								// true when a complete message is received
-char rx_1_buffer[UART1_BUFFER];
-char tx_1_buffer[UART1_BUFFER];
-int16_t	weather_tsky;							// readings from weather station
-int16_t	weather_tair;
-int16_t	weather_wind;
-int16_t	weather_hum;
-int16_t	weather_light;
-int16_t	weather_press;							// 2024-08-26 2.03 not used anymore
-int16_t	weather_rain;							// 2024-08-26 2.03 added
-int16_t	weather_clouds;							// 2024-08-26 2.03 added
-int16_t	weather_stars;							// 2024-08-26 2.03 added
-
-bool _sw_in[8], _sw_out[8];						// status of switch in and out
-uint8_t _sw_pwm[4], _prev_sw_pwm[4];			// switch PWMs
-uint8_t _sw_pwm_pins[4] = {OUT_PIN_PWM0, OUT_PIN_PWM1, OUT_PIN_PWM2, OUT_PIN_PWM3};		// definition of PWM pins
-
-uint32_t tmr_LED, tmr_shreg_in, tmr_shreg_out;	// timers for LEDs and shift registers
+SrIn_t _shift_reg_in, _prev_shift_reg_in;
+SrOut_t _shift_reg_out, _prev_shift_reg_out;
+
+uint32_t tmr_LED;								// timer for LEDs
 uint32_t restart_start_time_ms;					// timer for restart
 uint32_t const RESTART_DELAY_MS = 5000;			// restart delay
 
-bool parse_ws_message(void);
-void flush_tx(void);
-void flush_rx(void);
 void normal_boot(void);
-uint16_t read_shift_register( void );
-void write_shift_register( uint16_t value );
 void init_IO(void);
 void checkForRestart(void);
+void ctl_scan_in(void);
+void ctl_ws_link(void);
+void ctl_modbus(void);
+void ctl_sessions(void);
+void ctl_analog(void);
+void ctl_safety(void);
+void ctl_bus(void);
+void ctl_rules(void);
+void ctl_sched(void);
+void ctl_obscond(void);
+void ctl_dome(void);
+void ctl_switch(void);
+void ctl_dew(void);
+void ctl_leds(void);
+void ctl_scan_out(void);
 
 void setup() {
 	Serial.begin(115200);
@@ -81,347 +86,239 @@ void setup() {
 	normal_boot();
 
 	alpaca_server.Begin();
-
-	domeDevice.Begin();
-	alpaca_server.AddDevice(&domeDevice);
+	g_HeapMon.Begin(alpaca_server.getServerTCP());
+	sr_begin(alpaca_server.getServerTCP());
+	g_Rules.Begin(alpaca_server.getServerTCP());			// subscribes before the settings compile the rules
+	g_Scheduler.Begin(alpaca_server.getServerTCP());
+	g_Mqtt.Begin(alpaca_server.getServerTCP());				// subscribes before the control task starts
+	g_WsLink.Begin(alpaca_server.getServerTCP());			// opens Serial1, the ws_link stage owns it from then
+	g_Modbus.Begin(alpaca_server.getServerTCP());			// opens Serial2, the modbus stage owns it from then
+	g_RoofMem.Begin(alpaca_server.getServerTCP());			// stored roof states, applied by the first dome scan
+
+	for(size_t i = 0; i < k_num_of_domes; i++) {
+		domeDevice[i].Begin(k_dome_hw[i], i);
+		alpaca_server.AddDevice(&domeDevice[i]);
+		domeDevice[i].RegisterRoutes(alpaca_server.getServerTCP());	// after AddDevice, it numbers the dome
+	}
+	domeDevice[0].AttachEncoder(&g_RoofPcnt);				// PCNT on IN_PIN_ENC_A, used when Encoder_span is set
+	enc_begin(alpaca_server.getServerTCP(), domeDevice);
+	g_Analog.Begin(alpaca_server.getServerTCP());			// ADC DMA and its reduction task
 
 	switchDevice.Begin();
 	alpaca_server.AddDevice(&switchDevice);
+	switchDevice.RegisterRoutes(alpaca_server.getServerTCP());	// before RegisterCallbacks, the first matching handler wins
 
 	safemonDevice.Begin();
 	alpaca_server.AddDevice(&safemonDevice);
 
+	obscondDevice.Begin();
+	alpaca_server.AddDevice(&obscondDevice);
+
 	alpaca_server.RegisterCallbacks();
 	alpaca_server.LoadSettings();
 
-	_shift_reg_in = 0;
-	_shift_reg_out = 0;
-	_prev_shift_reg_out = 0;
+	g_HeapMon.AddTask(xTaskGetCurrentTaskHandle(), "loop");		// stack watermarks
+	g_HeapMon.AddTask(g_LogRing.getTask(), "log_ring");
+	g_HeapMon.AddTask(xTaskGetHandle("async_tcp"), "async_tcp");
+
+	_shift_reg_in = SrIn_t();
+	_prev_shift_reg_in = SrIn_t();
+	_shift_reg_out = SrOut_t();
+	_prev_shift_reg_out = SrOut_t();
 
 	tmr_LED = millis();
-	tmr_shreg_in = millis();
-	tmr_shreg_out = millis();
-
-	_safemon_inputs = 0;
-	tmr_rain_ini = 0; tmr_rain_len =0 ;
-	tmr_power_ini = 0; tmr_power_len = 0; 
-	//tmr_wstat_ini = 0; tmr_wstat_len = 0;
-	is_ws_connected = false;
-	rx_1_complete = false;
-	rx_1_idx = 0;
+
 	restart_start_time_ms = 0;
+
+	// I/O runs at a fixed rate in the control task, budgets in us
+	g_Control.AddStage("scan_in", ctl_scan_in, 100);
+	g_Control.AddStage("ws_link", ctl_ws_link, 500);
+	g_Control.AddStage("modbus", ctl_modbus, 150);
+	g_Control.AddStage("sessions", ctl_sessions, 50);
+	g_Control.AddStage("analog", ctl_analog, 30);
+	g_Control.AddStage("safety", ctl_safety, 200);
+	g_Control.AddStage("bus", ctl_bus, 300);
+	g_Control.AddStage("rules", ctl_rules, 100);
+	g_Control.AddStage("sched", ctl_sched, 50);
+	g_Control.AddStage("obscond", ctl_obscond, 100);
+	g_Control.AddStage("dome", ctl_dome, 200);
+	g_Control.AddStage("switch", ctl_switch, 300);
+	g_Control.AddStage("dew", ctl_dew, 100);
+	g_Control.AddStage("leds", ctl_leds, 20);
+	g_Control.AddStage("scan_out", ctl_scan_out, 100);
+	g_Control.Begin(alpaca_server.getServerTCP());
+	g_Interlock.Begin(alpaca_server.getServerTCP());
+	g_Trace.Begin(alpaca_server.getServerTCP());
+	g_WeatherStats.Begin(alpaca_server.getServerTCP());
+	g_StateBus.Begin(alpaca_server.getServerTCP());
+	g_Sessions.Begin(alpaca_server.getServerTCP());
+	g_HttpStats.Begin(alpaca_server.getServerTCP());		// per route counts and service times on /httpstats
+	g_HeapMon.AddTask(g_Control.GetTask(), "control");
+	g_HeapMon.AddTask(g_Mqtt.GetTask(), "mqtt");
+	g_HeapMon.AddTask(g_Analog.GetTask(), "adc");
 }
 
 void loop()
 {
 	checkForRestart();
 
-	alpaca_server.Loop();
+	alpaca_server.Loop();							// networking only, I/O runs in the control tick
 
-	domeDevice.Loop();
+	g_HeapMon.Loop();
+	g_RoofMem.Loop();								// roof state changes to NVS
 
-	switchDevice.Loop();
+	delay(2);										// don't busy-spin when idle
+}
+
+// control tick stage: read the 165 input chain
+void ctl_scan_in(void)
+{
+	read_shift_register(_shift_reg_in);
+	_shift_reg_in &= BIT_SR_IN_USED;
+	g_Interlock.Sample(_shift_reg_in);
 
-	safemonDevice.Loop();
+	if( _shift_reg_in != _prev_shift_reg_in ) {
+		TRACE_INPUT_EDGE();
 
-	if((millis() - tmr_shreg_in) > 100) {                  	// read shift register every 100ms
-		tmr_shreg_in = millis();
-		_shift_reg_in = read_shift_register();
+		BusEvent_t ev(Topic_t::kSrIn);
+		ev.in = _shift_reg_in;
+		if( g_StateBus.PublishChange(ev) )				// a state slot, kept for the next tick otherwise
+			_prev_shift_reg_in = _shift_reg_in;
 	}
+}
 
-	if( domeDevice.GetNumberOfConnectedClients() > 0 ) {
-		_shift_reg_out |= BIT_DOME;							// Dome connected LED ON
+// control tick stage: receive and decode frames from the weather station, poll it on the binary link
+void ctl_ws_link(void)
+{
+	g_WsLink.Loop();
+}
 
-		if( _shift_reg_in & BIT_FC_CLOSE )                	// handle close switch input
-			d_switch_closed = true;
-		else
-			d_switch_closed = false;
-
-		if( _shift_reg_in & BIT_FC_OPEN )                 	// handle open switch input
-			d_switch_opened = true;
-		else 
-			d_switch_opened = false;
-
-		if( d_relay_close && !d_switch_closed ){			// handle close relay bit in the out shift register
-			_shift_reg_out |= BIT_ROOF_CLOSE;
-			_shift_reg_out &= ~BIT_ROOF_OPEN;
-		} else {
-			_shift_reg_out &= ~BIT_ROOF_CLOSE;
-		}
-		
-		if( d_relay_open && !d_switch_opened) {				// handle open relay bit in the out shift register
-			_shift_reg_out |= BIT_ROOF_OPEN;
-			_shift_reg_out &= ~BIT_ROOF_CLOSE;
-		} else {
-			_shift_reg_out &= ~BIT_ROOF_OPEN;
-		}
-	} else {
-		_shift_reg_out &= ~BIT_DOME;		// Dome connected LED OFF
+// control tick stage: Modbus sensor bus, values join the weather sample like the station's
+void ctl_modbus(void)
+{
+	g_Modbus.Loop();
+}
 
-		// set flags according to bits in shift registers
-		if( _shift_reg_in & BIT_BUTTON_CLOSE)   	// if no clients connected, handle manual close button
-			d_close_button = true;
-		else
-			d_close_button = false;
-		
-		if( _shift_reg_in & BIT_BUTTON_OPEN )   	// if no clients connected, handle manual open button
-			d_open_button = true;
-		else
-			d_open_button = false;
-		
-		if( _shift_reg_in & BIT_FC_CLOSE )      	// handle close switch
-			d_switch_closed = true;
-		else
-			d_switch_closed = false;
-
-		if( _shift_reg_in & BIT_FC_OPEN )       	// handle open switch
-			d_switch_opened = true;
-		else 
-			d_switch_opened = false;
-		
-		// set relays if conditions are met
-		if( d_close_button && !d_open_button && !d_switch_closed ) {
-			_shift_reg_out |= BIT_ROOF_CLOSE; 			// set close relay bit in the shift register
-			_shift_reg_out &= ~BIT_ROOF_OPEN;			// be sure to clear OPEN RELAY bit
-		}
-		else if( !d_close_button && d_open_button && !d_switch_opened ) {
-			_shift_reg_out |= BIT_ROOF_OPEN;   			// set open relay bit in the shift register
-			_shift_reg_out &= ~BIT_ROOF_CLOSE;			// be sure to clear CLOSE RELAY bit
-		} else {
-			_shift_reg_out &= ~BIT_ROOF_CLOSE;			// bclear CLOSE RELAY bit
-			_shift_reg_out &= ~BIT_ROOF_OPEN;			// clear OPEN RELAY bit
-		}
-	}
+// control tick stage: drop client sessions whose lease ran out, before the devices read the counts
+void ctl_sessions(void)
+{
+	g_Sessions.Expire();
+}
 
-	if( safemonDevice.GetNumberOfConnectedClients() > 0 ) {
-		_shift_reg_out |= BIT_SAFEMON; 									// Sefemon connected LED ON
+// control tick stage: newest motor current and supply block, for the safety and dome stages
+void ctl_analog(void)
+{
+	g_Analog.Loop();
+}
 
-		if(( _shift_reg_in & BIT_SAFE_RAIN ) != 0) {					// rain signal
-			if( tmr_rain_ini == 0 ) {									// if it's the first event, start counting the rain delay
-				tmr_rain_ini = millis();
-				tmr_rain_len = 1000 * safemonDevice.getRainDelay();
-			}
-
-			if(( tmr_rain_ini != 0 ) && ((millis() - tmr_rain_ini) > tmr_rain_len))    // if alarm persists for rain_delay, set UNSAFE
-				_safemon_inputs |= SAFEMON_RAIN_BIT;		
-		
-		} else {
-			tmr_rain_ini = 0;											// clear timer and flag
-			_safemon_inputs &= ~SAFEMON_RAIN_BIT;
-		}
+// control tick stage: safety monitor delays and windowed rules, inputs and weather come by the bus
+void ctl_safety(void)
+{
+	bool interlock = false;
+	for(Dome &dome : domeDevice)
+		interlock |= ( dome.GetInterlockMask() != 0 );
 
-		if( safemonDevice.getPowerDelay() > 0 ) {                 		// enter only if power delay is > 0
-			if(( _shift_reg_in & BIT_SAFE_POWER ) != 0) {
-				if( tmr_power_ini == 0 ) {
-					tmr_power_ini = millis();
-					tmr_power_len = 1000 * safemonDevice.getPowerDelay();
-				}
-
-				if((tmr_power_ini != 0) && ((millis() - tmr_power_ini) > tmr_power_len))
-					_safemon_inputs |= SAFEMON_POWER_BIT;				
-			}
-			else
-			{
-				tmr_power_ini = 0;
-				_safemon_inputs &= ~SAFEMON_POWER_BIT;
-			}
-		} else {
-			tmr_power_ini = 0;
-			_safemon_inputs &= ~SAFEMON_POWER_BIT;
-		}
-	}
+	if( g_Sessions.Count(DevKind_t::kSafetyMonitor, 0) > 0 )
+		_shift_reg_out |= BIT_SAFEMON; 									// Sefemon connected LED ON
 	else
-	{
-		_shift_reg_out &= ~BIT_SAFEMON;		// Sefemon connected LED OFF
-		_safemon_inputs = 0;
-		is_ws_connected = false;
+		_shift_reg_out &= ~BIT_SAFEMON;									// Sefemon connected LED OFF
+
+	g_WeatherStats.Update(millis());
+	safemonDevice.Loop(interlock);										// the roof interlock needs rain and power without clients
+}
+
+// control tick stage: deliver the state changes of this tick to the devices
+void ctl_bus(void)
+{
+	g_StateBus.Dispatch();
+}
+
+// control tick stage: user automation rules, their Switch writes are applied next tick
+void ctl_rules(void)
+{
+	g_Rules.Exec();
+}
+
+// control tick stage: scheduled Switch writes, applied next tick like the rules
+void ctl_sched(void)
+{
+	g_Scheduler.Exec();
+}
+
+// control tick stage: running averages of the observing conditions
+void ctl_obscond(void)
+{
+	obscondDevice.Loop();
+}
+
+// control tick stage: shutter state machines, then relays and limit switches of each roof
+void ctl_dome(void)
+{
+	bool dome_connected = false;
+	SrOut_t prev_out = _shift_reg_out;
+
+	for(size_t i = 0; i < k_num_of_domes; i++) {
+		domeDevice[i].Loop();
+		domeDevice[i].Scan(_shift_reg_in, _shift_reg_out);
+		dome_connected |= ( g_Sessions.Count(DevKind_t::kDome, i) > 0 );
 	}
 
-	if( switchDevice.GetNumberOfConnectedClients() > 0)
-	{
-		uint32_t i;
-		uint16_t p;
-
-		_shift_reg_out |= BIT_SWITCH;		// Switch connected LED ON
-
-		for(i=0; i<8; i++)
-		{
-			if((_shift_reg_in & (1 << i) != 0))         // set _sw_in[] according to shift register inputs
-				_sw_in[i] = true;
-			else
-				_sw_in[i] = false;
-		
-			if( _sw_out[i] )                            // set out bits according to _sw_out[] status
-				_shift_reg_out |= (BIT_OUT_0 >> i);
-			else
-				_shift_reg_out &= ~(BIT_OUT_0 >> i);
-		}
+	if( _shift_reg_out != prev_out )						// relays moved, charge it to this tick's input edge
+		TRACE_DECISION_INPUT(TraceOut_t::kRelay);
 
-		for(i=0; i<4; i++)
-		{
-			if( _prev_sw_pwm[i] != _sw_pwm[i] ) {				// update pwm only if different
-				_prev_sw_pwm[i] = _sw_pwm[i];
-
-				if( p == 0) {                                   // set PWM pin to 0
-					digitalWrite(_sw_pwm_pins[i], LOW);
-				} else if( p == 100) {                          // set PWM pin to 1
-					digitalWrite(_sw_pwm_pins[i], HIGH);
-				} else {         
-					p = ((uint16_t)_sw_pwm[i] * 255) / 100;		// set PWM value
-					analogWrite(_sw_pwm_pins[i], (int)p);
-				}
-			}
-		}
-	} else {
-		uint32_t i;
+	if( dome_connected )
+		_shift_reg_out |= BIT_DOME;							// Dome connected LED ON
+	else
+		_shift_reg_out &= ~BIT_DOME;						// Dome connected LED OFF
+}
 
+// control tick stage: Switch relay outputs and PWMs, inputs come by the bus
+void ctl_switch(void)
+{
+	switchDevice.Loop();
+
+	if( g_Sessions.Count(DevKind_t::kSwitch, 0) > 0 )
+		_shift_reg_out |= BIT_SWITCH;						// Switch connected LED ON
+	else
 		_shift_reg_out &= ~BIT_SWITCH;						// Switch connected LED OFF
 
-		_shift_reg_out &= BIT_OUT_CLEAR;                  	// clear all OUT bits
-		for(i=0; i<8; i++)
-		{
-			_sw_out[i] = false;                             // clear all out
-			_sw_in[i] = false;                              // set input to false
-		}
+	switchDevice.Scan(_shift_reg_out);
+}
 
-		for(i=0; i<4; i++)
-		{
-			_sw_pwm[i] = 0;                                 // clear all PWMs
-			digitalWrite(_sw_pwm_pins[i], LOW);             // set PWM pin to 0
-		}
-	}
+// control tick stage: dew heater PI and PWM fades
+void ctl_dew(void)
+{
+	g_DewHeater.Loop();
+}
 
-	if(( millis() - tmr_LED ) < 1000 ) {                 	// blink CPU OK LED
-	
+// control tick stage: blink CPU OK LED
+void ctl_leds(void)
+{
+	if(( millis() - tmr_LED ) < 1000 ) {
 		if(( millis() - tmr_LED ) < 500 )
-		{
 			_shift_reg_out |= BIT_CPU_OK;		// CPU LED ON
-			//if( domeDevice.GetNumberOfConnectedClients() > 0) _shift_reg_out |= BIT_DOME;			// Dome connected LED ON
-			//if( safemonDevice.GetNumberOfConnectedClients() > 0) _shift_reg_out |= BIT_SAFEMON; 	// Sefemon connected LED ON
-			//if( switchDevice.GetNumberOfConnectedClients() > 0) _shift_reg_out |= BIT_SWITCH;		// Switch connected LED ON
-		}
 		else
-		{
 			_shift_reg_out &= ~BIT_CPU_OK;		// CPU LED OFF
-			//_shift_reg_out &= ~BIT_DOME;		// Dome connected LED OFF
-			//_shift_reg_out &= ~BIT_SAFEMON;		// Sefemon connected LED OFF
-			//_shift_reg_out &= ~BIT_SWITCH;		// Switch connected LED OFF
-		}
 	} else {
 		tmr_LED = millis();
 	}
-
-	if((millis() - tmr_shreg_out) > 100)                    // write shift register every 100ms
-	{
-		tmr_shreg_out = millis();
-	
-		if( _shift_reg_out != _prev_shift_reg_out )       	// write only if changed
-		{
-			_prev_shift_reg_out = _shift_reg_out;
-			write_shift_register( _shift_reg_out );
-		}
-	}
-
-	// serial from WS
-	if(Serial1.available())
-	{
-		char in_msg = (char)Serial1.read();
-		if( in_msg == '%' )                   		// frame start
-			rx_1_idx = 0;
-		
-		rx_1_buffer[rx_1_idx++] = in_msg;     		// store char in the rx_buffer
-
-		if(in_msg == '#') {                   		// frame end
-			rx_1_buffer[rx_1_idx++] = 0;        	// append termination char
-
-			if( rx_1_buffer[0] == '%') {
-				rx_1_complete = true;
-				is_ws_connected = true;
-				tmr_ws_connected = millis();      	// refresh connection timer
-			} else {                            	// message is incomplete, ignore
-				rx_1_idx = 0;
-				rx_1_buffer[rx_1_idx] = 0;
-			}
-		}
-	}
-
-	if (rx_1_complete) {
-		parse_ws_message();
-		rx_1_complete = false;
-		flush_rx();
-	}
 }
 
-// NEW -> decode messages from WStation and store to local variables (%WS, skytemp, airtemp, wind, humidity, rain, light, clouds, stars #)
-// NEW -> typical message			%WS,-175,-120,24,85,1,1270,-1,-1#
-bool parse_ws_message(void) {
-	Serial.println(rx_1_buffer);
-
-	uint8_t s, d, v;
-	int16_t params[8];
-	char s_val[8];
-
-	s = 0;
-	d = 0;
-	v = 0;
-
-	if((rx_1_buffer[0] == '%') && (rx_1_buffer[1] == 'W') && (rx_1_buffer[2] == 'S') && (rx_1_buffer[3] == ','))
+// control tick stage: write the 595 output chain, only if changed
+void ctl_scan_out(void)
+{
+	if( _shift_reg_out != _prev_shift_reg_out )
 	{
-		s = 4;
-
-		while(rx_1_buffer[s])
-		{
-			if(( rx_1_buffer[s] == ',' ) || ( rx_1_buffer[s] == '#' ))
-			{
-				params[v] = atoi( s_val );
-				v++;
-				s++;
-				d = 0;
-			}
-			else
-			{
-				s_val[d++] = rx_1_buffer[s++];
-				s_val[d] = 0;
-			}
-		}
-
-		if(!(( params[0] < -500 ) || ( params[0] > 500 )))		// sky temp -500 -> 500			1adu = 0,1°C
-			weather_tsky = params[0];
-		
-		if(!(( params[1] < -500 ) || ( params[1] > 500 )))		// air temp -500 -> 500			1adu = 0,1°C
-			weather_tair = params[1];
-		
-		if(!(( params[2] < 0 ) || ( params[2] > 100 )))			// wind 0 -> 100				1adu = 1km/h
-			weather_wind = params[2];
-		
-		if(!(( params[3] < 0 ) || ( params[3] > 110 )))			// humidity 0 -> 110			1adu = 1%
-			weather_hum = params[3];
-		
-		if(!(( params[4] < 0 ) || ( params[4] > 9999 )))		// rain 0 -> 1					0 safe, 1 rain
-			weather_rain = params[4];
-		
-		if(!(( params[5] < 0 ) || ( params[5] > 9999 )))		// light 0 -> 9999				1adu = 1lux
-			weather_light = params[5];
-		
-		if(!(( params[6] < -1 ) || ( params[6] > 100 )))		// cloud coverage -1 -> 100		-1 not used, 0~100 percentage
-			weather_clouds = params[6];
-		
-		if(!(( params[7] < -1 ) || ( params[7] > 9999 )))		// stars -1 -> 9999				-1 not used, 0~9999 number of stars in sight
-			weather_stars = params[7];
-		
-		/*
-		if(!(( params[5] < 0 ) || ( params[5] > 1100 )))		// pressure 0 -> 1100			1adu = 1mbar
-		weather_press = params[5];
-		*/
+		write_shift_register( _shift_reg_out );
+		TRACE_OUTPUT(TraceOut_t::kRelay);
+		g_Interlock.Written(_prev_shift_reg_out, _shift_reg_out);
+		_prev_shift_reg_out = _shift_reg_out;
 	}
 
-	return true;
+	g_Interlock.EndTick();
+	TRACE_END_TICK();
 }
 
-// flush UART buffers
-void flush_tx(void) { for(int i=0; i< UART1_BUFFER; i++) tx_1_buffer[i] = 0; }
-void flush_rx(void) { for(int i=0; i< UART1_BUFFER; i++) rx_1_buffer[i] = 0; }
-
 void normal_boot() {
 	// setup logging and WiFi
 	g_Slog.Begin(Serial, 115200);
@@ -456,70 +353,8 @@ void normal_boot() {
 	SLOG_INFO_PRINTF("SYSLOG enabled and running log_lvl=%s enable_serial=%s\n", g_Slog.GetLvlMskStr().c_str(), alpaca_server.GetSerialLog() ? "true" : "false"); 
 	g_Slog.SetLvlMsk(alpaca_server.GetLogLvl());
 	g_Slog.SetEnableSerial(alpaca_server.GetSerialLog());
-}
-
-// read inputs from shift register 165, returns uint16_t value
-uint16_t read_shift_register( void )
-{
-	uint16_t v = 0;
-
-	digitalWrite(SR_IN_PIN_CP, LOW);    	// be sure CP is low
-	digitalWrite(SR_IN_PIN_PL, LOW);    	// latch parallel inputs
-	delayMicroseconds(1);
-	digitalWrite(SR_IN_PIN_PL, HIGH);
-	delayMicroseconds(1);
-	digitalWrite(SR_IN_PIN_CE, LOW);    	// on CE -> low, D7 is available on serial out Q7
-	delayMicroseconds(1);
-
-	for(uint16_t i=0; i<16; i++) {
-		v = (v << 1);
-		v += digitalRead(SR_IN_PIN_SDIN);
-
-		digitalWrite(SR_IN_PIN_CP, HIGH);   // shift to the left
-		delayMicroseconds(1);
-		digitalWrite(SR_IN_PIN_CP, LOW);
-		delayMicroseconds(1);
-	}
-
-	digitalWrite(SR_IN_PIN_CE, HIGH);
-
-	return ((~v) & 0x3fff);
-}
-
-// put value on the shift registers 595
-void write_shift_register( uint16_t value )
-{
-	uint16_t v = value;
-
-	digitalWrite(SR_OUT_PIN_SDOUT, LOW);        // 14 serial data low
-	digitalWrite(SR_OUT_PIN_MR, LOW);           // 10 clear previous data
-	delayMicroseconds(1);
-	digitalWrite(SR_OUT_PIN_SHCP, HIGH);        // 11 shift register clock
-	delayMicroseconds(1);
-	digitalWrite(SR_OUT_PIN_SHCP, LOW);
-	delayMicroseconds(1);
-	digitalWrite(SR_OUT_PIN_MR, HIGH);
-	delayMicroseconds(1);
-
-	for(uint8_t i = 0; i < 16; i++) {
-		if((v & 0x8000) == 0 )
-			digitalWrite(SR_OUT_PIN_SDOUT, LOW);
-		else
-			digitalWrite(SR_OUT_PIN_SDOUT, HIGH);
-
-		delayMicroseconds(1);
-		digitalWrite(SR_OUT_PIN_SHCP, HIGH);
-		delayMicroseconds(1);
-		digitalWrite(SR_OUT_PIN_SHCP, LOW);
 
-		v = (v << 1);
-	}
-
-	delayMicroseconds(1);
-	digitalWrite(SR_OUT_PIN_STCP, HIGH);        // transfer serial data to parallel output
-	delayMicroseconds(1);
-	digitalWrite(SR_OUT_PIN_STCP, LOW);         // 12
-	digitalWrite(SR_OUT_PIN_OE, LOW);           // 13 enable output
+	g_LogRing.Begin();								// start deferred logging task
 }
 
 // initialize IOs and pin status
@@ -530,10 +365,8 @@ void init_IO( void ) {
 	pinMode(SR_OUT_PIN_SHCP, OUTPUT);           // shift register clock pulse
 	pinMode(SR_OUT_PIN_SDOUT, OUTPUT);          // serial data out
 
-	pinMode(OUT_PIN_PWM0, OUTPUT);
-	pinMode(OUT_PIN_PWM1, OUTPUT);
-	pinMode(OUT_PIN_PWM2, OUTPUT);
-	pinMode(OUT_PIN_PWM3, OUTPUT);
+	for(uint8_t pin : k_sw_pwm_pin)
+		pinMode(pin, OUTPUT);						// PWM channels
 
 	pinMode(SR_IN_PIN_CE, OUTPUT);              // chip enable
 	pinMode(SR_IN_PIN_CP, OUTPUT);              // clock pulse
@@ -549,10 +382,8 @@ void init_IO( void ) {
 	digitalWrite(SR_OUT_PIN_SHCP, LOW);
 	digitalWrite(SR_OUT_PIN_SDOUT, LOW);
 
-	digitalWrite(OUT_PIN_PWM0, LOW);
-	digitalWrite(OUT_PIN_PWM1, LOW);
-	digitalWrite(OUT_PIN_PWM2, LOW);
-	digitalWrite(OUT_PIN_PWM3, LOW);
+	for(uint8_t pin : k_sw_pwm_pin)
+		digitalWrite(pin, LOW);
 
 	digitalWrite(SR_IN_PIN_CE, HIGH);
 	digitalWrite(SR_IN_PIN_CP, LOW);
@@ -571,10 +402,7 @@ void init_IO( void ) {
 	usleep(10);
 	digitalWrite(SR_OUT_PIN_MR, HIGH);
 
-	analogWriteFrequency(1000);         // set PWM 1KHz 8bits
-	analogWriteResolution(8);
-
-	Serial1.begin(9600, SERIAL_8N1, IN_PIN_RX1, OUT_PIN_TX1);
+	g_DewHeater.Begin();				// PWM pins on LEDC, 1KHz 10bits
 }
 
 // restart ESP32 on 192.168.1.123/reset page
@@ -582,7 +410,7 @@ void checkForRestart(void) {
 	if ( alpaca_server.GetResetRequest() ) {
 		if( restart_start_time_ms == 0 ) {
 			restart_start_time_ms = millis();
-			Serial.println("Restart request");
+			RLOG_NOTICE_PRINTF("Restart request\n");
 		}
 
 		if(( millis() - restart_start_time_ms ) > RESTART_DELAY_MS ) {
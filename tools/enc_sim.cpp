@@ -0,0 +1,196 @@
+/**************************************************************************************************
+  Filename:       enc_sim.cpp
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    roof encoder tracking on the host, PulseCounter.h with SimCounter in place of
+                  the PCNT. A simulated roof runs 20ms control ticks: open and close at the given
+                  pulse rate, the counter wrapping at a small limit, a jam halfway with the relay
+                  still on, and a roof run into its end stops with the relay on, as the dome does
+                  without limit switches. Reports position, speed, how long the stall took to
+                  detect and where the end of travel was seen.
+                  Exit code 0 when every case is within its tolerance.
+
+                  g++ -std=gnu++17 -O2 -I src tools/enc_sim.cpp -o enc_sim
+                  ./enc_sim [-s span] [-r pulses/s] [-t stall ms] [-q]
+**************************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "PulseCounter.h"
+
+#define TICK_MS                 20
+
+struct Opt_t
+{
+	int32_t span = 3000;					// counts closed -> open
+	uint32_t rate = 500;					// pulses/s while the motor runs
+	uint32_t stall_ms = 1500;
+	bool quad = false;
+};
+
+struct Roof_t
+{
+	SimCounter ctr;
+	EncoderTrack enc;
+	uint32_t now = 1000;
+	double frac = 0;						// pulses not yet counted
+
+	Roof_t(int16_t limit, bool quad) : ctr(limit, quad) { enc.Attach(&ctr); }
+
+	// one tick: the motor moves at rate in direction drive unless jammed
+	void Tick(const Opt_t &opt, int8_t drive, bool jammed)
+	{
+		if(( drive != 0 ) && !jammed) {
+			frac += opt.rate * TICK_MS / 1000.0;
+			int32_t n = (int32_t)frac;
+			frac -= n;
+			ctr.Pulse(n * drive);
+		}
+		now += TICK_MS;
+		enc.Update(now, drive, opt.span, opt.stall_ms);
+	}
+};
+
+static int s_fail = 0;
+
+static void check(const char *what, bool ok)
+{
+	printf("  %-48s %s\n", what, ok ? "ok" : "FAIL");
+	if( !ok )
+		s_fail++;
+}
+
+// closed -> open -> closed at rate, position and speed at the ends and on the way
+static void run_travel(const Opt_t &opt, int16_t limit, const char *name)
+{
+	Roof_t r(limit, opt.quad);
+	uint32_t ticks = (uint32_t)(( (uint64_t)opt.span * 1000 ) / opt.rate / TICK_MS );
+	int32_t speed_mid = 0;
+
+	printf("%s: span %d, %u pulses/s, counter limit %d, %s\n", name, opt.span, opt.rate, limit, opt.quad ? "quadrature" : "single channel");
+	for(uint32_t i = 0; i < ticks; i++) {
+		r.Tick(opt, 1, false);
+		if( i == ticks / 2 )
+			speed_mid = r.enc.State().speed;
+	}
+	EncState_t s = r.enc.State();
+	printf("  opened: pos %d permille %u speed mid-travel %d\n", s.pos, s.permille, speed_mid);
+	check("position at the open end within 1%", abs(s.pos - opt.span) <= opt.span / 100);
+	check("speed within 5% of the pulse rate", abs(speed_mid - (int32_t)opt.rate) <= (int32_t)opt.rate / 20);
+	check("no stall while moving", !s.stalled);
+
+	for(uint32_t i = 0; i < 20; i++)
+		r.Tick(opt, 0, false);
+	check("speed back to 0 when stopped", r.enc.State().speed == 0);
+
+	for(uint32_t i = 0; i < ticks; i++)
+		r.Tick(opt, -1, false);
+	s = r.enc.State();
+	printf("  closed: pos %d permille %u\n", s.pos, s.permille);
+	check("position at the closed end within 1%", abs(s.pos) <= opt.span / 100);
+}
+
+// jam halfway with the relay on, time from the last pulse to the stall flag
+static void run_stall(const Opt_t &opt)
+{
+	Roof_t r(ENC_POS_FULL * 32, opt.quad);
+	uint32_t ticks = (uint32_t)(( (uint64_t)opt.span * 1000 ) / opt.rate / TICK_MS ) / 2;
+	uint32_t t_jam, t_stall = 0;
+
+	printf("stall: jam at half travel, stall_ms %u\n", opt.stall_ms);
+	for(uint32_t i = 0; i < ticks; i++)
+		r.Tick(opt, 1, false);
+	t_jam = r.now;
+	for(uint32_t i = 0; ( i < 60000 / TICK_MS ) && !t_stall; i++) {
+		r.Tick(opt, 1, true);
+		if( r.enc.Stalled() )
+			t_stall = r.now;
+	}
+	printf("  detected %u ms after the last pulse, at %u permille\n", t_stall - t_jam, r.enc.Permille());
+	check("stall detected within stall_ms + 1 tick", t_stall && ( t_stall - t_jam <= opt.stall_ms + TICK_MS ));
+
+	Roof_t s(ENC_POS_FULL * 32, opt.quad);
+	bool early = false;
+	for(uint32_t i = 0; i < opt.stall_ms / TICK_MS - 1; i++) {		// motor start: no pulses yet
+		s.Tick(opt, 1, true);
+		early |= s.enc.Stalled();
+	}
+	check("no stall inside the start grace", !early);
+}
+
+// relay on past the end, the end stop at stop_permille of the span: the end has to be reported
+// where a limit switch would be, never as a jam. The roof pulses until the stop, then no more
+static void run_end(const Opt_t &opt, int8_t drive, uint16_t stop_permille)
+{
+	Roof_t r(ENC_POS_FULL * 32, opt.quad);
+	int32_t stop = (int32_t)(( (int64_t)opt.span * stop_permille ) / ENC_POS_FULL );
+	int32_t target = ( drive > 0 ) ? stop : opt.span - stop;		// closing: the stop short of 0
+	uint32_t t_stop = 0, t_end = 0;
+	int8_t end = 0;
+	bool jam = false;
+
+	r.enc.SetPosition(( drive > 0 ) ? 0 : opt.span);
+	printf("end: %s into a stop at %u permille of the travel\n", ( drive > 0 ) ? "opening" : "closing", stop_permille);
+	for(uint32_t i = 0; ( i < 120000 / TICK_MS ) && !end; i++) {
+		bool at_stop = ( drive > 0 ) ? ( r.enc.State().pos >= target ) : ( r.enc.State().pos <= target );
+		if( at_stop && !t_stop )
+			t_stop = r.now;
+		r.Tick(opt, drive, at_stop);
+		end = r.enc.EndReached(drive, ENC_END_BAND);
+		jam |= r.enc.Stalled() && !end;
+		if( end )
+			t_end = r.now;
+	}
+	printf("  end %d seen %u ms after the stop, pos %d\n", end, t_stop ? t_end - t_stop : 0, r.enc.State().pos);
+	check("end of travel reported in the drive direction", end == drive);
+	check("no jam reported on the way", !jam);
+	check("end seen within stall_ms + 1 tick of the stop", t_end && ( !t_stop || ( t_end - t_stop <= opt.stall_ms + TICK_MS )));
+}
+
+// jam outside the end band: a stall that is not an end
+static void run_jam_near_end(const Opt_t &opt)
+{
+	Roof_t r(ENC_POS_FULL * 32, opt.quad);
+	int32_t stop = (int32_t)(( (int64_t)opt.span * ( ENC_POS_FULL - 2 * ENC_END_BAND )) / ENC_POS_FULL );
+
+	printf("jam: opening, stuck at %u permille, outside the end band\n", ENC_POS_FULL - 2 * ENC_END_BAND);
+	for(uint32_t i = 0; ( i < 120000 / TICK_MS ) && !r.enc.Stalled(); i++)
+		r.Tick(opt, 1, r.enc.State().pos >= stop);
+	check("stalled", r.enc.Stalled());
+	check("not taken for the open end", r.enc.EndReached(1, ENC_END_BAND) == 0);
+}
+
+int main(int argc, char **argv)
+{
+	Opt_t opt;
+	int c;
+
+	while(( c = getopt(argc, argv, "s:r:t:q") ) != -1) {
+		switch( c )
+		{
+			case 's': opt.span = atoi(optarg); break;
+			case 'r': opt.rate = (uint32_t)atoi(optarg); break;
+			case 't': opt.stall_ms = (uint32_t)atoi(optarg); break;
+			case 'q': opt.quad = true; break;
+			default:
+				fprintf(stderr, "usage: %s [-s span] [-r pulses/s] [-t stall ms] [-q]\n", argv[0]);
+				return 1;
+		}
+	}
+	if(( opt.span <= 0 ) || ( opt.rate == 0 )) {
+		fprintf(stderr, "span and rate must be > 0\n");
+		return 1;
+	}
+
+	run_travel(opt, 32000, "travel");
+	run_travel(opt, 700, "travel, counter wraps");
+	run_stall(opt);
+	run_end(opt, 1, ENC_POS_FULL);							// stop exactly at the span
+	run_end(opt, 1, ENC_POS_FULL - ENC_END_BAND / 2);		// count short of the span, drift
+	run_end(opt, -1, ENC_POS_FULL - ENC_END_BAND / 2);
+	run_jam_near_end(opt);
+
+	printf("%s\n", s_fail ? "FAILED" : "all ok");
+	return s_fail ? 1 : 0;
+}
@@ -0,0 +1,171 @@
+/**************************************************************************************************
+  Filename:       filter_bench.cpp
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    weather station ingest filter on the host, MedianFilter.h and WindowStats.h as
+                  built for the board. A sky temperature like signal, one sample per second with
+                  noise, isolated spikes and a real step, goes through the filtered path
+                  (MedianFilter then WindowStats::Add, as WeatherStats::Ingest) and through the
+                  unfiltered one (WindowStats::Add only). Reports the cost per sample of both,
+                  the spikes caught, the delay of the step and the window mean error against the
+                  clean signal. Exit code 0 when every spike is caught, the step passes within
+                  K/2+1 samples and clean samples are not rejected.
+
+                  g++ -std=gnu++17 -O2 -I src tools/filter_bench.cpp -o filter_bench
+                  ./filter_bench [-n samples] [-s spike every n] [-d dev limit] [-r rate limit/s]
+**************************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <random>
+#include <vector>
+#include <chrono>
+#include <math.h>
+#include "MedianFilter.h"
+#include "WindowStats.h"
+
+#define K                       5           // WSTAT_MEDIAN
+#define BUCKETS                 60          // WSTAT_BUCKETS
+#define BUCKET_MS               10000       // WSTAT_BUCKET_MS
+#define SAMPLE_MS               1000
+
+struct Opt_t
+{
+	uint32_t samples = 200000;
+	uint32_t spike_every = 97;				// one spike per n samples, 0 = none
+	int16_t dev = 80;						// tsky limits of WeatherStats
+	int16_t rate = 10;
+};
+
+struct Sample_t
+{
+	int16_t v;
+	int16_t clean;							// without the spike
+	bool spike;
+};
+
+static int s_fail = 0;
+
+static void check(const char *what, bool ok)
+{
+	printf("  %-56s %s\n", what, ok ? "ok" : "FAIL");
+	if( !ok )
+		s_fail++;
+}
+
+// -20.0C drifting slowly, noise of a few tenths, a 12.0C step at the middle (clouds)
+static std::vector<Sample_t> make_signal(const Opt_t &opt, uint32_t &step_at)
+{
+	std::mt19937 rng(1);
+	std::normal_distribution<float> noise(0, 1.5f);
+	std::uniform_int_distribution<int> spike(150, 600);
+	std::vector<Sample_t> s(opt.samples);
+
+	step_at = opt.samples / 2;
+	for(uint32_t i = 0; i < opt.samples; i++) {
+		float base = -200 + 10 * sinf(i / 3600.0f) + (( i >= step_at ) ? 120 : 0 );
+		int16_t clean = (int16_t)lroundf(base + noise(rng));
+		bool is_spike = opt.spike_every && ( i > K ) && (( i % opt.spike_every ) == 0 ) && (( i < step_at - K ) || ( i > step_at + K ));
+
+		s[i] = {(int16_t)( is_spike ? clean + (( rng() & 1 ) ? spike(rng) : -spike(rng)) : clean ), clean, is_spike};
+	}
+	return s;
+}
+
+int main(int argc, char **argv)
+{
+	Opt_t opt;
+	int c;
+
+	while(( c = getopt(argc, argv, "n:s:d:r:") ) != -1) {
+		switch( c )
+		{
+			case 'n': opt.samples = (uint32_t)atoi(optarg); break;
+			case 's': opt.spike_every = (uint32_t)atoi(optarg); break;
+			case 'd': opt.dev = (int16_t)atoi(optarg); break;
+			case 'r': opt.rate = (int16_t)atoi(optarg); break;
+			default:
+				fprintf(stderr, "usage: %s [-n samples] [-s spike every n] [-d dev limit] [-r rate limit/s]\n", argv[0]);
+				return 1;
+		}
+	}
+	if( opt.samples < 4 * K ) {
+		fprintf(stderr, "samples must be >= %u\n", 4 * K);
+		return 1;
+	}
+
+	uint32_t step_at;
+	std::vector<Sample_t> sig = make_signal(opt, step_at);
+
+	// unfiltered path
+	WindowStats<BUCKETS> raw(BUCKET_MS);
+	auto t0 = std::chrono::steady_clock::now();
+	for(uint32_t i = 0; i < opt.samples; i++)
+		raw.Add(sig[i].v, i * SAMPLE_MS);
+	auto t1 = std::chrono::steady_clock::now();
+
+	// filtered path
+	MedianFilter<K> filter(opt.dev, opt.rate);
+	WindowStats<BUCKETS> filtered(BUCKET_MS);
+	std::vector<uint8_t> ok(opt.samples);
+	auto t2 = std::chrono::steady_clock::now();
+	for(uint32_t i = 0; i < opt.samples; i++) {
+		ok[i] = filter.Filter(sig[i].v, i * SAMPLE_MS);
+		if( ok[i] )
+			filtered.Add(sig[i].v, i * SAMPLE_MS);
+	}
+	auto t3 = std::chrono::steady_clock::now();
+
+	// quality, counted outside the timed loops
+	uint32_t spikes = 0, caught = 0, false_rej = 0, step_delay = 0;
+	double err_raw = 0, err_filt = 0;
+	uint32_t n_err = 0;
+	for(uint32_t i = 0; i < opt.samples; i++) {
+		if( sig[i].spike ) {
+			spikes++;
+			caught += !ok[i];
+		} else if( !ok[i] && (( i < step_at ) || ( i > step_at + K ))) {
+			false_rej++;
+		}
+	}
+	for(uint32_t i = step_at; ( i < step_at + 4 * K ) && !ok[i]; i++)
+		step_delay++;
+
+	// window means at every bucket end, against the clean signal
+	MedianFilter<K> f2(opt.dev, opt.rate);
+	WindowStats<BUCKETS> r2(BUCKET_MS), c2(BUCKET_MS), f2w(BUCKET_MS);
+	for(uint32_t i = 0; i < opt.samples; i++) {
+		uint32_t now = i * SAMPLE_MS;
+		r2.Add(sig[i].v, now);
+		c2.Add(sig[i].clean, now);
+		if( f2.Filter(sig[i].v, now) )
+			f2w.Add(sig[i].v, now);
+		if(( i % ( BUCKET_MS / SAMPLE_MS )) == 0 && ( i > BUCKETS * BUCKET_MS / SAMPLE_MS )) {
+			err_raw += fabs(r2.Mean() - c2.Mean());
+			err_filt += fabs(f2w.Mean() - c2.Mean());
+			n_err++;
+		}
+	}
+
+	double ns_raw = std::chrono::duration<double, std::nano>(t1 - t0).count() / opt.samples;
+	double ns_filt = std::chrono::duration<double, std::nano>(t3 - t2).count() / opt.samples;
+
+	printf("%u samples, K %u, dev limit %d, rate limit %d/s, %u spikes\n", opt.samples, K, opt.dev, opt.rate, spikes);
+	printf("  unfiltered %.1f ns/sample, filtered %.1f ns/sample, filter adds %.1f ns (x%.2f)\n",
+		ns_raw, ns_filt, ns_filt - ns_raw, ns_raw > 0 ? ns_filt / ns_raw : 0);
+	printf("  accepted %u, rejected %u, spikes caught %u of %u, clean rejected %u\n",
+		filter.GetAccepted(), filter.GetRejected(), caught, spikes, false_rej);
+	printf("  step passes after %u samples\n", step_delay);
+	if( n_err )
+		printf("  window mean error vs clean: unfiltered %.2f, filtered %.2f adu\n", err_raw / n_err, err_filt / n_err);
+
+	check("every spike rejected", caught == spikes);
+	check("real step passes within K/2+1 samples", step_delay <= K / 2 + 1);
+	check("clean samples not rejected, outside the step", false_rej == 0);
+	if( n_err && spikes )
+		check("filtered window mean closer to the clean signal", err_filt < err_raw);
+
+	printf("%s\n", s_fail ? "FAILED" : "all ok");
+	return s_fail ? 1 : 0;
+}
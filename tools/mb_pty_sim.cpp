@@ -0,0 +1,227 @@
+/**************************************************************************************************
+  Filename:       mb_pty_sim.cpp
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    Modbus RTU slave simulator on a pseudo-terminal, ModbusRtu.h on both ends.
+                  A thread on the pty master answers fc 3/4 reads for the given slave ids, the
+                  main thread polls them like the board does, one request on the bus at a time,
+                  frame end by 3.5 characters of silence, and reports the cycle time per device.
+                  With -S it only runs the slaves and prints the pty to point another master at.
+                  The pty has no line speed, every write is delayed by its time on the wire.
+
+                  g++ -std=gnu++17 -O2 -I src tools/mb_pty_sim.cpp -o mb_pty_sim -lutil -lpthread
+                  ./mb_pty_sim [-s 2,3,4] [-r regs] [-n cycles] [-b baud] [-d slave ms] [-e bit error/byte] [-S]
+**************************************************************************************************/
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "ModbusRtu.h"
+
+struct Opt_t
+{
+	std::vector<uint8_t> slaves{2, 3, 4};
+	uint32_t regs = 2;						// per read
+	uint32_t cycles = 200;
+	uint32_t baud = 9600;
+	uint32_t slave_ms = 5;					// slave turnaround
+	double ber = 0;							// probability of one flipped bit per byte
+	bool slave_only = false;
+};
+
+static std::atomic<bool> s_stop{false};
+
+static uint32_t now_us()
+{
+	return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint32_t char_us(uint32_t baud) { return 11 * 1000000u / baud; }		// 8N1 plus margin
+
+// writes as the line would: corrupted with ber, paced at baud
+static void line_write(int fd, const uint8_t *p, size_t n, uint32_t baud, double ber, std::mt19937 &rng)
+{
+	std::uniform_real_distribution<double> u(0, 1);
+	uint8_t buf[MB_MAX_FRAME];
+
+	for(size_t i = 0; i < n; i++) {
+		buf[i] = p[i];
+		if(( ber > 0 ) && ( u(rng) < ber ))
+			buf[i] ^= (uint8_t)( 1 << ( rng() & 7 ));
+	}
+	usleep(n * char_us(baud));
+	if( write(fd, buf, n) != (ssize_t)n )
+		perror("write");
+}
+
+// one frame, ended by 3.5 characters of silence. Returns its length, 0 on timeout
+static size_t line_read(int fd, uint8_t *buf, size_t size, uint32_t baud, uint32_t timeout_ms)
+{
+	int gap_ms = std::max(2u, ( 35 * char_us(baud) / 10 + 999 ) / 1000);
+	size_t n = 0;
+	struct pollfd pf = {fd, POLLIN, 0};
+
+	if( poll(&pf, 1, timeout_ms) <= 0 )
+		return 0;
+	while( poll(&pf, 1, gap_ms) > 0 ) {
+		uint8_t c;
+		if( read(fd, &c, 1) != 1 )
+			break;
+		if( n < size )
+			buf[n++] = c;
+	}
+	return n;
+}
+
+static void slaves(int fd, Opt_t opt)
+{
+	std::mt19937 rng(1);
+	uint8_t req[MB_MAX_FRAME];
+	uint8_t rsp[MB_MAX_FRAME];
+	uint16_t tick = 0;
+
+	while( !s_stop ) {
+		size_t n = line_read(fd, req, sizeof(req), opt.baud, 50);
+
+		if(( n != MB_REQ_LEN ) || !mb_crc_ok(req, n))
+			continue;
+		if( std::find(opt.slaves.begin(), opt.slaves.end(), req[0]) == opt.slaves.end() )
+			continue;										// not on this bus
+
+		uint8_t fc = req[1];
+		uint16_t reg = mb_get_u16(&req[2]);
+		uint16_t count = mb_get_u16(&req[4]);
+		size_t len;
+
+		usleep(opt.slave_ms * 1000);
+		rsp[0] = req[0];
+		if((( fc != MB_FC_HOLDING ) && ( fc != MB_FC_INPUT )) || ( count == 0 ) || ( count > MB_MAX_REGS )) {
+			rsp[1] = fc | 0x80;
+			rsp[2] = ( count > MB_MAX_REGS ) ? 3 : 1;		// illegal data value, illegal function
+			len = 3;
+		} else {
+			rsp[1] = fc;
+			rsp[2] = (uint8_t)( count * 2 );
+			for(uint16_t r = 0; r < count; r++)				// slave * 1000 + register, with a slow ramp
+				mb_put_u16(&rsp[3 + r * 2], (uint16_t)( req[0] * 1000 + reg + r + ( tick & 15 )));
+			len = 3 + count * 2;
+			tick++;
+		}
+		mb_put_crc(rsp, len);
+		line_write(fd, rsp, len + 2, opt.baud, opt.ber, rng);
+	}
+}
+
+struct DevStats_t
+{
+	uint8_t slave;
+	uint32_t ok = 0, timeouts = 0, bad = 0, exceptions = 0;
+	std::vector<uint32_t> cycle_us;
+};
+
+int main(int argc, char **argv)
+{
+	Opt_t opt;
+	int c;
+
+	while(( c = getopt(argc, argv, "s:r:n:b:d:e:S") ) != -1) {
+		switch( c )
+		{
+			case 's':
+				opt.slaves.clear();
+				for(char *t = strtok(optarg, ","); t; t = strtok(nullptr, ","))
+					opt.slaves.push_back((uint8_t)atoi(t));
+				break;
+			case 'r': opt.regs = std::max(1, std::min(atoi(optarg), MB_MAX_REGS)); break;
+			case 'n': opt.cycles = atoi(optarg); break;
+			case 'b': opt.baud = atoi(optarg); break;
+			case 'd': opt.slave_ms = atoi(optarg); break;
+			case 'e': opt.ber = atof(optarg); break;
+			case 'S': opt.slave_only = true; break;
+			default:
+				fprintf(stderr, "usage: %s [-s 2,3,4] [-r regs] [-n cycles] [-b baud] [-d slave ms] [-e ber] [-S]\n", argv[0]);
+				return 1;
+		}
+	}
+
+	int master, slave;
+	char name[64];
+	struct termios tio;
+
+	if( openpty(&master, &slave, name, nullptr, nullptr) < 0 ) {
+		perror("openpty");
+		return 1;
+	}
+	tcgetattr(slave, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(slave, TCSANOW, &tio);
+
+	if( opt.slave_only ) {
+		printf("slaves on %s, ctrl-c to stop\n", name);
+		fflush(stdout);
+		slaves(master, opt);
+		return 0;
+	}
+
+	std::thread st(slaves, master, opt);
+	std::mt19937 rng(2);
+	std::vector<DevStats_t> dev(opt.slaves.size());
+	uint8_t req[MB_REQ_LEN];
+	uint8_t rsp[MB_MAX_FRAME];
+	uint32_t t_start = now_us();
+
+	for(size_t i = 0; i < dev.size(); i++)
+		dev[i].slave = opt.slaves[i];
+
+	for(uint32_t cyc = 0; cyc < opt.cycles; cyc++) {
+		for(DevStats_t &d : dev) {
+			uint32_t t0 = now_us();
+
+			line_write(slave, req, mb_read_request(req, d.slave, MB_FC_INPUT, 0, (uint16_t)opt.regs), opt.baud, opt.ber, rng);
+			size_t n = line_read(slave, rsp, sizeof(rsp), opt.baud, 200);
+
+			switch( n ? mb_check_response(rsp, n, d.slave, MB_FC_INPUT, (uint16_t)opt.regs) : MbResult_t::kShort )
+			{
+				case MbResult_t::kOk:
+					d.ok++;
+					d.cycle_us.push_back(now_us() - t0);
+					break;
+				case MbResult_t::kException:
+					d.exceptions++;
+					break;
+				default:
+					n ? d.bad++ : d.timeouts++;
+					break;
+			}
+		}
+	}
+
+	uint32_t dt = now_us() - t_start;
+	printf("baud %u, %zu slaves, %u regs per read, %u cycles in %.2fs, %.1f ms per bus cycle\n", opt.baud, dev.size(),
+		opt.regs, opt.cycles, dt / 1e6, dt / 1e3 / opt.cycles);
+	for(DevStats_t &d : dev) {
+		std::vector<uint32_t> &v = d.cycle_us;
+		std::sort(v.begin(), v.end());
+		auto pct = [&](size_t p) { return v.empty() ? 0u : v[std::min(v.size() - 1, v.size() * p / 100)]; };
+
+		printf("slave %3u ok %u timeouts %u bad frames %u exceptions %u, cycle us p50 %u p99 %u max %u\n", d.slave, d.ok,
+			d.timeouts, d.bad, d.exceptions, pct(50), pct(99), v.empty() ? 0u : v.back());
+	}
+
+	s_stop = true;
+	st.join();
+	close(master);
+	close(slave);
+	return 0;
+}
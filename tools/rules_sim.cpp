@@ -0,0 +1,310 @@
+/**************************************************************************************************
+  Filename:       rules_sim.cpp
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    automation rules on the host, RuleVm.h and RuleVm.cpp as built for the board.
+                  Without a file it runs the compiler and VM cases: grammar, error columns, FOR
+                  range, action and code limits, truth tables of the conditions against the input
+                  image, safety bits and link. With -f it compiles the rules in the file, one per
+                  line as in Rule_1 ~ Rule_8, prints the bytecode or the error of each and
+                  evaluates them over random states. Both end with a benchmark of compile and
+                  evaluation time per rule. Exit code 0 when every case and rule is ok.
+
+                  g++ -std=gnu++17 -O2 -I src tools/rules_sim.cpp src/RuleVm.cpp -o rules_sim
+                  ./rules_sim [-f rules.txt] [-n passes]
+**************************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <random>
+#include <chrono>
+#include "RuleVm.h"
+#include "SafetyBits.h"
+
+static int s_fail = 0;
+
+static void check(const char *what, bool ok)
+{
+	printf("  %-56s %s\n", what, ok ? "ok" : "FAIL");
+	if( !ok )
+		s_fail++;
+}
+
+static bool compile_one(const char *src, RuleProgram_t &prog, char *err)
+{
+	memset(&prog, 0, sizeof(prog));
+	return rule_compile(1, src, prog, err);
+}
+
+// input image with IN n set for each n in the list
+static SrIn_t inputs(std::initializer_list<size_t> in_n)
+{
+	SrIn_t in;
+
+	for(size_t n : in_n)
+		in.set(k_sw_in_pos[n - 1]);
+	return in;
+}
+
+static bool eval_one(const char *src, const SrIn_t &in, uint8_t safety, bool link)
+{
+	RuleProgram_t prog;
+	char err[RULES_ERR_LEN];
+
+	if( !compile_one(src, prog, err) ) {
+		printf("  %s: %s\n", src, err);
+		return false;
+	}
+	return rule_eval(prog, prog.rule[0], in, safety, link);
+}
+
+static void run_grammar()
+{
+	RuleProgram_t prog;
+	char err[RULES_ERR_LEN];
+
+	printf("grammar\n");
+	check("IF IN 1 THEN OUT 1 ON", compile_one("IF IN 1 THEN OUT 1 ON", prog, err) && ( prog.rule[0].n_then == 1 ));
+	check("lower case, ELSE", compile_one("if in 1 then out 1 on else out 1 off", prog, err) && ( prog.rule[0].n_else == 1 ));
+	check("OUT * expands to every output",
+		compile_one("IF UNSAFE THEN OUT * OFF", prog, err) && ( prog.rule[0].n_then == k_num_sw_out ));
+	check("PWM duty and HEAT mode",
+		compile_one("IF LINK THEN PWM 1 40, HEAT 1 AUTO ELSE HEAT 1 MANUAL", prog, err) &&
+		( prog.act[0].value == 40 ) && ( prog.act[1].value == 1 ) && ( prog.act[2].value == 0 ));
+
+	check("missing IF", !compile_one("IN 1 THEN OUT 1 ON", prog, err) && ( strcmp(err, "col 1: IF expected") == 0 ));
+	check("unknown condition, column", !compile_one("IF FOO THEN OUT 1 ON", prog, err) && ( strcmp(err, "col 4: unknown condition") == 0 ));
+	check("channel out of range", !compile_one("IF IN 99 THEN OUT 1 ON", prog, err) && ( strstr(err, "channel out of range") != nullptr ));
+	check("duty over 100", !compile_one("IF LINK THEN PWM 1 101", prog, err) && ( strstr(err, "duty") != nullptr ));
+	check("unbalanced parenthesis", !compile_one("IF ( IN 1 OR IN 2 THEN OUT 1 ON", prog, err) && ( strstr(err, "')'") != nullptr ));
+	check("trailing words", !compile_one("IF IN 1 THEN OUT 1 ON OUT 2 ON", prog, err) && ( strstr(err, "end of rule") != nullptr ));
+
+	// a failed rule leaves what was compiled before it
+	memset(&prog, 0, sizeof(prog));
+	rule_compile(1, "IF IN 1 THEN OUT 1 ON", prog, err);
+	uint16_t code = prog.code_len;
+	uint8_t act = prog.n_act;
+	bool bad = !rule_compile(2, "IF IN 1 AND THEN OUT 2 ON", prog, err);
+	check("failed rule leaves the program as it was", bad && ( prog.n_rules == 1 ) && ( prog.code_len == code ) && ( prog.n_act == act ));
+}
+
+static void run_limits()
+{
+	RuleProgram_t prog;
+	char err[RULES_ERR_LEN];
+	char src[512];
+
+	printf("limits\n");
+	check("FOR 10 MIN", compile_one("IF IN 1 FOR 10 MIN THEN OUT 1 ON", prog, err) && ( prog.rule[0].for_ms == 600000 ));
+	check("FOR 24 H is the maximum", compile_one("IF IN 1 FOR 24 H THEN OUT 1 ON", prog, err) && ( prog.rule[0].for_ms == 86400000 ));
+	check("FOR 25 H refused", !compile_one("IF IN 1 FOR 25 H THEN OUT 1 ON", prog, err) && ( strstr(err, "24H") != nullptr ));
+	check("FOR 99999 H refused, no wrap", !compile_one("IF IN 1 FOR 99999 H THEN OUT 1 ON", prog, err));
+	check("FOR 99999 MIN refused, no wrap", !compile_one("IF IN 1 FOR 99999 MIN THEN OUT 1 ON", prog, err));
+	check("FOR 86400 S", compile_one("IF IN 1 FOR 86400 S THEN OUT 1 ON", prog, err) && ( prog.rule[0].for_ms == 86400000 ));
+
+	// nesting pushes one stack bit per open level
+	size_t n = 0;
+	n += snprintf(src + n, sizeof(src) - n, "IF ");
+	for(int i = 0; i < RULES_STACK; i++)
+		n += snprintf(src + n, sizeof(src) - n, "(IN 1 AND ");
+	n += snprintf(src + n, sizeof(src) - n, "IN 1");
+	for(int i = 0; i < RULES_STACK; i++)
+		n += snprintf(src + n, sizeof(src) - n, ")");
+	snprintf(src + n, sizeof(src) - n, " THEN OUT 1 ON");
+	check("expression deeper than RULES_STACK refused", !compile_one(src, prog, err) && ( strstr(err, "too deep") != nullptr ));
+
+	// OUT * repeated past RULES_MAX_ACTIONS
+	n = snprintf(src, sizeof(src), "IF LINK THEN OUT * ON");
+	for(size_t i = k_num_sw_out; i <= RULES_MAX_ACTIONS; i += k_num_sw_out)
+		n += snprintf(src + n, sizeof(src) - n, ", OUT * OFF");
+	check("actions past RULES_MAX_ACTIONS refused", !compile_one(src, prog, err) && ( strstr(err, "too many actions") != nullptr ));
+
+	// the whole program: RULES_MAX rules of the longest condition that fits a rule line
+	memset(&prog, 0, sizeof(prog));
+	uint8_t ok = 0;
+	for(uint8_t i = 0; i < RULES_MAX; i++)
+		ok += rule_compile(i + 1, "IF (IN 1 OR IN 2) AND (IN 3 OR IN 4) AND NOT (RAIN OR WIND) AND LINK THEN OUT 1 ON", prog, err);
+	printf("  %u rules x %u code bytes = %u of %u\n", ok, prog.rule[0].code_len, prog.code_len, RULES_CODE_SIZE);
+	check("RULES_MAX long rules fit RULES_CODE_SIZE", ok == RULES_MAX);
+
+	RuleAction_t act[4];
+	check("actions only, as the scheduler uses", rule_compile_actions("X OUT 1 ON, OUT 2 OFF", "OUT 1 ON, OUT 2 OFF", act, 4, err) == 2);
+	check("actions only, over max", rule_compile_actions("OUT * ON", "OUT * ON", act, 1, err) < 0);
+}
+
+static void run_eval()
+{
+	printf("evaluation\n");
+	check("IN 1", eval_one("IF IN 1 THEN OUT 1 ON", inputs({1}), 0, false));
+	check("IN 1, input off", !eval_one("IF IN 1 THEN OUT 1 ON", inputs({2}), 0, false));
+	check("NOT IN 1", eval_one("IF NOT IN 1 THEN OUT 1 ON", inputs({}), 0, false));
+
+	// truth tables of AND, OR and precedence over IN 1 ~ IN 3
+	bool and_ok = true, or_ok = true, prec_ok = true;
+	for(int v = 0; v < 8; v++) {
+		bool a = v & 1, b = v & 2, c = v & 4;
+		SrIn_t in;
+		if( a ) in.set(k_sw_in_pos[0]);
+		if( b ) in.set(k_sw_in_pos[1]);
+		if( c ) in.set(k_sw_in_pos[2]);
+		and_ok &= eval_one("IF IN 1 AND IN 2 THEN OUT 1 ON", in, 0, false) == ( a && b );
+		or_ok &= eval_one("IF IN 1 OR IN 2 THEN OUT 1 ON", in, 0, false) == ( a || b );
+		prec_ok &= eval_one("IF IN 1 OR IN 2 AND IN 3 THEN OUT 1 ON", in, 0, false) == ( a || ( b && c ));
+		prec_ok &= eval_one("IF (IN 1 OR IN 2) AND IN 3 THEN OUT 1 ON", in, 0, false) == (( a || b ) && c );
+	}
+	check("AND truth table", and_ok);
+	check("OR truth table", or_ok);
+	check("AND binds before OR, parentheses", prec_ok);
+
+	check("RAIN on the rain bit", eval_one("IF RAIN THEN OUT 1 ON", inputs({}), SAFEMON_RAIN_BIT, false));
+	check("RAIN not on the wind bit", !eval_one("IF RAIN THEN OUT 1 ON", inputs({}), SAFEMON_WIND_BIT, false));
+	check("UNSAFE on any bit", eval_one("IF UNSAFE THEN OUT 1 ON", inputs({}), SAFEMON_TREND_BIT, false));
+	check("SAFE with no bit", eval_one("IF SAFE THEN OUT 1 ON", inputs({}), 0, false));
+	check("SAFE, a bit set", !eval_one("IF SAFE THEN OUT 1 ON", inputs({}), SAFEMON_HUM_BIT, false));
+	check("LINK", eval_one("IF LINK AND NOT IN 1 THEN OUT 1 ON", inputs({}), 0, true));
+	if( k_num_of_domes ) {
+		SrIn_t in;
+		in.set(ch_pos(ChKind_t::kLimitClosed, 0));
+		check("CLOSED 1 on the limit switch", eval_one("IF CLOSED 1 THEN OUT 1 ON", in, 0, false));
+		check("OPENED 1, closed switch", !eval_one("IF OPENED 1 THEN OUT 1 ON", in, 0, false));
+	}
+}
+
+// compile and evaluation time per rule, states from a fixed seed
+static void run_bench(const RuleProgram_t &prog, const char *const *src, uint8_t n_src, uint32_t passes)
+{
+	std::mt19937 rng(1);
+	const size_t k_states = 256;
+	static SrIn_t in[k_states];
+	static uint8_t safety[k_states];
+	RuleProgram_t p;
+	char err[RULES_ERR_LEN];
+
+	for(size_t s = 0; s < k_states; s++) {
+		for(size_t i = 0; i < SR_IN_BYTES; i++)
+			in[s].b[i] = (uint8_t)rng();
+		safety[s] = ( rng() & 3 ) ? 0 : (uint8_t)rng();
+	}
+
+	auto t0 = std::chrono::steady_clock::now();
+	for(uint32_t n = 0; n < passes; n++) {
+		memset(&p, 0, sizeof(p));
+		for(uint8_t i = 0; i < n_src; i++)
+			rule_compile(i + 1, src[i], p, err);
+	}
+	auto t1 = std::chrono::steady_clock::now();
+
+	volatile uint32_t sink = 0;
+	uint32_t fires = 0;
+	for(uint32_t n = 0; n < passes; n++) {
+		size_t s = n % k_states;
+		for(uint8_t j = 0; j < prog.n_rules; j++)
+			fires += rule_eval(prog, prog.rule[j], in[s], safety[s], n & 1);
+	}
+	sink = fires;
+	auto t2 = std::chrono::steady_clock::now();
+
+	double comp_ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / passes / ( n_src ? n_src : 1 );
+	double eval_ns = std::chrono::duration<double, std::nano>(t2 - t1).count() / passes / ( prog.n_rules ? prog.n_rules : 1 );
+	printf("bench: %u passes, %u rules, %u code bytes\n", passes, prog.n_rules, prog.code_len);
+	printf("  compile %.0f ns/rule, evaluate %.1f ns/rule, true %.1f%%\n", comp_ns, eval_ns, 100.0 * sink / passes / ( prog.n_rules ? prog.n_rules : 1 ));
+}
+
+// one rule per line, blank lines and # comments skipped
+static int run_file(const char *path, uint32_t passes)
+{
+	static char line[RULES_MAX][256];
+	const char *src[RULES_MAX];
+	RuleProgram_t prog;
+	char err[RULES_ERR_LEN];
+	char buf[256];
+	uint8_t n = 0;
+	FILE *f = fopen(path, "r");
+
+	if( f == nullptr ) {
+		perror(path);
+		return 1;
+	}
+	memset(&prog, 0, sizeof(prog));
+	while( fgets(buf, sizeof(buf), f ) && ( n < RULES_MAX )) {
+		buf[strcspn(buf, "\r\n")] = 0;
+		char *s = buf;
+		while( *s == ' ' )
+			s++;
+		if(( *s == 0 ) || ( *s == '#' ))
+			continue;
+		snprintf(line[n], sizeof(line[n]), "%s", s);
+		src[n] = line[n];
+
+		printf("Rule_%u: %s\n", n + 1, src[n]);
+		if( !rule_compile(n + 1, src[n], prog, err )) {
+			printf("  %s\n", err);
+			s_fail++;
+		} else {
+			const Rule_t &r = prog.rule[prog.n_rules - 1];
+			printf("  code ");
+			for(uint16_t k = 0; k < r.code_len; k++)
+				printf("%02x", prog.code[r.code_ofs + k]);
+			printf(", for %u ms, then %u, else %u actions\n", r.for_ms, r.n_then, r.n_else);
+		}
+		n++;
+	}
+	fclose(f);
+
+	printf("%u rules, %u of %u code bytes, %u of %u actions\n", prog.n_rules, prog.code_len, RULES_CODE_SIZE, prog.n_act, RULES_MAX_ACTIONS);
+	run_bench(prog, src, n, passes);
+	printf("%s\n", s_fail ? "FAILED" : "all ok");
+	return s_fail ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = nullptr;
+	uint32_t passes = 200000;
+	int c;
+
+	while(( c = getopt(argc, argv, "f:n:") ) != -1) {
+		switch( c )
+		{
+			case 'f': path = optarg; break;
+			case 'n': passes = (uint32_t)atoi(optarg); break;
+			default:
+				fprintf(stderr, "usage: %s [-f rules.txt] [-n passes]\n", argv[0]);
+				return 1;
+		}
+	}
+	if( passes == 0 ) {
+		fprintf(stderr, "passes must be > 0\n");
+		return 1;
+	}
+	if( path )
+		return run_file(path, passes);
+
+	run_grammar();
+	run_limits();
+	run_eval();
+
+	static const char *const k_bench[] = {
+		"IF IN 1 THEN OUT 1 ON ELSE OUT 1 OFF",
+		"IF UNSAFE THEN PWM * 0",
+		"IF CLOSED 1 FOR 10 MIN THEN OUT 5 OFF",
+		"IF RAIN OR WIND OR GUST THEN OUT 2 OFF",
+		"IF (IN 1 OR IN 2) AND (IN 3 OR IN 4) AND NOT (RAIN OR WIND) AND LINK THEN OUT 3 ON",
+		"IF NOT LINK FOR 5 MIN THEN HEAT * MANUAL ELSE HEAT * AUTO",
+		"IF IN 5 AND NOT IN 6 THEN PWM 1 50 ELSE PWM 1 0",
+		"IF SAFE AND OPENED 1 THEN OUT 4 ON ELSE OUT 4 OFF"
+	};
+	RuleProgram_t prog;
+	char err[RULES_ERR_LEN];
+	memset(&prog, 0, sizeof(prog));
+	for(uint8_t i = 0; i < RULES_MAX; i++)
+		if( !rule_compile(i + 1, k_bench[i], prog, err) )
+			printf("  bench Rule_%u: %s\n", i + 1, err);
+	check("benchmark rules compile", prog.n_rules == RULES_MAX);
+	run_bench(prog, k_bench, RULES_MAX, passes);
+
+	printf("%s\n", s_fail ? "FAILED" : "all ok");
+	return s_fail ? 1 : 0;
+}
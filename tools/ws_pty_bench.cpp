@@ -0,0 +1,273 @@
+/**************************************************************************************************
+  Filename:       ws_pty_bench.cpp
+  Revised:        Date: 2026-10-19
+  Revision:       Revision: 01
+
+  Description:    host bench for the weather station link, WsProto.h over a pseudo-terminal.
+                  A thread on the pty master stands in for the station, the main thread plays the
+                  board: HELLO, BAUD, then polls with a pipeline and reports latency and errors.
+                  The pty has no line speed, every write is delayed by its time on the wire at
+                  the current baud.
+
+                  g++ -std=gnu++17 -O2 -I src tools/ws_pty_bench.cpp -o ws_pty_bench -lutil -lpthread
+                  ./ws_pty_bench [-n polls] [-b baud] [-p pipeline] [-e bit error/byte] [-s station us] [-a]
+                      -a  old station firmware, ASCII push only, the board must stay on ASCII
+**************************************************************************************************/
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "WsProto.h"
+
+static std::atomic<bool> s_stop{false};
+static std::atomic<uint32_t> s_baud{WSP_BASE_BAUD};
+
+struct Opt_t
+{
+	uint32_t polls = 1000;
+	uint32_t baud = 115200;
+	uint32_t pipeline = WSP_PIPELINE;
+	double ber = 0;							// probability of one flipped bit per byte
+	uint32_t station_us = 200;				// station processing time per request
+	bool ascii_only = false;
+};
+
+static uint32_t now_us()
+{
+	return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// writes as the line would: corrupted with ber, paced at the current baud
+static void line_write(int fd, const uint8_t *p, size_t n, double ber, std::mt19937 &rng)
+{
+	std::uniform_real_distribution<double> u(0, 1);
+	uint8_t buf[WSP_MAX_FRAME + WSP_ASCII_LEN];
+
+	for(size_t i = 0; i < n; i++) {
+		buf[i] = p[i];
+		if(( ber > 0 ) && ( u(rng) < ber ))
+			buf[i] ^= (uint8_t)( 1 << ( rng() & 7 ));
+	}
+	usleep((useconds_t)( n * 10 * 1000000ull / s_baud.load() ));
+	if( write(fd, buf, n) != (ssize_t)n )
+		perror("write");
+}
+
+static void station(int fd, Opt_t opt)
+{
+	std::mt19937 rng(1);
+	WspDecoder dec;
+	uint8_t buf[WSP_MAX_FRAME];
+	uint32_t last_poll = now_us();
+	uint32_t last_push = 0;
+	int16_t tsky = -175;
+
+	while( !s_stop ) {
+		struct pollfd pf = {fd, POLLIN, 0};
+		uint8_t c;
+
+		if( opt.ascii_only && (( now_us() - last_push ) > 1000000 )) {	// old firmware pushes once a second
+			char a[WSP_ASCII_LEN];
+			int n = snprintf(a, sizeof(a), "%%WS,%d,-120,24,85,0,1270,-1,-1#", tsky);
+			line_write(fd, (const uint8_t *)a, n, opt.ber, rng);
+			last_push = now_us();
+		}
+
+		if(( s_baud != WSP_BASE_BAUD ) && (( now_us() - last_poll ) > WSP_FALLBACK_MS * 1000 ))
+			s_baud = WSP_BASE_BAUD;						// board went quiet, back to ASCII
+
+		if(( poll(&pf, 1, 10) <= 0 ) || ( read(fd, &c, 1) != 1 ))
+			continue;
+		if(( dec.Feed(c) != WspResult_t::kFrame ) || opt.ascii_only)
+			continue;
+
+		usleep(opt.station_us);
+		const WspFrame_t &f = dec.frame;
+		uint8_t p[WSP_MAX_PAYLOAD];
+		size_t n;
+
+		switch( f.type )
+		{
+			case kWspHello:
+				p[0] = WSP_VERSION;
+				wsp_put_u32(&p[1], 921600);
+				n = wsp_encode(buf, kWspHelloAck, f.seq, p, 5);
+				line_write(fd, buf, n, opt.ber, rng);
+				break;
+
+			case kWspBaud:
+				if( f.len < 4 )
+					break;
+				n = wsp_encode(buf, kWspBaudAck, f.seq, f.payload, 4);
+				line_write(fd, buf, n, opt.ber, rng);
+				s_baud = wsp_get_u32(f.payload);		// after the ack is on the wire
+				last_poll = now_us();
+				break;
+
+			case kWspPoll:
+				last_poll = now_us();
+				tsky = (int16_t)( -175 + ( rng() % 20 ));
+				{
+					const int16_t field[WSP_NUM_FIELDS] = {tsky, -120, 24, 85, 0, 1270, -1, -1};
+					for(uint8_t i = 0; i < WSP_NUM_FIELDS; i++)
+						wsp_put_i16(&p[i * 2], field[i]);
+				}
+				n = wsp_encode(buf, kWspSample, f.seq, p, WSP_NUM_FIELDS * 2);
+				line_write(fd, buf, n, opt.ber, rng);
+				break;
+		}
+	}
+}
+
+struct Board
+{
+	int fd = -1;
+	Opt_t opt;
+	std::mt19937 rng{2};
+	WspDecoder dec;
+	WspPoller poller;
+	std::vector<uint32_t> latency;
+	uint32_t frames = 0, ascii = 0, crc = 0, bad_len = 0, bad_seq = 0, timeouts = 0;
+
+	void send(uint8_t type, uint8_t seq, const uint8_t *p, uint8_t len)
+	{
+		uint8_t buf[WSP_MAX_FRAME];
+		line_write(fd, buf, wsp_encode(buf, type, seq, p, len), opt.ber, rng);
+	}
+
+	// feeds bytes until a frame arrives or timeout, returns true with dec.frame
+	bool receive(uint32_t timeout_us)
+	{
+		uint32_t t0 = now_us();
+
+		while(( now_us() - t0 ) < timeout_us) {
+			struct pollfd pf = {fd, POLLIN, 0};
+			uint8_t c;
+
+			if(( poll(&pf, 1, 1) <= 0 ) || ( read(fd, &c, 1) != 1 ))
+				continue;
+			switch( dec.Feed(c) )
+			{
+				case WspResult_t::kFrame:		frames++; return true;
+				case WspResult_t::kAscii:		ascii++; break;
+				case WspResult_t::kCrcError:	crc++; break;
+				case WspResult_t::kBadLength:	bad_len++; break;
+				default: break;
+			}
+		}
+		return false;
+	}
+
+	bool negotiate()
+	{
+		uint8_t p[4];
+
+		send(kWspHello, 0, nullptr, 0);
+		if( !receive(500000) || ( dec.frame.type != kWspHelloAck ) || ( dec.frame.len < 5 ))
+			return false;
+		uint32_t max = wsp_get_u32(&dec.frame.payload[1]);
+		uint32_t b = std::min(opt.baud, max);
+		wsp_put_u32(p, b);
+		send(kWspBaud, 0, p, 4);
+		if( !receive(500000) || ( dec.frame.type != kWspBaudAck ) || ( wsp_get_u32(dec.frame.payload) != b ))
+			return false;
+		s_baud = b;
+		return true;
+	}
+
+	void run()
+	{
+		uint32_t issued = 0;
+		uint32_t t0 = now_us();
+
+		while(( issued < opt.polls ) || poller.InFlight()) {
+			uint8_t seq;
+			uint32_t lat;
+
+			while(( issued < opt.polls ) && ( poller.InFlight() < opt.pipeline ) && poller.Issue(now_us(), seq)) {
+				send(kWspPoll, seq, nullptr, 0);
+				issued++;
+			}
+			if( receive(1000) && ( dec.frame.type == kWspSample )) {
+				if( poller.Complete(dec.frame.seq, now_us(), lat) )
+					latency.push_back(lat);
+				else
+					bad_seq++;
+			}
+			timeouts += poller.Expire(now_us(), 500000);
+		}
+
+		uint32_t dt = now_us() - t0;
+		std::sort(latency.begin(), latency.end());
+		auto pct = [&](size_t p) { return latency.empty() ? 0u : latency[std::min(latency.size() - 1, latency.size() * p / 100)]; };
+
+		printf("baud %u pipeline %u polls %u ok %zu in %.2fs, %.1f samples/s\n", s_baud.load(), opt.pipeline, opt.polls,
+			latency.size(), dt / 1e6, latency.size() * 1e6 / dt);
+		printf("latency us p50 %u p99 %u max %u\n", pct(50), pct(99), latency.empty() ? 0u : latency.back());
+		printf("frames %u crc errors %u bad length %u bad seq %u timeouts %u noise bytes %u\n", frames, crc, bad_len,
+			bad_seq, timeouts, dec.noise);
+	}
+};
+
+int main(int argc, char **argv)
+{
+	Opt_t opt;
+	int c;
+
+	while(( c = getopt(argc, argv, "n:b:p:e:s:a") ) != -1) {
+		switch( c )
+		{
+			case 'n': opt.polls = atoi(optarg); break;
+			case 'b': opt.baud = atoi(optarg); break;
+			case 'p': opt.pipeline = std::max(1, std::min(atoi(optarg), WSP_PIPELINE)); break;
+			case 'e': opt.ber = atof(optarg); break;
+			case 's': opt.station_us = atoi(optarg); break;
+			case 'a': opt.ascii_only = true; break;
+			default:
+				fprintf(stderr, "usage: %s [-n polls] [-b baud] [-p pipeline] [-e ber] [-s station us] [-a]\n", argv[0]);
+				return 1;
+		}
+	}
+
+	int master, slave;
+	struct termios tio;
+
+	if( openpty(&master, &slave, nullptr, nullptr, nullptr) < 0 ) {
+		perror("openpty");
+		return 1;
+	}
+	tcgetattr(slave, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(slave, TCSANOW, &tio);
+
+	std::thread st(station, master, opt);
+	Board board;
+	board.fd = slave;
+	board.opt = opt;
+	int rc = 0;
+
+	if( board.negotiate() )
+		board.run();
+	else if( opt.ascii_only ) {
+		board.receive(1500000);						// the pushed frames still arrive at 9600
+		printf("no binary answer, stays on ASCII: ascii frames %u noise bytes %u\n", board.ascii, board.dec.noise);
+	} else {
+		printf("negotiation failed, crc errors %u\n", board.crc);
+		rc = 1;
+	}
+
+	s_stop = true;
+	st.join();
+	close(master);
+	close(slave);
+	return rc;
+}